@@ -9,80 +9,85 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
 #include <pthread.h>
-#include <netdb.h>
 #include "constants.h"
 #include "data_array.h"
+#include <time.h>
+#include "io.h"
+#include "metrics.h"
+#include "probes.h"
+#include "net.h"
+
+static const char *io_backend_name = "auto"; // I/O backend asked for on the command line
+static struct timespec started_at; // When the program started, to time how long READY takes
+
+// Metrics, registered in main
+static int hellos_sent_metric;
+static int hellos_received_metric;
+static int ready_metric;
+static int time_to_ready_metric;
 
 // Thread dealing with UDP server socket
 void *server(void *arg) {
   data_array_t *prog_names = data_arr_copy(arg);
   char hostname[MAX_CHAR];
-  gethostname(hostname, sizeof(hostname)); // Get hostname of the machine
+  net_hostname(hostname, sizeof(hostname)); // Get hostname of the machine
   data_arr_remove(prog_names, hostname); // Remove hostname from list of programs
 
   int sock_fd;
-  char port_num[MAX_CHAR];
-  sprintf(port_num, "%d", PORT); // Convert port number to string
-  struct addrinfo hints, *res;
-  struct sockaddr_storage client_addr;
   data_array_t *received = data_arr_init();
 
-  // Get address info
-  memset(&hints, 0, sizeof(hints));
-  hints.ai_family = AF_INET;
-  hints.ai_socktype = SOCK_DGRAM;
-  hints.ai_flags = AI_PASSIVE;
-
-  if (getaddrinfo(hostname, port_num, &hints, &res) != 0) {
-    perror("Server side: Error getting address info");
+  // Open socket bound to this machine's address
+  if ((sock_fd = net_bind_udp(hostname, PORT)) < 0) {
+    perror("Server side: Error binding socket");
     perror(hostname);
     exit(1);
   }
 
-  // Create socket file descriptor
-  if ((sock_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol)) < 0) {
-    perror("Server side: Error opening socket");
-    exit(1);
-  }
-
-  // Bind socket with server address
-  if (bind(sock_fd, res->ai_addr, res->ai_addrlen) < 0) {
-    perror("Server side: Error binding socket");
+  io_t *io;
+  if ((io = io_open_receiver(io_backend_name, sock_fd)) == NULL) {
+    perror("Server side: Error opening I/O backend");
     exit(1);
   }
 
   // Receive messages from all programs
   while (data_arr_equals(prog_names, received) == 0) {
     char buf[MAX_CHAR];
+    ssize_t len;
 
-    socklen_t addr_len = sizeof(client_addr);
-    if (recvfrom(sock_fd, buf, MAX_CHAR, 0, (struct sockaddr *)&client_addr, &addr_len) < 0) {
+    if ((len = io_recv_datagram(io, buf, MAX_CHAR - 1)) < 0) {
       perror("Server side: Error receiving message");
       exit(1);
     }
+    buf[len] = '\0'; // Hostnames are sent without a terminator
+    metrics_inc(hellos_received_metric, 1);
+    PROBE(discovery, datagram_receive, buf, len);
 
     if (data_arr_contains(received, buf) == 0) {
       data_arr_add(received, buf);
     }
   }
 
-  // Create socket file descriptor
-  if ((sock_fd = socket(hints.ai_family, hints.ai_socktype, 0)) < 0) {
-    perror("Server side: Error opening socket");
-    exit(1);
-  }
-
   // Print "READY" to stderr when message is received from all programs
   fprintf(stderr, "READY\n");
 
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long long time_to_ready_us = (now.tv_sec - started_at.tv_sec) * 1000000LL
+                              + (now.tv_nsec - started_at.tv_nsec) / 1000;
+  PROBE(discovery, ready, data_arr_size(received), time_to_ready_us);
+  metrics_set(time_to_ready_metric, time_to_ready_us);
+  metrics_set(ready_metric, 1);
+
+  io_stats_t stats;
+  io_get_stats(io, &stats);
+  fprintf(stderr, "{io: %s, syscalls_per_msg: %.2f}\n", io_backend(io),
+          stats.messages ? (double)stats.syscalls / stats.messages : 0.0);
+
   // Free memory and close socket before exiting
   data_arr_obliterate(prog_names);
   data_arr_obliterate(received);
-  freeaddrinfo(res);
+  io_close(io);
   close(sock_fd);
   return NULL;
 }
@@ -92,58 +97,90 @@ void *client(void *arg) {
   data_array_t *prog_names = arg;
   int sock_fd;
   char hostname[MAX_CHAR];
-  gethostname(hostname, sizeof(hostname)); // Get hostname of the machine
-  char port_num[MAX_CHAR];
-  sprintf(port_num, "%d", PORT); // Convert port number to string
-  struct addrinfo hints, *res;
+  net_hostname(hostname, sizeof(hostname)); // Get hostname of the machine
+
+  // Create one socket to send to every program
+  io_t *io;
+  if ((sock_fd = net_udp_socket()) < 0) {
+    perror("Client side: Error opening socket");
+    exit(1);
+  }
+  if ((io = io_open_sender(io_backend_name)) == NULL) {
+    perror("Client side: Error opening I/O backend");
+    exit(1);
+  }
 
-  // Set hints to get address info
-  memset(&hints, 0, sizeof(hints));
-  hints.ai_family = AF_INET;
-  hints.ai_socktype = SOCK_DGRAM;
+  sleep(1); // Sleep for 1 second while the servers come up
 
+  // Queue a message for every server, then send them all at once
   for (int i = 0; i < data_arr_size(prog_names); i++) {
     const char *serv_name = data_arr_get(prog_names, i);
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
 
     if (strcmp(serv_name, hostname) == 0) {
       continue;
     }
 
-    // Get address info
-    if (getaddrinfo(serv_name, port_num, &hints, &res) != 0) {
-      fprintf(stderr, "Client side: Error getting address info for %s:", serv_name);
-      exit(1);
-    }
-
-    // Create socket file descriptor
-    if ((sock_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol)) < 0) {
-      fprintf(stderr, "Client side: Error opening socket for %s:", serv_name);
-      exit(1);
-    }
-
-    sleep(1); // Sleep for 1 second
-
-    // Send message to server
-    if (sendto(sock_fd, hostname, strlen(hostname), 0, res->ai_addr, res->ai_addrlen) < 0) {
+    if (net_resolve(serv_name, PORT, SOCK_DGRAM, &addr, &addr_len) < 0
+        || io_queue_datagram(io, sock_fd, &addr, addr_len, hostname, strlen(hostname)) < 0) {
       fprintf(stderr, "Client side: Error sending message for %s:", serv_name);
       exit(1);
     }
+  }
 
-    // Free memory and close socket
-    freeaddrinfo(res);
-    close(sock_fd);
+  if (io_flush(io) < 0) {
+    perror("Client side: Error sending messages");
+    exit(1);
   }
+  metrics_inc(hellos_sent_metric, data_arr_size(prog_names) - 1);
 
+  // Close socket
+  io_close(io);
+  close(sock_fd);
   return NULL;
 }
 
 int main(int argc, char *argv[]) {
-  if (argc != 3) {
+  clock_gettime(CLOCK_MONOTONIC, &started_at);
+  char *hostfile_path = NULL;
+  const char *metrics_endpoint = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "h:i:e:")) != -1) {
+    switch (opt) {
+      case 'h':
+        hostfile_path = optarg;
+        break;
+      case 'i':
+        io_backend_name = optarg;
+        break;
+      case 'e':
+        metrics_endpoint = optarg;
+        break;
+      default:
+        fprintf(stderr,
+                "Usage: %s -h <hostfile> [-i auto|uring|blocking] [-e <port>|unix:<path>]\n",
+                argv[0]);
+        exit(1);
+    }
+  }
+  if (hostfile_path == NULL) {
+    exit(1);
+  }
+
+  // Register the metrics, and serve them if asked to
+  hellos_sent_metric = metrics_counter("hellos_sent_total", "Hellos sent to other programs");
+  hellos_received_metric = metrics_counter("hellos_received_total", "Hellos received");
+  ready_metric = metrics_gauge("ready", "Whether a hello arrived from every other program");
+  time_to_ready_metric = metrics_gauge("time_to_ready_microseconds",
+                                       "Time from startup until READY");
+  if (metrics_endpoint != NULL && metrics_serve(metrics_endpoint) < 0) {
+    perror("Error serving metrics");
     exit(1);
   }
 
   // Open file
-  FILE *file = fopen(argv[2], "r");
+  FILE *file = fopen(hostfile_path, "r");
   if (file == NULL) {
     perror("Error opening file");
     exit(1);
@@ -194,5 +231,12 @@ int main(int argc, char *argv[]) {
   // Free memory and close file before exiting
   data_arr_obliterate(arr);
   fclose(file);
+
+  // Keep serving the metrics until the program is stopped
+  if (metrics_endpoint != NULL) {
+    while (1) {
+      pause();
+    }
+  }
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Prints when each program becomes READY and a histogram of the time it took, taken from the
+# discovery:datagram_receive and discovery:ready probes. Stop with Ctrl-C.
+#
+# Usage (as root): trace/ready.sh [program]
+# For programs running in containers, pass /proc/<pid>/root/app/program1.
+
+PROGRAM=${1:-./program1}
+
+exec bpftrace -e "
+usdt:$PROGRAM:discovery:datagram_receive {
+  @hellos_from[str(arg0, arg1)] = count();
+}
+
+usdt:$PROGRAM:discovery:ready {
+  printf(\"pid %d READY after %d us, %d hellos\\n\", pid, arg1, arg0);
+  @time_to_ready_us = hist(arg1);
+}
+"
@@ -0,0 +1,86 @@
+/*
+ * Microbenchmark of the token message codec. It encodes and decodes token messages with the
+ * generated binary codec and with the text format the program used before, and reports the time
+ * per message for each. The checksum of the decoded fields keeps the compiler from optimizing the
+ * work away.
+ *
+ * Usage: codec_bench [messages]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "messages.h"
+
+#define DEFAULT_MESSAGES 10000000 // Number of messages to encode and decode by default
+#define TEXT_LENGTH 256 // Length of a buffer for a text message
+#define NUM_BUFFERS 1024 // Number of buffers the binary messages are spread over
+
+/** Get the current monotonic time in nanoseconds */
+static long long now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/** Print the time spent on one phase of the benchmark */
+static void report(const char *phase, long num_messages, long long ns, unsigned long checksum) {
+  printf("%-14s %ld messages in %.3f s (%.1f ns per message, checksum %lu)\n", phase,
+         num_messages, ns / 1e9, (double)ns / num_messages, checksum);
+}
+
+int main(int argc, char *argv[]) {
+  long num_messages = (argc > 1) ? atol(argv[1]) : DEFAULT_MESSAGES;
+  if (num_messages <= 0) {
+    fprintf(stderr, "Usage: %s [messages]\n", argv[0]);
+    exit(1);
+  }
+
+  // Binary codec: encode into buffers, then decode them through views
+  static uint8_t bufs[NUM_BUFFERS][MESSAGES_MAX_SIZE];
+  unsigned long checksum = 0;
+  long long start = now_ns();
+  for (long i = 0; i < num_messages; i++) {
+    token_msg_t token = {.sender = (uint32_t)i, .receiver = (uint32_t)i + 1};
+    checksum += token_msg_encode(&token, bufs[i % NUM_BUFFERS], MESSAGES_MAX_SIZE);
+  }
+  for (int i = 0; i < NUM_BUFFERS; i++) {
+    checksum += bufs[i][5];
+  }
+  report("binary encode", num_messages, now_ns() - start, checksum);
+
+  checksum = 0;
+  start = now_ns();
+  for (long i = 0; i < num_messages; i++) {
+    token_msg_view_t view;
+    if (token_msg_view(bufs[i % NUM_BUFFERS], TOKEN_MSG_SIZE, &view)) {
+      checksum += token_msg_sender(&view) + token_msg_receiver(&view);
+    }
+  }
+  report("binary decode", num_messages, now_ns() - start, checksum);
+
+  // Text format: sprintf to encode, strstr and sscanf to decode
+  char text[TEXT_LENGTH];
+  checksum = 0;
+  start = now_ns();
+  for (long i = 0; i < num_messages; i++) {
+    checksum += sprintf(text, "{proc_id: %d, sender: %d, receiver: %d, message:\"token\"}\n",
+                        (int)i, (int)i, (int)i + 1);
+  }
+  report("text encode", num_messages, now_ns() - start, checksum);
+
+  checksum = 0;
+  start = now_ns();
+  for (long i = 0; i < num_messages; i++) {
+    text[10] = (char)('0' + i % 10);
+    int proc_id, sender, receiver;
+    if (strstr(text, "\"token\"") != NULL
+        && sscanf(text, "{proc_id: %d, sender: %d, receiver: %d", &proc_id, &sender,
+                  &receiver) == 3) {
+      checksum += sender + receiver;
+    }
+  }
+  report("text decode", num_messages, now_ns() - start, checksum);
+  return 0;
+}
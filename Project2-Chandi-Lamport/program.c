@@ -3,28 +3,43 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdbool.h>
-#include <netdb.h>
-#include <netinet/in.h>
 #include <sys/socket.h>
-#include <arpa/inet.h>
 #include <pthread.h>
+#include <time.h>
+#include "io.h"
+#include "messages.h"
+#include "metrics.h"
+#include "probes.h"
+#include "net.h"
+#include "pool.h"
 
 #define MAX_HOSTNAME_LENGTH 256 // Maximum length of a hostname string
 #define MAX_PROCESSES 5 // Maximum number of processes in this system
 #define PORT 7000 // the port users will be connecting to
-#define PORT_NUM_STR_LEN 6 // Length of the port number string
 #define BACKLOG 10 // how many pending connections queue will hold
 #define MAX_RETRIES 10 // Maximum number of connection retries
 #define RETRY_DELAY_SECONDS 1 // Delay between retries in seconds
+#define CONNECT_TIMEOUT_MS 1000 // How long to wait for a single connection attempt
 #define STRING_LENGTH 1024
+#define IO_REPORT_INTERVAL 10 // Number of tokens received between I/O reports
+#define FORWARD_QUEUE_LENGTH 16 // Number of messages the server can queue for the client
+#define MESSAGE_POOL_SIZE 128 // Number of message buffers, enough for the queue and thread caches
+
+// Message on its way from the server thread to the client thread, in a buffer from the pool
+typedef struct {
+  char line[STRING_LENGTH]; // Message to be printed when it is sent
+  size_t len; // Length of the encoded message
+  uint8_t msg[MESSAGES_MAX_SIZE]; // Message as received, then as encoded to be sent
+} Message;
 
 // Structure to hold process thread information
 typedef struct {
   char hostname[MAX_HOSTNAME_LENGTH]; // Hostname of this process
   pthread_mutex_t mutex; // Mutex for thread synchronization
   pthread_cond_t cond; // Condition variable for thread synchronization
-  char strbuf[STRING_LENGTH]; // Buffer for message to be sent
-  int ready; // Flag to indicate if message is ready to be sent
+  Message *queue[FORWARD_QUEUE_LENGTH]; // Messages waiting to be sent, oldest first
+  int queue_head; // Index of the oldest message in the queue
+  int queue_count; // Number of messages in the queue
 } ProcessThread;
 
 // Structure to hold process information
@@ -37,48 +52,42 @@ typedef struct {
   ProcessThread all_procs[MAX_PROCESSES]; // All process threads
   float tok_delay; // Delay between token transmissions in microseconds
   float mark_delay; // Delay between mark transmissions in microseconds
+  const char *io_backend; // I/O backend asked for on the command line
+  io_t *send_io; // I/O context of the client thread
+  pool_t *message_pool; // Buffers for messages, taken by the server and returned by the client
 } ProcessInfo;
 
+// Metrics, registered in main
+static int tokens_received_metric;
+static int tokens_forwarded_metric;
+static int hop_latency_metric;
+
+/** Get the current monotonic time in microseconds */
+static double now_us(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+/** Print the system calls per message of both threads and the latency of one hop of the ring */
+static void report_io(ProcessInfo *process, io_t *recv_io, double hop_latency_us) {
+  io_stats_t recv_stats, send_stats;
+  io_get_stats(recv_io, &recv_stats);
+  io_get_stats(process->send_io, &send_stats);
+  uint64_t messages = recv_stats.messages + send_stats.messages;
+  fprintf(stderr, "{proc_id: %d, io: %s, syscalls_per_msg: %.2f, hop_latency_us: %.1f}\n",
+          process->proc_id, io_backend(recv_io),
+          messages ? (double)(recv_stats.syscalls + send_stats.syscalls) / messages : 0.0,
+          hop_latency_us);
+}
+
 // Thread dealing with TCP server socket
 void *server(void *arg) {
   ProcessInfo *process = (ProcessInfo *)arg;
   int sock_fd;
-  char port_num[PORT_NUM_STR_LEN];
-  sprintf(port_num, "%d", PORT); // Convert port number to string
-  struct addrinfo hints, *res;
-
-  // Get address info
-  memset(&hints, 0, sizeof(hints));
-  hints.ai_family = AF_INET;
-  hints.ai_socktype = SOCK_STREAM;
-  hints.ai_flags = AI_PASSIVE;
-
-  if (getaddrinfo(NULL, port_num, &hints, &res) != 0) {
-    fprintf(stderr, "Server side error: Could not get address info for %s\n", process->hostname);
-    exit(1);
-  }
-
-  // Create socket file descriptor
-  if ((sock_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol)) < 0) {
-    fprintf(stderr, "Server side error: Could not open socket for %s\n", process->hostname);
-    exit(1);
-  }
-
-  // Set socket options
-  int opt = 1;
-  if (setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-      perror("Server side error: setting socket options");
-      exit(1);
-  }
-
-  // Bind socket with server address
-  if (bind(sock_fd, res->ai_addr, res->ai_addrlen) < 0) {
-    perror("Server side error: binding socket");
-    exit(1);
-  }
 
   // Listen for incoming connections
-  if (listen(sock_fd, BACKLOG) < 0) {
+  if ((sock_fd = net_listen_tcp(PORT, BACKLOG)) < 0) {
     perror("Server side error: listening on socket");
     exit(1);
   }
@@ -94,47 +103,97 @@ void *server(void *arg) {
     exit(1);
   }
 
+  io_t *recv_io;
+  if ((recv_io = io_open_receiver(process->io_backend, new_fd)) == NULL) {
+    perror("Server side error: opening I/O backend");
+    exit(1);
+  }
+
+  // A token takes MAX_PROCESSES hops, each with a delay, between two visits to this process
+  double last_token_at = 0.0;
+  double round_trips_us = 0.0;
+  int round_trips = 0;
+
   while (1) {
-    // Receive message from client
-    char msg[MAX_HOSTNAME_LENGTH];
+    // Receive message from client straight into a buffer that is then forwarded
+    Message *message;
     char rec_msg[MAX_HOSTNAME_LENGTH];
-    char new_msg[MAX_HOSTNAME_LENGTH];
+    ssize_t len;
 
-    if (recv(new_fd, msg, MAX_HOSTNAME_LENGTH, 0) < 0) {
+    if ((message = pool_alloc(process->message_pool)) == NULL) {
+      perror("Server side error: taking a message buffer");
+      exit(1);
+    }
+    if ((len = io_recv_frame(recv_io, message->msg, sizeof(message->msg))) < 0) {
       perror("Server side error: receiving message");
       exit(1);
     }
+    if (len == 0) {
+      fprintf(stderr, "Server side error: predecessor closed the connection\n");
+      pool_free(process->message_pool, message);
+      break;
+    }
 
-    // Process msg
-    char *result = strstr(msg, "\"token\"");
-    if (result != NULL) {
+    // Process msg, decoding its fields in place
+    token_msg_view_t token;
+    if (token_msg_view(message->msg, len, &token)) {
       process->state++; // update state
 
+      metrics_inc(tokens_received_metric, 1);
+      double token_at = now_us();
+      PROBE(ring, token_receive, process->proc_id, token_msg_sender(&token),
+            (long long)(token_at * 1000));
+      if (last_token_at > 0.0) {
+        double hop_us = (token_at - last_token_at) / MAX_PROCESSES - process->tok_delay;
+        metrics_observe(hop_latency_metric, (hop_us > 0.0) ? (uint64_t)hop_us : 0);
+        round_trips_us += token_at - last_token_at;
+        round_trips++;
+      }
+      last_token_at = token_at;
+      if (round_trips == IO_REPORT_INTERVAL) {
+        double hops_us = round_trips_us / round_trips - MAX_PROCESSES * process->tok_delay;
+        report_io(process, recv_io, hops_us / MAX_PROCESSES);
+        round_trips_us = 0.0;
+        round_trips = 0;
+      }
+
       // Print proccess id and state
       fprintf(stderr, "{proc_id: %d, state: %d}\n", process->proc_id, process->state);
 
       // Print message received
-      sprintf(rec_msg, "{proc_id: %d, sender: %d, receiver: %d, message:\"token\"}\n",
-              process->proc_id, process->predecessor, process->proc_id);
+      sprintf(rec_msg, "{proc_id: %d, sender: %u, receiver: %u, message:\"token\"}\n",
+              process->proc_id, token_msg_sender(&token), token_msg_receiver(&token));
       fprintf(stderr, "%s", rec_msg);
 
-      sprintf(new_msg, "{proc_id: %d, sender: %d, receiver: %d, message:\"token\"}\n",
+      // The received token is no longer needed, so encode the new one over it
+      sprintf(message->line, "{proc_id: %d, sender: %d, receiver: %d, message:\"token\"}\n",
               process->proc_id, process->proc_id, process->successor);
+      token_msg_t new_token = {.sender = process->proc_id, .receiver = process->successor};
+      message->len = token_msg_encode(&new_token, message->msg, sizeof(message->msg));
 
       usleep(process->tok_delay); // sleep for tok_delay seconds
 
-      // Send message to this server's client to send to successor
+      // Queue message for this server's client to send to successor
       ProcessThread *process_thread = &process->all_procs[process->proc_id - 1];
       pthread_mutex_lock(&process_thread->mutex);
-      strcpy(process_thread->strbuf, new_msg);
-      process_thread->ready = 1;
-      pthread_cond_signal(&process_thread->cond);
+      while (process_thread->queue_count == FORWARD_QUEUE_LENGTH) {
+        pthread_cond_wait(&process_thread->cond, &process_thread->mutex); // Wait for space
+      }
+      int tail = (process_thread->queue_head + process_thread->queue_count) % FORWARD_QUEUE_LENGTH;
+      process_thread->queue[tail] = message;
+      process_thread->queue_count++;
+      pthread_cond_broadcast(&process_thread->cond);
       pthread_mutex_unlock(&process_thread->mutex);
+    } else {
+      fprintf(stderr, "Server side error: unknown message type %d\n",
+              messages_type(message->msg, len));
+      pool_free(process->message_pool, message);
     }
   }
 
-  // Free memory and close socket before exiting
-  freeaddrinfo(res);
+  // Close sockets before exiting
+  io_close(recv_io);
+  close(new_fd);
   close(sock_fd);
   return NULL;
 }
@@ -143,50 +202,35 @@ void *server(void *arg) {
 void *client(void *arg) {
   ProcessInfo *process = (ProcessInfo *)arg;
   int sock_fd;
-  char port_num[PORT_NUM_STR_LEN];
-  sprintf(port_num, "%d", PORT); // Convert port number to string
-  struct addrinfo hints, *res;
   bool start_tok_pass = process->state == 1;
 
   sleep(1); // wait for servers to come up
 
-  // Get address info
-  memset(&hints, 0, sizeof(hints));
-  hints.ai_family = AF_INET;
-  hints.ai_socktype = SOCK_STREAM;
-
-  // Get address info
+  // Connect to server, retrying while the successor is still starting up
   const char *successor_name = process->all_procs[process->successor - 1].hostname;
-  if (getaddrinfo(successor_name, port_num, &hints, &res) != 0) {
-    fprintf(stderr, "Client side error: Could not get address info for %s\n", successor_name);
-    exit(1);
-  }
-
-  // Create socket file descriptor
-  if ((sock_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol)) < 0) {
-    fprintf(stderr, "Client side error: Could not open socket for %s\n", successor_name);
-    exit(1);
-  }
-
-  // Connect to server
-  if (connect(sock_fd, res->ai_addr, res->ai_addrlen) < 0) {
+  if ((sock_fd = net_connect_tcp_retry(successor_name, PORT, CONNECT_TIMEOUT_MS, MAX_RETRIES,
+                                       RETRY_DELAY_SECONDS * 1000)) < 0) {
     fprintf(stderr, "Client side error: Could not connect to %s\n", successor_name);
     exit(1);
   }
 
   // If state is 1, send token to successor to start the ring
   if (start_tok_pass) {
-      char msg[STRING_LENGTH];
-      sprintf(msg, "{proc_id: %d, sender: %d, receiver: %d, message:\"token\"}\n",
+      fprintf(stderr, "{proc_id: %d, sender: %d, receiver: %d, message:\"token\"}\n",
               process->proc_id, process->proc_id, process->successor);
 
-      fprintf(stderr, "%s", msg);
-
       // Send message to server
-      if (send(sock_fd, msg, strlen(msg), 0) < 0) {
+      PROBE(ring, token_forward, process->proc_id, process->successor,
+            (long long)(now_us() * 1000));
+      token_msg_t token = {.sender = process->proc_id, .receiver = process->successor};
+      uint8_t msg[TOKEN_MSG_SIZE];
+      size_t len = token_msg_encode(&token, msg, sizeof(msg));
+      if (io_queue_frame(process->send_io, sock_fd, msg, len) < 0
+          || io_flush(process->send_io) < 0) {
         fprintf(stderr, "Client side error: Could not send message for %s\n", successor_name);
         exit(1);
       }
+      metrics_inc(tokens_forwarded_metric, 1);
   }
 
   while (1) {
@@ -194,24 +238,32 @@ void *client(void *arg) {
     ProcessThread *process_thread = &process->all_procs[process->proc_id - 1];
     pthread_mutex_lock(&process_thread->mutex);
 
-    while (!process_thread->ready) {
+    while (process_thread->queue_count == 0) {
       pthread_cond_wait(&process_thread->cond, &process_thread->mutex); // Wait for signal
     }
 
-    process_thread->ready = 0; // Reset the flag for future use
+    // Take the oldest message, so the server can queue the next one
+    Message *message = process_thread->queue[process_thread->queue_head];
+    process_thread->queue_head = (process_thread->queue_head + 1) % FORWARD_QUEUE_LENGTH;
+    process_thread->queue_count--;
+    pthread_cond_broadcast(&process_thread->cond);
     pthread_mutex_unlock(&process_thread->mutex);
 
     // Print message to be sent
-    fprintf(stderr, "%s", process_thread->strbuf);
+    fprintf(stderr, "%s", message->line);
 
-    // Send message to server
-    if (send(sock_fd, process_thread->strbuf, strlen(process_thread->strbuf), 0) < 0) {
+    // Send message to server; the frame is copied out, so the buffer can go back to the pool
+    PROBE(ring, token_forward, process->proc_id, process->successor,
+          (long long)(now_us() * 1000));
+    if (io_queue_frame(process->send_io, sock_fd, message->msg, message->len) < 0
+        || io_flush(process->send_io) < 0) {
       fprintf(stderr, "Client side error: Could not send message for %s\n", successor_name);
       exit(1);
     }
+    pool_free(process->message_pool, message);
+    metrics_inc(tokens_forwarded_metric, 1);
   }
 
-  freeaddrinfo(res);
   close(sock_fd);
   return NULL;
 }
@@ -228,7 +280,9 @@ int main(int argc, char *argv[]) {
 
   // Parse command line arguments
   int opt;
-  while ((opt = getopt(argc, argv, "h:xt:m:s:p:")) != -1) {
+  const char *io_backend = "auto";
+  const char *metrics_endpoint = NULL;
+  while ((opt = getopt(argc, argv, "h:xt:m:s:p:i:e:")) != -1) {
     switch (opt) {
       case 'h':
         hostfile_path = optarg;
@@ -248,8 +302,14 @@ int main(int argc, char *argv[]) {
       case 'p':
         snapshot_id = atoi(optarg);
         break;
+      case 'i':
+        io_backend = optarg;
+        break;
+      case 'e':
+        metrics_endpoint = optarg;
+        break;
       default:
-        fprintf(stderr, "Usage: %s -h <hostfile> [-x] [-t <tok_delay>] [-m <mark_delay>] [-s <snapshot_state> -p <snapshot_id>]\n", argv[0]);
+        fprintf(stderr, "Usage: %s -h <hostfile> [-x] [-t <tok_delay>] [-m <mark_delay>] [-s <snapshot_state> -p <snapshot_id>] [-i auto|uring|blocking] [-e <port>|unix:<path>]\n", argv[0]);
         exit(1);
     }
   }
@@ -269,13 +329,34 @@ int main(int argc, char *argv[]) {
   process.state = starts_with_tok ? 1 : 0;
   process.tok_delay = tok_delay * 1000000; // Convert seconds to microseconds
   process.mark_delay = mark_delay * 1000000; // Convert seconds to microseconds
-  if (gethostname(process.hostname, sizeof(process.hostname)) != 0) {
+  process.io_backend = io_backend;
+
+  // Register the metrics, and serve them if asked to
+  tokens_received_metric = metrics_counter("tokens_received_total", "Tokens received");
+  tokens_forwarded_metric = metrics_counter("tokens_forwarded_total",
+                                            "Tokens sent to the successor");
+  hop_latency_metric = metrics_histogram("hop_latency_microseconds",
+                                         "Time for one hop of the ring, token delay excluded");
+  if (metrics_endpoint != NULL && metrics_serve(metrics_endpoint) < 0) {
+    perror("Error serving metrics");
+    exit(1);
+  }
+
+  if ((process.message_pool = pool_create(sizeof(Message), MESSAGE_POOL_SIZE)) == NULL) {
+    perror("Error creating message pool");
+    exit(1);
+  }
+  if ((process.send_io = io_open_sender(io_backend)) == NULL) {
+    perror("Error opening I/O backend");
+    exit(1);
+  }
+  if (net_hostname(process.hostname, sizeof(process.hostname)) != 0) {
     perror("Error getting hostname");
     exit(1);
   }
 
   // Open hostfile for reading
-  FILE *file = fopen("hostsfile.txt", "r");
+  FILE *file = fopen(hostfile_path, "r");
   char line[MAX_HOSTNAME_LENGTH];
   int line_num = 0;
   int num_processes = 0;
@@ -346,7 +427,8 @@ int main(int argc, char *argv[]) {
     exit(1);
   }
 
-  process.all_procs[process.proc_id - 1].ready = 0;
+  process.all_procs[process.proc_id - 1].queue_head = 0;
+  process.all_procs[process.proc_id - 1].queue_count = 0;
 
   // Create server thread
   if (pthread_create(&server_thread, NULL, server, &process) != 0) {
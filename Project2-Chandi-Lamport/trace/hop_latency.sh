@@ -0,0 +1,25 @@
+#!/bin/sh
+# Prints a histogram of hop latency: the time from a process forwarding the token to its successor
+# receiving it, taken from the ring:token_forward and ring:token_receive probes. Processes on the
+# same host share the monotonic clock, so every hop of the ring is measured. Stop with Ctrl-C.
+#
+# Usage (as root): trace/hop_latency.sh [program]
+# For programs running in containers, pass /proc/<pid>/root/app/program.
+
+PROGRAM=${1:-./program}
+
+exec bpftrace -e "
+usdt:$PROGRAM:ring:token_forward {
+  @forwarded_at[arg1] = arg2;
+}
+
+usdt:$PROGRAM:ring:token_receive /@forwarded_at[arg0]/ {
+  @hop_latency_us = hist((arg2 - @forwarded_at[arg0]) / 1000);
+  @hop_latency_us_by_receiver[arg0] = stats((arg2 - @forwarded_at[arg0]) / 1000);
+  delete(@forwarded_at[arg0]);
+}
+
+END {
+  clear(@forwarded_at);
+}
+"
@@ -0,0 +1,197 @@
+package main.java;
+
+import java.io.DataInputStream;
+import java.io.DataOutputStream;
+import java.io.IOException;
+import java.util.Arrays;
+import java.util.zip.DataFormatException;
+import java.util.zip.Deflater;
+import java.util.zip.Inflater;
+
+/**
+ * Splits object values into blocks of up to 64 KB, each of which may be compressed on its own. The
+ * same block format is used on the wire and on disk, so a peer can store the blocks it receives
+ * as they are. A block is framed as its raw length, the length of its data and the data. The data
+ * is compressed exactly when it is shorter than the raw length, so a block that does not shrink is
+ * kept raw. A value is a sequence of blocks followed by an end marker, a raw length of 0, so it can
+ * be streamed without knowing its size up front.
+ *
+ * <p>Compression uses DEFLATE at its fastest level, which trades ratio for speed.
+ */
+public final class BlockCodec {
+  public static final int BLOCK_SIZE = 64 * 1024;
+
+  /**
+   * A block of a value.
+   *
+   * @param rawLength the length of the block once decompressed
+   * @param data the data of the block, compressed if shorter than the raw length
+   */
+  public record Block(int rawLength, byte[] data) {
+    /**
+     * Checks whether the block is compressed.
+     *
+     * @return true if the block is compressed, false if it is raw
+     */
+    public boolean compressed() {
+      return this.data.length < this.rawLength;
+    }
+
+    /**
+     * Returns the size of the framed block.
+     *
+     * @return the number of bytes the block takes on the wire or on disk
+     */
+    public int framedLength() {
+      return 8 + this.data.length;
+    }
+
+    /**
+     * Returns the raw contents of the block, decompressing them if needed.
+     *
+     * @return the raw contents
+     * @throws IOException if the compressed data is corrupt
+     */
+    public byte[] decode() throws IOException {
+      if (!compressed()) {
+        return this.data;
+      }
+
+      Inflater inflater = new Inflater();
+      try {
+        inflater.setInput(this.data);
+        byte[] raw = new byte[this.rawLength];
+        int length = 0;
+        while (length < raw.length) {
+          int n = inflater.inflate(raw, length, raw.length - length);
+          if (n == 0 && (inflater.finished() || inflater.needsInput())) {
+            throw new IOException("Block codec error: truncated block");
+          }
+          length += n;
+        }
+        return raw;
+      } catch (DataFormatException e) {
+        throw new IOException("Block codec error: " + e.getMessage());
+      } finally {
+        inflater.end();
+      }
+    }
+
+    /**
+     * Returns the block compressed or raw, converting it only if needed.
+     *
+     * @param compress whether the block should be compressed
+     * @return the block in the requested form, or raw if it does not shrink when compressed
+     * @throws IOException if the compressed data is corrupt
+     */
+    public Block recode(boolean compress) throws IOException {
+      if (compressed() == compress) {
+        return this;
+      }
+      byte[] raw = decode();
+      return encode(raw, raw.length, compress);
+    }
+
+    /**
+     * Writes the framed block.
+     *
+     * @param out the output to write to
+     * @throws IOException if the block cannot be written
+     */
+    public void writeTo(DataOutputStream out) throws IOException {
+      out.writeInt(this.rawLength);
+      out.writeInt(this.data.length);
+      out.write(this.data);
+    }
+  }
+
+  /**
+   * Makes a block out of raw contents.
+   *
+   * @param raw the buffer holding the contents
+   * @param length the length of the contents, between 1 and BLOCK_SIZE
+   * @param compress whether to compress the block
+   * @return the block, raw if compression was not asked for or does not shrink it
+   * @throws IllegalArgumentException if the length is out of range
+   */
+  public static Block encode(byte[] raw, int length, boolean compress)
+          throws IllegalArgumentException {
+    if (length < 1 || length > BLOCK_SIZE) {
+      throw new IllegalArgumentException("Block codec error: invalid block length");
+    }
+
+    if (compress) {
+      Deflater deflater = new Deflater(Deflater.BEST_SPEED);
+      try {
+        deflater.setInput(raw, 0, length);
+        deflater.finish();
+        byte[] data = new byte[length - 1];
+        int dataLength = deflater.deflate(data);
+        if (deflater.finished()) {
+          return new Block(length, Arrays.copyOf(data, dataLength));
+        }
+      } finally {
+        deflater.end();
+      }
+    }
+    return new Block(length, Arrays.copyOf(raw, length));
+  }
+
+  /**
+   * Reads the next framed block of a value.
+   *
+   * @param in the input to read from
+   * @return the block, or null at the end of the value
+   * @throws IOException if the block cannot be read or is malformed
+   */
+  public static Block readFrom(DataInputStream in) throws IOException {
+    int rawLength = in.readInt();
+    if (rawLength == 0) {
+      return null;
+    }
+    int dataLength = in.readInt();
+    if (rawLength < 0 || rawLength > BLOCK_SIZE || dataLength < 0 || dataLength > rawLength) {
+      throw new IOException("Block codec error: malformed block");
+    }
+
+    byte[] data = new byte[dataLength];
+    in.readFully(data);
+    return new Block(rawLength, data);
+  }
+
+  /**
+   * Copies the blocks of a value as they are, up to and including its end marker.
+   *
+   * @param in the input to read the blocks from
+   * @param out the output to write them to
+   * @throws IOException if a block cannot be read or written, or is malformed
+   */
+  public static void copy(DataInputStream in, DataOutputStream out) throws IOException {
+    for (Block block; (block = readFrom(in)) != null;) {
+      block.writeTo(out);
+    }
+    writeEnd(out);
+  }
+
+  /**
+   * Reads the blocks of a value up to its end marker and discards them.
+   *
+   * @param in the input to read the blocks from
+   * @throws IOException if a block cannot be read or is malformed
+   */
+  public static void skip(DataInputStream in) throws IOException {
+    while (readFrom(in) != null) {
+      // nothing to keep
+    }
+  }
+
+  /**
+   * Writes the end marker of a value.
+   *
+   * @param out the output to write to
+   * @throws IOException if the marker cannot be written
+   */
+  public static void writeEnd(DataOutputStream out) throws IOException {
+    out.writeInt(0);
+  }
+}
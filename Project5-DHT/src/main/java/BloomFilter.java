@@ -0,0 +1,129 @@
+package main.java;
+
+import java.io.DataInput;
+import java.io.DataOutput;
+import java.io.IOException;
+
+/**
+ * A Bloom filter over string keys. It answers whether a key might have been added, with no false
+ * negatives and a false positive rate chosen at construction. The filter is sized with the usual
+ * formulas: m = -n ln(p) / (ln 2)^2 bits and k = (m / n) ln 2 hash functions. At a 1% false
+ * positive rate this is about 9.6 bits and 7 hash functions per key, or roughly 1.2 MB per million
+ * keys. The k bit positions are derived from two halves of a single 64-bit hash.
+ */
+public final class BloomFilter {
+  private final long[] bits;
+  private final long numBits;
+  private final int numHashes;
+
+  /**
+   * Constructs a new, empty Bloom filter.
+   *
+   * @param expectedKeys the number of keys the filter is sized for
+   * @param falsePositiveRate the false positive rate once the expected number of keys is added
+   * @throws IllegalArgumentException if the expected number of keys is not positive or the false
+   *         positive rate is not between 0 and 1
+   */
+  public BloomFilter(long expectedKeys, double falsePositiveRate)
+          throws IllegalArgumentException {
+    if (expectedKeys <= 0) {
+      throw new IllegalArgumentException("Bloom filter error: expected keys must be positive");
+    }
+    if (falsePositiveRate <= 0 || falsePositiveRate >= 1) {
+      throw new IllegalArgumentException("Bloom filter error: invalid false positive rate");
+    }
+
+    double ln2 = Math.log(2);
+    long wantedBits = (long) Math.ceil(-expectedKeys * Math.log(falsePositiveRate) / (ln2 * ln2));
+    this.bits = new long[(int) ((wantedBits + 63) / 64)];
+    this.numBits = this.bits.length * 64L;
+    this.numHashes = Math.max(1, (int) Math.round((double) this.numBits / expectedKeys * ln2));
+  }
+
+  /**
+   * Constructs a Bloom filter from its saved bit array.
+   *
+   * @param bits the bit array
+   * @param numHashes the number of hash functions
+   */
+  private BloomFilter(long[] bits, int numHashes) {
+    this.bits = bits;
+    this.numBits = bits.length * 64L;
+    this.numHashes = numHashes;
+  }
+
+  /**
+   * Reads a Bloom filter written by {@link #writeTo(DataOutput)}.
+   *
+   * @param in the input to read from
+   * @return the Bloom filter
+   * @throws IOException if the filter cannot be read
+   */
+  public static BloomFilter readFrom(DataInput in) throws IOException {
+    int numHashes = in.readInt();
+    long[] bits = new long[in.readInt()];
+    for (int i = 0; i < bits.length; i++) {
+      bits[i] = in.readLong();
+    }
+    return new BloomFilter(bits, numHashes);
+  }
+
+  /**
+   * Writes the filter so that it can be read back with {@link #readFrom(DataInput)}.
+   *
+   * @param out the output to write to
+   * @throws IOException if the filter cannot be written
+   */
+  public void writeTo(DataOutput out) throws IOException {
+    out.writeInt(this.numHashes);
+    out.writeInt(this.bits.length);
+    for (long word : this.bits) {
+      out.writeLong(word);
+    }
+  }
+
+  /**
+   * Adds a key to the filter.
+   *
+   * @param key the key
+   */
+  public void add(String key) {
+    long hash = Utils.hash64(key);
+    int h1 = (int) hash;
+    int h2 = (int) (hash >>> 32);
+
+    for (int i = 0; i < this.numHashes; i++) {
+      long bit = Integer.toUnsignedLong(h1 + i * h2) % this.numBits;
+      this.bits[(int) (bit >>> 6)] |= 1L << bit;
+    }
+  }
+
+  /**
+   * Checks whether a key might have been added to the filter.
+   *
+   * @param key the key
+   * @return false if the key was definitely never added, true if it might have been
+   */
+  public boolean mightContain(String key) {
+    long hash = Utils.hash64(key);
+    int h1 = (int) hash;
+    int h2 = (int) (hash >>> 32);
+
+    for (int i = 0; i < this.numHashes; i++) {
+      long bit = Integer.toUnsignedLong(h1 + i * h2) % this.numBits;
+      if ((this.bits[(int) (bit >>> 6)] & (1L << bit)) == 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Returns the number of bytes the filter's bit array occupies.
+   *
+   * @return the size of the filter in bytes
+   */
+  public long sizeInBytes() {
+    return this.bits.length * 8L;
+  }
+}
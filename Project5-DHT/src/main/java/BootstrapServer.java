@@ -5,36 +5,81 @@ import java.io.DataOutputStream;
 import java.io.IOException;
 import java.net.ServerSocket;
 import java.net.Socket;
-import java.util.ArrayList;
 import java.util.Collections;
 import java.util.Comparator;
+import java.util.HashMap;
 import java.util.LinkedHashMap;
 import java.util.List;
 import java.util.Map;
+import java.util.NavigableMap;
+import java.util.concurrent.ConcurrentHashMap;
 
 /**
  * The bootstrap server is responsible for maintaining the ring as peers join and telling each peer
  * where their place is in the ring. It will inform each peer from the ring that need to update
  * their predecessor and successor. It doesn't monitor the peers. A client can interact with the
  * boostrap server to store and retrieve objects in the ring. When receiving such a request, the
- * boostrap server will forward the request to the first peer in the ring.
+ * boostrap server will forward the request to the first peer in the ring. Alternatively, a client
+ * in direct mode only asks the bootstrap server for the current ring and then talks to the peers
+ * itself, which keeps the bootstrap server off the data path. A peer that shuts down tells the
+ * bootstrap server it is leaving, and its neighbors are then linked to each other. Peers that
+ * track hot objects push the lookups of those objects to the bootstrap server, which then answers
+ * requests for them without involving the ring until the lookups are invalidated or expire.
+ *
+ * <p>The ring is ordered by the peers' positions, which start out as the numeric part of their IDs.
+ * Peers periodically report how many objects they hold and how many requests they serve. Every so
+ * often the bootstrap server compares the busiest peer with the mean, and if it is too far above,
+ * moves the boundary between that peer and its less loaded neighbor so that the neighbor takes over
+ * part of its range. Only one boundary is moved per round, and the peers pace the transfer of the
+ * objects that change hands.
+ *
+ * <p>The ring is kept in a {@link RingIndex}, so a join or a leave costs O(log n) at the bootstrap
+ * server no matter how large the ring is. Only the peers whose neighbors change are told about a
+ * join; the rest of the ring learns of the new peer lazily, when lookups are forwarded through it.
  */
 public final class BootstrapServer {
-  private final List<String> ring;
+  private static final long REBALANCE_INTERVAL_MS = 30000;
+  private static final double REBALANCE_THRESHOLD = 1.25;
+  private static final int MAX_PRINTED_RING_SIZE = 64;
+  private static final long MEMBERSHIP_CHANGE_TIMEOUT_MS = 10000;
+
+  private final RingIndex ring;
+  private final Map<String, Load> loads = new ConcurrentHashMap<>();
+  private final HotKeyCache hotKeyCache = new HotKeyCache();
+  // joins, leaves and rebalancing moves are made one at a time; the state of the current one is
+  // guarded by membershipLock
+  private final Object membershipLock = new Object();
+  private boolean changeInProgress;
   private int joinUpdateCount = 0;
+  private int numPeersThatWillUpdate = 4;
+  private String change;
+  private List<String> affectedPeers = List.of();
+  private long changeStartedAt;
 
   /**
-   * Constructs a new BootstrapServer object. A bootstrap server has a list of peers in a sorted
-   * ring.
+   * Constructs a new BootstrapServer object. A bootstrap server has an index of the peers in a
+   * sorted ring.
    */
   public BootstrapServer() {
-    this.ring = new ArrayList<>();
+    this.ring = new RingIndex();
+  }
+
+  /**
+   * The load last reported by a peer.
+   *
+   * @param keys the number of objects the peer holds
+   * @param requestRate the number of requests per second the peer served
+   * @param reportedAt the time of the report, in milliseconds since the epoch
+   */
+  private record Load(long keys, double requestRate, long reportedAt) {
   }
 
   /**
    * Starts the bootstrap server, which listens for incoming connections from peers.
    */
   public void start() {
+    new Thread(this::runRebalancer).start();
+
     try (ServerSocket serverSocket = new ServerSocket(Utils.PORT)) {
       while (true) {
         Socket socket = serverSocket.accept();
@@ -54,9 +99,10 @@ public final class BootstrapServer {
   private void handleConnection(Socket socket) {
     try (
             DataInputStream in = new DataInputStream(socket.getInputStream());
+            DataOutputStream out = new DataOutputStream(socket.getOutputStream())
     ) {
       String msg = in.readUTF();
-      handleMessage(msg);
+      handleMessage(msg, out);
     } catch (IOException e) {
       throw new RuntimeException("Boostrap error: " + e.getMessage());
     }
@@ -66,21 +112,23 @@ public final class BootstrapServer {
    * Handles a message received from a peer appropriately depending on its contents.
    *
    * @param msg the message received from the peer
+   * @param out the output stream of the connection the message came from, used for replies that
+   *            are sent back on the same connection
+   * @throws IOException if a reply cannot be written
    */
-  private void handleMessage(String msg) {
+  private void handleMessage(String msg, DataOutputStream out) throws IOException {
     Map<String, String> msgRec = Utils.unpackMsg(msg);
 
     switch (msgRec.get("operation_type")) {
+      case "GET_RING" -> replyWithRing(out);
       case "JOIN" -> handlePeerJoining(msgRec);
-      case "PRED_ASSIGNED", "SUCC_ASSIGNED" -> {
-        this.joinUpdateCount++;
-        int numPeersThatWillUpdate = 4;
-        if (this.joinUpdateCount == numPeersThatWillUpdate) {
-          broadcastNewPeerJoined();
-          this.joinUpdateCount = 0;
-        }
-      }
-      case "STORE", "RETRIEVE" -> handleClientRequest(msg);
+      case "LEAVE" -> handlePeerLeaving(msgRec);
+      case "PRED_ASSIGNED", "SUCC_ASSIGNED" -> acknowledgeUpdate();
+      case "STORE", "RETRIEVE" -> handleClientRequest(msg, msgRec);
+      case "CACHE_HOT_KEY", "INVALIDATE_HOT_KEY" -> handleHotKeyUpdate(msgRec);
+      case "LOAD_REPORT" -> this.loads.put(msgRec.get("peer_id"),
+              new Load(Long.parseLong(msgRec.get("keys")),
+                      Double.parseDouble(msgRec.get("request_rate")), System.currentTimeMillis()));
       case "OBJ_STORED", "OBJ_RETRIEVED", "OBJ_NOT_FOUND" ->
               handleReportToClient(msg, msgRec.get("client_id"));
       default -> throw new RuntimeException("Boostrap error: unknown message type");
@@ -89,52 +137,293 @@ public final class BootstrapServer {
 
   /**
    * Handles a peer joining the ring. It adds the peer to the ring and makes appropriate
-   * adjustments to its predecessor and successor.
+   * adjustments to its predecessor and successor. The peer asks for the position of its numeric
+   * ID; if rebalancing has moved another peer there, the peer is told to take the next free
+   * position instead, before any of its neighbors learns about it.
    *
    * @param msgRec the message received from the peer telling the server that it is joining
    */
   private void handlePeerJoining(Map<String, String> msgRec) {
     String peerId = msgRec.get("peer_id");
-    addPeerToRing(peerId);
-    String pred = assignPred(peerId);
-    String succ = assignSucc(peerId);
-    assignSucc(pred);
-    assignPred(succ);
+    long startedAt = System.nanoTime();
+    int wantedToken = Utils.extractIdNum(peerId);
+    beginChange("JOINED " + peerId, 4, startedAt);
+    RingIndex.Placement placement;
+    try {
+      placement = this.ring.addNear(peerId, wantedToken);
+    } catch (IllegalArgumentException e) {
+      endChange();
+      throw new RuntimeException("Boostrap error: " + e.getMessage());
+    }
+    RingIndex.Neighbors neighbors = placement.neighbors();
+
+    if (placement.token() != wantedToken) {
+      System.err.println("POSITION " + wantedToken + " taken, " + peerId + " joins at "
+              + placement.token());
+      sendToPeer(peerId, Utils.prepareMsg(new LinkedHashMap<>() {{
+        put("peer_id", peerId);
+        put("operation_type", "REASSIGN_TOKEN");
+        put("new_token", String.valueOf(placement.token()));
+      }}));
+    }
+
+    synchronized (this.membershipLock) {
+      this.affectedPeers = List.of(peerId, neighbors.predecessor(), neighbors.successor())
+              .stream().distinct().toList();
+    }
+    assignPred(peerId, neighbors.predecessor());
+    assignSucc(peerId, neighbors.successor());
+    assignSucc(neighbors.predecessor(), peerId);
+    assignPred(neighbors.successor(), peerId);
   }
 
   /**
-   * Adds a peer to the ring in a sorted manner.
+   * Handles a peer leaving the ring. It removes the peer from the ring and links the peer's
+   * predecessor and successor to each other. The leaving peer has already handed its objects to
+   * its successor.
    *
-   * @param peerId the ID of the peer to add
+   * @param msgRec the message received from the peer telling the server that it is leaving
    */
-  private void addPeerToRing(String peerId) {
-    int insertionPoint = binarySearch(peerId);
-    if (insertionPoint >= 0) {
-      throw new RuntimeException("Boostrap error: cannot add duplicate peer to ring");
+  private void handlePeerLeaving(Map<String, String> msgRec) {
+    long startedAt = System.nanoTime();
+    beginChange("LEFT " + msgRec.get("peer_id"), 2, startedAt);
+    RingIndex.Neighbors neighbors;
+    try {
+      neighbors = this.ring.remove(msgRec.get("peer_id"));
+    } catch (IllegalArgumentException e) {
+      endChange();
+      throw new RuntimeException("Boostrap error: " + e.getMessage());
+    }
+    this.loads.remove(msgRec.get("peer_id"));
+    if (neighbors == null) {
+      endChange();
+      return;
     }
-    insertionPoint = -insertionPoint - 1;
-    this.ring.add(insertionPoint, peerId);
+
+    synchronized (this.membershipLock) {
+      this.affectedPeers = List.of(neighbors.predecessor(), neighbors.successor()).stream()
+              .distinct().toList();
+    }
+    assignSucc(neighbors.predecessor(), neighbors.successor());
+    assignPred(neighbors.successor(), neighbors.predecessor());
   }
 
   /**
-   * Sends a message to the given peer to assign a new predecessor.
+   * Rebalances the ring every REBALANCE_INTERVAL_MS.
+   */
+  private void runRebalancer() {
+    while (true) {
+      try {
+        Thread.sleep(REBALANCE_INTERVAL_MS);
+      } catch (InterruptedException e) {
+        return;
+      }
+
+      beginChange("REBALANCE", 0, System.nanoTime());
+      try {
+        rebalance();
+      } catch (RuntimeException e) {
+        System.err.println("Boostrap error: rebalancing failed: " + e.getMessage());
+      } finally {
+        endChange();
+      }
+    }
+  }
+
+  /**
+   * Waits until no other join, leave or rebalancing round is in progress and starts this one, so
+   * that the ring is changed one step at a time. A change that its peers have not acknowledged
+   * within MEMBERSHIP_CHANGE_TIMEOUT_MS is given up on, so a peer that dies halfway through a join
+   * does not hold up the ring for good.
    *
-   * @param peerId id of the peer to assign predecessor
-   * @return the id of the predecessor
+   * @param change what is changing, printed once the change is complete
+   * @param numUpdates the number of acknowledgements from peers that complete the change, or 0 if
+   *                   the change ends with {@link #endChange()} instead
+   * @param startedAt when the change was asked for, as given by {@link System#nanoTime()}
+   */
+  private void beginChange(String change, int numUpdates, long startedAt) {
+    synchronized (this.membershipLock) {
+      long deadline = System.currentTimeMillis() + MEMBERSHIP_CHANGE_TIMEOUT_MS;
+      while (this.changeInProgress) {
+        long waitMillis = deadline - System.currentTimeMillis();
+        if (waitMillis <= 0) {
+          System.err.println("Boostrap error: " + this.change + " not acknowledged, giving up");
+          break;
+        }
+        try {
+          this.membershipLock.wait(waitMillis);
+        } catch (InterruptedException e) {
+          throw new RuntimeException("Boostrap error: " + e.getMessage());
+        }
+      }
+      this.changeInProgress = true;
+      this.change = change;
+      this.changeStartedAt = startedAt;
+      this.numPeersThatWillUpdate = numUpdates;
+      this.joinUpdateCount = 0;
+      this.affectedPeers = List.of();
+    }
+  }
+
+  /**
+   * Ends the change in progress and lets the next one start.
+   */
+  private void endChange() {
+    synchronized (this.membershipLock) {
+      this.changeInProgress = false;
+      this.membershipLock.notifyAll();
+    }
+  }
+
+  /**
+   * Counts a peer's acknowledgement of its new predecessor or successor. Once every peer affected
+   * by the change in progress has acknowledged it, they are told the ring is updated and the next
+   * change may start. Acknowledgements of a change that was given up on are ignored.
+   */
+  private void acknowledgeUpdate() {
+    synchronized (this.membershipLock) {
+      if (!this.changeInProgress || this.numPeersThatWillUpdate == 0) {
+        return;
+      }
+      this.joinUpdateCount++;
+      if (this.joinUpdateCount == this.numPeersThatWillUpdate) {
+        try {
+          notifyNewPeerJoined();
+        } finally {
+          endChange();
+        }
+      }
+    }
+  }
+
+  /**
+   * Runs one round of rebalancing. A peer's load is the larger of its object count and its
+   * request rate, each relative to the mean over all peers. The load of the busiest peer relative
+   * to the mean is printed, and if it is above REBALANCE_THRESHOLD while one of the peer's
+   * neighbors is below the mean, the boundary between the two is moved so that they end up with
+   * about the same load. Rounds are skipped until every peer has reported its load recently.
    */
-  private String assignPred(String peerId) {
-    int peerIdx = binarySearch(peerId);
-    if (peerIdx < 0) {
-      throw new RuntimeException("Boostrap error: peer doesn't exist in ring");
+  private void rebalance() {
+    List<String> peers = this.ring.peers();
+    long now = System.currentTimeMillis();
+    if (peers.size() < 2 || !peers.stream().allMatch(peer -> this.loads.containsKey(peer)
+            && now - this.loads.get(peer).reportedAt() < 2 * REBALANCE_INTERVAL_MS)) {
+      return;
     }
 
-    String pred_id = this.ring.get((peerIdx == 0) ? this.ring.size() - 1 : peerIdx - 1);
+    double meanKeys = peers.stream().mapToLong(peer -> this.loads.get(peer).keys()).average()
+            .orElse(0);
+    double meanRate = peers.stream().mapToDouble(peer -> this.loads.get(peer).requestRate())
+            .average().orElse(0);
+    Map<String, Double> relativeLoads = new HashMap<>();
+    for (String peer : peers) {
+      Load load = this.loads.get(peer);
+      double keyLoad = (meanKeys > 0) ? load.keys() / meanKeys : 0;
+      double rateLoad = (meanRate > 0) ? load.requestRate() / meanRate : 0;
+      relativeLoads.put(peer, Math.max(keyLoad, rateLoad));
+    }
+
+    String busiest = Collections.max(peers, Comparator.comparingDouble(relativeLoads::get));
+    double maxLoad = relativeLoads.get(busiest);
+    System.err.printf("LOAD max/mean %.2f on %s (%.0f objects, %.1f requests/sec on average)%n",
+            maxLoad, busiest, meanKeys, meanRate);
+    if (maxLoad < REBALANCE_THRESHOLD) {
+      return;
+    }
+
+    RingIndex.Neighbors neighbors = this.ring.neighbors(busiest);
+    String pred = neighbors.predecessor();
+    String succ = neighbors.successor();
+    boolean toPred = relativeLoads.get(pred) <= relativeLoads.get(succ);
+    String target = toPred ? pred : succ;
+    double targetLoad = relativeLoads.get(target);
+    if (targetLoad >= 1) {
+      return;
+    }
+
+    // shed half of the difference, so that both end up near the average of their loads
+    double fraction = (maxLoad - targetLoad) / (2 * maxLoad);
+    Integer split = requestSplitPoint(busiest, fraction, toPred ? "low" : "high");
+    if (split == null) {
+      return;
+    }
+    System.err.printf("REBALANCE moving %.0f%% of %s's range to %s%n", fraction * 100, busiest,
+            target);
+    moveToken(toPred ? pred : busiest, split);
+  }
+
+  /**
+   * Asks a peer where to split its range so that a fraction of its objects goes to a neighbor.
+   * The peer replies on the same connection.
+   *
+   * @param peerId the ID of the peer
+   * @param fraction the fraction of the peer's objects to move
+   * @param side "low" to move the low end of the range to the predecessor, "high" to move the high
+   *             end to the successor
+   * @return the new position of the boundary, or null if the range cannot be split that way
+   */
+  private Integer requestSplitPoint(String peerId, double fraction, String side) {
     String msg = Utils.prepareMsg(new LinkedHashMap<>() {{
+      put("operation_type", "SPLIT_POINT");
+      put("fraction", String.valueOf(fraction));
+      put("side", side);
+    }});
+
+    try (
+            Socket peerSocket = new Socket(peerId, Utils.PORT);
+            DataOutputStream out = new DataOutputStream(peerSocket.getOutputStream());
+            DataInputStream in = new DataInputStream(peerSocket.getInputStream())
+    ) {
+      out.writeUTF(msg);
+      String token = Utils.unpackMsg(in.readUTF()).get("token");
+      return (token == null) ? null : Integer.parseInt(token);
+    } catch (IOException e) {
+      throw new RuntimeException("Boostrap error: " + e.getMessage());
+    }
+  }
+
+  /**
+   * Moves a peer to a new position on the ring, between its predecessor and its successor. The
+   * peer and its successor are told about the move, and whichever of them loses part of its range
+   * streams the objects in it to the other. The one that gains the range is told first, so that
+   * requests for it are never turned away by both.
+   *
+   * @param peerId the ID of the peer
+   * @param newToken the new position of the peer
+   */
+  private void moveToken(String peerId, int newToken) {
+    int oldToken = this.ring.move(peerId, newToken);
+    String succ = this.ring.neighbors(peerId).successor();
+
+    String tokenMsg = Utils.prepareMsg(new LinkedHashMap<>() {{
       put("peer_id", peerId);
+      put("operation_type", "REASSIGN_TOKEN");
+      put("new_token", String.valueOf(newToken));
+    }});
+    String predMsg = Utils.prepareMsg(new LinkedHashMap<>() {{
+      put("peer_id", succ);
       put("operation_type", "REASSIGN_PREDECESSOR");
-      put("new_id", pred_id);
+      put("new_id", peerId);
+      put("new_token", String.valueOf(newToken));
+      put("rebalance", "true");
     }});
 
+    if (Utils.inRange(newToken, oldToken, this.ring.token(succ))) {
+      sendToPeer(peerId, tokenMsg);
+      sendToPeer(succ, predMsg);
+    } else {
+      sendToPeer(succ, predMsg);
+      sendToPeer(peerId, tokenMsg);
+    }
+  }
+
+  /**
+   * Sends a message to a peer.
+   *
+   * @param peerId the ID of the peer
+   * @param msg the message
+   */
+  private void sendToPeer(String peerId, String msg) {
     try (
             Socket peerSocket = new Socket(peerId, Utils.PORT);
             DataOutputStream out = new DataOutputStream(peerSocket.getOutputStream())
@@ -143,27 +432,41 @@ public final class BootstrapServer {
     } catch (IOException e) {
       throw new RuntimeException("Boostrap error: " + e.getMessage());
     }
-
-    return pred_id;
   }
 
   /**
-   * Sends a message to the given peer to assign a new successor.
+   * Replies to a client asking for the current members of the ring and their positions. The reply
+   * is sent on the same connection as the request so the client does not need to be listening for
+   * it.
    *
-   * @param peerId id of the peer to assign successor
-   * @return the id of the successor
+   * @param out the output stream of the client's connection
+   * @throws IOException if the reply cannot be written
    */
-  private String assignSucc(String peerId) {
-    int peerIdx = binarySearch(peerId);
-    if (peerIdx < 0) {
-      throw new RuntimeException("Boostrap error: peer doesn't exist in ring");
-    }
+  private void replyWithRing(DataOutputStream out) throws IOException {
+    NavigableMap<Integer, String> snapshot = this.ring.snapshot();
+    String peers = Utils.joinPeerIds(List.copyOf(snapshot.values()));
+    String peerTokens = String.join(" ", snapshot.keySet().stream().map(String::valueOf).toList());
+
+    String msg = Utils.prepareMsg(new LinkedHashMap<>() {{
+      put("operation_type", "RING");
+      put("peers", peers);
+      put("tokens", peerTokens);
+    }});
+    out.writeUTF(msg);
+  }
 
-    String succ_id = this.ring.get((peerIdx == this.ring.size() - 1) ? 0 : peerIdx + 1);
+  /**
+   * Sends a message to the given peer to assign a new predecessor.
+   *
+   * @param peerId id of the peer to assign predecessor
+   * @param pred_id id of the predecessor
+   */
+  private void assignPred(String peerId, String pred_id) {
     String msg = Utils.prepareMsg(new LinkedHashMap<>() {{
       put("peer_id", peerId);
-      put("operation_type", "REASSIGN_SUCCESSOR");
-      put("new_id", succ_id);
+      put("operation_type", "REASSIGN_PREDECESSOR");
+      put("new_id", pred_id);
+      put("new_token", String.valueOf(ring.token(pred_id)));
     }});
 
     try (
@@ -174,30 +477,43 @@ public final class BootstrapServer {
     } catch (IOException e) {
       throw new RuntimeException("Boostrap error: " + e.getMessage());
     }
-
-    return succ_id;
   }
 
   /**
-   * Searches for a peer in the sorted ring by comparing the numeric parts of their ID.
+   * Sends a message to the given peer to assign a new successor.
    *
-   * @param peerId the peer ID to search for
-   * @return the index of the peer, if found; otherwise (-insertionPoint - 1) where insertionPoint
-   *         is the index it would've been inserted in
+   * @param peerId id of the peer to assign successor
+   * @param succ_id id of the successor
    */
-  private int binarySearch(String peerId) {
-    return Collections.binarySearch(this.ring, peerId,
-            Comparator.comparingInt(Utils::extractIdNum));
+  private void assignSucc(String peerId, String succ_id) {
+    String msg = Utils.prepareMsg(new LinkedHashMap<>() {{
+      put("peer_id", peerId);
+      put("operation_type", "REASSIGN_SUCCESSOR");
+      put("new_id", succ_id);
+    }});
+
+    try (
+            Socket peerSocket = new Socket(peerId, Utils.PORT);
+            DataOutputStream out = new DataOutputStream(peerSocket.getOutputStream())
+    ) {
+      out.writeUTF(msg);
+    } catch (IOException e) {
+      throw new RuntimeException("Boostrap error: " + e.getMessage());
+    }
   }
 
   /**
-   * Broadcasts a message to all peers in the ring indicating that a new peer has joined. The
-   * entire ring is also printed to the console.
+   * Tells the peers affected by the last join or leave, the peer and its neighbors, that the ring
+   * has been updated. The entire ring is also printed to the console while it is small, and the
+   * cost of the update is printed after it. Called with membershipLock held.
    */
-  private void broadcastNewPeerJoined() {
-    System.err.println("[" + String.join(" ", this.ring) + "]");
+  private void notifyNewPeerJoined() {
+    int ringSize = this.ring.size();
+    if (ringSize <= MAX_PRINTED_RING_SIZE) {
+      System.err.println("[" + String.join(" ", this.ring.peers()) + "]");
+    }
 
-    for (String peer : this.ring) {
+    for (String peer : this.affectedPeers) {
       try (
               Socket peerSocket = new Socket(peer, Utils.PORT);
               DataOutputStream out = new DataOutputStream(peerSocket.getOutputStream())
@@ -210,17 +526,43 @@ public final class BootstrapServer {
         throw new RuntimeException("Boostrap error: " + e.getMessage());
       }
     }
+    System.err.printf("%s: %d peers in ring, %d messages sent, %.1f ms%n", this.change, ringSize,
+            this.numPeersThatWillUpdate + this.affectedPeers.size(),
+            (System.nanoTime() - this.changeStartedAt) / 1e6);
   }
 
   /**
-   * Handles a client request to store or retrieve an object. It forwards the request to the first
-   * peer on the ring.
+   * Handles a client request to store or retrieve an object. A retrieve for a hot object whose
+   * lookup is cached here is answered right away; any other request is forwarded to the first
+   * peer on the ring. Storing an object drops its cached lookup.
    *
    * @param msg the message received from the client to be forwarded to the first peer
+   * @param msgRec the unpacked message
    */
-  private void handleClientRequest(String msg) {
+  private void handleClientRequest(String msg, Map<String, String> msgRec) {
+    String clientId = msgRec.get("client_id");
+    String key = ObjectStore.toKey(Utils.extractIdNum(clientId), msgRec.get("object_id"));
+    if (msgRec.get("operation_type").equals("STORE")) {
+      this.hotKeyCache.invalidate(key);
+    } else {
+      Boolean found = this.hotKeyCache.get(key);
+      if (found != null) {
+        handleReportToClient(Utils.prepareMsg(new LinkedHashMap<>() {{
+          put("req_id", msgRec.get("req_id"));
+          put("operation_type", found ? "OBJ_RETRIEVED" : "OBJ_NOT_FOUND");
+          put("object_id", msgRec.get("object_id"));
+          put("client_id", clientId);
+        }}), clientId);
+        return;
+      }
+    }
+
+    String firstPeer = this.ring.first();
+    if (firstPeer == null) {
+      throw new RuntimeException("Boostrap error: ring is empty");
+    }
     try (
-            Socket peerSocket = new Socket(this.ring.get(0), Utils.PORT);
+            Socket peerSocket = new Socket(firstPeer, Utils.PORT);
             DataOutputStream out = new DataOutputStream(peerSocket.getOutputStream())
     ) {
       out.writeUTF(msg);
@@ -229,6 +571,22 @@ public final class BootstrapServer {
     }
   }
 
+  /**
+   * Caches or invalidates the lookup of a hot object, as pushed by the peer that owns it.
+   *
+   * @param msgRec the update received from the peer
+   */
+  private void handleHotKeyUpdate(Map<String, String> msgRec) {
+    String key = ObjectStore.toKey(Utils.extractIdNum(msgRec.get("client_id")),
+            msgRec.get("object_id"));
+    if (msgRec.get("operation_type").equals("CACHE_HOT_KEY")) {
+      this.hotKeyCache.put(key, Boolean.parseBoolean(msgRec.get("found")),
+              Long.parseLong(msgRec.get("lease_ms")));
+    } else {
+      this.hotKeyCache.invalidate(key);
+    }
+  }
+
   /**
    * Handles a message received from a peer indicating that a client request has been completed. It
    * forwards the message to the client.
@@ -0,0 +1,238 @@
+package main.java;
+
+import java.io.BufferedReader;
+import java.io.IOException;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.NavigableMap;
+import java.util.TreeMap;
+import java.util.stream.Stream;
+
+/**
+ * Builds the object stores of a new ring offline, so that peers start already loaded instead of
+ * being seeded one STORE request at a time. The input is a file of keys in the
+ * "client_id::object_id" form of the object files, one per line, sorted in key order: by object ID
+ * and then by client ID. Each key is assigned to the peer that owns it on a ring made of the given
+ * peers at their initial positions, the numeric parts of their IDs, and a copy goes to that peer's
+ * successor as a replica. Since the input is sorted, the keys of every store arrive in order and
+ * each store is written straight out as a single {@link SSTable} with its block index and Bloom
+ * filter, see {@link LsmObjectStore.BulkLoad}.
+ *
+ * <p>The input is read twice: once to check its order and count the keys of each store, so that
+ * the Bloom filters are sized right, and once to write the stores. Run it with
+ * {@code java main.java.BulkLoader <key file> <output dir> <peer id>...}. The stores of peer
+ * {@code n5} are written for the object file {@code <output dir>/objects5.txt}, and the peer must
+ * be started with {@code -s lsm}.
+ */
+public final class BulkLoader {
+  private final NavigableMap<Integer, String> ring = new TreeMap<>();
+
+  /**
+   * Constructs a new BulkLoader for a ring of the given peers.
+   *
+   * @param peerIds the IDs of the peers
+   * @throws IllegalArgumentException if there are no peers or two peers share a position
+   */
+  public BulkLoader(List<String> peerIds) throws IllegalArgumentException {
+    for (String peerId : peerIds) {
+      if (this.ring.put(Utils.extractIdNum(peerId), peerId) != null) {
+        throw new IllegalArgumentException("Bulk loader error: position already taken in ring");
+      }
+    }
+    if (this.ring.isEmpty()) {
+      throw new IllegalArgumentException("Bulk loader error: no peers given");
+    }
+  }
+
+  /**
+   * Checks that the keys are sorted and counts the keys each peer will own.
+   *
+   * @param input the path of the key file
+   * @return the number of keys owned by each peer
+   * @throws IOException if the file cannot be read or is not sorted
+   */
+  public Map<String, Long> count(Path input) throws IOException {
+    Map<String, Long> counts = new HashMap<>();
+    this.ring.values().forEach(peer -> counts.put(peer, 0L));
+    forEachKey(input, key -> counts.merge(owner(key.objectNum()), 1L, Long::sum));
+    return counts;
+  }
+
+  /**
+   * Writes the object store and the replica store of every peer.
+   *
+   * @param input the path of the key file
+   * @param outputDir the directory to write the stores to
+   * @param counts the number of keys owned by each peer, as returned by {@link #count(Path)}
+   * @throws IOException if the file cannot be read or a store cannot be written
+   */
+  public void load(Path input, Path outputDir, Map<String, Long> counts) throws IOException {
+    Files.createDirectories(outputDir);
+    Map<String, LsmObjectStore.BulkLoad> stores = new HashMap<>();
+    Map<String, LsmObjectStore.BulkLoad> replicaStores = new HashMap<>();
+    for (String peer : this.ring.values()) {
+      String objFilePath = outputDir.resolve("objects" + Utils.extractIdNum(peer) + ".txt")
+              .toString();
+      stores.put(peer, new LsmObjectStore.BulkLoad(objFilePath, counts.get(peer)));
+      replicaStores.put(peer, new LsmObjectStore.BulkLoad(objFilePath + ".replica",
+              counts.get(predecessor(peer))));
+    }
+
+    forEachKey(input, key -> {
+      String owner = owner(key.objectNum());
+      stores.get(owner).add(key);
+      String succ = successor(owner);
+      if (!succ.equals(owner)) {
+        replicaStores.get(succ).add(key);
+      }
+    });
+
+    for (String peer : this.ring.values()) {
+      long numKeys = stores.get(peer).finish();
+      long numReplicas = replicaStores.get(peer).finish();
+      System.err.printf("LOADED %s: %d objects, %d replicas%n", peer, numKeys, numReplicas);
+    }
+  }
+
+  /**
+   * Finds the peer that owns an object, the first peer at or after the object's position.
+   *
+   * @param objectNum the numeric ID of the object
+   * @return the ID of the owning peer
+   */
+  private String owner(int objectNum) {
+    Map.Entry<Integer, String> entry = this.ring.ceilingEntry(objectNum);
+    return ((entry != null) ? entry : this.ring.firstEntry()).getValue();
+  }
+
+  /**
+   * Finds the peer after a peer on the ring.
+   *
+   * @param peerId the ID of the peer
+   * @return the ID of the successor
+   */
+  private String successor(String peerId) {
+    Map.Entry<Integer, String> entry = this.ring.higherEntry(Utils.extractIdNum(peerId));
+    return ((entry != null) ? entry : this.ring.firstEntry()).getValue();
+  }
+
+  /**
+   * Finds the peer before a peer on the ring.
+   *
+   * @param peerId the ID of the peer
+   * @return the ID of the predecessor
+   */
+  private String predecessor(String peerId) {
+    Map.Entry<Integer, String> entry = this.ring.lowerEntry(Utils.extractIdNum(peerId));
+    return ((entry != null) ? entry : this.ring.lastEntry()).getValue();
+  }
+
+  /**
+   * A visitor of the keys of the input.
+   */
+  @FunctionalInterface
+  private interface KeyVisitor {
+    /**
+     * Visits a key.
+     *
+     * @param key the key
+     * @throws IOException if the key cannot be handled
+     */
+    void visit(ObjectStore.Key key) throws IOException;
+  }
+
+  /**
+   * Reads the keys of the input in order, skipping blank lines.
+   *
+   * @param input the path of the key file
+   * @param visitor called with each key
+   * @throws IOException if the file cannot be read, or a key is not greater than the one before
+   */
+  private static void forEachKey(Path input, KeyVisitor visitor) throws IOException {
+    try (BufferedReader reader = Files.newBufferedReader(input)) {
+      ObjectStore.Key prev = null;
+      long lineNum = 0;
+      for (String line = reader.readLine(); line != null; line = reader.readLine()) {
+        lineNum++;
+        line = line.trim();
+        if (line.isEmpty()) {
+          continue;
+        }
+
+        ObjectStore.Key key = parseKey(line);
+        if (prev != null && key.compareTo(prev) <= 0) {
+          throw new IOException("Bulk loader error: key on line " + lineNum + " is out of order");
+        }
+        visitor.visit(key);
+        prev = key;
+      }
+    }
+  }
+
+  /**
+   * Parses a key, taking a fast path for the plain numeric IDs of generated input.
+   *
+   * @param line the key as a string
+   * @return the parsed key
+   */
+  private static ObjectStore.Key parseKey(String line) {
+    int sep = line.indexOf("::");
+    try {
+      return new ObjectStore.Key(Integer.parseInt(line, sep + 2, line.length(), 10),
+              Integer.parseInt(line, 0, sep, 10));
+    } catch (IndexOutOfBoundsException | NumberFormatException e) {
+      return ObjectStore.Key.parse(line);
+    }
+  }
+
+  /**
+   * Returns the total size of the files under a directory.
+   *
+   * @param dir the directory
+   * @return the number of bytes
+   * @throws IOException if the directory cannot be listed
+   */
+  private static long sizeOf(Path dir) throws IOException {
+    try (Stream<Path> files = Files.walk(dir)) {
+      long size = 0;
+      for (Path file : files.filter(Files::isRegularFile).toList()) {
+        size += Files.size(file);
+      }
+      return size;
+    }
+  }
+
+  /**
+   * Main method to bulk load the stores of a ring.
+   *
+   * @param args the key file, the output directory and the IDs of the peers
+   */
+  public static void main(String[] args) {
+    if (args.length < 3) {
+      throw new IllegalArgumentException("Bulk loader error: usage: BulkLoader <key file> "
+              + "<output dir> <peer id>...");
+    }
+    Path input = Paths.get(args[0]);
+    Path outputDir = Paths.get(args[1]);
+    BulkLoader loader = new BulkLoader(List.of(args).subList(2, args.length));
+
+    try {
+      long start = System.nanoTime();
+      Map<String, Long> counts = loader.count(input);
+      long countNanos = System.nanoTime() - start;
+      loader.load(input, outputDir, counts);
+      long totalNanos = System.nanoTime() - start;
+
+      long numKeys = counts.values().stream().mapToLong(Long::longValue).sum();
+      System.err.printf("BULK LOADED %d keys into %d peers in %.3f s (%.3f s counting), "
+                      + "%.0f keys/sec, %d bytes written%n", numKeys, counts.size(),
+              totalNanos / 1e9, countNanos / 1e9, numKeys / (totalNanos / 1e9), sizeOf(outputDir));
+    } catch (IOException e) {
+      throw new RuntimeException("Bulk loader error: " + e.getMessage());
+    }
+  }
+}
@@ -1,5 +1,7 @@
 package main.java;
 
+import java.io.BufferedInputStream;
+import java.io.BufferedOutputStream;
 import java.io.DataInputStream;
 import java.io.DataOutputStream;
 import java.io.File;
@@ -9,25 +11,84 @@ import java.net.ServerSocket;
 import java.net.Socket;
 import java.net.UnknownHostException;
 import java.nio.file.Files;
+import java.time.Duration;
 import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.Collections;
 import java.util.LinkedHashMap;
+import java.util.LinkedHashSet;
 import java.util.List;
 import java.util.Map;
+import java.util.NavigableMap;
 import java.util.Random;
+import java.util.Set;
+import java.util.TreeMap;
+import java.util.TreeSet;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.atomic.AtomicInteger;
 import java.util.stream.IntStream;
 
 /**
- * A client stores and retrieves objects from the DHT. It can only communicate with the bootstrap
- * server. The bootstrap server will let the client know when the object is successfully stored or
- * retrieved.
+ * A client stores and retrieves objects from the DHT. By default it only communicates with the
+ * bootstrap server, which will let the client know when the object is successfully stored or
+ * retrieved. In direct mode, the client only asks the bootstrap server for the members of the ring,
+ * sends each request to a peer itself and has the owning peer reply to it directly. A direct client
+ * can also cache which peer owns which range of the ring, learned from the replies, and send
+ * requests straight to the owning peer; a peer that no longer owns the object answers with a
+ * redirect that refreshes the cache. For bulk work, a direct client can also send its objects in
+ * batches, grouped by the peer that owns them so that each owner gets one framed batch. The client
+ * can issue several requests in a row, in which case it reports its throughput, and in direct mode
+ * the distribution of hops per request, once every reply is in. Finally, a direct client can scan
+ * a range of object IDs in order. The scan walks the ring one chunk at a time, each chunk ending
+ * with a continuation token that says where the next chunk starts and thus which peer serves it.
+ * Objects can be stored with a random time to live, after which the peers drop them. A direct
+ * client can also store objects along with values of a given size, or retrieve those values,
+ * streaming them to and from the owning peer in blocks that may be compressed.
+ *
+ * <p>A direct client looks objects up recursively by default, letting the peers forward each
+ * request to the owner, but can also look them up iteratively, asking one peer after another for
+ * the next hop and then sending the request to the owner itself, or alternate between the two
+ * request by request. An iterative lookup that cannot reach a peer skips over it using the client's
+ * view of the ring. After a multi-request run, the client reports the latency of each kind of
+ * lookup, and requests that are not answered in time count as failed.
  */
 public final class Client {
+  private static final int SCAN_CHUNK_SIZE = 1024;
+  private static final int MAX_REDIRECTS = 8;
+  private static final long REDIRECT_BACKOFF_MS = 50;
+  private static final long REQUEST_TIMEOUT_MS = 10000;
+  private static final String[] TEXT_WORDS = ("the of and to in is that for it as with was on "
+          + "be by at this have from or one had not but what all were when we there can an "
+          + "your which their said if do will each about how up out them then she many some "
+          + "so these would other into has more her two like him see time could no make than "
+          + "first been its who now people my made over did down only way find use may water "
+          + "long little very after words called just where most know get through back much "
+          + "before go good new write our used me man too any day same right look think also "
+          + "around another came come work").split(" ");
+
   private final String clientId;
   private final String bootstrapServerName;
   private final int delay;
-  private final int objectId;
+  private final List<Integer> objectIds;
   private final Action action;
-  private int requestId = 0;
+  private final boolean direct;
+  private final LocationCache locationCache;
+  private final int batchSize;
+  private final int maxTtl;
+  private final Scan scan;
+  private final Values values;
+  private final Lookup lookup;
+  private final Map<Integer, Long> sendTimes = new ConcurrentHashMap<>();
+  private final Map<String, List<Long>> latencies = new TreeMap<>();
+  private final Map<String, Integer> failures = new TreeMap<>();
+  private final Map<Integer, Integer> pendingRequests = new ConcurrentHashMap<>();
+  private final Map<Integer, Integer> redirectHops = new ConcurrentHashMap<>();
+  private final Map<Integer, Integer> hopCounts = new TreeMap<>();
+  private final AtomicInteger completedRequests = new AtomicInteger();
+  private final Random random = new Random();
+  private volatile NavigableMap<Integer, String> ring = new TreeMap<>();
+  private volatile long startTime;
+  private final AtomicInteger requestId = new AtomicInteger();
 
   /**
    * Constructs a new Client object.
@@ -35,16 +96,75 @@ public final class Client {
    * @param clientId the unique ID of the client
    * @param bootstrapServerName the hostname of the bootstrap server
    * @param delay the number of seconds to wait before starting the client
-   * @param objectId the ID of the object to be stored or retrieved
+   * @param objectIds the IDs of the objects to be stored or retrieved, one request per ID
    * @param action the action to be performed (STORE or RETRIEVE)
+   * @param direct whether requests go straight to the peers instead of through the bootstrap
+   *               server
+   * @param cache whether to cache the locations of objects, which requires direct mode
+   * @param batchSize the number of objects submitted at once, or 0 to send one request per object;
+   *                  batches require direct mode
+   * @param maxTtl the maximum time to live in seconds of the objects stored, each of which gets a
+   *               random one between 1 and this, or 0 for objects that never expire
+   * @param scan the range scan to run instead of the requests, or null; scans require direct mode
+   * @param values the values to store or retrieve along with the objects, or null; values require
+   *               direct mode
+   * @param lookup how requests find the owner of their object (RECURSIVE, ITERATIVE or MIXED);
+   *               lookups other than recursive require direct mode
    */
-  public Client(String clientId, String bootstrapServerName, int delay, int objectId,
-                String action) {
+  public Client(String clientId, String bootstrapServerName, int delay, List<Integer> objectIds,
+                String action, boolean direct, boolean cache, int batchSize, int maxTtl,
+                Scan scan, Values values, String lookup) {
     this.clientId = clientId;
     this.bootstrapServerName = bootstrapServerName;
     this.delay = delay;
-    this.objectId = objectId;
+    this.objectIds = objectIds;
     this.action = Action.valueOf(action);
+    this.direct = direct;
+    this.locationCache = cache ? new LocationCache() : null;
+    this.batchSize = batchSize;
+    this.maxTtl = maxTtl;
+    this.scan = scan;
+    this.values = values;
+    this.lookup = Lookup.valueOf(lookup);
+  }
+
+  /**
+   * A scan of the objects whose IDs fall in a range, in order of object ID and then client ID.
+   *
+   * @param start the lowest object ID to include
+   * @param end the highest object ID to include
+   * @param ownOnly whether to only include the objects of this client
+   */
+  private record Scan(int start, int end, boolean ownOnly) {
+  }
+
+  /**
+   * The values stored or retrieved along with the objects.
+   *
+   * @param size the length of each value stored, in bytes
+   * @param text whether to store text-like values, which compress well, instead of random bytes
+   * @param compress whether to compress the values' blocks on the wire
+   */
+  private record Values(int size, boolean text, boolean compress) {
+  }
+
+  /**
+   * How requests find the owner of their object: by being forwarded from peer to peer, by the
+   * client asking each peer for the next hop, or alternating between the two.
+   */
+  private enum Lookup {
+    RECURSIVE,
+    ITERATIVE,
+    MIXED
+  }
+
+  /**
+   * The result of an iterative lookup.
+   *
+   * @param owner the ID of the peer that owns the object
+   * @param hops the number of peers asked, the owner included
+   */
+  private record LookupResult(String owner, int hops) {
   }
 
   /**
@@ -76,7 +196,8 @@ public final class Client {
   }
 
   /**
-   * Starts the client process.
+   * Starts the client process. The client starts listening for replies before sending any request
+   * so that replies coming straight from the peers are never missed.
    */
   public void start() {
     try {
@@ -85,9 +206,9 @@ public final class Client {
       throw new RuntimeException("Peer error: " + e.getMessage());
     }
 
-    sendRequest();
-
     try (ServerSocket socket = new ServerSocket(Utils.PORT)) {
+      new Thread(this::sendRequests).start();
+
       while (true) {
         Socket bootstrapSocket = socket.accept();
         new Thread(() -> handleConnection(bootstrapSocket)).start();
@@ -98,27 +219,584 @@ public final class Client {
   }
 
   /**
-   * Sends a request to the bootstrap server to store or retrieve an object.
+   * Sends one request per object ID, or the object IDs in batches. In direct mode, the members of
+   * the ring are fetched from the bootstrap server first.
    */
-  private void sendRequest() {
-    this.requestId++;
-    String msg = Utils.prepareMsg(new LinkedHashMap<>(){{
-      put("req_id", String.valueOf(requestId));
-      put("operation_type", action.getActionName());
+  private void sendRequests() {
+    if (this.direct) {
+      this.ring = fetchRing();
+      if (this.ring.isEmpty()) {
+        throw new RuntimeException("Client error: No peers in the ring");
+      }
+    }
+
+    this.startTime = System.nanoTime();
+    if (this.scan != null) {
+      runScan();
+      return;
+    }
+    if (this.values != null) {
+      runValues();
+      return;
+    }
+    if (this.batchSize > 0) {
+      for (int i = 0; i < this.objectIds.size(); i += this.batchSize) {
+        sendBatch(this.objectIds.subList(i, Math.min(i + this.batchSize, this.objectIds.size())));
+      }
+      return;
+    }
+
+    for (int objectId : this.objectIds) {
+      sendNewRequest(objectId);
+    }
+    if (this.direct && this.objectIds.size() > 1) {
+      reportUnanswered();
+    }
+  }
+
+  /**
+   * Sends a new request for one object.
+   *
+   * @param objectId the ID of the object to be stored or retrieved
+   */
+  private void sendNewRequest(int objectId) {
+    int reqId = this.requestId.incrementAndGet();
+    this.pendingRequests.put(reqId, objectId);
+    this.sendTimes.put(reqId, System.nanoTime());
+    sendRequest(reqId, objectId);
+  }
+
+  /**
+   * Submits a batch of objects. The objects are grouped by the peer that owns them according to
+   * the ring, and each owner gets its group as one framed batch: a header, the number of objects
+   * and their IDs, each followed by its time to live if the objects expire. The owners answer on
+   * the same connection with one status byte per object. Objects an owner turns out not to own,
+   * because the ring has changed, are sent again as single requests.
+   *
+   * @param batch the IDs of the objects in the batch
+   */
+  private void sendBatch(List<Integer> batch) {
+    Map<String, List<Integer>> byOwner = new LinkedHashMap<>();
+    for (int objectId : batch) {
+      byOwner.computeIfAbsent(Utils.findOwner(this.ring, objectId), k -> new ArrayList<>())
+              .add(objectId);
+    }
+
+    boolean expiring = expiring();
+    LinkedHashMap<String, String> fields = new LinkedHashMap<>() {{
+      put("operation_type", action.getActionName() + "_BATCH");
+      put("client_id", clientId);
+    }};
+    if (expiring) {
+      fields.put("ttls", "true");
+    }
+    String header = Utils.prepareMsg(fields);
+
+    byOwner.entrySet().parallelStream().forEach(group -> {
+      List<Integer> ids = group.getValue();
+      byte[] statuses = new byte[ids.size()];
+
+      try (
+              Socket ownerSocket = new Socket(group.getKey(), Utils.PORT);
+              DataOutputStream out = new DataOutputStream(
+                      new BufferedOutputStream(ownerSocket.getOutputStream()));
+              DataInputStream in = new DataInputStream(ownerSocket.getInputStream())
+      ) {
+        out.writeUTF(header);
+        out.writeInt(ids.size());
+        for (int id : ids) {
+          out.writeInt(id);
+          if (expiring) {
+            out.writeInt(pickTtl());
+          }
+        }
+        out.flush();
+        in.readFully(statuses);
+      } catch (IOException e) {
+        throw new RuntimeException("Client error: " + e.getMessage());
+      }
+
+      int done = 0;
+      for (int i = 0; i < ids.size(); i++) {
+        if (statuses[i] == Utils.BATCH_NOT_OWNED) {
+          sendNewRequest(ids.get(i));
+        } else {
+          done++;
+        }
+      }
+      System.err.println(action.getActionName() + " BATCH " + done + " objects on "
+              + group.getKey());
+      recordCompletion(done);
+    });
+  }
+
+  /**
+   * Runs the range scan. Each chunk is requested from the peer that owns the position the
+   * continuation token resumes from, which answers on the same connection with the keys and the
+   * token for the next chunk. If that peer no longer owns the position, the ring is fetched again
+   * and the chunk is requested anew, see {@link #retryAfterRedirect(int, String)}. Once the last
+   * chunk is in, the client prints how many keys it scanned and how fast.
+   */
+  private void runScan() {
+    String token = this.scan.start() + "/-1";
+    long numKeys = 0;
+    int numChunks = 0;
+    int redirects = 0;
+
+    while (token != null) {
+      String resumeToken = token;
+      LinkedHashMap<String, String> fields = new LinkedHashMap<>() {{
+        put("operation_type", "SCAN");
+        put("client_id", clientId);
+        put("token", resumeToken);
+        put("range_end", String.valueOf(scan.end()));
+        put("limit", String.valueOf(SCAN_CHUNK_SIZE));
+      }};
+      if (this.scan.ownOnly()) {
+        fields.put("scan_client", this.clientId);
+      }
+      int position = Integer.parseInt(token.split("/")[0]);
+      String owner = Utils.findOwner(this.ring, position);
+
+      try (
+              Socket ownerSocket = new Socket(owner, Utils.PORT);
+              DataOutputStream out = new DataOutputStream(ownerSocket.getOutputStream());
+              DataInputStream in = new DataInputStream(
+                      new BufferedInputStream(ownerSocket.getInputStream()))
+      ) {
+        out.writeUTF(Utils.prepareMsg(fields));
+        Map<String, String> header = Utils.unpackMsg(in.readUTF());
+        if (header.get("operation_type").equals("REDIRECT")) {
+          retryAfterRedirect(++redirects, "scan at " + resumeToken);
+          continue;
+        }
+        redirects = 0;
+
+        int count = Integer.parseInt(header.get("count"));
+        for (int i = 0; i < count; i++) {
+          System.out.println(in.readUTF());
+        }
+        numKeys += count;
+        numChunks++;
+        token = header.get("next_token");
+      } catch (IOException e) {
+        throw new RuntimeException("Client error: " + e.getMessage());
+      }
+    }
+
+    double elapsedSecs = (System.nanoTime() - this.startTime) / 1e9;
+    System.err.printf("SCAN %d keys in %.3f s (%.1f keys/sec, %d chunks)%n", numKeys, elapsedSecs,
+            numKeys / elapsedSecs, numChunks);
+  }
+
+  /**
+   * Fetches the ring again before retrying a request that a peer redirected because it no longer
+   * owns the position. The bootstrap server's ring may itself lag behind a join or a rebalancing
+   * move, so the client first waits REDIRECT_BACKOFF_MS, twice as long after each redirect in a
+   * row, and gives up after MAX_REDIRECTS of them.
+   *
+   * @param redirects the number of redirects in a row, this one included
+   * @param request the request, for the error message
+   * @throws RuntimeException if the request was redirected too many times in a row
+   */
+  private void retryAfterRedirect(int redirects, String request) {
+    if (redirects > MAX_REDIRECTS) {
+      throw new RuntimeException("Client error: " + request + " redirected " + MAX_REDIRECTS
+              + " times in a row");
+    }
+    try {
+      Thread.sleep(REDIRECT_BACKOFF_MS << (redirects - 1));
+    } catch (InterruptedException e) {
+      throw new RuntimeException("Client error: " + e.getMessage());
+    }
+    this.ring = fetchRing();
+  }
+
+  /**
+   * Stores or retrieves the value of every object, one object at a time, and then prints how many
+   * bytes went over the wire, how fast and how much CPU time the client spent, which includes
+   * compressing or decompressing the blocks.
+   */
+  private void runValues() {
+    long[] bytes = new long[2];
+    long cpuStart = cpuNanos();
+    for (int objectId : this.objectIds) {
+      transferValue(objectId, bytes);
+    }
+
+    double elapsedSecs = (System.nanoTime() - this.startTime) / 1e9;
+    System.err.printf("VALUES %s %d objects, %d bytes (%d bytes on the wire) in %.3f s "
+                    + "(%.2f MB/s, %.3f s CPU, %s payload, %s)%n", this.action.getActionName(),
+            this.objectIds.size(), bytes[0], bytes[1], elapsedSecs, bytes[0] / 1e6 / elapsedSecs,
+            (cpuNanos() - cpuStart) / 1e9, this.values.text() ? "text" : "random",
+            this.values.compress() ? "compressed" : "uncompressed");
+  }
+
+  /**
+   * Stores or retrieves the value of one object on the peer that owns it. The peer first answers
+   * with a status byte. An upload then streams the value in blocks, generating each block as it
+   * goes, and waits for the second status byte that says the value is on disk. A download reads
+   * the blocks until the end marker. If the peer no longer owns the object, the ring is fetched
+   * again and the request is sent anew, see {@link #retryAfterRedirect(int, String)}. A peer whose
+   * store cannot hold values says so up front.
+   *
+   * @param objectId the ID of the object
+   * @param bytes the counters of raw bytes and of bytes on the wire, added to
+   */
+  private void transferValue(int objectId, long[] bytes) {
+    boolean store = this.action == Action.STORE;
+    LinkedHashMap<String, String> fields = new LinkedHashMap<>() {{
+      put("operation_type", store ? "PUT_VALUE" : "GET_VALUE");
       put("object_id", String.valueOf(objectId));
       put("client_id", clientId);
+    }};
+    if (this.values.compress()) {
+      fields.put("compressed", "true");
+    }
+
+    int redirects = 0;
+    while (true) {
+      String owner = Utils.findOwner(this.ring, objectId);
+      try (
+              Socket ownerSocket = new Socket(owner, Utils.PORT);
+              DataOutputStream out = new DataOutputStream(new BufferedOutputStream(
+                      ownerSocket.getOutputStream(), BlockCodec.BLOCK_SIZE));
+              DataInputStream in = new DataInputStream(new BufferedInputStream(
+                      ownerSocket.getInputStream(), BlockCodec.BLOCK_SIZE))
+      ) {
+        out.writeUTF(Utils.prepareMsg(fields));
+        out.flush();
+        byte status = in.readByte();
+        if (status == Utils.BATCH_NOT_OWNED) {
+          retryAfterRedirect(++redirects, "value of " + objectId);
+          continue;
+        }
+        if (status == Utils.BATCH_UNSUPPORTED) {
+          System.err.println("VALUES NOT SUPPORTED by " + owner + " for " + objectId);
+          return;
+        }
+
+        if (store) {
+          byte[] raw = new byte[BlockCodec.BLOCK_SIZE];
+          for (int sent = 0; sent < this.values.size(); sent += BlockCodec.BLOCK_SIZE) {
+            int length = Math.min(BlockCodec.BLOCK_SIZE, this.values.size() - sent);
+            fillPayload(raw, length);
+            BlockCodec.Block block = BlockCodec.encode(raw, length, this.values.compress());
+            block.writeTo(out);
+            bytes[0] += length;
+            bytes[1] += block.framedLength();
+          }
+          BlockCodec.writeEnd(out);
+          out.flush();
+          in.readByte();
+          System.err.println("STORED VALUE " + objectId);
+        } else if (status == Utils.BATCH_NOT_FOUND) {
+          System.err.println("NOT FOUND " + objectId);
+        } else {
+          for (BlockCodec.Block block; (block = BlockCodec.readFrom(in)) != null;) {
+            bytes[0] += block.decode().length;
+            bytes[1] += block.framedLength();
+          }
+          System.err.println("RETRIEVED VALUE " + objectId);
+        }
+        return;
+      } catch (IOException e) {
+        throw new RuntimeException("Client error: " + e.getMessage());
+      }
+    }
+  }
+
+  /**
+   * Fills a buffer with the payload of a value block, either text made of common English words,
+   * or random bytes.
+   *
+   * @param buf the buffer
+   * @param length the number of bytes to fill
+   */
+  private void fillPayload(byte[] buf, int length) {
+    if (!this.values.text()) {
+      byte[] randomBytes = new byte[length];
+      this.random.nextBytes(randomBytes);
+      System.arraycopy(randomBytes, 0, buf, 0, length);
+      return;
+    }
+
+    int pos = 0;
+    while (pos < length) {
+      String word = TEXT_WORDS[this.random.nextInt(TEXT_WORDS.length)];
+      for (int i = 0; i < word.length() && pos < length; i++) {
+        buf[pos++] = (byte) word.charAt(i);
+      }
+      if (pos < length) {
+        buf[pos++] = (byte) ' ';
+      }
+    }
+  }
+
+  /**
+   * Returns the CPU time this process has used so far.
+   *
+   * @return the CPU time in nanoseconds, or 0 if it is not available
+   */
+  private static long cpuNanos() {
+    return ProcessHandle.current().info().totalCpuDuration().map(Duration::toNanos).orElse(0L);
+  }
+
+  /**
+   * Asks the bootstrap server for the peers currently in the ring and their positions on it. The
+   * bootstrap server replies on the same connection.
+   *
+   * @return the IDs of the peers in the ring, keyed by their position on the ring
+   */
+  private NavigableMap<Integer, String> fetchRing() {
+    String msg = Utils.prepareMsg(new LinkedHashMap<>() {{
+      put("operation_type", "GET_RING");
+      put("client_id", clientId);
     }});
 
     try (
             Socket bootstrapSocket = new Socket(this.bootstrapServerName, Utils.PORT);
-            DataOutputStream out = new DataOutputStream(bootstrapSocket.getOutputStream())
+            DataOutputStream out = new DataOutputStream(bootstrapSocket.getOutputStream());
+            DataInputStream in = new DataInputStream(bootstrapSocket.getInputStream())
     ) {
       out.writeUTF(msg);
+      Map<String, String> reply = Utils.unpackMsg(in.readUTF());
+      List<String> peers = Utils.splitPeerIds(reply.get("peers"));
+      List<String> tokens = Utils.splitPeerIds(reply.get("tokens"));
+
+      NavigableMap<Integer, String> ring = new TreeMap<>();
+      for (int i = 0; i < peers.size(); i++) {
+        ring.put(Integer.parseInt(tokens.get(i)), peers.get(i));
+      }
+      return ring;
     } catch (IOException e) {
       throw new RuntimeException("Client error: " + e.getMessage());
     }
   }
 
+  /**
+   * Sends a request to store or retrieve an object. The request goes to the bootstrap server, or
+   * in direct mode to a peer of the ring along with the address the owning peer should reply to.
+   * That peer is the cached owner of the object if there is one, or the owner found by an
+   * iterative lookup, in which cases the peer is asked to redirect rather than forward the request
+   * if it turns out not to own the object, and a random peer otherwise. A request that cannot be
+   * sent fails.
+   *
+   * @param reqId the ID of the request
+   * @param objectId the ID of the object to be stored or retrieved
+   */
+  private void sendRequest(int reqId, int objectId) {
+    LinkedHashMap<String, String> fields = new LinkedHashMap<>() {{
+      put("req_id", String.valueOf(reqId));
+      put("operation_type", action.getActionName());
+      put("object_id", String.valueOf(objectId));
+      put("client_id", clientId);
+    }};
+    if (expiring()) {
+      fields.put("ttl", String.valueOf(pickTtl()));
+    }
+
+    String dest = this.bootstrapServerName;
+    if (this.direct) {
+      fields.put("reply_to", Utils.extractHostname(this.clientId));
+      fields.put("hops", "1");
+      String cachedOwner = (this.locationCache == null) ? null
+              : this.locationCache.lookup(objectId);
+      if (cachedOwner != null) {
+        fields.put("on_miss", "REDIRECT");
+        dest = cachedOwner;
+      } else if (isIterative(reqId)) {
+        LookupResult result = lookupIteratively(objectId);
+        if (result == null) {
+          failRequest(reqId, "no owner found");
+          return;
+        }
+        fields.put("on_miss", "REDIRECT");
+        fields.put("hops", String.valueOf(result.hops()));
+        dest = result.owner();
+      } else {
+        List<String> peers = new ArrayList<>(this.ring.values());
+        dest = peers.get(this.random.nextInt(peers.size()));
+      }
+    }
+
+    try (
+            Socket destSocket = new Socket(dest, Utils.PORT);
+            DataOutputStream out = new DataOutputStream(destSocket.getOutputStream())
+    ) {
+      out.writeUTF(Utils.prepareMsg(fields));
+    } catch (IOException e) {
+      failRequest(reqId, e.getMessage());
+    }
+  }
+
+  /**
+   * Checks whether a request looks its object up iteratively. With mixed lookups, every other
+   * request does.
+   *
+   * @param reqId the ID of the request
+   * @return true if the lookup is iterative, false if it is recursive
+   */
+  private boolean isIterative(int reqId) {
+    return this.lookup == Lookup.ITERATIVE || (this.lookup == Lookup.MIXED && reqId % 2 == 0);
+  }
+
+  /**
+   * Looks up the owner of an object iteratively, starting at a random peer. Each peer asked says
+   * whether it owns the object and, if not, which peer to ask next. A peer that cannot be reached
+   * is skipped over using the client's view of the ring. The lookup gives up after walking around
+   * the ring twice.
+   *
+   * @param objectId the ID of the object
+   * @return the owner of the object and the number of peers asked, or null if no owner was found
+   */
+  private LookupResult lookupIteratively(int objectId) {
+    String msg = Utils.prepareMsg(new LinkedHashMap<>() {{
+      put("operation_type", "NEXT_HOP");
+      put("object_id", String.valueOf(objectId));
+      put("client_id", clientId);
+    }});
+
+    List<String> peers = new ArrayList<>(this.ring.values());
+    String current = peers.get(this.random.nextInt(peers.size()));
+    int hops = 0;
+    for (int step = 0; step < 2 * peers.size(); step++) {
+      try (
+              Socket peerSocket = new Socket(current, Utils.PORT);
+              DataOutputStream out = new DataOutputStream(peerSocket.getOutputStream());
+              DataInputStream in = new DataInputStream(peerSocket.getInputStream())
+      ) {
+        out.writeUTF(msg);
+        Map<String, String> reply = Utils.unpackMsg(in.readUTF());
+        hops++;
+        if ("true".equals(reply.get("owner"))) {
+          return new LookupResult(current, hops);
+        }
+        current = reply.get("next_id");
+      } catch (IOException e) {
+        current = nextInRing(current);
+      }
+    }
+    return null;
+  }
+
+  /**
+   * Returns the peer that follows a given peer in the client's view of the ring.
+   *
+   * @param peerId the ID of the peer
+   * @return the ID of the next peer, or a random peer if the given one is not in the ring
+   */
+  private String nextInRing(String peerId) {
+    NavigableMap<Integer, String> ring = this.ring;
+    for (Map.Entry<Integer, String> entry : ring.entrySet()) {
+      if (entry.getValue().equals(peerId)) {
+        Map.Entry<Integer, String> next = ring.higherEntry(entry.getKey());
+        return (next != null) ? next.getValue() : ring.firstEntry().getValue();
+      }
+    }
+    List<String> peers = new ArrayList<>(ring.values());
+    return peers.get(this.random.nextInt(peers.size()));
+  }
+
+  /**
+   * Gives up on a request.
+   *
+   * @param reqId the ID of the request
+   * @param reason why the request failed
+   */
+  private void failRequest(int reqId, String reason) {
+    Integer objectId = this.pendingRequests.remove(reqId);
+    this.sendTimes.remove(reqId);
+    synchronized (this.latencies) {
+      this.failures.merge(lookupName(reqId), 1, Integer::sum);
+    }
+    System.err.println("FAILED " + objectId + ": " + reason);
+  }
+
+  /**
+   * Waits for the requests still pending to be answered. If some are not answered within
+   * REQUEST_TIMEOUT_MS, they count as failed and the client reports the latencies so far.
+   */
+  private void reportUnanswered() {
+    try {
+      Thread.sleep(REQUEST_TIMEOUT_MS);
+    } catch (InterruptedException e) {
+      return;
+    }
+
+    if (this.completedRequests.get() == this.objectIds.size()) {
+      return;
+    }
+    for (int reqId : this.pendingRequests.keySet()) {
+      failRequest(reqId, "no reply after " + REQUEST_TIMEOUT_MS / 1000 + " s");
+    }
+    System.err.printf("INCOMPLETE %d of %d requests answered%n", this.completedRequests.get(),
+            this.objectIds.size());
+    printLatencies();
+  }
+
+  /**
+   * Returns the name of the kind of lookup a request uses.
+   *
+   * @param reqId the ID of the request
+   * @return "iterative" or "recursive"
+   */
+  private String lookupName(int reqId) {
+    return isIterative(reqId) ? "iterative" : "recursive";
+  }
+
+  /**
+   * Prints the median, tail and maximum latency of the answered requests and the number of failed
+   * requests, for each kind of lookup.
+   */
+  private void printLatencies() {
+    synchronized (this.latencies) {
+      Set<String> kinds = new TreeSet<>(this.latencies.keySet());
+      kinds.addAll(this.failures.keySet());
+      for (String kind : kinds) {
+        List<Long> sorted = new ArrayList<>(this.latencies.getOrDefault(kind, List.of()));
+        Collections.sort(sorted);
+        System.err.printf("LATENCY %s: %d answered, p50 %.1f ms, p95 %.1f ms, p99 %.1f ms, "
+                        + "max %.1f ms, %d failed%n", kind, sorted.size(), percentile(sorted, 0.5),
+                percentile(sorted, 0.95), percentile(sorted, 0.99), percentile(sorted, 1),
+                this.failures.getOrDefault(kind, 0));
+      }
+    }
+  }
+
+  /**
+   * Returns a percentile of sorted latencies.
+   *
+   * @param sorted the latencies in nanoseconds, in increasing order
+   * @param fraction the percentile as a fraction between 0 and 1
+   * @return the percentile in milliseconds, or 0 if there are no latencies
+   */
+  private static double percentile(List<Long> sorted, double fraction) {
+    if (sorted.isEmpty()) {
+      return 0;
+    }
+    int idx = (int) Math.ceil(fraction * sorted.size()) - 1;
+    return sorted.get(Math.max(0, Math.min(idx, sorted.size() - 1))) / 1e6;
+  }
+
+  /**
+   * Checks whether the objects this client stores expire.
+   *
+   * @return true if the client stores objects with a time to live, false otherwise
+   */
+  private boolean expiring() {
+    return this.action == Action.STORE && this.maxTtl > 0;
+  }
+
+  /**
+   * Picks a random time to live for an object to be stored.
+   *
+   * @return the time to live in seconds, between 1 and the maximum
+   */
+  private int pickTtl() {
+    return this.random.nextInt(1, this.maxTtl + 1);
+  }
+
   /**
    * Handles each connection with the bootstrap server. It reads the message from the bootstrap
    * server and leaves it to another helper method to handle the message.
@@ -138,24 +816,118 @@ public final class Client {
 
   /**
    * Handles a message received from the bootstrap server appropriately depending on its contents.
+   * A reply to a request that is no longer pending, because it already failed or was answered, is
+   * reported and dropped.
    *
    * @param msg the message received from the bootstrap server
    * @throws IllegalArgumentException if the message is invalid
    */
   private void handleMessage(String msg) throws IllegalArgumentException {
     Map<String, String> msgRec = Utils.unpackMsg(msg);
+    int reqId = Integer.parseInt(msgRec.get("req_id"));
+    Integer objectId = this.pendingRequests.get(reqId);
+    if (objectId == null) {
+      printLateReply(reqId, msgRec);
+      return;
+    }
     if (!this.clientId.equals(msgRec.get("client_id"))
-            || this.objectId != Integer.parseInt(msgRec.get("object_id"))) {
+            || objectId != Integer.parseInt(msgRec.get("object_id"))) {
       throw new IllegalArgumentException(
               "Client error: Invalid message received - client/object do not match");
     }
 
-    switch (msgRec.get("operation_type")) {
-      case "OBJ_STORED" -> System.err.println("STORED " + this.objectId);
-      case "OBJ_RETRIEVED" -> System.err.println("RETRIEVED " + this.objectId);
-      case "OBJ_NOT_FOUND" -> System.err.println("NOT FOUND " + this.objectId);
+    if (this.locationCache != null && msgRec.containsKey("range_end")) {
+      this.locationCache.learn(msgRec.get("peer_id"), Integer.parseInt(msgRec.get("range_start")),
+              Integer.parseInt(msgRec.get("range_end")));
+    }
+
+    String operationType = msgRec.get("operation_type");
+    if (operationType.equals("REDIRECT")) {
+      this.redirectHops.merge(reqId, Integer.parseInt(msgRec.get("hops")), Integer::sum);
+      sendRequest(reqId, objectId);
+      return;
+    }
+    if (!this.pendingRequests.remove(reqId, objectId)) {
+      printLateReply(reqId, msgRec);
+      return;
+    }
+    Long sendTime = this.sendTimes.remove(reqId);
+    if (sendTime != null) {
+      synchronized (this.latencies) {
+        this.latencies.computeIfAbsent(lookupName(reqId), k -> new ArrayList<>())
+                .add(System.nanoTime() - sendTime);
+      }
+    }
+
+    switch (operationType) {
+      case "OBJ_STORED" -> System.err.println("STORED " + objectId);
+      case "OBJ_RETRIEVED" -> System.err.println("RETRIEVED " + objectId);
+      case "OBJ_NOT_FOUND" -> System.err.println("NOT FOUND " + objectId);
       default -> throw new RuntimeException("Peer error: Unknown message type received");
     }
+
+    if (msgRec.containsKey("hops")) {
+      int hops = Integer.parseInt(msgRec.get("hops"));
+      Integer redirected = this.redirectHops.remove(reqId);
+      recordHops(hops + ((redirected == null) ? 0 : redirected));
+    }
+    recordCompletion(1);
+  }
+
+  /**
+   * Reports a reply to a request that is no longer pending.
+   *
+   * @param reqId the ID of the request
+   * @param msgRec the reply
+   */
+  private void printLateReply(int reqId, Map<String, String> msgRec) {
+    System.err.println("LATE " + msgRec.get("operation_type") + " for request " + reqId
+            + " (object " + msgRec.get("object_id") + ")");
+  }
+
+  /**
+   * Records the number of peers a completed request visited.
+   *
+   * @param hops the number of peers the request visited
+   */
+  private void recordHops(int hops) {
+    synchronized (this.hopCounts) {
+      this.hopCounts.merge(hops, 1, Integer::sum);
+    }
+  }
+
+  /**
+   * Counts completed requests. Once every request of a multi-request run has completed, the
+   * client prints its throughput, and in direct mode how many requests needed how many hops.
+   *
+   * @param count the number of requests that completed
+   */
+  private void recordCompletion(int count) {
+    int numRequests = this.objectIds.size();
+    if (count == 0 || this.completedRequests.addAndGet(count) != numRequests
+            || numRequests == 1) {
+      return;
+    }
+
+    double elapsedSecs = (System.nanoTime() - this.startTime) / 1e9;
+    String mode = this.direct ? "direct" : "via bootstrap";
+    if (this.locationCache != null) {
+      mode += ", cached";
+    }
+    if (this.batchSize > 0) {
+      mode += ", batches of " + this.batchSize;
+    }
+    System.err.printf("THROUGHPUT %d ops in %.3f s (%.1f ops/sec, %s)%n", numRequests,
+            elapsedSecs, numRequests / elapsedSecs, mode);
+
+    if (this.direct && this.batchSize == 0) {
+      String cached = (this.locationCache == null) ? ""
+              : " (" + this.locationCache.size() + " ranges cached)";
+      synchronized (this.hopCounts) {
+        System.err.println("HOPS " + this.hopCounts + cached);
+      }
+      printLatencies();
+    }
   }
 
   /**
@@ -180,8 +952,19 @@ public final class Client {
     String bootstrapServerName = null;
     int testcase = -1;
     int delay = 0;
-    int objectId;
-    String action;
+    int numRequests = 1;
+    boolean direct = false;
+    boolean cache = false;
+    int batchSize = 0;
+    Integer scanStart = null;
+    int scanEnd = 0;
+    boolean ownOnly = false;
+    double zipfExponent = 0;
+    int maxTtl = 0;
+    int valueSize = 0;
+    boolean textValues = true;
+    boolean compressValues = false;
+    String lookup = "RECURSIVE";
 
     // read arguments
     for (int i = 0; i < args.length; i++) {
@@ -207,10 +990,106 @@ public final class Client {
             throw new IllegalArgumentException("Client error: Missing delay");
           }
         }
+        case "-n" -> {
+          if (i + 1 < args.length) {
+            numRequests = Integer.parseInt(args[++i]);
+          } else {
+            throw new IllegalArgumentException("Client error: Missing number of requests");
+          }
+        }
+        case "-r" -> direct = true;
+        case "-c" -> {
+          direct = true;
+          cache = true;
+        }
+        case "-B" -> {
+          if (i + 1 < args.length) {
+            direct = true;
+            batchSize = Integer.parseInt(args[++i]);
+          } else {
+            throw new IllegalArgumentException("Client error: Missing batch size");
+          }
+        }
+        case "-S" -> {
+          if (i + 1 < args.length) {
+            String[] range = args[++i].split("-");
+            if (range.length != 2) {
+              throw new IllegalArgumentException("Client error: Scan range must be <start>-<end>");
+            }
+            direct = true;
+            scanStart = Integer.parseInt(range[0]);
+            scanEnd = Integer.parseInt(range[1]);
+          } else {
+            throw new IllegalArgumentException("Client error: Missing scan range");
+          }
+        }
+        case "-O" -> ownOnly = true;
+        case "-z" -> {
+          if (i + 1 < args.length) {
+            zipfExponent = Double.parseDouble(args[++i]);
+          } else {
+            throw new IllegalArgumentException("Client error: Missing Zipf exponent");
+          }
+        }
+        case "-e" -> {
+          if (i + 1 < args.length) {
+            maxTtl = Integer.parseInt(args[++i]);
+          } else {
+            throw new IllegalArgumentException("Client error: Missing maximum time to live");
+          }
+        }
+        case "-V" -> {
+          if (i + 1 < args.length) {
+            direct = true;
+            valueSize = Integer.parseInt(args[++i]);
+          } else {
+            throw new IllegalArgumentException("Client error: Missing value size");
+          }
+        }
+        case "-P" -> {
+          if (i + 1 < args.length) {
+            String payload = args[++i];
+            if (!payload.equals("text") && !payload.equals("random")) {
+              throw new IllegalArgumentException("Client error: Payload must be text or random");
+            }
+            textValues = payload.equals("text");
+          } else {
+            throw new IllegalArgumentException("Client error: Missing payload kind");
+          }
+        }
+        case "-Z" -> compressValues = true;
+        case "-l" -> {
+          if (i + 1 < args.length) {
+            direct = true;
+            lookup = args[++i].toUpperCase();
+            if (!Set.of("RECURSIVE", "ITERATIVE", "MIXED").contains(lookup)) {
+              throw new IllegalArgumentException(
+                      "Client error: Lookup must be recursive, iterative or mixed");
+            }
+          } else {
+            throw new IllegalArgumentException("Client error: Missing lookup mode");
+          }
+        }
         default -> throw new IllegalArgumentException("Client error: Invalid argument");
       }
     }
 
+    if (numRequests < 1) {
+      throw new IllegalArgumentException("Client error: Number of requests must be positive");
+    }
+    if (batchSize < 0) {
+      throw new IllegalArgumentException("Client error: Batch size must not be negative");
+    }
+    if (valueSize < 0) {
+      throw new IllegalArgumentException("Client error: Value size must not be negative");
+    }
+    if (maxTtl < 0) {
+      throw new IllegalArgumentException("Client error: Time to live must not be negative");
+    }
+    if (scanStart != null && (scanStart < 0 || scanStart > scanEnd)) {
+      throw new IllegalArgumentException("Client error: Invalid scan range");
+    }
+
     // get client id
     try {
       int lowestClientId = 1;
@@ -221,36 +1100,90 @@ public final class Client {
       throw new RuntimeException("Client error: Unable to determine hostname: " + e.getMessage());
     }
 
-    // get object id and action from testcase
+    if (scanStart != null) {
+      return new Client(clientId, bootstrapServerName, delay, List.of(), "RETRIEVE", true, false, 0,
+              0, new Scan(scanStart, scanEnd, ownOnly), null, lookup);
+    }
+
+    // get object ids and action from testcase
     List<Integer> objIds = getObjIds(clientId);
     if (objIds.isEmpty()) {
       throw new IllegalArgumentException("Client error: No object IDs found for client ID: " +
               clientId);
     }
+
+    List<Integer> objectIds = new ArrayList<>();
+    if (zipfExponent > 0) {
+      objectIds = pickZipfObjectIds(objIds, numRequests, zipfExponent);
+    } else {
+      for (int i = 0; i < numRequests; i++) {
+        objectIds.add(pickObjectId(testcase, objIds));
+      }
+    }
+    String action = (testcase == 3) ? "STORE" : "RETRIEVE";
+
+    Values values = (valueSize > 0) ? new Values(valueSize, textValues, compressValues) : null;
+    return new Client(clientId, bootstrapServerName, delay, objectIds, action, direct, cache,
+            batchSize, maxTtl, null, values, lookup);
+  }
+
+  /**
+   * Picks the ID of an object to be stored or retrieved based on the testcase.
+   *
+   * @param testcase the testcase being run
+   * @param objIds the IDs of the objects already associated with the client
+   * @return the ID of the object
+   * @throws IllegalArgumentException if the testcase is invalid
+   */
+  private static int pickObjectId(int testcase, List<Integer> objIds)
+          throws IllegalArgumentException {
     int lowerBound = 1;
     int upperBound = 127;
 
-    switch (testcase) {
-      case 3 -> {
-        objectId = new Random().nextInt(lowerBound, upperBound + 1);
-        action = "STORE";
-      }
-      case 4 -> {
-        objectId = objIds.get(new Random().nextInt(objIds.size()));
-        action = "RETRIEVE";
-      }
+    return switch (testcase) {
+      case 3 -> new Random().nextInt(lowerBound, upperBound + 1);
+      case 4 -> objIds.get(new Random().nextInt(objIds.size()));
       case 5 -> {
         List<Integer> unretrievableObjects = IntStream.rangeClosed(lowerBound, upperBound)
                 .filter(i -> !objIds.contains(i))
                 .boxed()
                 .toList();
-        objectId = unretrievableObjects.get(new Random().nextInt(unretrievableObjects.size()));
-        action = "RETRIEVE";
+        yield unretrievableObjects.get(new Random().nextInt(unretrievableObjects.size()));
       }
       default -> throw new IllegalArgumentException("Client error: Invalid testcase");
+    };
+  }
+
+  /**
+   * Picks the IDs of objects to be retrieved with Zipf-distributed popularity. The client's
+   * objects are ranked in a random order, and the object of rank r is picked with probability
+   * proportional to 1 / r^exponent.
+   *
+   * @param objIds the IDs of the objects already associated with the client
+   * @param count the number of IDs to pick
+   * @param exponent the exponent of the Zipf distribution
+   * @return the IDs of the objects
+   */
+  private static List<Integer> pickZipfObjectIds(List<Integer> objIds, int count,
+                                                 double exponent) {
+    Random random = new Random();
+    List<Integer> ranked = new ArrayList<>(new LinkedHashSet<>(objIds));
+    Collections.shuffle(ranked, random);
+
+    double[] cumulative = new double[ranked.size()];
+    double total = 0;
+    for (int rank = 1; rank <= ranked.size(); rank++) {
+      total += 1 / Math.pow(rank, exponent);
+      cumulative[rank - 1] = total;
     }
 
-    return new Client(clientId, bootstrapServerName, delay, objectId, action);
+    List<Integer> picked = new ArrayList<>();
+    for (int i = 0; i < count; i++) {
+      int idx = Arrays.binarySearch(cumulative, random.nextDouble() * total);
+      idx = (idx < 0) ? -idx - 1 : idx;
+      picked.add(ranked.get(Math.min(idx, ranked.size() - 1)));
+    }
+    return picked;
   }
 
   /**
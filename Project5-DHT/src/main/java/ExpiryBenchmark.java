@@ -0,0 +1,70 @@
+package main.java;
+
+import java.util.ArrayList;
+import java.util.List;
+import java.util.Random;
+
+/**
+ * Measures the overhead of expiring objects with the {@link TimerWheel} used by the object store.
+ * It schedules a given number of timers with random times to live, reschedules a tenth of them as
+ * if the objects were stored again, and then advances the wheel one 100 ms tick at a time until
+ * every timer has expired. The clock is simulated, so the run takes only as long as the work on
+ * the wheel. Run it with {@code java main.java.ExpiryBenchmark [objects] [max ttl in seconds]},
+ * which defaults to 10 million objects with times to live of up to an hour.
+ */
+public final class ExpiryBenchmark {
+  private static final long TICK_MS = 100;
+
+  /**
+   * Runs the benchmark and prints the time spent per object in each phase.
+   *
+   * @param args the number of objects and the maximum time to live in seconds, both optional
+   */
+  public static void main(String[] args) {
+    int numObjects = (args.length > 0) ? Integer.parseInt(args[0]) : 10_000_000;
+    int maxTtlSecs = (args.length > 1) ? Integer.parseInt(args[1]) : 3600;
+    Random random = new Random(42);
+    long now = 0;
+
+    TimerWheel<Integer> wheel = new TimerWheel<>(TICK_MS, now);
+    List<TimerWheel.Timer<Integer>> timers = new ArrayList<>(numObjects);
+    long start = System.nanoTime();
+    for (int i = 0; i < numObjects; i++) {
+      timers.add(wheel.schedule(i, now + random.nextLong(1, maxTtlSecs + 1) * 1000));
+    }
+    report("schedule", numObjects, System.nanoTime() - start);
+
+    int numRescheduled = numObjects / 10;
+    start = System.nanoTime();
+    for (int i = 0; i < numRescheduled; i++) {
+      int idx = random.nextInt(numObjects);
+      wheel.cancel(timers.get(idx));
+      timers.set(idx, wheel.schedule(idx, now + random.nextLong(1, maxTtlSecs + 1) * 1000));
+    }
+    report("reschedule", numRescheduled, System.nanoTime() - start);
+
+    long numExpired = 0;
+    long numTicks = 0;
+    start = System.nanoTime();
+    while (wheel.size() > 0) {
+      now += TICK_MS;
+      numExpired += wheel.advance(now).size();
+      numTicks++;
+    }
+    long expiryNanos = System.nanoTime() - start;
+    report("expire", numExpired, expiryNanos);
+    System.out.printf("%d ticks, %.1f us per tick%n", numTicks, expiryNanos / 1e3 / numTicks);
+  }
+
+  /**
+   * Prints the time spent on one phase of the benchmark.
+   *
+   * @param phase the name of the phase
+   * @param count the number of operations in the phase
+   * @param nanos the time spent on the phase, in nanoseconds
+   */
+  private static void report(String phase, long count, long nanos) {
+    System.out.printf("%-10s %d timers in %.3f s (%.1f ns per timer)%n", phase, count,
+            nanos / 1e9, (double) nanos / count);
+  }
+}
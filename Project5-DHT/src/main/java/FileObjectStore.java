@@ -0,0 +1,618 @@
+package main.java;
+
+import java.io.BufferedInputStream;
+import java.io.BufferedOutputStream;
+import java.io.BufferedReader;
+import java.io.BufferedWriter;
+import java.io.DataInputStream;
+import java.io.DataOutputStream;
+import java.io.FileOutputStream;
+import java.io.FileReader;
+import java.io.IOException;
+import java.io.OutputStreamWriter;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.nio.file.StandardCopyOption;
+import java.util.ArrayList;
+import java.util.Collection;
+import java.util.HashMap;
+import java.util.HashSet;
+import java.util.LinkedHashSet;
+import java.util.List;
+import java.util.Map;
+import java.util.Set;
+import java.util.TreeSet;
+
+/**
+ * An object store backed by a single file. Objects are kept in the peer's object file, one
+ * "client_id::object_id" line per object. The store also maintains a Merkle tree over its objects,
+ * updated on every store, so that two stores can find the objects they disagree on without
+ * comparing every object. An object is stored at most once.
+ *
+ * <p>The keys of all stored objects are also kept in an ordered in-memory index, sorted by object
+ * ID and then by client ID, which is rebuilt from the file at startup. It answers every lookup,
+ * hits and misses alike, exactly and without reading the object file, and serves range scans. The
+ * object file is only read to rebuild the in-memory structures.
+ *
+ * <p>Objects can be stored with an expiry time, which is appended to a second file next to the
+ * object file, "object file.ttl". The pending expiries are kept on a {@link TimerWheel}, and a
+ * background thread advances the wheel every tick and drops the objects that expired from the
+ * in-memory structures, so no expiry ever scans the store. Expired objects are only removed from
+ * the files once they outnumber the live ones, which keeps the cost of rewriting the files
+ * proportional to the number of objects that expired.
+ *
+ * <p>An object may also have a value, kept in its own file in a directory next to the object file,
+ * "object file.values", as the blocks described in {@link BlockCodec}. Values are streamed to a
+ * temporary file and moved into place once complete, so they are never buffered whole and a value
+ * is never seen half-written.
+ */
+public final class FileObjectStore implements ObjectStore {
+  private static final int MIN_EXPIRED_BEFORE_REWRITE = 1024;
+  private static final long EXPIRY_TICK_MS = 100;
+  private static final long EXPIRY_REPORT_INTERVAL_MS = 10000;
+
+  private final Path objFilePath;
+  private final Path ttlFilePath;
+  private final Path valueDir;
+  private final TimerWheel<Key> expiryWheel;
+  private final Map<Key, TimerWheel.Timer<Key>> expiryTimers = new HashMap<>();
+  private final Set<Key> expiredInFiles = new HashSet<>();
+  private final MerkleTree merkleTree = new MerkleTree(MERKLE_DEPTH);
+  private final TreeSet<Key> index = new TreeSet<>();
+
+  /**
+   * Constructs a new FileObjectStore backed by the given object file and builds the index and the
+   * Merkle tree from the objects already in it, leaving out those that have expired.
+   *
+   * @param objFilePath path to the object file
+   */
+  public FileObjectStore(String objFilePath) {
+    this.objFilePath = Paths.get(objFilePath);
+    this.ttlFilePath = Paths.get(objFilePath + ".ttl");
+    this.valueDir = Paths.get(objFilePath + ".values");
+    this.expiryWheel = new TimerWheel<>(EXPIRY_TICK_MS, System.currentTimeMillis());
+    rebuildIndexes();
+
+    Thread expirer = new Thread(this::runExpiry, "expiry");
+    expirer.setDaemon(true);
+    expirer.start();
+  }
+
+  /**
+   * Stores an object by appending it to the object file.
+   *
+   * @param clientNum the numeric ID of the client that owns the object
+   * @param objId the ID of the object
+   */
+  @Override
+  public void store(int clientNum, String objId) {
+    storeAll(List.of(ObjectStore.toKey(clientNum, objId)));
+  }
+
+  /**
+   * Stores a batch of objects, given by their keys, with a single append to the object file that
+   * is synced to disk once for the whole batch. Objects that are already stored are skipped.
+   *
+   * @param keys the keys of the objects
+   */
+  @Override
+  public synchronized void storeAll(Collection<String> keys) {
+    List<String> newKeys = new ArrayList<>();
+    for (String key : new LinkedHashSet<>(keys)) {
+      Key parsed = Key.parse(key);
+      if (!this.index.contains(parsed)) {
+        newKeys.add(parsed.toString());
+      }
+    }
+    if (newKeys.isEmpty()) {
+      return;
+    }
+
+    appendLines(this.objFilePath, newKeys);
+
+    // an object stored again after it expired must not pick up its old expiry when reloaded
+    List<String> clearedExpiries = newKeys.stream()
+            .filter(key -> this.expiredInFiles.remove(Key.parse(key)))
+            .map(key -> key + " 0")
+            .toList();
+    if (!clearedExpiries.isEmpty()) {
+      appendLines(this.ttlFilePath, clearedExpiries);
+    }
+
+    for (String key : newKeys) {
+      this.index.add(Key.parse(key));
+      this.merkleTree.add(key);
+    }
+  }
+
+  /**
+   * Stores a batch of objects that expire at the given times. The objects are stored as usual and
+   * their expiry times are appended to the expiry file, which is synced to disk once for the whole
+   * batch. An object that is already stored has its timer replaced.
+   *
+   * @param expiries the keys of the objects, mapped to the times they expire, in milliseconds since
+   *                 the epoch
+   */
+  @Override
+  public synchronized void storeAllExpiring(Map<String, Long> expiries) {
+    storeAll(expiries.keySet());
+
+    List<String> lines = new ArrayList<>();
+    for (Map.Entry<String, Long> expiry : expiries.entrySet()) {
+      lines.add(Key.parse(expiry.getKey()) + " " + expiry.getValue());
+    }
+    appendLines(this.ttlFilePath, lines);
+
+    for (Map.Entry<String, Long> expiry : expiries.entrySet()) {
+      scheduleExpiry(Key.parse(expiry.getKey()), expiry.getValue());
+    }
+  }
+
+  /**
+   * Returns the expiry times of those of the given objects that expire, from their timers.
+   *
+   * @param keys the keys of the objects
+   * @return the keys of the objects that expire, mapped to the times they expire
+   */
+  @Override
+  public synchronized Map<String, Long> expiriesOf(Collection<String> keys) {
+    Map<String, Long> expiries = new HashMap<>();
+    for (String key : keys) {
+      TimerWheel.Timer<Key> timer = this.expiryTimers.get(Key.parse(key));
+      if (timer != null) {
+        expiries.put(key, timer.expiresAt());
+      }
+    }
+    return expiries;
+  }
+
+  @Override
+  public boolean holdsValues() {
+    return true;
+  }
+
+  /**
+   * Stores an object along with its value. The blocks are recoded as needed and written to a
+   * temporary file, which is synced and then moved over the object's value file. Only that last
+   * step holds the store's lock, so slow uploads do not hold up other requests.
+   *
+   * @param key the key of the object
+   * @param in the input to read the blocks from
+   * @param compress whether to compress the blocks on disk
+   * @return the size of the value
+   * @throws IOException if the value cannot be read or written
+   */
+  @Override
+  public ValueSize storeValue(String key, DataInputStream in, boolean compress)
+          throws IOException {
+    Path valuePath = valuePath(key);
+    Files.createDirectories(this.valueDir);
+    Path tmpPath = Files.createTempFile(this.valueDir, valuePath.getFileName().toString(), ".tmp");
+    long rawBytes = 0;
+    long storedBytes = 0;
+
+    try (FileOutputStream fileOut = new FileOutputStream(tmpPath.toFile());
+         DataOutputStream out = new DataOutputStream(new BufferedOutputStream(fileOut))) {
+      for (BlockCodec.Block block; (block = BlockCodec.readFrom(in)) != null;) {
+        block = block.recode(compress);
+        block.writeTo(out);
+        rawBytes += block.rawLength();
+        storedBytes += block.framedLength();
+      }
+      BlockCodec.writeEnd(out);
+      out.flush();
+      fileOut.getFD().sync();
+    } catch (IOException e) {
+      Files.deleteIfExists(tmpPath);
+      throw e;
+    }
+
+    synchronized (this) {
+      Files.move(tmpPath, valuePath, StandardCopyOption.REPLACE_EXISTING,
+              StandardCopyOption.ATOMIC_MOVE);
+      storeAll(List.of(key));
+    }
+    return new ValueSize(rawBytes, storedBytes);
+  }
+
+  /**
+   * Opens the value file of an object for reading.
+   *
+   * @param key the key of the object
+   * @return the input to read the blocks from, or null if the object is not stored or has no value
+   * @throws IOException if the value file cannot be opened
+   */
+  @Override
+  public synchronized DataInputStream openValue(String key) throws IOException {
+    Path valuePath = valuePath(key);
+    if (!this.index.contains(Key.parse(key)) || !Files.exists(valuePath)) {
+      return null;
+    }
+    return new DataInputStream(new BufferedInputStream(Files.newInputStream(valuePath),
+            BlockCodec.BLOCK_SIZE));
+  }
+
+  /**
+   * Returns the keys of the stored objects whose object ID falls in the ring range (start, end].
+   *
+   * @param start the exclusive start of the range
+   * @param end the inclusive end of the range
+   * @return the keys of the objects in the range
+   */
+  @Override
+  public synchronized List<String> keysInRange(int start, int end) {
+    return this.index.stream()
+            .filter(key -> Utils.inRange(key.objectNum(), start, end))
+            .map(Key::toString)
+            .toList();
+  }
+
+  /**
+   * Scans the stored objects in key order, starting right after a given key.
+   *
+   * @param after the key to start after
+   * @param lastObjectNum the highest object ID to include
+   * @param clientNum the numeric ID of the only client whose objects to include, or null to
+   *                  include the objects of every client
+   * @param limit the maximum number of keys to return
+   * @return the keys of the objects found, in key order
+   */
+  @Override
+  public synchronized List<Key> scan(Key after, int lastObjectNum, Integer clientNum, int limit) {
+    List<Key> keys = new ArrayList<>();
+    for (Key key : this.index.tailSet(after, false)) {
+      if (key.objectNum() > lastObjectNum || keys.size() == limit) {
+        break;
+      }
+      if (clientNum == null || key.clientNum() == clientNum) {
+        keys.add(key);
+      }
+    }
+    return keys;
+  }
+
+  /**
+   * Removes objects, given by their keys, by rewriting the object file without them. The index and
+   * Merkle tree are rebuilt afterwards so removed objects stop showing up in them.
+   * Nothing is rewritten when there is nothing to remove.
+   *
+   * @param keys the keys of the objects
+   */
+  @Override
+  public synchronized void removeAll(Collection<String> keys) {
+    if (keys.isEmpty()) {
+      return;
+    }
+    rewriteFiles(new HashSet<>(keys));
+    keys.forEach(this::deleteValue);
+    rebuildIndexes();
+  }
+
+  /**
+   * Removes every object.
+   */
+  @Override
+  public synchronized void clear() {
+    removeAll(keysInRange(0, 0));
+  }
+
+  /**
+   * Returns the hash of a node of the store's Merkle tree.
+   *
+   * @param node the number of the node, see {@link MerkleTree}
+   * @return the hash of the node
+   */
+  @Override
+  public synchronized long merkleHash(int node) {
+    return this.merkleTree.hash(node);
+  }
+
+  /**
+   * Checks whether a node of the store's Merkle tree is a leaf.
+   *
+   * @param node the number of the node, see {@link MerkleTree}
+   * @return true if the node is a leaf, false otherwise
+   */
+  @Override
+  public boolean isMerkleLeaf(int node) {
+    return this.merkleTree.isLeaf(node);
+  }
+
+  /**
+   * Returns the keys of the stored objects that belong to the given leaves of the store's Merkle
+   * tree.
+   *
+   * @param leaves the numbers of the leaf nodes
+   * @return the keys of the objects in those leaves
+   */
+  @Override
+  public synchronized List<String> keysInMerkleLeaves(Set<Integer> leaves) {
+    if (leaves.isEmpty()) {
+      return List.of();
+    }
+    return this.index.stream()
+            .map(Key::toString)
+            .filter(key -> leaves.contains(this.merkleTree.leafOf(key)))
+            .toList();
+  }
+
+  /**
+   * Checks whether an object is stored.
+   *
+   * @param clientNum the numeric ID of the client that owns the object
+   * @param objId the ID of the object
+   * @return true if the object is stored, false otherwise
+   */
+  @Override
+  public synchronized boolean contains(int clientNum, String objId) {
+    return this.index.contains(Key.parse(ObjectStore.toKey(clientNum, objId)));
+  }
+
+  /**
+   * Checks which of a batch of objects are stored.
+   *
+   * @param keys the keys of the objects
+   * @return whether each object is stored, in the order of the keys
+   */
+  @Override
+  public synchronized boolean[] containsAll(List<String> keys) {
+    boolean[] found = new boolean[keys.size()];
+    for (int i = 0; i < keys.size(); i++) {
+      found[i] = this.index.contains(Key.parse(keys.get(i)));
+    }
+    return found;
+  }
+
+  @Override
+  public synchronized long size() {
+    return this.index.size();
+  }
+
+  /**
+   * Returns the contents of the object file, leaving out the objects that have expired.
+   *
+   * @return the stored objects, one per line
+   */
+  @Override
+  public synchronized String dump() {
+    StringBuilder objFileContent = new StringBuilder();
+    try (BufferedReader reader = new BufferedReader(
+            new FileReader(this.objFilePath.toFile()))) {
+      for (String line; (line = reader.readLine()) != null;) {
+        if (this.expiredInFiles.isEmpty() || line.isBlank()
+                || this.index.contains(Key.parse(line.trim()))) {
+          objFileContent.append(line).append("\n");
+        }
+      }
+    } catch (IOException e) {
+      throw new RuntimeException("Object store error: " + e.getMessage());
+    }
+    return objFileContent.toString().trim();
+  }
+
+  /**
+   * Rebuilds the index, the Merkle tree and the expiry timers from the object file and the expiry
+   * file. Objects that have expired are left out.
+   */
+  private void rebuildIndexes() {
+    this.index.clear();
+    this.merkleTree.clear();
+    for (String line : readLines(this.objFilePath)) {
+      Key key = Key.parse(line);
+      if (this.index.add(key)) {
+        this.merkleTree.add(key.toString());
+      }
+    }
+
+    // the last expiry written for an object is the one that holds, and 0 means none
+    Map<Key, Long> expiries = new HashMap<>();
+    for (String line : readLines(this.ttlFilePath)) {
+      String[] parts = line.split(" ");
+      expiries.put(Key.parse(parts[0]), Long.parseLong(parts[1]));
+    }
+
+    this.expiryTimers.values().forEach(this.expiryWheel::cancel);
+    this.expiryTimers.clear();
+    this.expiredInFiles.clear();
+    long now = System.currentTimeMillis();
+    for (Map.Entry<Key, Long> expiry : expiries.entrySet()) {
+      Key key = expiry.getKey();
+      if (!this.index.contains(key)) {
+        continue;
+      }
+      if (expiry.getValue() == 0) {
+        continue;
+      }
+      if (expiry.getValue() <= now) {
+        this.index.remove(key);
+        this.merkleTree.remove(key.toString());
+        this.expiredInFiles.add(key);
+      } else {
+        scheduleExpiry(key, expiry.getValue());
+      }
+    }
+  }
+
+  /**
+   * Rewrites the object file and the expiry file, keeping only the objects that are still stored
+   * and not given.
+   *
+   * @param removed the keys of the objects to leave out
+   */
+  private void rewriteFiles(Set<String> removed) {
+    List<String> kept = readLines(this.objFilePath).stream()
+            .filter(key -> !removed.contains(key) && this.index.contains(Key.parse(key)))
+            .toList();
+    List<String> keptExpiries = this.expiryTimers.values().stream()
+            .filter(timer -> !removed.contains(timer.item().toString()))
+            .map(timer -> timer.item() + " " + timer.expiresAt())
+            .toList();
+
+    writeAtomically(this.objFilePath, kept);
+    writeAtomically(this.ttlFilePath, keptExpiries);
+  }
+
+  /**
+   * Schedules the expiry of an object, replacing any expiry it had.
+   *
+   * @param key the key of the object
+   * @param expiresAt the time the object expires, in milliseconds since the epoch
+   */
+  private void scheduleExpiry(Key key, long expiresAt) {
+    TimerWheel.Timer<Key> old = this.expiryTimers.put(key,
+            this.expiryWheel.schedule(key, expiresAt));
+    if (old != null) {
+      this.expiryWheel.cancel(old);
+    }
+  }
+
+  /**
+   * Advances the expiry wheel every tick and prints how much work expiry took every
+   * EXPIRY_REPORT_INTERVAL_MS, if any object expired.
+   */
+  private void runExpiry() {
+    long reportStart = System.currentTimeMillis();
+    long numExpired = 0;
+    long expiryNanos = 0;
+
+    while (true) {
+      try {
+        Thread.sleep(EXPIRY_TICK_MS);
+      } catch (InterruptedException e) {
+        return;
+      }
+
+      long start = System.nanoTime();
+      numExpired += expireDue();
+      expiryNanos += System.nanoTime() - start;
+
+      long now = System.currentTimeMillis();
+      if (now - reportStart >= EXPIRY_REPORT_INTERVAL_MS) {
+        if (numExpired > 0) {
+          int pending;
+          synchronized (this) {
+            pending = this.expiryWheel.size();
+          }
+          System.err.printf("EXPIRED %d objects from %s in %.1f s: %.1f ms of expiry work "
+                  + "(%.2f us per object), %d pending%n", numExpired,
+                  this.objFilePath.getFileName(), (now - reportStart) / 1000.0,
+                  expiryNanos / 1e6, expiryNanos / 1e3 / numExpired, pending);
+        }
+        reportStart = now;
+        numExpired = 0;
+        expiryNanos = 0;
+      }
+    }
+  }
+
+  /**
+   * Drops the objects that have expired by now from the in-memory structures. Once the expired
+   * objects still in the files outnumber the live ones, the files are rewritten without them.
+   *
+   * @return the number of objects that expired
+   */
+  private synchronized int expireDue() {
+    List<Key> expired = this.expiryWheel.advance(System.currentTimeMillis());
+    for (Key key : expired) {
+      this.expiryTimers.remove(key);
+      if (this.index.remove(key)) {
+        this.merkleTree.remove(key.toString());
+        this.expiredInFiles.add(key);
+        deleteValue(key.toString());
+      }
+    }
+
+    if (this.expiredInFiles.size() > Math.max(MIN_EXPIRED_BEFORE_REWRITE, this.index.size())) {
+      rewriteFiles(Set.of());
+      rebuildIndexes();
+    }
+    return expired.size();
+  }
+
+  /**
+   * Returns the path of the value file of an object.
+   *
+   * @param key the key of the object
+   * @return the path of the value file
+   */
+  private Path valuePath(String key) {
+    Key parsed = Key.parse(key);
+    return this.valueDir.resolve(parsed.clientNum() + "-" + parsed.objectNum() + ".val");
+  }
+
+  /**
+   * Deletes the value file of an object, if it has one.
+   *
+   * @param key the key of the object
+   */
+  private void deleteValue(String key) {
+    if (!Files.isDirectory(this.valueDir)) {
+      return;
+    }
+
+    try {
+      Files.deleteIfExists(valuePath(key));
+    } catch (IOException e) {
+      throw new RuntimeException("Object store error: " + e.getMessage());
+    }
+  }
+
+  /**
+   * Appends lines to a file with a single write that is synced to disk.
+   *
+   * @param path the path of the file
+   * @param lines the lines to append
+   */
+  private static void appendLines(Path path, List<String> lines) {
+    try (FileOutputStream fileOut = new FileOutputStream(path.toFile(), true);
+         BufferedWriter writer = new BufferedWriter(new OutputStreamWriter(fileOut))) {
+      for (String line : lines) {
+        writer.write(line);
+        writer.newLine();
+      }
+      writer.flush();
+      fileOut.getFD().sync();
+    } catch (IOException e) {
+      throw new RuntimeException("Object store error: " + e.getMessage());
+    }
+  }
+
+  /**
+   * Writes a file by writing a temporary file and moving it into place.
+   *
+   * @param path the path of the file
+   * @param lines the lines of the file
+   */
+  private static void writeAtomically(Path path, List<String> lines) {
+    try {
+      Path tmpPath = path.resolveSibling(path.getFileName() + ".tmp");
+      Files.write(tmpPath, lines);
+      Files.move(tmpPath, path, StandardCopyOption.REPLACE_EXISTING);
+    } catch (IOException e) {
+      throw new RuntimeException("Object store error: " + e.getMessage());
+    }
+  }
+
+  /**
+   * Reads the trimmed, non-empty lines of the object file or the expiry file. A missing file is
+   * empty.
+   *
+   * @param path the path of the file
+   * @return the lines of the file
+   */
+  private static List<String> readLines(Path path) {
+    if (!Files.exists(path)) {
+      return List.of();
+    }
+
+    try {
+      return Files.readAllLines(path).stream()
+              .map(String::trim)
+              .filter(line -> !line.isEmpty())
+              .toList();
+    } catch (IOException e) {
+      throw new RuntimeException("Object store error: " + e.getMessage());
+    }
+  }
+}
@@ -0,0 +1,66 @@
+package main.java;
+
+import java.util.Map;
+import java.util.concurrent.ConcurrentHashMap;
+
+/**
+ * A cache of lookups for hot objects, pushed by the peer that owns them. Each entry says whether
+ * the object exists and holds for a lease, after which it is dropped, so an entry whose
+ * invalidation was lost only lingers until its lease runs out.
+ */
+public final class HotKeyCache {
+  private static final int PURGE_THRESHOLD = 4096;
+
+  private final Map<String, Entry> entries = new ConcurrentHashMap<>();
+
+  /**
+   * A cached lookup.
+   *
+   * @param found whether the object exists
+   * @param expiresAt the time the lease ends, in milliseconds since the epoch
+   */
+  private record Entry(boolean found, long expiresAt) {
+  }
+
+  /**
+   * Caches the lookup of an object.
+   *
+   * @param key the key of the object
+   * @param found whether the object exists
+   * @param leaseMillis how long the entry holds, in milliseconds
+   */
+  public void put(String key, boolean found, long leaseMillis) {
+    long now = System.currentTimeMillis();
+    if (this.entries.size() >= PURGE_THRESHOLD) {
+      this.entries.values().removeIf(entry -> entry.expiresAt() <= now);
+    }
+    this.entries.put(key, new Entry(found, now + leaseMillis));
+  }
+
+  /**
+   * Looks up an object.
+   *
+   * @param key the key of the object
+   * @return whether the object exists, or null if it is not cached or its lease has run out
+   */
+  public Boolean get(String key) {
+    Entry entry = this.entries.get(key);
+    if (entry == null) {
+      return null;
+    }
+    if (entry.expiresAt() <= System.currentTimeMillis()) {
+      this.entries.remove(key, entry);
+      return null;
+    }
+    return entry.found();
+  }
+
+  /**
+   * Drops the cached lookup of an object.
+   *
+   * @param key the key of the object
+   */
+  public void invalidate(String key) {
+    this.entries.remove(key);
+  }
+}
@@ -0,0 +1,79 @@
+package main.java;
+
+import java.util.Arrays;
+
+/**
+ * Tracks how often keys are accessed over a sliding window, in constant memory. The counts are
+ * kept in a count-min sketch: each key is counted in one cell of every row, and its estimate is
+ * the smallest of those cells, which can only overestimate. The window is split into slices, each
+ * with its own sketch, and the sketch of the oldest slice is cleared as the window slides past it,
+ * so an estimate covers between (slices - 1) / slices and all of the window.
+ */
+public final class HotKeyTracker {
+  private static final int DEPTH = 4;
+  private static final int WIDTH = 2048;
+
+  private final int[][][] slices;
+  private final long sliceMillis;
+  private long currentSlice;
+
+  /**
+   * Constructs a new tracker.
+   *
+   * @param windowMillis the length of the window in milliseconds
+   * @param numSlices the number of slices the window is split into
+   * @throws IllegalArgumentException if the window or the number of slices is not positive
+   */
+  public HotKeyTracker(long windowMillis, int numSlices) throws IllegalArgumentException {
+    if (windowMillis <= 0 || numSlices <= 0) {
+      throw new IllegalArgumentException("Hot key tracker error: invalid window");
+    }
+
+    this.slices = new int[numSlices][DEPTH][WIDTH];
+    this.sliceMillis = Math.max(1, windowMillis / numSlices);
+    this.currentSlice = System.currentTimeMillis() / this.sliceMillis;
+  }
+
+  /**
+   * Counts an access to a key.
+   *
+   * @param key the key
+   * @return the estimated number of accesses to the key within the window, this one included
+   */
+  public synchronized int record(String key) {
+    slide(System.currentTimeMillis() / this.sliceMillis);
+
+    long hash = Utils.hash64(key);
+    int h1 = (int) hash;
+    int h2 = (int) (hash >>> 32);
+    int[][] sketch = this.slices[(int) (this.currentSlice % this.slices.length)];
+    int estimate = Integer.MAX_VALUE;
+
+    for (int row = 0; row < DEPTH; row++) {
+      int cell = Integer.remainderUnsigned(h1 + row * h2, WIDTH);
+      sketch[row][cell]++;
+
+      int count = 0;
+      for (int[][] slice : this.slices) {
+        count += slice[row][cell];
+      }
+      estimate = Math.min(estimate, count);
+    }
+    return estimate;
+  }
+
+  /**
+   * Moves the window forward, clearing the slices it has moved past.
+   *
+   * @param slice the number of the slice the current time falls in
+   */
+  private void slide(long slice) {
+    long numStale = Math.min(slice - this.currentSlice, this.slices.length);
+    for (long i = 1; i <= numStale; i++) {
+      for (int[] row : this.slices[(int) ((this.currentSlice + i) % this.slices.length)]) {
+        Arrays.fill(row, 0);
+      }
+    }
+    this.currentSlice = Math.max(this.currentSlice, slice);
+  }
+}
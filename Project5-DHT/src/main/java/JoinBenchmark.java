@@ -0,0 +1,96 @@
+package main.java;
+
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.List;
+import java.util.Random;
+
+/**
+ * Measures the cost of peers joining the ring at the bootstrap server. It joins a given number of
+ * peers at random positions, in random order, once with the {@link RingIndex} the bootstrap server
+ * uses and once with the sorted list it used before, where every join shifted part of the list
+ * and every peer in the ring was told about the join. The network is not involved: the benchmark
+ * counts the messages a join sends instead. Run it with
+ * {@code java main.java.JoinBenchmark [peers]}, which defaults to 10,000 peers.
+ */
+public final class JoinBenchmark {
+  private static final int ASSIGNMENT_MESSAGES = 4;
+
+  /**
+   * Runs the benchmark and prints the cost of the joins with each ring.
+   *
+   * @param args the number of peers, optional
+   */
+  public static void main(String[] args) {
+    int numPeers = (args.length > 0) ? Integer.parseInt(args[0]) : 10_000;
+    Random random = new Random(42);
+    List<Integer> tokens = new ArrayList<>();
+    for (int i = 0; i < numPeers; i++) {
+      tokens.add(i * 7);
+    }
+    Collections.shuffle(tokens, random);
+
+    // warm up both rings so that the first run does not pay for compilation
+    for (int i = 0; i < 5; i++) {
+      joinIndexed(tokens);
+      joinListed(tokens);
+    }
+
+    long start = System.nanoTime();
+    long indexedMessages = joinIndexed(tokens);
+    report("index", numPeers, indexedMessages, System.nanoTime() - start);
+
+    start = System.nanoTime();
+    long listedMessages = joinListed(tokens);
+    report("list", numPeers, listedMessages, System.nanoTime() - start);
+  }
+
+  /**
+   * Joins peers to a ring index, telling only the new peer and its neighbors about each join.
+   *
+   * @param tokens the positions of the peers, in the order they join
+   * @return the number of messages the joins send
+   */
+  private static long joinIndexed(List<Integer> tokens) {
+    RingIndex ring = new RingIndex();
+    long numMessages = 0;
+    for (int token : tokens) {
+      String peerId = "peer" + token;
+      RingIndex.Neighbors neighbors = ring.add(peerId, token);
+      numMessages += ASSIGNMENT_MESSAGES + List.of(peerId, neighbors.predecessor(),
+              neighbors.successor()).stream().distinct().count();
+    }
+    return numMessages;
+  }
+
+  /**
+   * Joins peers to a sorted list, telling every peer in the ring about each join.
+   *
+   * @param tokens the positions of the peers, in the order they join
+   * @return the number of messages the joins send
+   */
+  private static long joinListed(List<Integer> tokens) {
+    List<Integer> ring = new ArrayList<>();
+    long numMessages = 0;
+    for (int token : tokens) {
+      int insertionPoint = -Collections.binarySearch(ring, token) - 1;
+      ring.add(insertionPoint, token);
+      numMessages += ASSIGNMENT_MESSAGES + ring.size();
+    }
+    return numMessages;
+  }
+
+  /**
+   * Prints the cost of joining the peers to one kind of ring.
+   *
+   * @param kind the kind of ring
+   * @param numPeers the number of peers that joined
+   * @param numMessages the number of messages the joins send
+   * @param nanos the time spent on the joins, in nanoseconds
+   */
+  private static void report(String kind, int numPeers, long numMessages, long nanos) {
+    System.out.printf("%-6s %d joins in %.3f ms (%.0f ns per join), %.1f messages per join, "
+            + "%d messages in all%n", kind, numPeers, nanos / 1e6, (double) nanos / numPeers,
+            (double) numMessages / numPeers, numMessages);
+  }
+}
@@ -0,0 +1,72 @@
+package main.java;
+
+import java.util.ArrayList;
+import java.util.Map;
+import java.util.TreeMap;
+
+/**
+ * A client-side cache of which peer owns which range of the ring. Each entry is learned from a
+ * peer's reply, which carries the peer's ID and the range (start, end] of the ring it owns.
+ * Entries are indexed by the end of their range, which makes a lookup a single ceiling search. An
+ * entry that turns out to be stale is replaced as soon as the peer it points to reports its actual
+ * range.
+ */
+public final class LocationCache {
+  private final TreeMap<Integer, Location> locations = new TreeMap<>();
+
+  /**
+   * A cached range of the ring and the peer that owns it.
+   *
+   * @param start the exclusive start of the range
+   * @param peerId the ID of the peer owning the range
+   */
+  private record Location(int start, String peerId) {
+  }
+
+  /**
+   * Looks up the peer that owns a key.
+   *
+   * @param key the key
+   * @return the ID of the peer owning the key, or null if no cached range covers it
+   */
+  public synchronized String lookup(int key) {
+    Map.Entry<Integer, Location> entry = this.locations.ceilingEntry(key);
+    if (entry == null) {
+      // keys above the last cached range may belong to the range that wraps around the ring
+      entry = this.locations.firstEntry();
+    }
+    if (entry == null || !Utils.inRange(key, entry.getValue().start(), entry.getKey())) {
+      return null;
+    }
+
+    return entry.getValue().peerId();
+  }
+
+  /**
+   * Learns the range owned by a peer, dropping the range previously cached for the peer and any
+   * cached range that overlaps the new one, since the ring must have changed since those ranges
+   * were cached.
+   *
+   * @param peerId the ID of the peer
+   * @param start the exclusive start of the peer's range
+   * @param end the inclusive end of the peer's range
+   */
+  public synchronized void learn(String peerId, int start, int end) {
+    this.locations.values().removeIf(location -> location.peerId().equals(peerId));
+    for (int cachedEnd : new ArrayList<>(this.locations.keySet())) {
+      if (Utils.inRange(cachedEnd, start, end)) {
+        this.locations.remove(cachedEnd);
+      }
+    }
+    this.locations.put(end, new Location(start, peerId));
+  }
+
+  /**
+   * Returns the number of cached ranges.
+   *
+   * @return the number of cached ranges
+   */
+  public synchronized int size() {
+    return this.locations.size();
+  }
+}
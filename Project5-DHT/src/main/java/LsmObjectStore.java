@@ -0,0 +1,1097 @@
+package main.java;
+
+import java.io.BufferedInputStream;
+import java.io.BufferedOutputStream;
+import java.io.DataInputStream;
+import java.io.DataOutputStream;
+import java.io.EOFException;
+import java.io.FileInputStream;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.UncheckedIOException;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.nio.file.StandardCopyOption;
+import java.util.ArrayDeque;
+import java.util.ArrayList;
+import java.util.Collection;
+import java.util.Comparator;
+import java.util.Deque;
+import java.util.HashMap;
+import java.util.Iterator;
+import java.util.LinkedHashMap;
+import java.util.LinkedHashSet;
+import java.util.List;
+import java.util.Map;
+import java.util.PriorityQueue;
+import java.util.Set;
+import java.util.concurrent.ConcurrentSkipListMap;
+import java.util.function.Predicate;
+import java.util.stream.Stream;
+
+/**
+ * An object store built as a log-structured merge tree, for write-heavy workloads. Writes go to a
+ * write-ahead log, synced once per batch, and to an in-memory memtable, a skip list sorted by key.
+ * Once the memtable is full it is frozen and a background thread writes it out as an immutable
+ * {@link SSTable}, after which its log is deleted. Tables are merged in size tiers: once enough
+ * adjacent tables of similar size pile up, the same thread merges them into one, so an object is
+ * rewritten about once per tier rather than once per merge. Removed objects are dropped for good
+ * when a merge reaches the oldest table. Removals are written as tombstones, and a lookup checks
+ * the memtable, then the frozen memtables, then the tables from newest to oldest, skipping any
+ * table whose Bloom filter rules the key out.
+ *
+ * <p>Stores and removals are written without reading the tables first. A stored object that is in
+ * none of the memtables is counted as new, and a removed one as gone, and its key is kept aside
+ * until the tables are checked for it, before its memtable is flushed or before the Merkle tree or
+ * the count is read, whichever comes first. If the guess was wrong, the count and the Merkle tree
+ * are corrected then.
+ *
+ * <p>The store's files live in a directory next to the object file. A manifest lists the tables
+ * from newest to oldest and is replaced atomically whenever a table is added or a compaction
+ * finishes, so a crash never exposes a half-written table. On startup the tables in the manifest
+ * are opened and any logs that were not flushed yet are replayed. The first time the store is
+ * opened, the objects in the object file are imported. A store can also be written offline from
+ * keys that are already sorted, see {@link BulkLoad}.
+ *
+ * <p>Objects can be stored with an expiry time. Expiry times are appended to a log of their own,
+ * as is a cleared time whenever an object expires or is removed, and the pending expiries are kept
+ * on a {@link TimerWheel} that a background thread advances every tick, writing tombstones for the
+ * objects that expired. The log is rewritten with only the pending expiries on startup and
+ * whenever cleared times make up most of it.
+ *
+ * <p>Like the file store, this store keeps a Merkle tree over its objects in memory. It also
+ * counts how many table blocks its lookups read, its read amplification, which {@link #dump()}
+ * reports.
+ */
+public final class LsmObjectStore implements ObjectStore {
+  private static final int MEMTABLE_LIMIT = 65536;
+  private static final int COMPACTION_TRIGGER = 4; // adjacent tables of a tier before a merge
+  private static final int TIER_RATIO = 2; // largest to smallest table of a tier
+  private static final long COMPACTION_RETRY_MS = 1000;
+  private static final long EXPIRY_TICK_MS = 100;
+  private static final long EXPIRY_REPORT_INTERVAL_MS = 10000;
+  private static final int MIN_EXPIRY_RECORDS = 1024;
+  private static final String MANIFEST = "MANIFEST";
+  private static final String EXPIRIES = "EXPIRIES";
+  private static final String LOG_SUFFIX = ".log";
+  private static final String TABLE_SUFFIX = ".sst";
+  private static final Key FIRST_KEY = new Key(Integer.MIN_VALUE, Integer.MIN_VALUE);
+
+  private final Path dir;
+  private final MerkleTree merkleTree = new MerkleTree(MERKLE_DEPTH);
+  private final Deque<Memtable> frozenMemtables = new ArrayDeque<>(); // newest first
+  private final List<SSTable> tables = new ArrayList<>(); // newest first
+  private final TimerWheel<Key> expiryWheel = new TimerWheel<>(EXPIRY_TICK_MS,
+          System.currentTimeMillis());
+  private final Map<Key, TimerWheel.Timer<Key>> expiryTimers = new HashMap<>();
+  private Memtable memtable;
+  private FileOutputStream logFile;
+  private DataOutputStream log;
+  private FileOutputStream expiryFile;
+  private DataOutputStream expiryLog;
+  private long numExpiryRecords;
+  private long nextFileNum;
+  private long numObjects;
+  private long numLookups;
+  private long numBlocksRead;
+
+  /**
+   * A memtable and the number of its write-ahead log, which is also the number of the table it is
+   * flushed to.
+   *
+   * @param fileNum the number of the memtable's log
+   * @param entries the entries, mapping each key to true if the object is live and false for a
+   *                tombstone
+   * @param unverified the keys written here without checking the tables, mapping each key to true
+   *                   if it was removed and counted as live before, and false if it was stored and
+   *                   counted as new
+   */
+  private record Memtable(long fileNum, ConcurrentSkipListMap<Key, Boolean> entries,
+                          Map<Key, Boolean> unverified) {
+  }
+
+  /**
+   * Writes the files of a new store from keys that are already sorted, as a single table with its
+   * block index and Bloom filter, skipping the write-ahead log and the memtable. The store is then
+   * opened as usual, and the object file is not imported into it.
+   */
+  public static final class BulkLoad {
+    private final Path dir;
+    private final SSTable.Builder builder;
+
+    /**
+     * Starts writing a new store.
+     *
+     * @param objFilePath path to the object file the store belongs to
+     * @param numKeys the number of keys that will be added, used to size the Bloom filter
+     * @throws IOException if the store already exists or its files cannot be created
+     */
+    public BulkLoad(String objFilePath, long numKeys) throws IOException {
+      this.dir = storeDir(Paths.get(objFilePath));
+      if (Files.exists(this.dir)) {
+        throw new IOException("Object store error: store already exists in " + this.dir);
+      }
+      Files.createDirectories(this.dir);
+      this.builder = new SSTable.Builder(this.dir.resolve(String.format("%06d%s", 0,
+              TABLE_SUFFIX)), numKeys);
+    }
+
+    /**
+     * Adds a live object to the store.
+     *
+     * @param key the key, which must be greater than the key of the previous object
+     * @throws IOException if the object cannot be written
+     */
+    public void add(Key key) throws IOException {
+      this.builder.add(key, true);
+    }
+
+    /**
+     * Finishes the table and writes the manifest listing it.
+     *
+     * @return the number of objects in the store
+     * @throws IOException if the table or the manifest cannot be written
+     */
+    public long finish() throws IOException {
+      SSTable table = this.builder.finish();
+      try {
+        writeManifest(this.dir, List.of(table));
+        return table.numEntries();
+      } finally {
+        table.close();
+      }
+    }
+  }
+
+  /**
+   * Constructs a new LsmObjectStore next to the given object file, recovers its state from disk
+   * and starts its compaction and expiry threads.
+   *
+   * @param objFilePath path to the object file
+   */
+  public LsmObjectStore(String objFilePath) {
+    Path objFile = Paths.get(objFilePath);
+    this.dir = storeDir(objFile);
+    boolean isNew = !Files.isDirectory(this.dir);
+
+    try {
+      Files.createDirectories(this.dir);
+      recover();
+    } catch (IOException e) {
+      throw new RuntimeException("Object store error: " + e.getMessage());
+    }
+
+    Thread compactor = new Thread(this::runCompaction, "lsm-compaction");
+    compactor.setDaemon(true);
+    compactor.start();
+
+    Thread expirer = new Thread(this::runExpiry, "lsm-expiry");
+    expirer.setDaemon(true);
+    expirer.start();
+
+    if (isNew && Files.exists(objFile)) {
+      try (Stream<String> lines = Files.lines(objFile)) {
+        storeAll(lines.map(String::trim).filter(line -> !line.isEmpty()).toList());
+      } catch (IOException e) {
+        throw new RuntimeException("Object store error: " + e.getMessage());
+      }
+    }
+  }
+
+  @Override
+  public void store(int clientNum, String objId) {
+    storeAll(List.of(ObjectStore.toKey(clientNum, objId)));
+  }
+
+  /**
+   * Stores a batch of objects with a single append to the write-ahead log that is synced to disk
+   * once for the whole batch. Objects that a memtable holds are skipped, and the tables are not
+   * read: objects found in no memtable are written and counted as new until they are verified.
+   *
+   * @param keys the keys of the objects
+   */
+  @Override
+  public synchronized void storeAll(Collection<String> keys) {
+    List<Key> newKeys = new ArrayList<>();
+    for (Key key : parseAll(keys)) {
+      Boolean live = liveInMemtables(key);
+      if (live == null) {
+        this.memtable.unverified().put(key, false);
+      }
+      if (!Boolean.TRUE.equals(live)) {
+        newKeys.add(key);
+      }
+    }
+    if (newKeys.isEmpty()) {
+      return;
+    }
+
+    write(newKeys, true);
+    newKeys.forEach(key -> this.merkleTree.add(key.toString()));
+    this.numObjects += newKeys.size();
+  }
+
+  /**
+   * Stores a batch of objects that expire at the given times. The objects are stored as usual and
+   * their expiry times are appended to the expiry log, which is synced once for the whole batch.
+   * An object that is already stored has its timer replaced.
+   *
+   * @param expiries the keys of the objects, mapped to the times they expire, in milliseconds since
+   *                 the epoch
+   */
+  @Override
+  public synchronized void storeAllExpiring(Map<String, Long> expiries) {
+    storeAll(expiries.keySet());
+
+    Map<Key, Long> parsed = new LinkedHashMap<>();
+    expiries.forEach((key, expiresAt) -> parsed.put(Key.parse(key), expiresAt));
+    appendExpiries(parsed);
+    parsed.forEach(this::scheduleExpiry);
+  }
+
+  @Override
+  public synchronized Map<String, Long> expiriesOf(Collection<String> keys) {
+    Map<String, Long> expiries = new HashMap<>();
+    for (String key : keys) {
+      TimerWheel.Timer<Key> timer = this.expiryTimers.get(Key.parse(key));
+      if (timer != null) {
+        expiries.put(key, timer.expiresAt());
+      }
+    }
+    return expiries;
+  }
+
+  @Override
+  public synchronized List<String> keysInRange(int start, int end) {
+    List<String> keys = new ArrayList<>();
+    forEachLive(FIRST_KEY, key -> {
+      if (Utils.inRange(key.objectNum(), start, end)) {
+        keys.add(key.toString());
+      }
+      return true;
+    });
+    return keys;
+  }
+
+  @Override
+  public synchronized List<Key> scan(Key after, int lastObjectNum, Integer clientNum, int limit) {
+    List<Key> keys = new ArrayList<>();
+    forEachLive(after, key -> {
+      if (key.equals(after)) {
+        return true;
+      }
+      if (key.objectNum() > lastObjectNum || keys.size() == limit) {
+        return false;
+      }
+      if (clientNum == null || key.clientNum() == clientNum) {
+        keys.add(key);
+      }
+      return true;
+    });
+    return keys;
+  }
+
+  /**
+   * Removes objects by writing a tombstone for each of them, and cancels their expiries. Like
+   * stores, removals do not read the tables: objects found in no memtable are counted as removed
+   * until they are verified. The objects are only gone from disk once the tables holding them are
+   * compacted.
+   *
+   * @param keys the keys of the objects
+   */
+  @Override
+  public synchronized void removeAll(Collection<String> keys) {
+    Set<Key> parsed = parseAll(keys);
+    tombstone(parsed);
+
+    // an object stored again later must not pick up its old expiry on recovery
+    Map<Key, Long> cleared = new LinkedHashMap<>();
+    for (Key key : parsed) {
+      TimerWheel.Timer<Key> timer = this.expiryTimers.remove(key);
+      if (timer != null) {
+        this.expiryWheel.cancel(timer);
+        cleared.put(key, 0L);
+      }
+    }
+    appendExpiries(cleared);
+  }
+
+  /**
+   * Removes every object by dropping the memtables and tables and deleting their files, rather
+   * than writing a tombstone for each object.
+   */
+  @Override
+  public synchronized void clear() {
+    try {
+      this.log.close();
+      List<SSTable> dropped = new ArrayList<>(this.tables);
+      this.tables.clear();
+      writeManifest();
+
+      Files.deleteIfExists(logPath(this.memtable.fileNum()));
+      for (Memtable frozen : this.frozenMemtables) {
+        Files.deleteIfExists(logPath(frozen.fileNum()));
+      }
+      this.frozenMemtables.clear();
+      for (SSTable table : dropped) {
+        table.delete();
+      }
+      startMemtable();
+
+      this.expiryTimers.values().forEach(this.expiryWheel::cancel);
+      this.expiryTimers.clear();
+      rewriteExpiries();
+      this.merkleTree.clear();
+      this.numObjects = 0;
+    } catch (IOException e) {
+      throw new RuntimeException("Object store error: " + e.getMessage());
+    }
+  }
+
+  @Override
+  public synchronized long merkleHash(int node) {
+    verifyAll();
+    return this.merkleTree.hash(node);
+  }
+
+  @Override
+  public boolean isMerkleLeaf(int node) {
+    return this.merkleTree.isLeaf(node);
+  }
+
+  @Override
+  public synchronized List<String> keysInMerkleLeaves(Set<Integer> leaves) {
+    verifyAll();
+    List<String> keys = new ArrayList<>();
+    if (!leaves.isEmpty()) {
+      forEachLive(FIRST_KEY, key -> {
+        if (leaves.contains(this.merkleTree.leafOf(key.toString()))) {
+          keys.add(key.toString());
+        }
+        return true;
+      });
+    }
+    return keys;
+  }
+
+  @Override
+  public synchronized boolean contains(int clientNum, String objId) {
+    return isLive(Key.parse(ObjectStore.toKey(clientNum, objId)));
+  }
+
+  @Override
+  public synchronized boolean[] containsAll(List<String> keys) {
+    boolean[] found = new boolean[keys.size()];
+    for (int i = 0; i < keys.size(); i++) {
+      found[i] = isLive(Key.parse(keys.get(i)));
+    }
+    return found;
+  }
+
+  @Override
+  public synchronized long size() {
+    verifyAll();
+    return this.numObjects;
+  }
+
+  /**
+   * Summarizes the store rather than listing every object, which would mean reading every table.
+   *
+   * @return the number of objects, the shape of the tree and the read amplification so far
+   */
+  @Override
+  public synchronized String dump() {
+    verifyAll();
+    double blocksPerLookup = (this.numLookups == 0) ? 0
+            : (double) this.numBlocksRead / this.numLookups;
+    return String.format("LSM %d objects: memtable of %d keys, %d frozen memtables, %d tables "
+                    + "(%.3f blocks read per lookup)", this.numObjects,
+            this.memtable.entries().size(), this.frozenMemtables.size(), this.tables.size(),
+            blocksPerLookup);
+  }
+
+  /**
+   * Parses and deduplicates a batch of keys.
+   *
+   * @param keys the keys as strings
+   * @return the distinct keys, in their original order
+   */
+  private static Set<Key> parseAll(Collection<String> keys) {
+    Set<Key> parsed = new LinkedHashSet<>();
+    for (String key : keys) {
+      parsed.add(Key.parse(key));
+    }
+    return parsed;
+  }
+
+  /**
+   * Writes tombstones for the given objects, skipping those that a memtable holds a tombstone for.
+   * Objects found in no memtable are assumed live until they are verified.
+   *
+   * @param keys the keys of the objects
+   */
+  private void tombstone(Collection<Key> keys) {
+    List<Key> removedKeys = new ArrayList<>();
+    for (Key key : keys) {
+      Boolean live = liveInMemtables(key);
+      if (live == null) {
+        this.memtable.unverified().put(key, true);
+      }
+      if (!Boolean.FALSE.equals(live)) {
+        removedKeys.add(key);
+      }
+    }
+    if (removedKeys.isEmpty()) {
+      return;
+    }
+
+    write(removedKeys, false);
+    removedKeys.forEach(key -> this.merkleTree.remove(key.toString()));
+    this.numObjects -= removedKeys.size();
+  }
+
+  /**
+   * Appends a batch of entries to the write-ahead log, syncs it and adds the entries to the
+   * memtable, freezing the memtable if it is full.
+   *
+   * @param keys the keys of the entries
+   * @param live true to store the objects, false to write tombstones for them
+   */
+  private void write(List<Key> keys, boolean live) {
+    try {
+      for (Key key : keys) {
+        this.log.writeBoolean(live);
+        this.log.writeInt(key.objectNum());
+        this.log.writeInt(key.clientNum());
+      }
+      this.log.flush();
+      this.logFile.getFD().sync();
+
+      for (Key key : keys) {
+        this.memtable.entries().put(key, live);
+      }
+      if (this.memtable.entries().size() >= MEMTABLE_LIMIT) {
+        this.log.close();
+        this.frozenMemtables.addFirst(this.memtable);
+        startMemtable();
+        notifyAll();
+      }
+    } catch (IOException e) {
+      throw new RuntimeException("Object store error: " + e.getMessage());
+    }
+  }
+
+  /**
+   * Checks whether an object is stored, newest data first.
+   *
+   * @param key the key of the object
+   * @return true if the object is live, false if it was never stored or has been removed
+   */
+  private boolean isLive(Key key) {
+    Boolean live = liveInMemtables(key);
+    return (live != null) ? live : liveInTables(key);
+  }
+
+  /**
+   * Looks an object up in the memtables, newest first, without reading the tables.
+   *
+   * @param key the key of the object
+   * @return true if the newest memtable holding the object has it live, false if it has a
+   *         tombstone, or null if no memtable holds the object
+   */
+  private Boolean liveInMemtables(Key key) {
+    Boolean live = this.memtable.entries().get(key);
+    for (Iterator<Memtable> it = this.frozenMemtables.iterator(); live == null && it.hasNext();) {
+      live = it.next().entries().get(key);
+    }
+    return live;
+  }
+
+  /**
+   * Looks an object up in the tables, newest first, skipping those whose Bloom filter rules it
+   * out.
+   *
+   * @param key the key of the object
+   * @return true if the newest table holding the object has it live, false otherwise
+   */
+  private boolean liveInTables(Key key) {
+    this.numLookups++;
+    Boolean live = null;
+    try {
+      for (Iterator<SSTable> it = this.tables.iterator(); live == null && it.hasNext();) {
+        SSTable table = it.next();
+        if (table.mightContain(key)) {
+          this.numBlocksRead++;
+          live = table.get(key);
+        }
+      }
+    } catch (IOException e) {
+      throw new RuntimeException("Object store error: " + e.getMessage());
+    }
+    return Boolean.TRUE.equals(live);
+  }
+
+  /**
+   * Verifies the objects that were written without checking the tables in every memtable.
+   */
+  private void verifyAll() {
+    verify(this.memtable);
+    this.frozenMemtables.forEach(this::verify);
+  }
+
+  /**
+   * Checks the tables for the objects a memtable wrote without checking them. The tables only hold
+   * data older than every memtable, so this tells whether an object was live before it was first
+   * written to the memtable. A stored object that was already live was counted and added to the
+   * Merkle tree twice, and a removed object that was not live was counted and removed once too
+   * often; since a Merkle tree toggles keys, toggling the key once more fixes either.
+   *
+   * @param memtable the memtable
+   */
+  private void verify(Memtable memtable) {
+    for (Map.Entry<Key, Boolean> entry : memtable.unverified().entrySet()) {
+      boolean assumedLive = entry.getValue();
+      if (liveInTables(entry.getKey()) != assumedLive) {
+        this.merkleTree.remove(entry.getKey().toString());
+        this.numObjects += assumedLive ? 1 : -1;
+      }
+    }
+    memtable.unverified().clear();
+  }
+
+  /**
+   * Visits the live objects in key order, starting at the first key not less than the given one.
+   *
+   * @param from the key to start from
+   * @param visitor called with each key, returning false to stop the walk
+   */
+  private void forEachLive(Key from, Predicate<Key> visitor) {
+    List<Iterator<Map.Entry<Key, Boolean>>> sources = new ArrayList<>();
+    sources.add(this.memtable.entries().tailMap(from).entrySet().iterator());
+    for (Memtable frozen : this.frozenMemtables) {
+      sources.add(frozen.entries().tailMap(from).entrySet().iterator());
+    }
+    for (SSTable table : this.tables) {
+      sources.add(table.iterator(from));
+    }
+
+    try {
+      merge(sources, entry -> !entry.getValue() || visitor.test(entry.getKey()));
+    } catch (UncheckedIOException e) {
+      throw new RuntimeException("Object store error: " + e.getMessage());
+    }
+  }
+
+  /**
+   * Merges sorted sources of entries, visiting only the newest entry for each key.
+   *
+   * @param sources the sources, newest first
+   * @param visitor called with each entry in key order, returning false to stop the merge
+   */
+  private static void merge(List<Iterator<Map.Entry<Key, Boolean>>> sources,
+                            Predicate<Map.Entry<Key, Boolean>> visitor) {
+    record Cursor(int rank, Iterator<Map.Entry<Key, Boolean>> source,
+                  Map.Entry<Key, Boolean> entry) {
+    }
+
+    PriorityQueue<Cursor> queue = new PriorityQueue<>(Comparator
+            .comparing((Cursor cursor) -> cursor.entry().getKey())
+            .thenComparingInt(Cursor::rank));
+    for (int i = 0; i < sources.size(); i++) {
+      if (sources.get(i).hasNext()) {
+        queue.add(new Cursor(i, sources.get(i), sources.get(i).next()));
+      }
+    }
+
+    while (!queue.isEmpty()) {
+      Cursor newest = queue.poll();
+      Key key = newest.entry().getKey();
+      for (Cursor cursor = newest; cursor != null;) {
+        if (cursor.source().hasNext()) {
+          queue.add(new Cursor(cursor.rank(), cursor.source(), cursor.source().next()));
+        }
+        Cursor peeked = queue.peek();
+        cursor = (peeked != null && peeked.entry().getKey().equals(key)) ? queue.poll() : null;
+      }
+
+      if (!visitor.test(newest.entry())) {
+        return;
+      }
+    }
+  }
+
+  /**
+   * Flushes frozen memtables and compacts tables in the background, waiting for work whenever
+   * there is none. Errors are reported and the work is retried after a pause.
+   */
+  private void runCompaction() {
+    while (true) {
+      try {
+        Memtable oldestFrozen;
+        List<SSTable> toCompact;
+        boolean dropTombstones;
+        synchronized (this) {
+          while (this.frozenMemtables.isEmpty() && pickTier().isEmpty()) {
+            wait();
+          }
+          oldestFrozen = this.frozenMemtables.peekLast();
+          if (oldestFrozen != null) {
+            verify(oldestFrozen);
+          }
+          toCompact = pickTier();
+          dropTombstones = !toCompact.isEmpty()
+                  && toCompact.get(toCompact.size() - 1) == this.tables.get(this.tables.size() - 1);
+        }
+
+        if (oldestFrozen != null) {
+          flush(oldestFrozen);
+        } else {
+          compact(toCompact, dropTombstones);
+        }
+      } catch (InterruptedException e) {
+        return;
+      } catch (IOException | RuntimeException e) {
+        System.err.println("LSM compaction error: " + e.getMessage());
+        try {
+          Thread.sleep(COMPACTION_RETRY_MS);
+        } catch (InterruptedException ie) {
+          return;
+        }
+      }
+    }
+  }
+
+  /**
+   * Picks the tables to merge next: the newest run of at least COMPACTION_TRIGGER adjacent tables
+   * whose sizes are within TIER_RATIO of each other. Only adjacent tables are merged, so the merged
+   * table can take their place without moving any entry in front of a newer one.
+   *
+   * @return the tables, newest first, or an empty list if no tier is full
+   */
+  private List<SSTable> pickTier() {
+    for (int start = 0; start + COMPACTION_TRIGGER <= this.tables.size(); start++) {
+      long min = Math.max(1, this.tables.get(start).numEntries());
+      long max = min;
+      int end = start + 1;
+      for (; end < this.tables.size(); end++) {
+        long size = Math.max(1, this.tables.get(end).numEntries());
+        if (Math.max(max, size) > TIER_RATIO * Math.min(min, size)) {
+          break;
+        }
+        min = Math.min(min, size);
+        max = Math.max(max, size);
+      }
+      if (end - start >= COMPACTION_TRIGGER) {
+        return new ArrayList<>(this.tables.subList(start, end));
+      }
+    }
+    return List.of();
+  }
+
+  /**
+   * Writes a frozen memtable out as a new table and deletes its log.
+   *
+   * @param frozen the memtable
+   * @throws IOException if the table cannot be written
+   */
+  private void flush(Memtable frozen) throws IOException {
+    long start = System.nanoTime();
+    SSTable.Builder builder = new SSTable.Builder(tablePath(frozen.fileNum()),
+            frozen.entries().size());
+    for (Map.Entry<Key, Boolean> entry : frozen.entries().entrySet()) {
+      builder.add(entry.getKey(), entry.getValue());
+    }
+    SSTable table = builder.finish();
+
+    synchronized (this) {
+      // the store was cleared while the table was written
+      if (this.frozenMemtables.peekLast() != frozen) {
+        table.delete();
+        return;
+      }
+      this.tables.add(0, table);
+      writeManifest();
+      this.frozenMemtables.removeLast();
+      notifyAll();
+    }
+    Files.deleteIfExists(logPath(frozen.fileNum()));
+
+    System.err.printf("LSM FLUSHED %d keys to %s in %.3f s%n", table.numEntries(),
+            table.path().getFileName(), (System.nanoTime() - start) / 1e9);
+  }
+
+  /**
+   * Merges a run of adjacent tables into one, which takes their place. Tombstones are only dropped
+   * when the run includes the oldest table, since otherwise they may hide objects in older tables.
+   * Only this thread adds or removes tables, apart from a clear, so the run stays in place while
+   * the merge runs.
+   *
+   * @param toCompact the tables, newest first
+   * @param dropTombstones whether to leave tombstones out of the merged table
+   * @throws IOException if the merged table cannot be written
+   */
+  private void compact(List<SSTable> toCompact, boolean dropTombstones) throws IOException {
+    long start = System.nanoTime();
+    long fileNum;
+    synchronized (this) {
+      fileNum = this.nextFileNum++;
+    }
+
+    long maxEntries = 0;
+    List<Iterator<Map.Entry<Key, Boolean>>> sources = new ArrayList<>();
+    for (SSTable table : toCompact) {
+      maxEntries += table.numEntries();
+      sources.add(table.iterator(FIRST_KEY));
+    }
+    SSTable.Builder builder = new SSTable.Builder(tablePath(fileNum), maxEntries);
+    try {
+      merge(sources, entry -> {
+        if (entry.getValue() || !dropTombstones) {
+          try {
+            builder.add(entry.getKey(), entry.getValue());
+          } catch (IOException e) {
+            throw new UncheckedIOException(e);
+          }
+        }
+        return true;
+      });
+    } catch (UncheckedIOException e) {
+      throw e.getCause();
+    }
+    SSTable merged = builder.finish();
+
+    synchronized (this) {
+      // the store was cleared while the tables were merged
+      if (!this.tables.containsAll(toCompact)) {
+        merged.delete();
+        return;
+      }
+      int index = this.tables.indexOf(toCompact.get(0));
+      this.tables.removeAll(toCompact);
+      if (merged.numEntries() > 0) {
+        this.tables.add(index, merged);
+      }
+      writeManifest();
+      for (SSTable table : toCompact) {
+        table.delete();
+      }
+      if (merged.numEntries() == 0) {
+        merged.delete();
+      }
+    }
+
+    System.err.printf("LSM COMPACTED %d tables (%d entries) into %d keys in %.3f s%n",
+            toCompact.size(), maxEntries, merged.numEntries(),
+            (System.nanoTime() - start) / 1e9);
+  }
+
+  /**
+   * Schedules the expiry of an object, replacing any expiry it had.
+   *
+   * @param key the key of the object
+   * @param expiresAt the time the object expires, in milliseconds since the epoch
+   */
+  private void scheduleExpiry(Key key, long expiresAt) {
+    TimerWheel.Timer<Key> old = this.expiryTimers.put(key,
+            this.expiryWheel.schedule(key, expiresAt));
+    if (old != null) {
+      this.expiryWheel.cancel(old);
+    }
+  }
+
+  /**
+   * Advances the expiry wheel every tick and prints how many objects expired every
+   * EXPIRY_REPORT_INTERVAL_MS, if any did.
+   */
+  private void runExpiry() {
+    long reportStart = System.currentTimeMillis();
+    long numExpired = 0;
+
+    while (true) {
+      try {
+        Thread.sleep(EXPIRY_TICK_MS);
+      } catch (InterruptedException e) {
+        return;
+      }
+
+      try {
+        numExpired += expireDue();
+      } catch (RuntimeException e) {
+        System.err.println("LSM expiry error: " + e.getMessage());
+      }
+
+      long now = System.currentTimeMillis();
+      if (now - reportStart >= EXPIRY_REPORT_INTERVAL_MS) {
+        if (numExpired > 0) {
+          int pending;
+          synchronized (this) {
+            pending = this.expiryWheel.size();
+          }
+          System.err.printf("LSM EXPIRED %d objects in %.1f s, %d pending%n", numExpired,
+                  (now - reportStart) / 1000.0, pending);
+        }
+        reportStart = now;
+        numExpired = 0;
+      }
+    }
+  }
+
+  /**
+   * Writes tombstones for the objects that have expired by now and clears their expiry times.
+   *
+   * @return the number of objects that expired
+   */
+  private synchronized int expireDue() {
+    List<Key> expired = this.expiryWheel.advance(System.currentTimeMillis());
+    if (expired.isEmpty()) {
+      return 0;
+    }
+
+    Map<Key, Long> cleared = new LinkedHashMap<>();
+    for (Key key : expired) {
+      this.expiryTimers.remove(key);
+      cleared.put(key, 0L);
+    }
+    tombstone(expired);
+    appendExpiries(cleared);
+    return expired.size();
+  }
+
+  /**
+   * Appends expiry times to the expiry log and syncs it, then rewrites the log if cleared times
+   * make up most of it.
+   *
+   * @param expiries the keys of the objects, mapped to the times they expire, or 0 for none
+   */
+  private void appendExpiries(Map<Key, Long> expiries) {
+    if (expiries.isEmpty()) {
+      return;
+    }
+
+    try {
+      for (Map.Entry<Key, Long> expiry : expiries.entrySet()) {
+        this.expiryLog.writeInt(expiry.getKey().objectNum());
+        this.expiryLog.writeInt(expiry.getKey().clientNum());
+        this.expiryLog.writeLong(expiry.getValue());
+      }
+      this.expiryLog.flush();
+      this.expiryFile.getFD().sync();
+      this.numExpiryRecords += expiries.size();
+
+      if (this.numExpiryRecords > Math.max(MIN_EXPIRY_RECORDS, 2L * this.expiryTimers.size())) {
+        rewriteExpiries();
+      }
+    } catch (IOException e) {
+      throw new RuntimeException("Object store error: " + e.getMessage());
+    }
+  }
+
+  /**
+   * Replaces the expiry log with one holding only the pending expiries, and reopens it for
+   * appending.
+   *
+   * @throws IOException if the log cannot be written
+   */
+  private void rewriteExpiries() throws IOException {
+    if (this.expiryLog != null) {
+      this.expiryLog.close();
+    }
+
+    Path tmpPath = this.dir.resolve(EXPIRIES + ".tmp");
+    try (FileOutputStream fileOut = new FileOutputStream(tmpPath.toFile());
+         DataOutputStream out = new DataOutputStream(new BufferedOutputStream(fileOut))) {
+      for (TimerWheel.Timer<Key> timer : this.expiryTimers.values()) {
+        out.writeInt(timer.item().objectNum());
+        out.writeInt(timer.item().clientNum());
+        out.writeLong(timer.expiresAt());
+      }
+      out.flush();
+      fileOut.getFD().sync();
+    }
+    Files.move(tmpPath, this.dir.resolve(EXPIRIES), StandardCopyOption.ATOMIC_MOVE);
+
+    this.numExpiryRecords = this.expiryTimers.size();
+    this.expiryFile = new FileOutputStream(this.dir.resolve(EXPIRIES).toFile(), true);
+    this.expiryLog = new DataOutputStream(new BufferedOutputStream(this.expiryFile));
+  }
+
+  /**
+   * Recovers the pending expiries from the expiry log, in which the last time written for an
+   * object holds and 0 means none. Objects whose time passed while the store was closed are
+   * removed, and the log is rewritten with the rest.
+   *
+   * @throws IOException if the log cannot be read or rewritten
+   */
+  private synchronized void recoverExpiries() throws IOException {
+    Map<Key, Long> expiries = new HashMap<>();
+    Path path = this.dir.resolve(EXPIRIES);
+    if (Files.exists(path)) {
+      try (DataInputStream in = new DataInputStream(new BufferedInputStream(
+              new FileInputStream(path.toFile())))) {
+        while (true) {
+          Key key = new Key(in.readInt(), in.readInt());
+          expiries.put(key, in.readLong());
+        }
+      } catch (EOFException e) {
+        // a record cut short by a crash ends the log
+      }
+    }
+
+    long now = System.currentTimeMillis();
+    List<Key> expired = new ArrayList<>();
+    for (Map.Entry<Key, Long> expiry : expiries.entrySet()) {
+      if (expiry.getValue() == 0 || !isLive(expiry.getKey())) {
+        continue;
+      }
+      if (expiry.getValue() <= now) {
+        expired.add(expiry.getKey());
+      } else {
+        scheduleExpiry(expiry.getKey(), expiry.getValue());
+      }
+    }
+    tombstone(expired);
+    rewriteExpiries();
+  }
+
+  /**
+   * Recovers the store from its directory: opens the tables listed in the manifest, deletes files
+   * left behind by an interrupted flush or compaction, replays the logs of memtables that were not
+   * flushed, rebuilds the Merkle tree and reschedules the pending expiries.
+   *
+   * @throws IOException if the store cannot be read
+   */
+  private void recover() throws IOException {
+    Path manifest = this.dir.resolve(MANIFEST);
+    List<Long> tableNums = new ArrayList<>();
+    if (Files.exists(manifest)) {
+      for (String line : Files.readAllLines(manifest)) {
+        if (!line.isBlank()) {
+          tableNums.add(Long.parseLong(line.trim()));
+        }
+      }
+    }
+    for (long tableNum : tableNums) {
+      this.tables.add(SSTable.open(tablePath(tableNum)));
+    }
+
+    List<Long> logNums = new ArrayList<>();
+    try (Stream<Path> files = Files.list(this.dir)) {
+      for (Path file : files.toList()) {
+        String name = file.getFileName().toString();
+        long num = name.matches("\\d+\\..*") ? Long.parseLong(name.split("\\.")[0]) : -1;
+        this.nextFileNum = Math.max(this.nextFileNum, num + 1);
+        if (name.equals(MANIFEST) || name.equals(EXPIRIES)
+                || (name.endsWith(TABLE_SUFFIX) && tableNums.contains(num))) {
+          continue;
+        }
+        if (name.endsWith(LOG_SUFFIX) && !tableNums.contains(num)) {
+          logNums.add(num);
+        } else {
+          Files.delete(file);
+        }
+      }
+    }
+    logNums.sort(null);
+    for (long logNum : logNums) {
+      this.frozenMemtables.addFirst(new Memtable(logNum, replayLog(logPath(logNum)),
+              new HashMap<>()));
+    }
+    startMemtable();
+
+    forEachLive(FIRST_KEY, key -> {
+      this.merkleTree.add(key.toString());
+      this.numObjects++;
+      return true;
+    });
+    recoverExpiries();
+  }
+
+  /**
+   * Reads the entries of a write-ahead log. A record cut short by a crash ends the log.
+   *
+   * @param path the path of the log
+   * @return the entries of the log
+   * @throws IOException if the log cannot be read
+   */
+  private static ConcurrentSkipListMap<Key, Boolean> replayLog(Path path) throws IOException {
+    ConcurrentSkipListMap<Key, Boolean> entries = new ConcurrentSkipListMap<>();
+    try (DataInputStream in = new DataInputStream(new BufferedInputStream(
+            new FileInputStream(path.toFile())))) {
+      while (true) {
+        boolean live = in.readBoolean();
+        entries.put(new Key(in.readInt(), in.readInt()), live);
+      }
+    } catch (EOFException e) {
+      return entries;
+    }
+  }
+
+  /**
+   * Starts a new, empty memtable with its own write-ahead log.
+   *
+   * @throws IOException if the log cannot be created
+   */
+  private void startMemtable() throws IOException {
+    this.memtable = new Memtable(this.nextFileNum++, new ConcurrentSkipListMap<>(),
+            new HashMap<>());
+    this.logFile = new FileOutputStream(logPath(this.memtable.fileNum()).toFile());
+    this.log = new DataOutputStream(new BufferedOutputStream(this.logFile));
+  }
+
+  /**
+   * Replaces the manifest with one listing the current tables, newest first.
+   *
+   * @throws IOException if the manifest cannot be written
+   */
+  private void writeManifest() throws IOException {
+    writeManifest(this.dir, this.tables);
+  }
+
+  /**
+   * Replaces the manifest of a store with one listing the given tables.
+   *
+   * @param dir the directory of the store
+   * @param tables the tables, newest first
+   * @throws IOException if the manifest cannot be written
+   */
+  private static void writeManifest(Path dir, List<SSTable> tables) throws IOException {
+    List<String> lines = new ArrayList<>();
+    for (SSTable table : tables) {
+      lines.add(table.path().getFileName().toString().split("\\.")[0]);
+    }
+    Path tmpPath = dir.resolve(MANIFEST + ".tmp");
+    Files.write(tmpPath, lines);
+    Files.move(tmpPath, dir.resolve(MANIFEST), StandardCopyOption.ATOMIC_MOVE);
+  }
+
+  /**
+   * Returns the directory of the store that belongs to an object file.
+   *
+   * @param objFile the path of the object file
+   * @return the path of the directory
+   */
+  private static Path storeDir(Path objFile) {
+    return objFile.resolveSibling(objFile.getFileName() + ".lsm");
+  }
+
+  /**
+   * Returns the path of a write-ahead log.
+   *
+   * @param fileNum the number of the log
+   * @return the path of the log
+   */
+  private Path logPath(long fileNum) {
+    return this.dir.resolve(String.format("%06d%s", fileNum, LOG_SUFFIX));
+  }
+
+  /**
+   * Returns the path of a table.
+   *
+   * @param fileNum the number of the table
+   * @return the path of the table
+   */
+  private Path tablePath(long fileNum) {
+    return this.dir.resolve(String.format("%06d%s", fileNum, TABLE_SUFFIX));
+  }
+}
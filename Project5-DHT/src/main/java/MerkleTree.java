@@ -0,0 +1,125 @@
+package main.java;
+
+import java.util.Arrays;
+
+/**
+ * A Merkle tree over a set of keys. Keys are spread over a fixed number of leaves by their hash,
+ * and each leaf holds the XOR of the hashes of its keys, so adding or removing a key only touches
+ * one leaf and the nodes on its path to the root. An inner node's hash combines the hashes of its
+ * two children, and an empty subtree hashes to 0. Two trees over the same set of keys are
+ * identical, so comparing them top-down narrows any difference down to the leaves whose keys
+ * differ.
+ *
+ * <p>The nodes are numbered like a binary heap: the root is node 1, the children of node i are
+ * nodes 2i and 2i + 1, and the leaves are the last numLeaves nodes.
+ */
+public final class MerkleTree {
+  private final int depth;
+  private final int numLeaves;
+  private final long[] nodes;
+
+  /**
+   * Constructs a new, empty Merkle tree.
+   *
+   * @param depth the number of levels below the root, so the tree has 2^depth leaves
+   * @throws IllegalArgumentException if the depth is not between 0 and 24
+   */
+  public MerkleTree(int depth) throws IllegalArgumentException {
+    if (depth < 0 || depth > 24) {
+      throw new IllegalArgumentException("Merkle tree error: invalid depth");
+    }
+
+    this.depth = depth;
+    this.numLeaves = 1 << depth;
+    this.nodes = new long[2 * this.numLeaves];
+  }
+
+  /**
+   * Adds a key to the tree. The key must not be in the tree already.
+   *
+   * @param key the key
+   */
+  public void add(String key) {
+    toggle(key);
+  }
+
+  /**
+   * Removes a key from the tree. The key must be in the tree.
+   *
+   * @param key the key
+   */
+  public void remove(String key) {
+    toggle(key);
+  }
+
+  /**
+   * Removes every key from the tree.
+   */
+  public void clear() {
+    Arrays.fill(this.nodes, 0L);
+  }
+
+  /**
+   * Returns the hash of a node.
+   *
+   * @param node the number of the node
+   * @return the hash of the node
+   */
+  public long hash(int node) {
+    return this.nodes[node];
+  }
+
+  /**
+   * Checks whether a node is a leaf.
+   *
+   * @param node the number of the node
+   * @return true if the node is a leaf, false otherwise
+   */
+  public boolean isLeaf(int node) {
+    return node >= this.numLeaves;
+  }
+
+  /**
+   * Returns the leaf node a key belongs to.
+   *
+   * @param key the key
+   * @return the number of the leaf node
+   */
+  public int leafOf(String key) {
+    if (this.depth == 0) {
+      return 1;
+    }
+    return this.numLeaves + (int) (Utils.hash64(key) >>> (64 - this.depth));
+  }
+
+  /**
+   * Flips a key's hash into its leaf and updates the path from that leaf to the root.
+   *
+   * @param key the key
+   */
+  private void toggle(String key) {
+    int node = leafOf(key);
+    this.nodes[node] ^= Utils.hash64(key);
+
+    for (node /= 2; node >= 1; node /= 2) {
+      long left = this.nodes[2 * node];
+      long right = this.nodes[2 * node + 1];
+      this.nodes[node] = (left == 0 && right == 0) ? 0 : combine(left, right);
+    }
+  }
+
+  /**
+   * Combines the hashes of two children into the hash of their parent.
+   *
+   * @param left the hash of the left child
+   * @param right the hash of the right child
+   * @return the hash of the parent
+   */
+  private static long combine(long left, long right) {
+    long hash = left * 0x9e3779b97f4a7c15L + Long.rotateLeft(right, 31);
+    hash ^= hash >>> 33;
+    hash *= 0xc4ceb9fe1a85ec53L;
+    hash ^= hash >>> 33;
+    return hash;
+  }
+}
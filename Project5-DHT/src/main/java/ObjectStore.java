@@ -0,0 +1,251 @@
+package main.java;
+
+import java.io.DataInputStream;
+import java.io.IOException;
+import java.util.Collection;
+import java.util.List;
+import java.util.Map;
+import java.util.Set;
+
+/**
+ * The object store of a peer. An object is identified by its key, "client_id::object_id", and is
+ * stored at most once. Every store keeps a Merkle tree of the same depth over its objects, so that
+ * two stores can find the objects they disagree on without comparing every object, and can list
+ * its objects in key order for range scans.
+ */
+public interface ObjectStore {
+  int MERKLE_DEPTH = 16;
+
+  /**
+   * The key of a stored object. Keys are ordered by object ID and then by client ID.
+   *
+   * @param objectNum the numeric ID of the object
+   * @param clientNum the numeric ID of the client that owns the object
+   */
+  record Key(int objectNum, int clientNum) implements Comparable<Key> {
+    /**
+     * Parses a key in the "client_id::object_id" form used by the object file.
+     *
+     * @param key the key as a string
+     * @return the parsed key
+     */
+    public static Key parse(String key) {
+      String[] parts = key.split("::");
+      return new Key(Utils.extractIdNum(parts[1]), Integer.parseInt(parts[0].trim()));
+    }
+
+    @Override
+    public int compareTo(Key other) {
+      int cmp = Integer.compare(this.objectNum, other.objectNum);
+      return (cmp != 0) ? cmp : Integer.compare(this.clientNum, other.clientNum);
+    }
+
+    @Override
+    public String toString() {
+      return toKey(this.clientNum, String.valueOf(this.objectNum));
+    }
+  }
+
+  /**
+   * The size of a stored value.
+   *
+   * @param rawBytes the length of the value
+   * @param storedBytes the number of bytes the value takes on disk
+   */
+  record ValueSize(long rawBytes, long storedBytes) {
+  }
+
+  /**
+   * Opens the object store of the given kind.
+   *
+   * @param kind the kind of store, "file" or "lsm"
+   * @param objFilePath path to the object file; an LSM store keeps its files in a directory next
+   *                    to it and imports the object file the first time it is opened
+   * @return the object store
+   * @throws IllegalArgumentException if the kind of store is unknown
+   */
+  static ObjectStore open(String kind, String objFilePath) throws IllegalArgumentException {
+    return switch (kind) {
+      case "file" -> new FileObjectStore(objFilePath);
+      case "lsm" -> new LsmObjectStore(objFilePath);
+      default -> throw new IllegalArgumentException("Object store error: unknown store " + kind);
+    };
+  }
+
+  /**
+   * Stores an object.
+   *
+   * @param clientNum the numeric ID of the client that owns the object
+   * @param objId the ID of the object
+   */
+  void store(int clientNum, String objId);
+
+  /**
+   * Stores a batch of objects, given by their keys. Objects that are already stored are skipped.
+   *
+   * @param keys the keys of the objects
+   */
+  void storeAll(Collection<String> keys);
+
+  /**
+   * Stores a batch of objects that expire at the given times. An object that is already stored
+   * expires at its new time instead. Expired objects are removed in the background.
+   *
+   * @param expiries the keys of the objects, mapped to the times they expire, in milliseconds since
+   *                 the epoch
+   * @throws UnsupportedOperationException if objects cannot expire in this store
+   */
+  default void storeAllExpiring(Map<String, Long> expiries) throws UnsupportedOperationException {
+    throw new UnsupportedOperationException("Object store error: objects cannot expire in store");
+  }
+
+  /**
+   * Returns the expiry times of those of the given objects that expire.
+   *
+   * @param keys the keys of the objects
+   * @return the keys of the objects that expire, mapped to the times they expire, in milliseconds
+   *         since the epoch; empty if objects cannot expire in this store
+   */
+  default Map<String, Long> expiriesOf(Collection<String> keys) {
+    return Map.of();
+  }
+
+  /**
+   * Checks whether this store can hold values.
+   *
+   * @return true if {@link #storeValue} and {@link #openValue} are supported, false otherwise
+   */
+  default boolean holdsValues() {
+    return false;
+  }
+
+  /**
+   * Stores an object along with its value, which is read as a stream of blocks in the format of
+   * {@link BlockCodec} up to the end marker. A value the object already had is replaced once the
+   * new one has been read in full.
+   *
+   * @param key the key of the object
+   * @param in the input to read the blocks from
+   * @param compress whether to compress the blocks on disk
+   * @return the size of the value
+   * @throws IOException if the value cannot be read or written
+   * @throws UnsupportedOperationException if this store cannot hold values
+   */
+  default ValueSize storeValue(String key, DataInputStream in, boolean compress)
+          throws IOException, UnsupportedOperationException {
+    throw new UnsupportedOperationException("Object store error: values cannot be stored in store");
+  }
+
+  /**
+   * Opens the value of an object for reading. The value is read as a stream of blocks in the
+   * format of {@link BlockCodec} up to the end marker.
+   *
+   * @param key the key of the object
+   * @return the input to read the blocks from, which the caller must close, or null if the object
+   *         has no value
+   * @throws IOException if the value cannot be opened
+   */
+  default DataInputStream openValue(String key) throws IOException {
+    return null;
+  }
+
+  /**
+   * Returns the keys of the stored objects whose object ID falls in the ring range (start, end].
+   *
+   * @param start the exclusive start of the range
+   * @param end the inclusive end of the range
+   * @return the keys of the objects in the range
+   */
+  List<String> keysInRange(int start, int end);
+
+  /**
+   * Scans the stored objects in key order, starting right after a given key.
+   *
+   * @param after the key to start after
+   * @param lastObjectNum the highest object ID to include
+   * @param clientNum the numeric ID of the only client whose objects to include, or null to
+   *                  include the objects of every client
+   * @param limit the maximum number of keys to return
+   * @return the keys of the objects found, in key order
+   */
+  List<Key> scan(Key after, int lastObjectNum, Integer clientNum, int limit);
+
+  /**
+   * Removes objects, given by their keys.
+   *
+   * @param keys the keys of the objects
+   */
+  void removeAll(Collection<String> keys);
+
+  /**
+   * Removes every object.
+   */
+  void clear();
+
+  /**
+   * Returns the hash of a node of the store's Merkle tree.
+   *
+   * @param node the number of the node, see {@link MerkleTree}
+   * @return the hash of the node
+   */
+  long merkleHash(int node);
+
+  /**
+   * Checks whether a node of the store's Merkle tree is a leaf.
+   *
+   * @param node the number of the node, see {@link MerkleTree}
+   * @return true if the node is a leaf, false otherwise
+   */
+  boolean isMerkleLeaf(int node);
+
+  /**
+   * Returns the keys of the stored objects that belong to the given leaves of the store's Merkle
+   * tree.
+   *
+   * @param leaves the numbers of the leaf nodes
+   * @return the keys of the objects in those leaves
+   */
+  List<String> keysInMerkleLeaves(Set<Integer> leaves);
+
+  /**
+   * Checks whether an object is stored.
+   *
+   * @param clientNum the numeric ID of the client that owns the object
+   * @param objId the ID of the object
+   * @return true if the object is stored, false otherwise
+   */
+  boolean contains(int clientNum, String objId);
+
+  /**
+   * Checks which of a batch of objects are stored.
+   *
+   * @param keys the keys of the objects
+   * @return whether each object is stored, in the order of the keys
+   */
+  boolean[] containsAll(List<String> keys);
+
+  /**
+   * Returns the number of stored objects.
+   *
+   * @return the number of objects
+   */
+  long size();
+
+  /**
+   * Describes the contents of the store for printing.
+   *
+   * @return a printable description of the stored objects
+   */
+  String dump();
+
+  /**
+   * Builds the key under which an object is stored.
+   *
+   * @param clientNum the numeric ID of the client that owns the object
+   * @param objId the ID of the object
+   * @return the key of the object
+   */
+  static String toKey(int clientNum, String objId) {
+    return clientNum + "::" + objId;
+  }
+}
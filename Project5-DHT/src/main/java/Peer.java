@@ -1,37 +1,113 @@
 package main.java;
 
-import java.io.BufferedReader;
-import java.io.BufferedWriter;
+import java.io.BufferedInputStream;
+import java.io.BufferedOutputStream;
 import java.io.DataInputStream;
 import java.io.DataOutputStream;
-import java.io.FileReader;
-import java.io.FileWriter;
 import java.io.IOException;
 import java.net.InetAddress;
 import java.net.ServerSocket;
 import java.net.Socket;
 import java.net.UnknownHostException;
-import java.nio.file.Files;
-import java.nio.file.Paths;
+import java.util.ArrayList;
+import java.util.Comparator;
+import java.util.HashMap;
+import java.util.HashSet;
 import java.util.LinkedHashMap;
 import java.util.List;
 import java.util.Map;
+import java.util.Set;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.concurrent.atomic.AtomicReference;
 
 /**
  * Represents a peer in a ring. Each peer maintains a predecessor and successor peer in the ring,
- * and a file with stored objects. Each peer starts by contacting the bootstrap server, which will
- * tell each peer their place in the ring. As new peers join, the boostrap server may inform the
- * peers to update their predecessor and successor. Peers may get a request to store or retrieve
- * an object in or from the object file. If the object to be stored or retrieved does not belong
- * to the peer, the peer will forward the request to its successor in the ring.
+ * and an object store backed by a file. Each peer starts by contacting the bootstrap server, which
+ * will tell each peer their place in the ring. As new peers join, the boostrap server may inform
+ * the peers to update their predecessor and successor. Peers may get a request to store or
+ * retrieve an object in or from the object store. If the object to be stored or retrieved does not
+ * belong to the peer, the peer will forward the request to its successor in the ring. The peer
+ * that owns the object reports back to the client directly when the request says where to reply,
+ * and through the bootstrap server otherwise. When a peer joins, its successor streams the objects
+ * that now belong to the new peer over to it, and a peer that shuts down streams all of its objects
+ * to its successor before leaving the ring. The sending peer keeps answering reads for the objects
+ * being moved until the transfer is complete. Every object stored on a peer is replicated to its
+ * successor, and each peer periodically compares the Merkle tree of its objects with the one of the
+ * replicas on its successor, so that only the objects on which they disagree are exchanged. A
+ * peer's own objects are authoritative: the successor adds the replicas it lacks and drops the
+ * ones the peer no longer has, and a peer that moves objects away has their replicas dropped too.
+ *
+ * <p>A peer can also track which of its objects are read the most. When an object turns hot, the
+ * peer pushes the result of looking it up to the bootstrap server and to one or more of its
+ * predecessors, more of them the hotter the object is, so that requests walking the ring towards
+ * the object are answered before they reach it. The cached lookups hold for a short lease and are
+ * invalidated when the object is stored.
+ *
+ * <p>Each peer owns the range of the ring between its predecessor's position (exclusive) and its
+ * own (inclusive). A peer starts at the position given by the numeric part of its ID, but the
+ * bootstrap server may move it to balance the load, in which case the objects that change hands
+ * are streamed between the two neighbors at a limited rate. To that end every peer periodically
+ * reports how many objects it holds and how many requests it serves to the bootstrap server.
+ *
+ * <p>A store request may carry a time to live in seconds, after which the object expires. The
+ * expiry time travels with the object's replica, so both copies expire together, and with the
+ * object itself when it moves to another peer.
+ *
+ * <p>Objects may carry a binary value. Values are stored and retrieved straight from the owning
+ * peer over a single connection, streamed in blocks that are optionally compressed, both on the
+ * wire and on disk; see {@link BlockCodec}. A value is replicated along with its object and moves
+ * with it when the ring changes.
+ *
+ * <p>Lookups are recursive by default: a request is forwarded from successor to successor until it
+ * reaches the owner. A client may instead look an object up iteratively, asking each peer in turn
+ * for the next hop and contacting it itself. For experiments, a peer can delay every lookup message
+ * it handles, which stands in for the latency of a hop across a wide-area network.
  */
 public final class Peer {
+  private static final int MIGRATION_BATCH_SIZE = 4096;
+  private static final long ANTI_ENTROPY_INTERVAL_MS = 10000;
+  private static final long HOT_KEY_WINDOW_MS = 10000;
+  private static final int HOT_KEY_WINDOW_SLICES = 5;
+  private static final int HOT_KEY_THRESHOLD = 100;
+  private static final long HOT_KEY_LEASE_MS = 5000;
+  private static final int MAX_HOT_KEY_FANOUT = 3;
+  private static final long LOAD_REPORT_INTERVAL_MS = 5000;
+  private static final int REBALANCE_MIGRATION_RATE = 2000; // keys per second
+  private static final long MIGRATION_TIMEOUT_MS = 10000;
+  private static final Set<String> LOOKUP_OPERATIONS = Set.of("STORE", "RETRIEVE", "NEXT_HOP");
+
   private final String peerId;
   private final String bootstrapServerName;
-  private final String objFilePath;
+  private final ObjectStore objectStore;
+  private final ObjectStore replicaStore;
   private final int delay;
+  private final HotKeyTracker hotKeyTracker;
+  private final HotKeyCache hotKeyCache = new HotKeyCache();
+  private final Map<String, Long> promotedHotKeys = new ConcurrentHashMap<>();
+  private final AtomicLong numRequests = new AtomicLong();
+  private final boolean compressValues;
+  private final int hopDelayMs;
+  private final boolean leaveOnStop;
+  private volatile boolean leaving;
+  private final AtomicLong valueRawBytes = new AtomicLong();
+  private final AtomicLong valueStoredBytes = new AtomicLong();
   private String predecessorId;
   private String successorId;
+  private volatile int token;
+  private volatile int predecessorToken;
+  private final AtomicReference<Migration> migration = new AtomicReference<>();
+
+  /**
+   * A transfer of objects to this peer, during which reads for objects this peer does not have yet
+   * are passed back to the sending peer.
+   *
+   * @param sourceId the ID of the peer sending the objects
+   * @param deadline the time after which the transfer is given up on, in milliseconds since the
+   *                 epoch, pushed back each time an object arrives
+   */
+  private record Migration(String sourceId, long deadline) {
+  }
 
   /**
    * Constructs a new Peer object. Each peer has its unique ID, a predecessor, and successor.
@@ -39,15 +115,31 @@ public final class Peer {
    * @param peerId the unique ID of the peer
    * @param bootstrapServerName the hostname of the bootstrap server
    * @param objFilePath path to a file containing the object store of the peer
+   * @param storeKind the kind of object store, "file" or "lsm"
    * @param delay the number of seconds to wait before joining after startup
+   * @param trackHotKeys whether to track hot objects and have them cached closer to the clients
+   * @param compressValues whether to compress the values of objects on disk
+   * @param hopDelayMs the number of milliseconds to wait before handling each lookup message
+   * @param leaveOnStop whether to hand the objects to the successor and leave the ring when the
+   *                    peer is stopped, instead of keeping them for a restart
    */
-  public Peer(String peerId, String bootstrapServerName, String objFilePath, int delay) {
+  public Peer(String peerId, String bootstrapServerName, String objFilePath, String storeKind,
+              int delay, boolean trackHotKeys, boolean compressValues, int hopDelayMs,
+              boolean leaveOnStop) {
     this.peerId = peerId;
     this.bootstrapServerName = bootstrapServerName;
-    this.objFilePath = objFilePath;
+    this.objectStore = ObjectStore.open(storeKind, objFilePath);
+    this.replicaStore = ObjectStore.open(storeKind, objFilePath + ".replica");
     this.delay = delay;
+    this.hotKeyTracker = trackHotKeys
+            ? new HotKeyTracker(HOT_KEY_WINDOW_MS, HOT_KEY_WINDOW_SLICES) : null;
+    this.compressValues = compressValues;
+    this.hopDelayMs = hopDelayMs;
+    this.leaveOnStop = leaveOnStop;
     this.predecessorId = null;
     this.successorId = null;
+    this.token = Utils.extractIdNum(peerId);
+    this.predecessorToken = this.token;
   }
 
   /**
@@ -61,6 +153,11 @@ public final class Peer {
     }
 
     joinRing();
+    if (this.leaveOnStop) {
+      Runtime.getRuntime().addShutdownHook(new Thread(this::leaveRing));
+    }
+    new Thread(this::runAntiEntropy).start();
+    new Thread(this::runLoadReports).start();
 
     try (ServerSocket socket = new ServerSocket(Utils.PORT)) {
       while (true) {
@@ -90,6 +187,40 @@ public final class Peer {
     }
   }
 
+  /**
+   * Hands this peer's objects over to its successor and tells the bootstrap server that this peer
+   * is leaving the ring. Runs when a peer started with -l shuts down. If the handoff fails, the
+   * objects are kept here, where a restart of the peer finds them, and the peer leaves anyway.
+   */
+  private void leaveRing() {
+    this.leaving = true;
+    String succ = this.successorId;
+    if (succ == null || succ.equals(this.peerId)) {
+      return;
+    }
+
+    int selfToken = this.token;
+    try {
+      migrateRange(succ, selfToken, selfToken, 0);
+    } catch (RuntimeException e) {
+      System.err.println("LEAVE without handing off to " + succ + ", objects kept: "
+              + e.getMessage());
+    }
+
+    try (
+            Socket bootstrapSocket = new Socket(bootstrapServerName, Utils.PORT);
+            DataOutputStream out = new DataOutputStream(bootstrapSocket.getOutputStream())
+    ) {
+      String msg = Utils.prepareMsg(new LinkedHashMap<>() {{
+        put("peer_id", peerId);
+        put("operation_type", "LEAVE");
+      }});
+      out.writeUTF(msg);
+    } catch (IOException e) {
+      throw new RuntimeException("Peer error: " + e.getMessage());
+    }
+  }
+
   /**
    * Handles each connection with the bootstrap server. It reads the message from the bootstrap
    * server and leaves it to another helper method to handle the message.
@@ -99,9 +230,10 @@ public final class Peer {
   private void handleConnection(Socket bootstrapSocket) {
     try (
             DataInputStream in = new DataInputStream(bootstrapSocket.getInputStream());
+            DataOutputStream out = new DataOutputStream(bootstrapSocket.getOutputStream())
     ) {
       String msg = in.readUTF();
-      handleMessage(msg);
+      handleMessage(msg, in, out);
     } catch (IOException e) {
       throw new RuntimeException("Peer error: " + e.getMessage());
     }
@@ -111,13 +243,38 @@ public final class Peer {
    * Handles a message received from the bootstrap server appropriately depending on its contents.
    *
    * @param msg the message received from the bootstrap server
+   * @param in the input stream of the connection the message came from, for messages followed by
+   *           a stream of data
+   * @param out the output stream of the connection the message came from, for replies that are
+   *            sent back on the same connection
+   * @throws IOException if the rest of the connection cannot be read or written
    */
-  private void handleMessage(String msg) {
+  private void handleMessage(String msg, DataInputStream in, DataOutputStream out)
+          throws IOException {
     Map<String, String> msgRec = Utils.unpackMsg(msg);
+    if (this.hopDelayMs > 0 && LOOKUP_OPERATIONS.contains(msgRec.get("operation_type"))) {
+      try {
+        Thread.sleep(this.hopDelayMs);
+      } catch (InterruptedException e) {
+        throw new RuntimeException("Peer error: " + e.getMessage());
+      }
+    }
 
     switch (msgRec.get("operation_type")) {
+      case "MIGRATE" -> receiveMigration(msgRec, in, out);
+      case "STORE_BATCH", "RETRIEVE_BATCH" -> handleBatch(msgRec, in, out);
+      case "SCAN" -> handleScan(msgRec, out);
+      case "PUT_VALUE", "GET_VALUE" -> handleValue(msgRec, in, out);
+      case "NEXT_HOP" -> answerNextHop(msgRec, out);
+      case "CACHE_HOT_KEY", "INVALIDATE_HOT_KEY" -> handleHotKeyUpdate(msgRec);
+      case "REPLICATE" -> receiveReplicas(msgRec, in);
+      case "REPLICATE_VALUE" -> receiveReplicaValue(in);
+      case "DROP_REPLICAS" -> dropReplicas(in);
+      case "SYNC" -> serveReplicaSync(in, out);
       case "REASSIGN_PREDECESSOR" -> reassignPredecessor(msgRec);
       case "REASSIGN_SUCCESSOR" -> reassignSuccessor(msgRec);
+      case "REASSIGN_TOKEN" -> reassignToken(msgRec);
+      case "SPLIT_POINT" -> findSplitPoint(msgRec, out);
       case "NEW_PEER_JOINED" -> printPredAndSucc();
       case "STORE" -> storeObject(msg);
       case "RETRIEVE" -> retrieveObject(msg);
@@ -126,16 +283,138 @@ public final class Peer {
   }
 
   /**
-   * Reassigns the predecessor of the peer based on the message received from the bootstrap server
-   * and notifies the bootstrap server.
+   * Reassigns the predecessor of the peer, or the predecessor's position on the ring, based on the
+   * message received from the bootstrap server and notifies the bootstrap server, unless the
+   * message is part of a rebalancing.
    *
    * @param msg the message received from the bootstrap server
    */
   private void reassignPredecessor(Map<String, String> msg) {
-    this.predecessorId = msg.get("new_id");
+    String oldPredId = this.predecessorId;
+    int oldPredToken = this.predecessorToken;
+    String newPredId = msg.get("new_id");
+    int newPredToken = Integer.parseInt(msg.get("new_token"));
+    boolean rebalance = msg.containsKey("rebalance");
+    this.predecessorId = newPredId;
+    this.predecessorToken = newPredToken;
+
+    // the replicas held here belonged to the old predecessor; anti-entropy refills them. On the
+    // first assignment there is no old predecessor, and anti-entropy drops whatever replicas a
+    // previous run left behind that the new one does not have
+    if (oldPredId != null && !newPredId.equals(oldPredId)) {
+      this.replicaStore.clear();
+    }
+
+    if (!rebalance) {
+      String newMsg = Utils.prepareMsg(new LinkedHashMap<>() {{
+        put("peer_id", peerId);
+        put("operation_type", "PRED_ASSIGNED");
+      }});
+
+      try (
+              Socket bootstrapSocket = new Socket(this.bootstrapServerName, Utils.PORT);
+              DataOutputStream out = new DataOutputStream(bootstrapSocket.getOutputStream())
+      ) {
+        out.writeUTF(newMsg);
+      } catch (IOException e) {
+        throw new RuntimeException("Peer error: " + e.getMessage());
+      }
+    }
+
+    // a predecessor now inside the old range is a peer that just joined and took part of it, or
+    // a neighbor that was moved up to take some of the load off this peer
+    if (oldPredId != null && !newPredId.equals(this.peerId) && newPredToken != oldPredToken
+            && Utils.inRange(newPredToken, oldPredToken, this.token)) {
+      int rate = rebalance ? REBALANCE_MIGRATION_RATE : 0;
+      new Thread(() -> migrateRange(newPredId, oldPredToken, newPredToken, rate)).start();
+    }
+  }
+
+  /**
+   * Moves this peer to a new position on the ring, as told by the bootstrap server when it
+   * rebalances the ring. A peer moved back hands the objects between its new and its old position
+   * to its successor, at a limited rate; a peer moved forward gets the objects it takes over from
+   * its successor, which is told about the move separately. A joining peer is also moved, before
+   * it has any neighbors, when another peer already holds the position of its numeric ID.
+   *
+   * @param msg the message received from the bootstrap server
+   */
+  private void reassignToken(Map<String, String> msg) {
+    int oldToken = this.token;
+    int newToken = Integer.parseInt(msg.get("new_token"));
+    this.token = newToken;
+    if (this.predecessorId == null) {
+      // joining at another position than asked for; the peer owns the whole ring until it is
+      // given a predecessor
+      this.predecessorToken = newToken;
+    }
+    System.err.println("MOVED from " + oldToken + " to " + newToken);
+
+    String succ = this.successorId;
+    if (succ != null && !succ.equals(this.peerId) && newToken != oldToken
+            && Utils.inRange(newToken, this.predecessorToken, oldToken)) {
+      new Thread(() -> migrateRange(succ, newToken, oldToken, REBALANCE_MIGRATION_RATE)).start();
+    }
+  }
+
+  /**
+   * Finds where to split this peer's range so that a given fraction of its objects goes to one of
+   * its neighbors, and replies on the same connection. The split point is the position after
+   * which the objects are kept when shedding the low end of the range to the predecessor, and the
+   * position after which the objects are given away when shedding the high end to the successor.
+   * The reply has no split point if the range cannot be split that way.
+   *
+   * @param msg the request received from the bootstrap server
+   * @param out the output stream used to send back the split point
+   * @throws IOException if the reply cannot be sent
+   */
+  private void findSplitPoint(Map<String, String> msg, DataOutputStream out) throws IOException {
+    double fraction = Double.parseDouble(msg.get("fraction"));
+    boolean low = msg.get("side").equals("low");
+    int start = this.predecessorToken;
+    int end = this.token;
+
+    // positions of the objects in ring order, starting right after the predecessor
+    List<Integer> positions = this.objectStore.keysInRange(start, end).stream()
+            .map(key -> ObjectStore.Key.parse(key).objectNum())
+            .sorted(Comparator.comparingInt((Integer pos) -> (pos > start) ? 0 : 1)
+                    .thenComparingInt(pos -> pos))
+            .toList();
+
+    LinkedHashMap<String, String> reply = new LinkedHashMap<>() {{
+      put("operation_type", "SPLIT_POINT");
+      put("peer_id", peerId);
+    }};
+    int numMoved = (int) Math.round(positions.size() * fraction);
+    if (numMoved > 0 && numMoved < positions.size()) {
+      int split = positions.get(low ? numMoved - 1 : positions.size() - numMoved - 1);
+      if (split != positions.get(positions.size() - 1)) {
+        reply.put("token", String.valueOf(split));
+      }
+    }
+    out.writeUTF(Utils.prepareMsg(reply));
+    out.flush();
+  }
+
+  /**
+   * Reassigns the successor of the peer based on the message received from the bootstrap server
+   * and notifies the bootstrap server.
+   *
+   * @param msg the message received from the bootstrap server
+   */
+  private void reassignSuccessor(Map<String, String> msg) {
+    String newSuccId = msg.get("new_id");
+
+    // a peer that just joined gets its objects from its successor, unless it never sends them
+    if (this.successorId == null && !newSuccId.equals(this.peerId)) {
+      this.migration.set(new Migration(newSuccId,
+              System.currentTimeMillis() + MIGRATION_TIMEOUT_MS));
+    }
+    this.successorId = newSuccId;
+
     String newMsg = Utils.prepareMsg(new LinkedHashMap<>() {{
       put("peer_id", peerId);
-      put("operation_type", "PRED_ASSIGNED");
+      put("operation_type", "SUCC_ASSIGNED");
     }});
 
     try (
@@ -149,29 +428,575 @@ public final class Peer {
   }
 
   /**
-   * Reassigns the successor of the peer based on the message received from the bootstrap server
-   * and notifies the bootstrap server.
+   * Streams the objects in the ring range (start, end] to another peer over a single connection,
+   * in batches of up to MIGRATION_BATCH_SIZE keys, each followed by the time the object expires or
+   * 0 if it does not and by the object's value, if it has one, and removes them, their values and
+   * their replicas from this peer and its successor once the other peer acknowledges the whole
+   * transfer. Until then this peer keeps the objects and answers reads for them that the other
+   * peer passes back. The transfer can be paced so that it does not crowd out the requests both
+   * peers keep serving meanwhile.
    *
-   * @param msg the message received from the bootstrap server
+   * @param destId the ID of the peer receiving the objects
+   * @param start the exclusive start of the range
+   * @param end the inclusive end of the range
+   * @param keysPerSec the maximum number of keys sent per second, or 0 for no limit
    */
-  private void reassignSuccessor(Map<String, String> msg) {
-    this.successorId = msg.get("new_id");
+  private void migrateRange(String destId, int start, int end, int keysPerSec) {
+    List<String> keys = this.objectStore.keysInRange(start, end);
+    int batchSize = (keysPerSec > 0) ? Math.min(MIGRATION_BATCH_SIZE, keysPerSec)
+            : MIGRATION_BATCH_SIZE;
+    long startTime = System.nanoTime();
+    String header = Utils.prepareMsg(new LinkedHashMap<>() {{
+      put("operation_type", "MIGRATE");
+      put("peer_id", peerId);
+      put("range_start", String.valueOf(start));
+      put("range_end", String.valueOf(end));
+    }});
 
-    String newMsg = Utils.prepareMsg(new LinkedHashMap<>() {{
+    try (
+            Socket destSocket = new Socket(destId, Utils.PORT);
+            DataOutputStream out = new DataOutputStream(
+                    new BufferedOutputStream(destSocket.getOutputStream()));
+            DataInputStream in = new DataInputStream(destSocket.getInputStream())
+    ) {
+      out.writeUTF(header);
+      for (int i = 0; i < keys.size(); i += batchSize) {
+        List<String> batch = keys.subList(i, Math.min(i + batchSize, keys.size()));
+        Map<String, Long> expiries = this.objectStore.expiriesOf(batch);
+        out.writeInt(batch.size());
+        for (String key : batch) {
+          out.writeUTF(key);
+          out.writeLong(expiries.getOrDefault(key, 0L));
+          writeValue(this.objectStore, key, out);
+        }
+
+        if (keysPerSec > 0) {
+          out.flush();
+          long dueNanos = startTime + (i + batch.size()) * 1_000_000_000L / keysPerSec;
+          long waitMillis = (dueNanos - System.nanoTime()) / 1_000_000;
+          if (waitMillis > 0) {
+            Thread.sleep(waitMillis);
+          }
+        }
+      }
+      out.writeInt(0);
+      out.flush();
+
+      // cut over once the receiving peer has everything
+      in.readUTF();
+    } catch (IOException | InterruptedException e) {
+      throw new RuntimeException("Peer error: " + e.getMessage());
+    }
+
+    this.objectStore.removeAll(keys);
+    unreplicate(keys);
+  }
+
+  /**
+   * Receives objects streamed by another peer and stores each batch with a single append, keeping
+   * the expiry times of the objects that expire and replicating them with those times. Values are
+   * stored as they arrive and replicated once their batch is in. While the transfer is running,
+   * reads for objects this peer does not have yet are passed back to the sending peer. That stops
+   * when the transfer ends, however it ends, or when no object has arrived for
+   * MIGRATION_TIMEOUT_MS. Once the last batch is in, the peer acknowledges the transfer and prints
+   * how fast it went.
+   *
+   * @param msg the header of the transfer
+   * @param in the input stream carrying the batches
+   * @param out the output stream used to acknowledge the transfer
+   * @throws IOException if the transfer cannot be read or acknowledged
+   */
+  private void receiveMigration(Map<String, String> msg, DataInputStream in,
+                                DataOutputStream out) throws IOException {
+    String sourceId = msg.get("peer_id");
+    if (this.leaving) {
+      // the objects would leave with this peer; the sender keeps them instead
+      throw new RuntimeException("Peer error: refusing objects from " + sourceId
+              + " while leaving");
+    }
+    Migration current = new Migration(sourceId, System.currentTimeMillis() + MIGRATION_TIMEOUT_MS);
+    this.migration.set(current);
+    long startTime = System.nanoTime();
+    long numObjects = 0;
+    long numBytes = 0;
+
+    try {
+      for (int batchSize; (batchSize = in.readInt()) > 0;) {
+        List<String> batch = new ArrayList<>(batchSize);
+        Map<String, Long> expiries = new LinkedHashMap<>();
+        List<String> withValues = new ArrayList<>();
+        for (int i = 0; i < batchSize; i++) {
+          String key = in.readUTF();
+          long expiresAt = in.readLong();
+          if (expiresAt == 0) {
+            batch.add(key);
+          } else {
+            expiries.put(key, expiresAt);
+          }
+          if (readValue(this.objectStore, key, in)) {
+            withValues.add(key);
+          }
+          numBytes += key.length() + 11;
+          current = renewMigration(current);
+        }
+        this.objectStore.storeAll(batch);
+        replicate(batch);
+        if (!expiries.isEmpty()) {
+          this.objectStore.storeAllExpiring(expiries);
+          replicate(new ArrayList<>(expiries.keySet()), expiries);
+        }
+        withValues.forEach(this::replicateValue);
+        numObjects += batchSize;
+      }
+    } finally {
+      // a transfer that started since this one is left alone
+      this.migration.compareAndSet(current, null);
+    }
+
+    String ack = Utils.prepareMsg(new LinkedHashMap<>() {{
+      put("operation_type", "MIGRATE_DONE");
       put("peer_id", peerId);
-      put("operation_type", "SUCC_ASSIGNED");
     }});
+    out.writeUTF(ack);
+    out.flush();
+
+    double elapsedSecs = (System.nanoTime() - startTime) / 1e9;
+    System.err.printf("MIGRATED %d objects (%d bytes) from %s in %.3f s (%.2f MB/s)%n",
+            numObjects, numBytes, sourceId, elapsedSecs, numBytes / 1e6 / elapsedSecs);
+  }
+
+  /**
+   * Pushes back the deadline of a transfer to this peer, unless another transfer has taken its
+   * place.
+   *
+   * @param current the transfer
+   * @return the transfer with its new deadline, or the one given if it was replaced
+   */
+  private Migration renewMigration(Migration current) {
+    Migration renewed = new Migration(current.sourceId(),
+            System.currentTimeMillis() + MIGRATION_TIMEOUT_MS);
+    return this.migration.compareAndSet(current, renewed) ? renewed : current;
+  }
+
+  /**
+   * Returns the peer moving objects to this peer, if a transfer is under way.
+   *
+   * @return the ID of the sending peer, or null if there is no transfer or it timed out
+   */
+  private String migrationSource() {
+    Migration current = this.migration.get();
+    return (current != null && System.currentTimeMillis() < current.deadline())
+            ? current.sourceId() : null;
+  }
+
+  /**
+   * Sends copies of newly stored objects to the successor, which keeps them as replicas.
+   *
+   * @param keys the keys of the objects
+   */
+  private void replicate(List<String> keys) {
+    replicate(keys, null);
+  }
+
+  /**
+   * Sends copies of newly stored objects to the successor, which keeps them as replicas. If the
+   * objects expire, each key is followed by its expiry time.
+   *
+   * @param keys the keys of the objects
+   * @param expiries the times the objects expire, in milliseconds since the epoch, or null if they
+   *                 do not expire
+   */
+  private void replicate(List<String> keys, Map<String, Long> expiries) {
+    String succ = this.successorId;
+    if (keys.isEmpty() || succ == null || succ.equals(this.peerId)) {
+      return;
+    }
+
+    LinkedHashMap<String, String> fields = new LinkedHashMap<>() {{
+      put("operation_type", "REPLICATE");
+      put("peer_id", peerId);
+    }};
+    if (expiries != null) {
+      fields.put("expiring", "true");
+    }
+    String header = Utils.prepareMsg(fields);
 
     try (
-            Socket bootstrapSocket = new Socket(this.bootstrapServerName, Utils.PORT);
-            DataOutputStream out = new DataOutputStream(bootstrapSocket.getOutputStream())
+            Socket succSocket = new Socket(succ, Utils.PORT);
+            DataOutputStream out = new DataOutputStream(
+                    new BufferedOutputStream(succSocket.getOutputStream()))
     ) {
-      out.writeUTF(newMsg);
+      out.writeUTF(header);
+      out.writeInt(keys.size());
+      for (String key : keys) {
+        out.writeUTF(key);
+        if (expiries != null) {
+          out.writeLong(expiries.get(key));
+        }
+      }
     } catch (IOException e) {
       throw new RuntimeException("Peer error: " + e.getMessage());
     }
   }
 
+  /**
+   * Sends a copy of an object's value to the successor, which stores it with the object's replica.
+   *
+   * @param key the key of the object
+   */
+  private void replicateValue(String key) {
+    String succ = this.successorId;
+    if (succ == null || succ.equals(this.peerId)) {
+      return;
+    }
+
+    String header = Utils.prepareMsg(new LinkedHashMap<>() {{
+      put("operation_type", "REPLICATE_VALUE");
+      put("peer_id", peerId);
+    }});
+
+    try (
+            Socket succSocket = new Socket(succ, Utils.PORT);
+            DataOutputStream out = new DataOutputStream(new BufferedOutputStream(
+                    succSocket.getOutputStream(), BlockCodec.BLOCK_SIZE))
+    ) {
+      out.writeUTF(header);
+      out.writeUTF(key);
+      writeValue(this.objectStore, key, out);
+    } catch (IOException e) {
+      throw new RuntimeException("Peer error: " + e.getMessage());
+    }
+  }
+
+  /**
+   * Stores the replica of an object along with its value, sent by the predecessor.
+   *
+   * @param in the input stream carrying the key of the object and its value
+   * @throws IOException if the key or the value cannot be read
+   */
+  private void receiveReplicaValue(DataInputStream in) throws IOException {
+    String key = in.readUTF();
+    if (!readValue(this.replicaStore, key, in)) {
+      this.replicaStore.storeAll(List.of(key));
+    }
+  }
+
+  /**
+   * Writes whether an object has a value and, if it does, the value's blocks as they are stored.
+   *
+   * @param store the store holding the object
+   * @param key the key of the object
+   * @param out the output stream to write to
+   * @throws IOException if the value cannot be read or written
+   */
+  private static void writeValue(ObjectStore store, String key, DataOutputStream out)
+          throws IOException {
+    try (DataInputStream value = store.openValue(key)) {
+      out.writeBoolean(value != null);
+      if (value != null) {
+        BlockCodec.copy(value, out);
+      }
+    }
+  }
+
+  /**
+   * Reads what {@link #writeValue} wrote and stores the value, if there is one. A store that cannot
+   * hold values skips it, so the rest of the stream can still be read.
+   *
+   * @param store the store to put the value in
+   * @param key the key of the object
+   * @param in the input stream to read from
+   * @return true if a value was stored, false otherwise
+   * @throws IOException if the value cannot be read or written
+   */
+  private boolean readValue(ObjectStore store, String key, DataInputStream in)
+          throws IOException {
+    if (!in.readBoolean()) {
+      return false;
+    }
+    if (!store.holdsValues()) {
+      BlockCodec.skip(in);
+      System.err.println("Peer error: dropped the value of " + key
+              + ", the store cannot hold values");
+      return false;
+    }
+    store.storeValue(key, in, this.compressValues);
+    return true;
+  }
+
+  /**
+   * Tells the successor to drop the replicas of objects this peer no longer holds.
+   *
+   * @param keys the keys of the objects
+   */
+  private void unreplicate(List<String> keys) {
+    String succ = this.successorId;
+    if (keys.isEmpty() || succ == null || succ.equals(this.peerId)) {
+      return;
+    }
+
+    String header = Utils.prepareMsg(new LinkedHashMap<>() {{
+      put("operation_type", "DROP_REPLICAS");
+      put("peer_id", peerId);
+    }});
+
+    try (
+            Socket succSocket = new Socket(succ, Utils.PORT);
+            DataOutputStream out = new DataOutputStream(
+                    new BufferedOutputStream(succSocket.getOutputStream()))
+    ) {
+      out.writeUTF(header);
+      out.writeInt(keys.size());
+      for (String key : keys) {
+        out.writeUTF(key);
+      }
+    } catch (IOException e) {
+      throw new RuntimeException("Peer error: " + e.getMessage());
+    }
+  }
+
+  /**
+   * Drops the replicas of objects the predecessor no longer holds.
+   *
+   * @param in the input stream carrying the keys of the objects
+   * @throws IOException if the keys cannot be read
+   */
+  private void dropReplicas(DataInputStream in) throws IOException {
+    int count = in.readInt();
+    List<String> keys = new ArrayList<>(count);
+    for (int i = 0; i < count; i++) {
+      keys.add(in.readUTF());
+    }
+    this.replicaStore.removeAll(keys);
+  }
+
+  /**
+   * Stores the replicas sent by the predecessor.
+   *
+   * @param msg the header of the replication
+   * @param in the input stream carrying the keys of the replicated objects
+   * @throws IOException if the keys cannot be read
+   */
+  private void receiveReplicas(Map<String, String> msg, DataInputStream in) throws IOException {
+    boolean expiring = msg.containsKey("expiring");
+    int count = in.readInt();
+    List<String> keys = new ArrayList<>(count);
+    Map<String, Long> expiries = new LinkedHashMap<>();
+    for (int i = 0; i < count; i++) {
+      String key = in.readUTF();
+      keys.add(key);
+      if (expiring) {
+        expiries.put(key, in.readLong());
+      }
+    }
+
+    if (expiring) {
+      this.replicaStore.storeAllExpiring(expiries);
+    } else {
+      this.replicaStore.storeAll(keys);
+    }
+  }
+
+  /**
+   * Periodically repairs the replicas of this peer's objects on its successor. Sessions are
+   * skipped while objects are being moved to this peer.
+   */
+  private void runAntiEntropy() {
+    while (true) {
+      try {
+        Thread.sleep(ANTI_ENTROPY_INTERVAL_MS);
+      } catch (InterruptedException e) {
+        return;
+      }
+
+      String succ = this.successorId;
+      if (succ == null || succ.equals(this.peerId) || migrationSource() != null) {
+        continue;
+      }
+
+      try {
+        syncReplica(succ);
+      } catch (RuntimeException e) {
+        System.err.println("Peer error: anti-entropy with " + succ + " failed: "
+                + e.getMessage());
+      }
+    }
+  }
+
+  /**
+   * Periodically reports to the bootstrap server how many objects this peer holds and how many
+   * requests per second it has served since the last report.
+   */
+  private void runLoadReports() {
+    while (true) {
+      try {
+        Thread.sleep(LOAD_REPORT_INTERVAL_MS);
+      } catch (InterruptedException e) {
+        return;
+      }
+
+      double rate = this.numRequests.getAndSet(0) * 1000.0 / LOAD_REPORT_INTERVAL_MS;
+      String msg = Utils.prepareMsg(new LinkedHashMap<>() {{
+        put("operation_type", "LOAD_REPORT");
+        put("peer_id", peerId);
+        put("keys", String.valueOf(objectStore.size()));
+        put("request_rate", String.valueOf(rate));
+      }});
+
+      try (
+              Socket bootstrapSocket = new Socket(this.bootstrapServerName, Utils.PORT);
+              DataOutputStream out = new DataOutputStream(bootstrapSocket.getOutputStream())
+      ) {
+        out.writeUTF(msg);
+      } catch (IOException e) {
+        System.err.println("Peer error: load report failed: " + e.getMessage());
+      }
+    }
+  }
+
+  /**
+   * Runs one anti-entropy session with the successor over a single connection. The two Merkle
+   * trees are compared top-down, one level per round trip, descending only into nodes whose hashes
+   * differ. Once the differing leaves are known, this peer sends the keys it has in them, each
+   * followed by the time the object expires or 0 if it does not. This
+   * peer's objects are authoritative, so the successor stores the ones its replicas are missing,
+   * drops the replicas in those leaves that this peer no longer has, such as objects that were
+   * moved away or expired, and answers with how many it dropped. Nothing is copied back, which
+   * would bring such objects back to life. A session that finds differences prints how much it
+   * exchanged.
+   *
+   * @param succ the ID of the successor
+   */
+  private void syncReplica(String succ) {
+    long startTime = System.nanoTime();
+    long bytesIn = 0;
+    Set<Integer> diffLeaves = new HashSet<>();
+    int numSent;
+    int numDropped;
+    int bytesOut;
+
+    try (
+            Socket succSocket = new Socket(succ, Utils.PORT);
+            DataOutputStream out = new DataOutputStream(
+                    new BufferedOutputStream(succSocket.getOutputStream()));
+            DataInputStream in = new DataInputStream(succSocket.getInputStream())
+    ) {
+      out.writeUTF(Utils.prepareMsg(new LinkedHashMap<>() {{
+        put("operation_type", "SYNC");
+        put("peer_id", peerId);
+      }}));
+
+      // walk down both trees, one level at a time
+      List<Integer> nodes = List.of(1);
+      while (!nodes.isEmpty()) {
+        out.writeInt(nodes.size());
+        for (int node : nodes) {
+          out.writeInt(node);
+        }
+        out.flush();
+
+        List<Integer> nextNodes = new ArrayList<>();
+        for (int node : nodes) {
+          long theirHash = in.readLong();
+          bytesIn += 8;
+          if (theirHash == this.objectStore.merkleHash(node)) {
+            continue;
+          }
+          if (this.objectStore.isMerkleLeaf(node)) {
+            diffLeaves.add(node);
+          } else {
+            nextNodes.add(2 * node);
+            nextNodes.add(2 * node + 1);
+          }
+        }
+        nodes = nextNodes;
+      }
+      out.writeInt(0);
+
+      // exchange the keys of the differing leaves
+      List<String> ourKeys = this.objectStore.keysInMerkleLeaves(diffLeaves);
+      out.writeInt(diffLeaves.size());
+      for (int leaf : diffLeaves) {
+        out.writeInt(leaf);
+      }
+      Map<String, Long> expiries = this.objectStore.expiriesOf(ourKeys);
+      out.writeInt(ourKeys.size());
+      for (String key : ourKeys) {
+        out.writeUTF(key);
+        out.writeLong(expiries.getOrDefault(key, 0L));
+      }
+      out.flush();
+      numSent = ourKeys.size();
+      bytesOut = out.size();
+
+      numDropped = in.readInt();
+      bytesIn += 4;
+    } catch (IOException e) {
+      throw new RuntimeException("Peer error: " + e.getMessage());
+    }
+
+    if (!diffLeaves.isEmpty()) {
+      double elapsedSecs = (System.nanoTime() - startTime) / 1e9;
+      System.err.printf("ANTI-ENTROPY with %s: %d differing leaves, sent %d keys, %d stale "
+              + "replicas dropped, %d bytes in %.3f s%n", succ, diffLeaves.size(), numSent,
+              numDropped, bytesOut + bytesIn, elapsedSecs);
+    }
+  }
+
+  /**
+   * Serves an anti-entropy session started by the predecessor; see {@link #syncReplica(String)}.
+   *
+   * @param in the input stream of the session
+   * @param out the output stream of the session
+   * @throws IOException if the session cannot be read or answered
+   */
+  private void serveReplicaSync(DataInputStream in, DataOutputStream out) throws IOException {
+    for (int count; (count = in.readInt()) > 0;) {
+      long[] hashes = new long[count];
+      for (int i = 0; i < count; i++) {
+        hashes[i] = this.replicaStore.merkleHash(in.readInt());
+      }
+      for (long hash : hashes) {
+        out.writeLong(hash);
+      }
+      out.flush();
+    }
+
+    Set<Integer> diffLeaves = new HashSet<>();
+    int numLeaves = in.readInt();
+    for (int i = 0; i < numLeaves; i++) {
+      diffLeaves.add(in.readInt());
+    }
+    Set<String> theirKeys = new HashSet<>();
+    Map<String, Long> theirExpiries = new HashMap<>();
+    int numKeys = in.readInt();
+    for (int i = 0; i < numKeys; i++) {
+      String key = in.readUTF();
+      long expiresAt = in.readLong();
+      theirKeys.add(key);
+      if (expiresAt != 0) {
+        theirExpiries.put(key, expiresAt);
+      }
+    }
+
+    // the predecessor no longer has the objects only the replicas have
+    List<String> stale = this.replicaStore.keysInMerkleLeaves(diffLeaves).stream()
+            .filter(key -> !theirKeys.contains(key))
+            .toList();
+    if (!stale.isEmpty()) {
+      this.replicaStore.removeAll(stale);
+    }
+    this.replicaStore.storeAll(theirKeys.stream()
+            .filter(key -> !theirExpiries.containsKey(key))
+            .toList());
+    if (!theirExpiries.isEmpty()) {
+      this.replicaStore.storeAllExpiring(theirExpiries);
+    }
+
+    out.writeInt(stale.size());
+    out.flush();
+  }
+
   /**
    * Prints the predecessor and successor of the peer.
    */
@@ -196,95 +1021,453 @@ public final class Peer {
     }
 
     String clientId = msgRec.get("client_id");
-    String objStorageStr = Utils.extractIdNum(clientId) + "::" + objId;
 
-    // store the object in the object file
-    try (BufferedWriter writer = new BufferedWriter(
-            new FileWriter(this.objFilePath, true))) {
-      writer.write(objStorageStr);
-      writer.newLine();
-    } catch (IOException e) {
-      throw new RuntimeException("Peer error: " + e.getMessage());
+    this.numRequests.incrementAndGet();
+
+    // store the object in the object file, replicate it and print the object file
+    String key = ObjectStore.toKey(Utils.extractIdNum(clientId), objId);
+    if (msgRec.containsKey("ttl")) {
+      Map<String, Long> expiries = Map.of(key, expiryTime(msgRec.get("ttl")));
+      this.objectStore.storeAllExpiring(expiries);
+      replicate(List.of(key), expiries);
+    } else {
+      this.objectStore.store(Utils.extractIdNum(clientId), objId);
+      replicate(List.of(key));
     }
+    invalidateHotKey(key);
+    System.err.println(this.objectStore.dump());
+
+    // report back to the client
+    reportToClient(msgRec, new LinkedHashMap<>() {{
+      put("operation_type", "OBJ_STORED");
+      put("object_id", objId);
+      put("client_id", clientId);
+      put("peer_id", peerId);
+    }});
+  }
 
-    // print the object file
-    StringBuilder objFileContent = new StringBuilder();
-    try (BufferedReader reader = new BufferedReader(
-            new FileReader(this.objFilePath))) {
-      for (String line; (line = reader.readLine()) != null;) {
-        objFileContent.append(line).append("\n");
+  /**
+   * Retrieves the object from the object store. If the object is not here, it passes the request
+   * to the successor. After retrieving the object, it will notify the bootstrap server that the
+   * object has been successfully retrieved.
+   *
+   * @param msg the message to be passed
+   */
+  private void retrieveObject(String msg) {
+    Map<String, String> msgRec = Utils.unpackMsg(msg);
+    String objId = msgRec.get("object_id");
+    String clientId = msgRec.get("client_id");
+    String key = ObjectStore.toKey(Utils.extractIdNum(clientId), objId);
+    boolean migrationRead = "true".equals(msgRec.get("migration_read"));
+
+    // a hot object owned by another peer may have been cached here
+    Boolean cached = this.hotKeyCache.get(key);
+    if (!migrationRead && cached != null && !ownsObject(objId)) {
+      reportRetrieval(msgRec, cached);
+      return;
+    }
+
+    // pass to successor if object does not belong in this peer, unless the read was passed back
+    // by a peer this peer is moving objects to
+    if (!migrationRead && passObjToSuccIfNotHere(msg, objId)) {
+      return;
+    }
+
+    this.numRequests.incrementAndGet();
+    boolean found = this.objectStore.contains(Utils.extractIdNum(clientId), objId);
+
+    // the object may still be with the peer moving objects here
+    String sourceId = migrationSource();
+    if (!found && !migrationRead && sourceId != null) {
+      msgRec.put("migration_read", "true");
+      try (
+              Socket sourceSocket = new Socket(sourceId, Utils.PORT);
+              DataOutputStream out = new DataOutputStream(sourceSocket.getOutputStream())
+      ) {
+        out.writeUTF(Utils.prepareMsg(new LinkedHashMap<>(msgRec)));
+        return;
+      } catch (IOException e) {
+        throw new RuntimeException("Peer error: " + e.getMessage());
       }
-    } catch (IOException e) {
-      throw new RuntimeException("Peer error: " + e.getMessage());
     }
-    System.err.println(objFileContent.toString().trim());
 
-    // send message to bootstrap server
+    reportRetrieval(msgRec, found);
+    trackHotKey(msgRec, key, found);
+  }
+
+  /**
+   * Reports to the client whether the object of a retrieve request was found.
+   *
+   * @param msgRec the retrieve request
+   * @param found whether the object was found
+   */
+  private void reportRetrieval(Map<String, String> msgRec, boolean found) {
+    reportToClient(msgRec, new LinkedHashMap<>() {{
+      put("operation_type", found ? "OBJ_RETRIEVED" : "OBJ_NOT_FOUND");
+      put("object_id", msgRec.get("object_id"));
+      put("client_id", msgRec.get("client_id"));
+      put("peer_id", peerId);
+    }});
+  }
+
+  /**
+   * Counts a read of an object this peer owns. Once the object is read often enough within the
+   * tracking window, the result of the lookup is pushed to the bootstrap server and to up to
+   * {@value #MAX_HOT_KEY_FANOUT} predecessors, one more for every multiple of the threshold the
+   * object is read. The push is renewed at half the lease while the object stays hot, which also
+   * lets the fan-out grow with the object's popularity. Misses are counted but never pushed, so a
+   * client that stores an object and then reads it is never told it is missing by a cache that
+   * the invalidation has not reached yet. A miss on an object whose lookup was pushed before
+   * invalidates it.
+   *
+   * @param msgRec the retrieve request
+   * @param key the key of the object
+   * @param found whether the object was found
+   */
+  private void trackHotKey(Map<String, String> msgRec, String key, boolean found) {
+    if (this.hotKeyTracker == null) {
+      return;
+    }
+
+    int reads = this.hotKeyTracker.record(key);
+    if (!found) {
+      invalidateHotKey(key);
+      return;
+    }
+    long now = System.currentTimeMillis();
+    Long renewAt = this.promotedHotKeys.get(key);
+    if (reads < HOT_KEY_THRESHOLD || (renewAt != null && renewAt > now)) {
+      return;
+    }
+    this.promotedHotKeys.put(key, now + HOT_KEY_LEASE_MS / 2);
+
+    int fanout = Math.min(MAX_HOT_KEY_FANOUT, reads / HOT_KEY_THRESHOLD);
+    LinkedHashMap<String, String> update = new LinkedHashMap<>() {{
+      put("operation_type", "CACHE_HOT_KEY");
+      put("object_id", msgRec.get("object_id"));
+      put("client_id", msgRec.get("client_id"));
+      put("found", "true");
+      put("lease_ms", String.valueOf(HOT_KEY_LEASE_MS));
+      put("fanout", String.valueOf(fanout));
+      put("owner_id", peerId);
+    }};
+    sendHotKeyUpdate(this.bootstrapServerName, update);
+    sendHotKeyUpdate(this.predecessorId, update);
+    System.err.println("HOT KEY " + key + " (" + reads + " reads in window), cached on " + fanout
+            + " predecessors");
+  }
+
+  /**
+   * Invalidates the cached lookups of an object that was just stored, if the object is hot.
+   *
+   * @param key the key of the object
+   */
+  private void invalidateHotKey(String key) {
+    if (this.promotedHotKeys.remove(key) == null) {
+      return;
+    }
+
+    ObjectStore.Key parsed = ObjectStore.Key.parse(key);
+    LinkedHashMap<String, String> update = new LinkedHashMap<>() {{
+      put("operation_type", "INVALIDATE_HOT_KEY");
+      put("object_id", String.valueOf(parsed.objectNum()));
+      put("client_id", String.valueOf(parsed.clientNum()));
+      put("fanout", String.valueOf(MAX_HOT_KEY_FANOUT));
+      put("owner_id", peerId);
+    }};
+    sendHotKeyUpdate(this.bootstrapServerName, update);
+    sendHotKeyUpdate(this.predecessorId, update);
+  }
+
+  /**
+   * Caches or invalidates the lookup of a hot object owned by a successor, and passes the update
+   * on to this peer's predecessor until the update's fan-out is used up.
+   *
+   * @param msgRec the update
+   */
+  private void handleHotKeyUpdate(Map<String, String> msgRec) {
+    String key = ObjectStore.toKey(Utils.extractIdNum(msgRec.get("client_id")),
+            msgRec.get("object_id"));
+    if (msgRec.get("operation_type").equals("CACHE_HOT_KEY")) {
+      this.hotKeyCache.put(key, Boolean.parseBoolean(msgRec.get("found")),
+              Long.parseLong(msgRec.get("lease_ms")));
+    } else {
+      this.hotKeyCache.invalidate(key);
+    }
+
+    int fanout = Integer.parseInt(msgRec.get("fanout"));
+    String pred = this.predecessorId;
+    if (fanout > 1 && pred != null && !pred.equals(msgRec.get("owner_id"))) {
+      msgRec.put("fanout", String.valueOf(fanout - 1));
+      sendHotKeyUpdate(pred, new LinkedHashMap<>(msgRec));
+    }
+  }
+
+  /**
+   * Sends an update about a hot object.
+   *
+   * @param destId the peer or bootstrap server to send the update to, or null to skip it
+   * @param update the fields of the update
+   */
+  private void sendHotKeyUpdate(String destId, LinkedHashMap<String, String> update) {
+    if (destId == null || destId.equals(this.peerId)) {
+      return;
+    }
+
     try (
-            Socket bootstrapSocket = new Socket(this.bootstrapServerName, Utils.PORT);
-            DataOutputStream out = new DataOutputStream(bootstrapSocket.getOutputStream())
+            Socket destSocket = new Socket(destId, Utils.PORT);
+            DataOutputStream out = new DataOutputStream(destSocket.getOutputStream())
     ) {
-      String newMsg = Utils.prepareMsg(new LinkedHashMap<>() {{
-        put("operation_type", "OBJ_STORED");
-        put("object_id", objId);
-        put("client_id", clientId);
-        put("peer_id", peerId);
-      }});
-      out.writeUTF(newMsg);
+      out.writeUTF(Utils.prepareMsg(update));
     } catch (IOException e) {
       throw new RuntimeException("Peer error: " + e.getMessage());
     }
   }
 
   /**
-   * Retrieves the object from the object file. If the object is not here, it passes the request to
-   * the successor. After retrieving the object, it will notify the bootstrap server that the
-   * object has been successfully retrieved.
+   * Stores or retrieves a batch of objects sent by a client on one connection. The objects this
+   * peer owns are stored with a single append and sync of the object store, or looked up in its
+   * index. The client gets one status byte per object back on the same connection. A batch of
+   * objects to store that expire has each object ID followed by its time to live in seconds.
    *
-   * @param msg the message to be passed
+   * @param msg the header of the batch
+   * @param in the input stream carrying the object IDs
+   * @param out the output stream used to send back the statuses
+   * @throws IOException if the batch cannot be read or answered
    */
-  private void retrieveObject(String msg) {
-    Map<String, String> msgRec = Utils.unpackMsg(msg);
-    String objId = msgRec.get("object_id");
+  private void handleBatch(Map<String, String> msg, DataInputStream in, DataOutputStream out)
+          throws IOException {
+    boolean store = msg.get("operation_type").equals("STORE_BATCH");
+    boolean expiring = msg.containsKey("ttls");
+    int clientNum = Utils.extractIdNum(msg.get("client_id"));
+    int count = in.readInt();
+    byte[] statuses = new byte[count];
+    List<String> keys = new ArrayList<>();
+    List<Integer> keyIdxs = new ArrayList<>();
+    Map<String, Long> expiries = expiring ? new LinkedHashMap<>() : null;
 
-    // pass to successor if object does not belong in this peer
-    if (passObjToSuccIfNotHere(msg, objId)) {
+    for (int i = 0; i < count; i++) {
+      String objId = String.valueOf(in.readInt());
+      String ttl = expiring ? String.valueOf(in.readInt()) : null;
+      if (ownsObject(objId)) {
+        String key = ObjectStore.toKey(clientNum, objId);
+        keys.add(key);
+        keyIdxs.add(i);
+        if (expiring) {
+          expiries.put(key, expiryTime(ttl));
+        }
+      } else {
+        statuses[i] = Utils.BATCH_NOT_OWNED;
+      }
+    }
+
+    this.numRequests.addAndGet(keys.size());
+    if (store) {
+      if (expiring) {
+        this.objectStore.storeAllExpiring(expiries);
+      } else {
+        this.objectStore.storeAll(keys);
+      }
+      replicate(keys, expiries);
+      keys.forEach(this::invalidateHotKey);
+      keyIdxs.forEach(i -> statuses[i] = Utils.BATCH_OK);
+      System.err.println("STORED BATCH " + keys.size() + " objects");
+    } else {
+      boolean[] found = this.objectStore.containsAll(keys);
+      for (int i = 0; i < found.length; i++) {
+        statuses[keyIdxs.get(i)] = found[i] ? Utils.BATCH_OK : Utils.BATCH_NOT_FOUND;
+      }
+    }
+
+    out.write(statuses);
+    out.flush();
+  }
+
+  /**
+   * Stores or retrieves the value of an object, sent by a client straight to the owning peer. The
+   * peer first answers with one status byte, telling the client whether it owns the object and,
+   * for a retrieval, whether the object has a value. An upload then streams the value's blocks to
+   * the object store and gets a second status byte once the value is on disk. A download gets the
+   * value's blocks, recoded to match whether the client asked for compressed blocks, and the end
+   * marker. A peer whose store cannot hold values answers with BATCH_UNSUPPORTED instead. The
+   * object and its value are replicated once the value is on disk.
+   *
+   * @param msg the header of the request
+   * @param in the input stream carrying the value of an upload
+   * @param out the output stream used to send back the statuses and the value of a download
+   * @throws IOException if the value cannot be read or sent
+   */
+  private void handleValue(Map<String, String> msg, DataInputStream in, DataOutputStream out)
+          throws IOException {
+    String objId = msg.get("object_id");
+    String key = ObjectStore.toKey(Utils.extractIdNum(msg.get("client_id")), objId);
+    if (!ownsObject(objId)) {
+      out.writeByte(Utils.BATCH_NOT_OWNED);
+      out.flush();
+      return;
+    }
+    if (!this.objectStore.holdsValues()) {
+      out.writeByte(Utils.BATCH_UNSUPPORTED);
+      out.flush();
       return;
     }
+    this.numRequests.incrementAndGet();
 
-    String clientId = msgRec.get("client_id");
+    if (msg.get("operation_type").equals("PUT_VALUE")) {
+      out.writeByte(Utils.BATCH_OK);
+      out.flush();
 
-    try {
-      // look for the object in the object file
-      List<String> objList = Files.readAllLines(Paths.get(this.objFilePath)).stream()
-              .map(line -> line.split("::"))
-              .filter(line -> line[0].equals(String.valueOf(Utils.extractIdNum(clientId))))
-              .filter(line -> line[1].equals(objId))
-              .map(line -> line[1]).toList();
-
-      // send message to bootstrap server
-      Socket bootstrapSocket = new Socket(this.bootstrapServerName, Utils.PORT);
-      DataOutputStream out = new DataOutputStream(bootstrapSocket.getOutputStream());
-
-      String newMsg;
-      if (objList.isEmpty()) {
-        newMsg = Utils.prepareMsg(new LinkedHashMap<>() {{
-          put("operation_type", "OBJ_NOT_FOUND");
-          put("object_id", objId);
-          put("client_id", clientId);
-        }});
-      } else {
-        newMsg = Utils.prepareMsg(new LinkedHashMap<>() {{
-          put("operation_type", "OBJ_RETRIEVED");
-          put("object_id", objId);
-          put("client_id", clientId);
-          put("peer_id", peerId);
-        }});
+      long startTime = System.nanoTime();
+      ObjectStore.ValueSize size = this.objectStore.storeValue(key,
+              new DataInputStream(new BufferedInputStream(in, BlockCodec.BLOCK_SIZE)),
+              this.compressValues);
+      replicateValue(key);
+      invalidateHotKey(key);
+      out.writeByte(Utils.BATCH_OK);
+      out.flush();
+
+      System.err.printf("STORED VALUE %s: %d bytes, %d bytes on disk in %.3f ms "
+                      + "(%d bytes, %d bytes on disk in total)%n", key, size.rawBytes(),
+              size.storedBytes(), (System.nanoTime() - startTime) / 1e6,
+              this.valueRawBytes.addAndGet(size.rawBytes()),
+              this.valueStoredBytes.addAndGet(size.storedBytes()));
+      return;
+    }
+
+    boolean compress = msg.containsKey("compressed");
+    try (DataInputStream value = this.objectStore.openValue(key)) {
+      if (value == null) {
+        out.writeByte(Utils.BATCH_NOT_FOUND);
+        out.flush();
+        return;
       }
 
-      out.writeUTF(newMsg);
-      out.close();
-      bootstrapSocket.close();
+      DataOutputStream blockOut = new DataOutputStream(
+              new BufferedOutputStream(out, BlockCodec.BLOCK_SIZE));
+      blockOut.writeByte(Utils.BATCH_OK);
+      for (BlockCodec.Block block; (block = BlockCodec.readFrom(value)) != null;) {
+        block.recode(compress).writeTo(blockOut);
+      }
+      BlockCodec.writeEnd(blockOut);
+      blockOut.flush();
+    }
+  }
+
+  /**
+   * Answers one step of an iterative lookup on the same connection: whether this peer owns the
+   * object and, if not, which peer to ask next, which is this peer's successor.
+   *
+   * @param msg the lookup request
+   * @param out the output stream used to send back the answer
+   * @throws IOException if the answer cannot be sent
+   */
+  private void answerNextHop(Map<String, String> msg, DataOutputStream out) throws IOException {
+    boolean owner = ownsObject(msg.get("object_id"));
+    LinkedHashMap<String, String> reply = new LinkedHashMap<>() {{
+      put("operation_type", "NEXT_HOP");
+      put("peer_id", peerId);
+      put("owner", String.valueOf(owner));
+    }};
+    if (!owner) {
+      reply.put("next_id", this.successorId);
+    }
+
+    out.writeUTF(Utils.prepareMsg(reply));
+    out.flush();
+  }
+
+  /**
+   * Turns a time to live into the time an object expires.
+   *
+   * @param ttl the time to live in seconds
+   * @return the time the object expires, in milliseconds since the epoch
+   */
+  private static long expiryTime(String ttl) {
+    return System.currentTimeMillis() + Long.parseLong(ttl) * 1000;
+  }
+
+  /**
+   * Serves one chunk of an ordered range scan. The scan resumes right after the key in its
+   * continuation token, which is "object_id/client_id", and this peer returns the keys it holds
+   * from there on, in order, up to the end of its part of the ring or of the scanned range. The
+   * reply goes back on the same connection as a header, carrying the number of keys and the token
+   * to continue from, followed by the keys. The token is left out once the scan is complete. If
+   * the ring has changed and the scan does not resume in this peer's range, the client is told to
+   * refresh its view of the ring instead.
+   *
+   * @param msg the scan request
+   * @param out the output stream used to send back the chunk
+   * @throws IOException if the chunk cannot be sent
+   */
+  private void handleScan(Map<String, String> msg, DataOutputStream out) throws IOException {
+    String[] token = msg.get("token").split("/");
+    ObjectStore.Key after = new ObjectStore.Key(Integer.parseInt(token[0]),
+            Integer.parseInt(token[1]));
+    int rangeEnd = Integer.parseInt(msg.get("range_end"));
+    Integer clientNum = msg.containsKey("scan_client")
+            ? Utils.extractIdNum(msg.get("scan_client")) : null;
+    int limit = Integer.parseInt(msg.get("limit"));
+
+    if (!ownsObject(token[0])) {
+      out.writeUTF(Utils.prepareMsg(new LinkedHashMap<>() {{
+        put("operation_type", "REDIRECT");
+        put("peer_id", peerId);
+      }}));
+      out.flush();
+      return;
+    }
+
+    // the first peer of the ring also owns the keys above the last peer, up to the range's end
+    int myNum = this.token;
+    int portionEnd = (after.objectNum() <= myNum) ? Math.min(myNum, rangeEnd) : rangeEnd;
+    List<ObjectStore.Key> keys = this.objectStore.scan(after, portionEnd, clientNum, limit);
+
+    LinkedHashMap<String, String> header = new LinkedHashMap<>() {{
+      put("operation_type", "SCAN_CHUNK");
+      put("peer_id", peerId);
+      put("count", String.valueOf(keys.size()));
+    }};
+    if (keys.size() == limit) {
+      ObjectStore.Key last = keys.get(keys.size() - 1);
+      header.put("next_token", last.objectNum() + "/" + last.clientNum());
+    } else if (portionEnd < rangeEnd) {
+      header.put("next_token", (portionEnd + 1) + "/-1");
+    }
+
+    DataOutputStream chunkOut = new DataOutputStream(new BufferedOutputStream(out));
+    chunkOut.writeUTF(Utils.prepareMsg(header));
+    for (ObjectStore.Key key : keys) {
+      chunkOut.writeUTF(key.toString());
+    }
+    chunkOut.flush();
+  }
+
+  /**
+   * Reports the outcome of a client request. If the request carries the client's reply address,
+   * the report is sent straight to the client; otherwise it goes to the bootstrap server, which
+   * relays it to the client. The request ID and hop count are echoed so the client can match the
+   * report to its request, and the peer's range of the ring is included so the client can cache
+   * where the object lives.
+   *
+   * @param request the request being answered
+   * @param report the fields of the report
+   */
+  private void reportToClient(Map<String, String> request, LinkedHashMap<String, String> report) {
+    for (String field : new String[] {"req_id", "hops"}) {
+      if (request.containsKey(field)) {
+        report.put(field, request.get(field));
+      }
+    }
+    report.put("pred_id", this.predecessorId);
+    report.put("range_start", String.valueOf(this.predecessorToken));
+    report.put("range_end", String.valueOf(this.token));
+    String dest = request.getOrDefault("reply_to", this.bootstrapServerName);
+
+    try (
+            Socket destSocket = new Socket(dest, Utils.PORT);
+            DataOutputStream out = new DataOutputStream(destSocket.getOutputStream())
+    ) {
+      out.writeUTF(Utils.prepareMsg(report));
     } catch (IOException e) {
       throw new RuntimeException("Peer error: " + e.getMessage());
     }
@@ -292,34 +1475,56 @@ public final class Peer {
 
   /**
    * Passes the object to the successor if it is not here. Returns true if the object was passed,
-   * false otherwise.
+   * false otherwise. A request sent here because of a stale client-side location cache is not
+   * passed on; the client gets a redirect carrying this peer's actual range instead. The hop count
+   * of the request, if it has one, is incremented on the way.
    *
    * @param msg the message to be passed
    * @param objId the object ID
-   * @return true if the object was passed, false otherwise
+   * @return true if the object was passed or redirected, false otherwise
    */
   private boolean passObjToSuccIfNotHere(String msg, String objId) {
-    boolean objIdLargerThanPeerId = Utils.extractIdNum(objId)
-            > Utils.extractIdNum(this.peerId);
-    boolean atStartOfRing = Utils.extractIdNum(this.predecessorId)
-            > Utils.extractIdNum(this.peerId);
-    boolean objIdLargerThanPredecessorId = Utils.extractIdNum(objId)
-            > Utils.extractIdNum(this.predecessorId);
-    boolean objIdLargerThanRing = atStartOfRing && objIdLargerThanPredecessorId;
-
-    if (objIdLargerThanPeerId && !objIdLargerThanRing) {
-      try (
-              Socket succSocket = new Socket(this.successorId, Utils.PORT);
-              DataOutputStream out = new DataOutputStream(succSocket.getOutputStream())
-      ) {
-        out.writeUTF(msg);
-        return true;
-      } catch (IOException e) {
-        throw new RuntimeException("Peer error: " + e.getMessage());
-      }
+    if (ownsObject(objId)) {
+      return false;
+    }
+
+    Map<String, String> msgRec = Utils.unpackMsg(msg);
+    if ("REDIRECT".equals(msgRec.get("on_miss"))) {
+      reportToClient(msgRec, new LinkedHashMap<>() {{
+        put("operation_type", "REDIRECT");
+        put("object_id", objId);
+        put("client_id", msgRec.get("client_id"));
+        put("peer_id", peerId);
+      }});
+      return true;
     }
 
-    return false;
+    if (msgRec.containsKey("hops")) {
+      msgRec.put("hops", String.valueOf(Integer.parseInt(msgRec.get("hops")) + 1));
+      msg = Utils.prepareMsg(new LinkedHashMap<>(msgRec));
+    }
+
+    try (
+            Socket succSocket = new Socket(this.successorId, Utils.PORT);
+            DataOutputStream out = new DataOutputStream(succSocket.getOutputStream())
+    ) {
+      out.writeUTF(msg);
+      return true;
+    } catch (IOException e) {
+      throw new RuntimeException("Peer error: " + e.getMessage());
+    }
+  }
+
+  /**
+   * Checks whether an object belongs to this peer, that is whether its ID falls between the
+   * position of the predecessor (exclusive) and the position of this peer (inclusive), wrapping
+   * around the ring.
+   *
+   * @param objId the object ID
+   * @return true if the object belongs to this peer, false otherwise
+   */
+  private boolean ownsObject(String objId) {
+    return Utils.inRange(Utils.extractIdNum(objId), this.predecessorToken, this.token);
   }
 
   /**
@@ -343,7 +1548,12 @@ public final class Peer {
     String peerId;
     String bootstrapServerName = null;
     String objFilePath = null;
+    String storeKind = "file";
     int delay = 0;
+    boolean trackHotKeys = false;
+    boolean compressValues = false;
+    int hopDelayMs = 0;
+    boolean leaveOnStop = false;
 
     for (int i = 0; i < args.length; i++) {
       switch (args[i]) {
@@ -368,6 +1578,23 @@ public final class Peer {
             throw new IllegalArgumentException("Peer error: Missing delay");
           }
         }
+        case "-H" -> trackHotKeys = true;
+        case "-Z" -> compressValues = true;
+        case "-l" -> leaveOnStop = true;
+        case "-L" -> {
+          if (i + 1 < args.length) {
+            hopDelayMs = Integer.parseInt(args[++i]);
+          } else {
+            throw new IllegalArgumentException("Peer error: Missing hop delay");
+          }
+        }
+        case "-s" -> {
+          if (i + 1 < args.length) {
+            storeKind = args[++i];
+          } else {
+            throw new IllegalArgumentException("Peer error: Missing object store kind");
+          }
+        }
         default -> throw new IllegalArgumentException("Peer error: Invalid argument");
       }
     }
@@ -378,6 +1605,7 @@ public final class Peer {
       throw new RuntimeException("Peer error: Unable to determine hostname: " + e.getMessage());
     }
 
-    return new Peer(peerId, bootstrapServerName, objFilePath, delay);
+    return new Peer(peerId, bootstrapServerName, objFilePath, storeKind, delay, trackHotKeys,
+            compressValues, hopDelayMs, leaveOnStop);
   }
 }
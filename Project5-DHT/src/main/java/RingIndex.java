@@ -0,0 +1,207 @@
+package main.java;
+
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.NavigableMap;
+import java.util.TreeMap;
+
+/**
+ * The bootstrap server's index of the ring: the peers ordered by their positions on the ring. The
+ * peers are kept in a red-black tree keyed by position, next to a map from each peer to its
+ * position, so adding, removing or moving a peer and finding a peer's neighbors all take O(log n)
+ * time, and every change reports the only peers it affects, the changed peer's new neighbors.
+ */
+public final class RingIndex {
+  private final NavigableMap<Integer, String> peersByToken = new TreeMap<>();
+  private final Map<String, Integer> tokens = new HashMap<>();
+
+  /**
+   * The neighbors of a position on the ring.
+   *
+   * @param predecessor the ID of the peer before the position
+   * @param successor the ID of the peer after the position
+   */
+  public record Neighbors(String predecessor, String successor) {
+  }
+
+  /**
+   * Where a peer was added to the ring.
+   *
+   * @param token the position of the peer
+   * @param neighbors the peer's neighbors
+   */
+  public record Placement(int token, Neighbors neighbors) {
+  }
+
+  /**
+   * Adds a peer to the ring.
+   *
+   * @param peerId the ID of the peer
+   * @param token the position of the peer
+   * @return the peer's neighbors, which are the peer itself if it is alone in the ring
+   * @throws IllegalArgumentException if the peer or the position is already in the ring
+   */
+  public synchronized Neighbors add(String peerId, int token) throws IllegalArgumentException {
+    if (this.tokens.containsKey(peerId) || this.peersByToken.containsKey(token)) {
+      throw new IllegalArgumentException("Ring index error: peer or position already in ring");
+    }
+
+    this.tokens.put(peerId, token);
+    this.peersByToken.put(token, peerId);
+    return neighborsOf(token);
+  }
+
+  /**
+   * Adds a peer at the first free position at or after the one it asks for, going on from 0 past
+   * the highest position. A joining peer asks for its numeric ID, which a peer moved there by
+   * rebalancing may already hold; it then joins right after that peer instead.
+   *
+   * @param peerId the ID of the peer
+   * @param token the position the peer asks for, which like the peers' IDs is not negative
+   * @return the position the peer was added at and its neighbors
+   * @throws IllegalArgumentException if the position is negative or the peer is already in the
+   *         ring
+   */
+  public synchronized Placement addNear(String peerId, int token) throws IllegalArgumentException {
+    if (token < 0) {
+      throw new IllegalArgumentException("Ring index error: negative position");
+    }
+
+    int free = token;
+    while (this.peersByToken.containsKey(free)) {
+      free = (free == Integer.MAX_VALUE) ? 0 : free + 1;
+    }
+    return new Placement(free, add(peerId, free));
+  }
+
+  /**
+   * Removes a peer from the ring.
+   *
+   * @param peerId the ID of the peer
+   * @return the peers that were before and after the removed peer, or null if the ring is now
+   *         empty
+   * @throws IllegalArgumentException if the peer is not in the ring
+   */
+  public synchronized Neighbors remove(String peerId) throws IllegalArgumentException {
+    Integer token = this.tokens.remove(peerId);
+    if (token == null) {
+      throw new IllegalArgumentException("Ring index error: peer doesn't exist in ring");
+    }
+
+    this.peersByToken.remove(token);
+    return this.peersByToken.isEmpty() ? null : neighborsOf(token);
+  }
+
+  /**
+   * Moves a peer to a new position, which must lie between its predecessor and its successor so
+   * that the order of the peers does not change.
+   *
+   * @param peerId the ID of the peer
+   * @param newToken the new position of the peer
+   * @return the old position of the peer
+   * @throws IllegalArgumentException if the peer is not in the ring, or the position is taken or
+   *         not between the peer's neighbors
+   */
+  public synchronized int move(String peerId, int newToken) throws IllegalArgumentException {
+    Integer oldToken = this.tokens.get(peerId);
+    if (oldToken == null) {
+      throw new IllegalArgumentException("Ring index error: peer doesn't exist in ring");
+    }
+    if (oldToken != newToken && this.peersByToken.containsKey(newToken)) {
+      throw new IllegalArgumentException("Ring index error: position already taken in ring");
+    }
+    Neighbors neighbors = neighborsOf(oldToken);
+    if (!Utils.inRange(newToken, this.tokens.get(neighbors.predecessor()),
+            this.tokens.get(neighbors.successor()))) {
+      throw new IllegalArgumentException("Ring index error: position not between neighbors");
+    }
+
+    this.peersByToken.remove(oldToken);
+    this.peersByToken.put(newToken, peerId);
+    this.tokens.put(peerId, newToken);
+    return oldToken;
+  }
+
+  /**
+   * Returns the neighbors of a peer.
+   *
+   * @param peerId the ID of the peer
+   * @return the peer's neighbors
+   * @throws IllegalArgumentException if the peer is not in the ring
+   */
+  public synchronized Neighbors neighbors(String peerId) throws IllegalArgumentException {
+    return neighborsOf(token(peerId));
+  }
+
+  /**
+   * Returns the position of a peer.
+   *
+   * @param peerId the ID of the peer
+   * @return the position of the peer
+   * @throws IllegalArgumentException if the peer is not in the ring
+   */
+  public synchronized int token(String peerId) throws IllegalArgumentException {
+    Integer token = this.tokens.get(peerId);
+    if (token == null) {
+      throw new IllegalArgumentException("Ring index error: peer doesn't exist in ring");
+    }
+    return token;
+  }
+
+  /**
+   * Returns the peer with the lowest position.
+   *
+   * @return the ID of the peer, or null if the ring is empty
+   */
+  public synchronized String first() {
+    return this.peersByToken.isEmpty() ? null : this.peersByToken.firstEntry().getValue();
+  }
+
+  /**
+   * Returns the peers in ring order.
+   *
+   * @return the IDs of the peers, ordered by position
+   */
+  public synchronized List<String> peers() {
+    return new ArrayList<>(this.peersByToken.values());
+  }
+
+  /**
+   * Returns a copy of the ring.
+   *
+   * @return the IDs of the peers keyed by their positions
+   */
+  public synchronized NavigableMap<Integer, String> snapshot() {
+    return new TreeMap<>(this.peersByToken);
+  }
+
+  /**
+   * Returns the number of peers in the ring.
+   *
+   * @return the number of peers
+   */
+  public synchronized int size() {
+    return this.peersByToken.size();
+  }
+
+  /**
+   * Finds the peers before and after a position, wrapping around the ring. A peer at the position
+   * itself is not its own neighbor unless it is alone.
+   *
+   * @param token the position
+   * @return the neighbors of the position
+   */
+  private Neighbors neighborsOf(int token) {
+    Map.Entry<Integer, String> pred = this.peersByToken.lowerEntry(token);
+    Map.Entry<Integer, String> succ = this.peersByToken.higherEntry(token);
+    if (pred == null) {
+      pred = this.peersByToken.lastEntry();
+    }
+    if (succ == null) {
+      succ = this.peersByToken.firstEntry();
+    }
+    return new Neighbors(pred.getValue(), succ.getValue());
+  }
+}
@@ -0,0 +1,363 @@
+package main.java;
+
+import java.io.BufferedInputStream;
+import java.io.BufferedOutputStream;
+import java.io.DataInputStream;
+import java.io.DataOutputStream;
+import java.io.EOFException;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.UncheckedIOException;
+import java.nio.ByteBuffer;
+import java.nio.channels.Channels;
+import java.nio.channels.FileChannel;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.StandardCopyOption;
+import java.nio.file.StandardOpenOption;
+import java.util.ArrayList;
+import java.util.Iterator;
+import java.util.List;
+import java.util.Map;
+import java.util.NoSuchElementException;
+
+/**
+ * An immutable table of object keys on disk, sorted by key, as written by {@link LsmObjectStore}.
+ * Each entry is a key and whether the object is live or was removed (a tombstone). Entries have a
+ * fixed size and are grouped into blocks of about 4 KB. The first key of every block is kept in an
+ * in-memory block index, so a lookup reads a single block. A Bloom filter over the keys, also kept
+ * in memory, lets lookups skip the table without any read if it cannot hold the key.
+ *
+ * <p>The file holds the entries, then the block index (the number of blocks and the first key of
+ * each block), then the Bloom filter, and finally a footer with the number of entries, the offset
+ * of the block index and a magic number.
+ */
+public final class SSTable {
+  private static final int ENTRY_BYTES = 9;
+  private static final int BLOCK_ENTRIES = 455;
+  private static final int BLOCK_BYTES = ENTRY_BYTES * BLOCK_ENTRIES;
+  private static final int FOOTER_BYTES = 20;
+  private static final int MAGIC = 0x5353544c;
+  private static final double FALSE_POSITIVE_RATE = 0.01;
+
+  private final Path path;
+  private final FileChannel channel;
+  private final long numEntries;
+  private final ObjectStore.Key[] blockIndex;
+  private final BloomFilter filter;
+
+  /**
+   * Constructs a table over an open file.
+   *
+   * @param path the path of the file
+   * @param channel the open file
+   * @param numEntries the number of entries in the table
+   * @param blockIndex the first key of every block
+   * @param filter the Bloom filter over the keys
+   */
+  private SSTable(Path path, FileChannel channel, long numEntries, ObjectStore.Key[] blockIndex,
+                  BloomFilter filter) {
+    this.path = path;
+    this.channel = channel;
+    this.numEntries = numEntries;
+    this.blockIndex = blockIndex;
+    this.filter = filter;
+  }
+
+  /**
+   * Writes a new table. Entries must be added in increasing key order. The table is written to a
+   * temporary file and only moved into place once it is complete and synced to disk.
+   */
+  public static final class Builder {
+    private final Path path;
+    private final Path tmpPath;
+    private final FileOutputStream fileOut;
+    private final DataOutputStream out;
+    private final BloomFilter filter;
+    private final List<ObjectStore.Key> blockIndex = new ArrayList<>();
+    private long numEntries;
+
+    /**
+     * Starts writing a new table.
+     *
+     * @param path the path of the table's file
+     * @param maxEntries an upper bound on the number of entries, used to size the Bloom filter
+     * @throws IOException if the file cannot be created
+     */
+    public Builder(Path path, long maxEntries) throws IOException {
+      this.path = path;
+      this.tmpPath = path.resolveSibling(path.getFileName() + ".tmp");
+      this.fileOut = new FileOutputStream(this.tmpPath.toFile());
+      this.out = new DataOutputStream(new BufferedOutputStream(this.fileOut));
+      this.filter = new BloomFilter(Math.max(1, maxEntries), FALSE_POSITIVE_RATE);
+    }
+
+    /**
+     * Adds an entry to the table.
+     *
+     * @param key the key, which must be greater than the key of the previous entry
+     * @param live true if the object is live, false for a tombstone
+     * @throws IOException if the entry cannot be written
+     */
+    public void add(ObjectStore.Key key, boolean live) throws IOException {
+      if (this.numEntries % BLOCK_ENTRIES == 0) {
+        this.blockIndex.add(key);
+      }
+      this.out.writeInt(key.objectNum());
+      this.out.writeInt(key.clientNum());
+      this.out.writeBoolean(live);
+      this.filter.add(key.toString());
+      this.numEntries++;
+    }
+
+    /**
+     * Finishes the table and opens it for reading.
+     *
+     * @return the new table
+     * @throws IOException if the table cannot be written or opened
+     */
+    public SSTable finish() throws IOException {
+      try (this.out) {
+        this.out.writeInt(this.blockIndex.size());
+        for (ObjectStore.Key key : this.blockIndex) {
+          this.out.writeInt(key.objectNum());
+          this.out.writeInt(key.clientNum());
+        }
+        this.filter.writeTo(this.out);
+        this.out.writeLong(this.numEntries);
+        this.out.writeLong(this.numEntries * ENTRY_BYTES);
+        this.out.writeInt(MAGIC);
+        this.out.flush();
+        this.fileOut.getFD().sync();
+      }
+
+      Files.move(this.tmpPath, this.path, StandardCopyOption.ATOMIC_MOVE);
+      return open(this.path);
+    }
+  }
+
+  /**
+   * Opens an existing table and loads its block index and Bloom filter.
+   *
+   * @param path the path of the table's file
+   * @return the table
+   * @throws IOException if the file cannot be read or is not a table
+   */
+  public static SSTable open(Path path) throws IOException {
+    FileChannel channel = FileChannel.open(path, StandardOpenOption.READ);
+    try {
+      long size = channel.size();
+      if (size < FOOTER_BYTES) {
+        throw new IOException("SSTable error: truncated table " + path);
+      }
+      ByteBuffer footer = ByteBuffer.allocate(FOOTER_BYTES);
+      readFully(channel, footer, size - FOOTER_BYTES);
+      long numEntries = footer.getLong();
+      long indexOffset = footer.getLong();
+      if (footer.getInt() != MAGIC) {
+        throw new IOException("SSTable error: bad magic number in " + path);
+      }
+
+      // the stream is not closed since that would close the channel
+      DataInputStream in = new DataInputStream(new BufferedInputStream(
+              Channels.newInputStream(channel.position(indexOffset))));
+      ObjectStore.Key[] blockIndex = new ObjectStore.Key[in.readInt()];
+      for (int i = 0; i < blockIndex.length; i++) {
+        blockIndex[i] = new ObjectStore.Key(in.readInt(), in.readInt());
+      }
+      BloomFilter filter = BloomFilter.readFrom(in);
+
+      return new SSTable(path, channel, numEntries, blockIndex, filter);
+    } catch (IOException e) {
+      channel.close();
+      throw e;
+    }
+  }
+
+  /**
+   * Checks whether the table might hold a key, without reading the file.
+   *
+   * @param key the key
+   * @return false if the table definitely does not hold the key, true if it might
+   */
+  public boolean mightContain(ObjectStore.Key key) {
+    return this.filter.mightContain(key.toString());
+  }
+
+  /**
+   * Looks up a key, reading at most one block.
+   *
+   * @param key the key
+   * @return true if the object is live, false if the table holds a tombstone for it, or null if
+   *         the table does not hold the key
+   * @throws IOException if the block cannot be read
+   */
+  public Boolean get(ObjectStore.Key key) throws IOException {
+    int block = floorBlock(key);
+    if (block < 0) {
+      return null;
+    }
+
+    ByteBuffer buf = readBlock(block);
+    int lo = 0;
+    int hi = buf.limit() / ENTRY_BYTES - 1;
+    while (lo <= hi) {
+      int mid = (lo + hi) >>> 1;
+      int offset = mid * ENTRY_BYTES;
+      int cmp = new ObjectStore.Key(buf.getInt(offset), buf.getInt(offset + 4)).compareTo(key);
+      if (cmp < 0) {
+        lo = mid + 1;
+      } else if (cmp > 0) {
+        hi = mid - 1;
+      } else {
+        return buf.get(offset + 8) != 0;
+      }
+    }
+    return null;
+  }
+
+  /**
+   * Iterates over the entries of the table in key order, starting at the first key not less than
+   * the given one. The file is read one block at a time.
+   *
+   * @param from the key to start from
+   * @return an iterator over the entries, which throws {@link UncheckedIOException} if a block
+   *         cannot be read
+   */
+  public Iterator<Map.Entry<ObjectStore.Key, Boolean>> iterator(ObjectStore.Key from) {
+    return new Iterator<>() {
+      private int block = Math.max(0, floorBlock(from));
+      private ByteBuffer buf = ByteBuffer.allocate(0);
+      private Map.Entry<ObjectStore.Key, Boolean> next = skipTo(from);
+
+      @Override
+      public boolean hasNext() {
+        return this.next != null;
+      }
+
+      @Override
+      public Map.Entry<ObjectStore.Key, Boolean> next() {
+        if (this.next == null) {
+          throw new NoSuchElementException();
+        }
+        Map.Entry<ObjectStore.Key, Boolean> entry = this.next;
+        this.next = load();
+        return entry;
+      }
+
+      private Map.Entry<ObjectStore.Key, Boolean> skipTo(ObjectStore.Key key) {
+        Map.Entry<ObjectStore.Key, Boolean> entry = load();
+        while (entry != null && entry.getKey().compareTo(key) < 0) {
+          entry = load();
+        }
+        return entry;
+      }
+
+      private Map.Entry<ObjectStore.Key, Boolean> load() {
+        if (!this.buf.hasRemaining()) {
+          if (this.block >= blockIndex.length) {
+            return null;
+          }
+          try {
+            this.buf = readBlock(this.block++);
+          } catch (IOException e) {
+            throw new UncheckedIOException(e);
+          }
+        }
+        ObjectStore.Key key = new ObjectStore.Key(this.buf.getInt(), this.buf.getInt());
+        return Map.entry(key, this.buf.get() != 0);
+      }
+    };
+  }
+
+  /**
+   * Returns the number of entries in the table, tombstones included.
+   *
+   * @return the number of entries
+   */
+  public long numEntries() {
+    return this.numEntries;
+  }
+
+  /**
+   * Returns the path of the table's file.
+   *
+   * @return the path of the file
+   */
+  public Path path() {
+    return this.path;
+  }
+
+  /**
+   * Closes the table, keeping its file.
+   *
+   * @throws IOException if the file cannot be closed
+   */
+  public void close() throws IOException {
+    this.channel.close();
+  }
+
+  /**
+   * Closes the table and deletes its file.
+   *
+   * @throws IOException if the file cannot be deleted
+   */
+  public void delete() throws IOException {
+    this.channel.close();
+    Files.deleteIfExists(this.path);
+  }
+
+  /**
+   * Finds the block that would hold a key.
+   *
+   * @param key the key
+   * @return the number of the last block whose first key is not greater than the key, or -1 if
+   *         the key comes before every block
+   */
+  private int floorBlock(ObjectStore.Key key) {
+    int lo = 0;
+    int hi = this.blockIndex.length - 1;
+    while (lo <= hi) {
+      int mid = (lo + hi) >>> 1;
+      if (this.blockIndex[mid].compareTo(key) <= 0) {
+        lo = mid + 1;
+      } else {
+        hi = mid - 1;
+      }
+    }
+    return hi;
+  }
+
+  /**
+   * Reads a block of entries.
+   *
+   * @param block the number of the block
+   * @return the entries of the block, ready to be read
+   * @throws IOException if the block cannot be read
+   */
+  private ByteBuffer readBlock(int block) throws IOException {
+    long offset = (long) block * BLOCK_BYTES;
+    int length = (int) Math.min(BLOCK_BYTES, this.numEntries * ENTRY_BYTES - offset);
+    ByteBuffer buf = ByteBuffer.allocate(length);
+    readFully(this.channel, buf, offset);
+    return buf;
+  }
+
+  /**
+   * Fills a buffer from a file at the given position and flips it for reading.
+   *
+   * @param channel the file
+   * @param buf the buffer
+   * @param position the position in the file
+   * @throws IOException if the file ends before the buffer is full
+   */
+  private static void readFully(FileChannel channel, ByteBuffer buf, long position)
+          throws IOException {
+    while (buf.hasRemaining()) {
+      if (channel.read(buf, position + buf.position()) < 0) {
+        throw new EOFException("SSTable error: unexpected end of file");
+      }
+    }
+    buf.flip();
+  }
+}
@@ -0,0 +1,225 @@
+package main.java;
+
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * A hierarchical timer wheel. Time is cut into ticks, and the wheel has four levels of 64 slots.
+ * A level-0 slot holds the timers due in one tick, a level-1 slot those due in a 64-tick span,
+ * and so on, so the wheel covers 2^24 ticks ahead; timers further out wait in the top level. Each
+ * slot is a doubly-linked list, so scheduling and cancelling a timer take constant time. As time
+ * advances, each tick expires one level-0 slot, and whenever a level wraps around, the next slot
+ * of the level above is cascaded: its timers are moved down to the level matching the time they
+ * have left. Every timer is moved at most once per level.
+ *
+ * <p>The wheel is not thread-safe.
+ *
+ * @param <T> the type of the items the timers carry
+ */
+public final class TimerWheel<T> {
+  private static final int SLOT_BITS = 6;
+  private static final int NUM_SLOTS = 1 << SLOT_BITS;
+  private static final int SLOT_MASK = NUM_SLOTS - 1;
+  private static final int NUM_LEVELS = 4;
+  private static final long MAX_TICKS_AHEAD = (1L << (SLOT_BITS * NUM_LEVELS)) - 1;
+
+  private final long tickMs;
+  private final Timer<T>[][] slots;
+  private long currentTick;
+  private int size;
+
+  /**
+   * A timer scheduled on a wheel, which can be used to cancel it.
+   *
+   * @param <T> the type of the item the timer carries
+   */
+  public static final class Timer<T> {
+    private final T item;
+    private final long expiresAt;
+    private final long deadlineTick;
+    private Timer<T> prev;
+    private Timer<T> next;
+
+    /**
+     * Constructs a new timer, not linked into any slot yet.
+     *
+     * @param item the item the timer carries
+     * @param expiresAt the time the timer expires, in milliseconds since the epoch
+     * @param deadlineTick the tick the timer expires in
+     */
+    private Timer(T item, long expiresAt, long deadlineTick) {
+      this.item = item;
+      this.expiresAt = expiresAt;
+      this.deadlineTick = deadlineTick;
+    }
+
+    /**
+     * Returns the item the timer carries.
+     *
+     * @return the item
+     */
+    public T item() {
+      return this.item;
+    }
+
+    /**
+     * Returns the time the timer expires.
+     *
+     * @return the time, in milliseconds since the epoch
+     */
+    public long expiresAt() {
+      return this.expiresAt;
+    }
+  }
+
+  /**
+   * Constructs a new, empty timer wheel.
+   *
+   * @param tickMs the length of a tick in milliseconds, which is the wheel's resolution
+   * @param now the current time, in milliseconds since the epoch
+   * @throws IllegalArgumentException if the tick length is not positive
+   */
+  @SuppressWarnings("unchecked")
+  public TimerWheel(long tickMs, long now) throws IllegalArgumentException {
+    if (tickMs <= 0) {
+      throw new IllegalArgumentException("Timer wheel error: tick length must be positive");
+    }
+
+    this.tickMs = tickMs;
+    this.currentTick = Math.floorDiv(now, tickMs);
+    this.slots = new Timer[NUM_LEVELS][NUM_SLOTS];
+    for (Timer<T>[] level : this.slots) {
+      for (int i = 0; i < NUM_SLOTS; i++) {
+        Timer<T> head = new Timer<>(null, 0, 0);
+        head.prev = head;
+        head.next = head;
+        level[i] = head;
+      }
+    }
+  }
+
+  /**
+   * Schedules a timer. A timer is never expired before its time, and at most one tick after it.
+   * A time that has already passed expires on the next tick.
+   *
+   * @param item the item the timer carries
+   * @param expiresAt the time the timer expires, in milliseconds since the epoch
+   * @return the timer
+   */
+  public Timer<T> schedule(T item, long expiresAt) {
+    long deadlineTick = Math.max(Math.floorDiv(expiresAt + this.tickMs - 1, this.tickMs),
+            this.currentTick + 1);
+    Timer<T> timer = new Timer<>(item, expiresAt, deadlineTick);
+    insert(timer);
+    this.size++;
+    return timer;
+  }
+
+  /**
+   * Cancels a timer. Cancelling a timer that has expired or was cancelled already does nothing.
+   *
+   * @param timer the timer
+   */
+  public void cancel(Timer<T> timer) {
+    if (timer.next != null) {
+      unlink(timer);
+      this.size--;
+    }
+  }
+
+  /**
+   * Advances the wheel to the given time and expires every timer due by then.
+   *
+   * @param now the current time, in milliseconds since the epoch
+   * @return the items of the expired timers, in the order they expired
+   */
+  public List<T> advance(long now) {
+    List<T> expired = new ArrayList<>();
+    long targetTick = Math.floorDiv(now, this.tickMs);
+
+    while (this.currentTick < targetTick) {
+      if (this.size == 0) {
+        this.currentTick = targetTick;
+        break;
+      }
+
+      this.currentTick++;
+      for (int level = 1; level < NUM_LEVELS
+              && (this.currentTick & ((1L << (SLOT_BITS * level)) - 1)) == 0; level++) {
+        cascade(level);
+      }
+
+      Timer<T> head = this.slots[0][(int) (this.currentTick & SLOT_MASK)];
+      while (head.next != head) {
+        Timer<T> timer = head.next;
+        unlink(timer);
+        this.size--;
+        expired.add(timer.item);
+      }
+    }
+    return expired;
+  }
+
+  /**
+   * Returns the number of timers that are scheduled and have not expired yet.
+   *
+   * @return the number of pending timers
+   */
+  public int size() {
+    return this.size;
+  }
+
+  /**
+   * Moves the timers of the current slot of a level down to the levels matching the time they
+   * have left.
+   *
+   * @param level the level, at least 1
+   */
+  private void cascade(int level) {
+    Timer<T> head = this.slots[level][(int) ((this.currentTick >>> (SLOT_BITS * level))
+            & SLOT_MASK)];
+    Timer<T> timer = head.next;
+    head.prev = head;
+    head.next = head;
+
+    while (timer != head) {
+      Timer<T> next = timer.next;
+      insert(timer);
+      timer = next;
+    }
+  }
+
+  /**
+   * Links a timer into the slot for its deadline. The level is the lowest one whose span covers
+   * the ticks left until the deadline; timers beyond the top level's span go where the span ends
+   * and are cascaded back up until they are in reach.
+   *
+   * @param timer the timer
+   */
+  private void insert(Timer<T> timer) {
+    long ticksLeft = Math.min(Math.max(0, timer.deadlineTick - this.currentTick), MAX_TICKS_AHEAD);
+    long slotTick = this.currentTick + ticksLeft;
+    int level = 0;
+    while (level < NUM_LEVELS - 1 && ticksLeft >= 1L << (SLOT_BITS * (level + 1))) {
+      level++;
+    }
+
+    Timer<T> head = this.slots[level][(int) ((slotTick >>> (SLOT_BITS * level)) & SLOT_MASK)];
+    timer.prev = head.prev;
+    timer.next = head;
+    head.prev.next = timer;
+    head.prev = timer;
+  }
+
+  /**
+   * Unlinks a timer from its slot.
+   *
+   * @param timer the timer
+   */
+  private void unlink(Timer<T> timer) {
+    timer.prev.next = timer.next;
+    timer.next.prev = timer.prev;
+    timer.prev = null;
+    timer.next = null;
+  }
+}
@@ -1,10 +1,14 @@
 package main.java;
 
+import java.nio.charset.StandardCharsets;
+import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.HashMap;
 import java.util.Iterator;
 import java.util.LinkedHashMap;
+import java.util.List;
 import java.util.Map;
+import java.util.NavigableMap;
 
 /**
  * Utility class to make life easier.
@@ -12,6 +16,12 @@ import java.util.Map;
 public final class Utils {
   public static final int PORT = 7000; // universal port number
 
+  // statuses of the objects of a batch, one byte per object
+  public static final byte BATCH_NOT_FOUND = 0;
+  public static final byte BATCH_OK = 1;
+  public static final byte BATCH_NOT_OWNED = 2;
+  public static final byte BATCH_UNSUPPORTED = 3; // the peer's store cannot hold values
+
   /**
    * Builds a message string from an ordered map of key-value pairs.
    *
@@ -46,7 +56,7 @@ public final class Utils {
     String[] parts = msg.substring(1, msg.length() - 1).split(", ");
 
     for (String part : parts) {
-      String[] pair = part.split(":");
+      String[] pair = part.split(":", 2);
       String key = pair[0];
       String value = pair[1];
       unpackedMsg.put(key, value);
@@ -55,6 +65,79 @@ public final class Utils {
     return unpackedMsg;
   }
 
+  /**
+   * Joins a list of peer IDs into a single message value. The IDs are separated by spaces since
+   * commas and colons are reserved by the message format.
+   *
+   * @param peerIds the peer IDs
+   * @return the peer IDs as a single string
+   */
+  public static String joinPeerIds(List<String> peerIds) {
+    return String.join(" ", peerIds);
+  }
+
+  /**
+   * Splits a message value created by {@link #joinPeerIds(List)} back into a list of peer IDs.
+   *
+   * @param peerIds the peer IDs as a single string
+   * @return the list of peer IDs, empty if there are none
+   */
+  public static List<String> splitPeerIds(String peerIds) {
+    if (peerIds == null || peerIds.isBlank()) {
+      return new ArrayList<>();
+    }
+    return new ArrayList<>(Arrays.asList(peerIds.trim().split(" ")));
+  }
+
+  /**
+   * Checks whether a key falls in the ring range (start, end]. If start is not below end, the
+   * range wraps around the top of the ring, which is also the case for a ring with a single peer.
+   *
+   * @param key the key
+   * @param start the exclusive start of the range
+   * @param end the inclusive end of the range
+   * @return true if the key falls in the range, false otherwise
+   */
+  public static boolean inRange(int key, int start, int end) {
+    if (start < end) {
+      return key > start && key <= end;
+    }
+    return key > start || key <= end;
+  }
+
+  /**
+   * Finds the peer that owns a key, that is the first peer at or after the key going around the
+   * ring.
+   *
+   * @param ring the IDs of the peers in the ring, keyed by their position on the ring
+   * @param key the key
+   * @return the ID of the peer owning the key
+   */
+  public static String findOwner(NavigableMap<Integer, String> ring, int key) {
+    Map.Entry<Integer, String> owner = ring.ceilingEntry(key);
+    return (owner != null) ? owner.getValue() : ring.firstEntry().getValue();
+  }
+
+  /**
+   * Hashes a string with 64-bit FNV-1a followed by a final avalanche step, so that every bit of
+   * the result, and in particular both 32-bit halves, is usable as a hash.
+   *
+   * @param str the string
+   * @return the 64-bit hash of the string
+   */
+  public static long hash64(String str) {
+    long hash = 0xcbf29ce484222325L;
+    for (byte b : str.getBytes(StandardCharsets.UTF_8)) {
+      hash ^= b & 0xff;
+      hash *= 0x100000001b3L;
+    }
+
+    hash ^= hash >>> 33;
+    hash *= 0xff51afd7ed558ccdL;
+    hash ^= hash >>> 33;
+    return hash;
+  }
+
   /**
    * Extracts numeric portion from an ID.
    *
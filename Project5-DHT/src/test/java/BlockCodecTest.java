@@ -0,0 +1,110 @@
+package test.java;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.DataInputStream;
+import java.io.DataOutputStream;
+import java.io.IOException;
+import java.util.Arrays;
+import java.util.Random;
+import main.java.BlockCodec;
+
+/**
+ * Tests of {@link BlockCodec}: blocks that shrink are compressed and decode to their contents,
+ * blocks that do not are kept raw, and a value streamed as blocks can be read, copied and skipped.
+ */
+final class BlockCodecTest {
+  private BlockCodecTest() {
+  }
+
+  /**
+   * Runs the tests.
+   *
+   * @throws IOException if a block cannot be decoded or streamed
+   */
+  static void run() throws IOException {
+    byte[] text = new byte[BlockCodec.BLOCK_SIZE];
+    for (int i = 0; i < text.length; i++) {
+      text[i] = (byte) "the quick brown fox ".charAt(i % 20);
+    }
+    byte[] random = new byte[BlockCodec.BLOCK_SIZE];
+    new Random(1).nextBytes(random);
+
+    checkEncoding(text, random);
+    checkStreaming(text, random);
+
+    Check.fails(IllegalArgumentException.class, () -> BlockCodec.encode(text, 0, false),
+            "encoding an empty block");
+    Check.fails(IllegalArgumentException.class,
+        () -> BlockCodec.encode(text, BlockCodec.BLOCK_SIZE + 1, false), "encoding a long block");
+  }
+
+  /**
+   * Checks that text compresses and random bytes do not, and that every form decodes to the
+   * original contents.
+   *
+   * @param text the contents of a text block
+   * @param random the contents of a random block
+   * @throws IOException if a block cannot be decoded
+   */
+  private static void checkEncoding(byte[] text, byte[] random) throws IOException {
+    BlockCodec.Block compressed = BlockCodec.encode(text, text.length, true);
+    Check.that(compressed.compressed(), "text block not compressed");
+    Check.that(compressed.framedLength() < text.length / 2, "text block compressed to only "
+            + compressed.framedLength() + " bytes");
+    Check.that(Arrays.equals(text, compressed.decode()), "compressed block decoded wrong");
+
+    BlockCodec.Block raw = compressed.recode(false);
+    Check.that(!raw.compressed(), "block recoded raw is compressed");
+    Check.that(Arrays.equals(text, raw.decode()), "block recoded raw decoded wrong");
+    Check.that(raw.recode(true).compressed(), "block recoded compressed is raw");
+
+    BlockCodec.Block incompressible = BlockCodec.encode(random, random.length, true);
+    Check.that(!incompressible.compressed(), "random block compressed");
+    Check.that(Arrays.equals(random, incompressible.decode()), "random block decoded wrong");
+  }
+
+  /**
+   * Checks that a value of two blocks is read back block by block up to its end marker, copied
+   * whole, and skipped without touching what follows it.
+   *
+   * @param text the contents of the first block
+   * @param random the contents of the second block
+   * @throws IOException if the value cannot be written or read
+   */
+  private static void checkStreaming(byte[] text, byte[] random) throws IOException {
+    ByteArrayOutputStream bytes = new ByteArrayOutputStream();
+    DataOutputStream out = new DataOutputStream(bytes);
+    BlockCodec.encode(text, text.length, true).writeTo(out);
+    BlockCodec.encode(random, 1000, false).writeTo(out);
+    BlockCodec.writeEnd(out);
+    out.writeInt(42);
+    byte[] value = bytes.toByteArray();
+
+    DataInputStream in = new DataInputStream(new ByteArrayInputStream(value));
+    BlockCodec.Block first = BlockCodec.readFrom(in);
+    BlockCodec.Block second = BlockCodec.readFrom(in);
+    Check.that(first != null && Arrays.equals(text, first.decode()), "first block read wrong");
+    Check.that(second != null && Arrays.equals(Arrays.copyOf(random, 1000), second.decode()),
+            "second block read wrong");
+    Check.equal(null, BlockCodec.readFrom(in), "block after the end marker");
+    Check.equal(42, in.readInt(), "data after the value");
+
+    ByteArrayOutputStream copied = new ByteArrayOutputStream();
+    in = new DataInputStream(new ByteArrayInputStream(value));
+    BlockCodec.copy(in, new DataOutputStream(copied));
+    Check.that(Arrays.equals(Arrays.copyOf(value, value.length - 4), copied.toByteArray()),
+            "copied value differs");
+
+    in = new DataInputStream(new ByteArrayInputStream(value));
+    BlockCodec.skip(in);
+    Check.equal(42, in.readInt(), "data after a skipped value");
+
+    ByteArrayOutputStream malformed = new ByteArrayOutputStream();
+    out = new DataOutputStream(malformed);
+    out.writeInt(BlockCodec.BLOCK_SIZE + 1);
+    out.writeInt(1);
+    Check.fails(IOException.class, () -> BlockCodec.readFrom(new DataInputStream(
+            new ByteArrayInputStream(malformed.toByteArray()))), "reading an oversized block");
+  }
+}
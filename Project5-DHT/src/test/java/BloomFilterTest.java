@@ -0,0 +1,68 @@
+package test.java;
+
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.DataInputStream;
+import java.io.DataOutputStream;
+import java.io.IOException;
+import main.java.BloomFilter;
+
+/**
+ * Tests of {@link BloomFilter}: no key that was added is ruled out, keys that were not added are
+ * rarely let through, and a saved filter answers like the original.
+ */
+final class BloomFilterTest {
+  private static final int NUM_KEYS = 10000;
+  private static final double FALSE_POSITIVE_RATE = 0.01;
+
+  private BloomFilterTest() {
+  }
+
+  /**
+   * Runs the tests.
+   *
+   * @throws IOException if a filter cannot be saved or read back
+   */
+  static void run() throws IOException {
+    BloomFilter filter = new BloomFilter(NUM_KEYS, FALSE_POSITIVE_RATE);
+    for (int i = 0; i < NUM_KEYS; i++) {
+      filter.add("1::" + i);
+    }
+    checkAnswers(filter, "filter");
+
+    ByteArrayOutputStream bytes = new ByteArrayOutputStream();
+    filter.writeTo(new DataOutputStream(bytes));
+    BloomFilter saved = BloomFilter.readFrom(new DataInputStream(
+            new ByteArrayInputStream(bytes.toByteArray())));
+    checkAnswers(saved, "saved filter");
+    Check.equal(filter.sizeInBytes(), saved.sizeInBytes(), "size of the saved filter");
+
+    Check.fails(IllegalArgumentException.class, () -> new BloomFilter(0, FALSE_POSITIVE_RATE),
+            "filter for no keys");
+    Check.fails(IllegalArgumentException.class, () -> new BloomFilter(NUM_KEYS, 1.0),
+            "false positive rate of 1");
+  }
+
+  /**
+   * Checks that a filter holding the test keys has no false negatives, and no more than twice the
+   * target rate of false positives.
+   *
+   * @param filter the filter
+   * @param name the name of the filter in failure messages
+   */
+  private static void checkAnswers(BloomFilter filter, String name) {
+    int falseNegatives = 0;
+    int falsePositives = 0;
+    for (int i = 0; i < NUM_KEYS; i++) {
+      if (!filter.mightContain("1::" + i)) {
+        falseNegatives++;
+      }
+      if (filter.mightContain("2::" + i)) {
+        falsePositives++;
+      }
+    }
+    Check.equal(0, falseNegatives, "false negatives of the " + name);
+    Check.that(falsePositives <= 2 * FALSE_POSITIVE_RATE * NUM_KEYS,
+            falsePositives + " false positives of the " + name + " out of " + NUM_KEYS);
+  }
+}
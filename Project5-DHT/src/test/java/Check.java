@@ -0,0 +1,86 @@
+package test.java;
+
+import java.util.Objects;
+
+/**
+ * The checks used by the unit tests, which run without a test framework. A failed check is printed
+ * and counted, and the test goes on, so one run reports every failure.
+ */
+final class Check {
+  private static int failures;
+
+  /**
+   * A piece of test code that may throw.
+   */
+  interface Action {
+    /**
+     * Runs the code.
+     *
+     * @throws Exception if the code fails
+     */
+    void run() throws Exception;
+  }
+
+  private Check() {
+  }
+
+  /**
+   * Checks that a condition holds.
+   *
+   * @param condition the condition
+   * @param what what went wrong if the condition does not hold
+   */
+  static void that(boolean condition, String what) {
+    if (!condition) {
+      failures++;
+      System.err.println("  FAILED: " + what);
+    }
+  }
+
+  /**
+   * Checks that a number is the expected one.
+   *
+   * @param expected the expected number
+   * @param actual the actual number
+   * @param what what the number is
+   */
+  static void equal(long expected, long actual, String what) {
+    that(expected == actual, what + ": expected " + expected + ", got " + actual);
+  }
+
+  /**
+   * Checks that a value is equal to the expected one.
+   *
+   * @param expected the expected value
+   * @param actual the actual value
+   * @param what what the value is
+   */
+  static void equal(Object expected, Object actual, String what) {
+    that(Objects.equals(expected, actual), what + ": expected " + expected + ", got " + actual);
+  }
+
+  /**
+   * Checks that some code throws an exception of the given type.
+   *
+   * @param type the type of exception
+   * @param action the code
+   * @param what what the code does
+   */
+  static void fails(Class<? extends Exception> type, Action action, String what) {
+    try {
+      action.run();
+      that(false, what + ": no " + type.getSimpleName() + " thrown");
+    } catch (Exception e) {
+      that(type.isInstance(e), what + ": threw " + e + " instead of " + type.getSimpleName());
+    }
+  }
+
+  /**
+   * Returns the number of checks that failed so far.
+   *
+   * @return the number of failed checks
+   */
+  static int failures() {
+    return failures;
+  }
+}
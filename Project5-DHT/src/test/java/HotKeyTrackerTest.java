@@ -0,0 +1,47 @@
+package test.java;
+
+import main.java.HotKeyTracker;
+
+/**
+ * Tests of {@link HotKeyTracker}: estimates never fall below the true counts within the window,
+ * and a cold key is not mistaken for a hot one.
+ */
+final class HotKeyTrackerTest {
+  private static final long WINDOW_MS = 60000;
+  private static final int NUM_SLICES = 5;
+
+  private HotKeyTrackerTest() {
+  }
+
+  /**
+   * Runs the tests. The window is long enough that it does not slide past any access while they
+   * run.
+   */
+  static void run() {
+    HotKeyTracker tracker = new HotKeyTracker(WINDOW_MS, NUM_SLICES);
+    int hotEstimate = 0;
+    for (int i = 0; i < 100; i++) {
+      hotEstimate = tracker.record("1::hot");
+    }
+    Check.that(hotEstimate >= 100, "key accessed 100 times estimated at " + hotEstimate);
+    Check.that(tracker.record("1::cold") < 100, "cold key estimated as hot");
+
+    // key i is accessed i + 1 times
+    int underestimates = 0;
+    for (int i = 0; i < 200; i++) {
+      int estimate = 0;
+      for (int j = 0; j <= i; j++) {
+        estimate = tracker.record("2::" + i);
+      }
+      if (estimate < i + 1) {
+        underestimates++;
+      }
+    }
+    Check.equal(0, underestimates, "keys estimated below their access count");
+
+    Check.fails(IllegalArgumentException.class, () -> new HotKeyTracker(0, NUM_SLICES),
+            "empty window");
+    Check.fails(IllegalArgumentException.class, () -> new HotKeyTracker(WINDOW_MS, 0),
+            "window without slices");
+  }
+}
@@ -0,0 +1,134 @@
+package test.java;
+
+import java.io.IOException;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.util.ArrayList;
+import java.util.Comparator;
+import java.util.List;
+import java.util.TreeSet;
+import java.util.stream.Stream;
+import main.java.LsmObjectStore;
+import main.java.MerkleTree;
+import main.java.ObjectStore;
+
+/**
+ * Tests of {@link LsmObjectStore}: stores and removals that are written without reading the
+ * tables leave the same count and Merkle tree as a store that checked every key, whether the keys
+ * were in a table, in the memtable or nowhere.
+ */
+final class LsmObjectStoreTest {
+  private static final int NUM_FLUSHED = 65536; // exactly fills the first memtable
+  private static final long FLUSH_TIMEOUT_MS = 10000;
+
+  private LsmObjectStoreTest() {
+  }
+
+  /**
+   * Runs the tests.
+   *
+   * @throws IOException if the store's directory cannot be created or deleted
+   * @throws InterruptedException if interrupted while waiting for the flush
+   */
+  static void run() throws IOException, InterruptedException {
+    Path dir = Files.createTempDirectory("lsm-test");
+    try {
+      LsmObjectStore store = new LsmObjectStore(dir.resolve("objects.txt").toString());
+      TreeSet<Integer> expected = new TreeSet<>();
+
+      store.storeAll(range(0, NUM_FLUSHED));
+      addRange(expected, 0, NUM_FLUSHED);
+      awaitFlush(store);
+      check(store, expected, "after the flush");
+
+      // already in a table, and new
+      store.storeAll(range(0, 100));
+      store.storeAll(range(NUM_FLUSHED, NUM_FLUSHED + 100));
+      addRange(expected, NUM_FLUSHED, NUM_FLUSHED + 100);
+      check(store, expected, "after storing again");
+
+      // in a table, in the memtable, and never stored
+      store.removeAll(range(100, 200));
+      store.removeAll(range(NUM_FLUSHED, NUM_FLUSHED + 10));
+      store.removeAll(range(NUM_FLUSHED + 1000, NUM_FLUSHED + 1050));
+      expected.subSet(100, 200).clear();
+      expected.subSet(NUM_FLUSHED, NUM_FLUSHED + 10).clear();
+      // removed blind, then stored again before the memtable is verified
+      store.removeAll(range(200, 210));
+      store.removeAll(range(NUM_FLUSHED + 2000, NUM_FLUSHED + 2010));
+      store.storeAll(range(200, 210));
+      store.storeAll(range(NUM_FLUSHED + 2000, NUM_FLUSHED + 2010));
+      addRange(expected, NUM_FLUSHED + 2000, NUM_FLUSHED + 2010);
+      check(store, expected, "after removing");
+
+      Check.that(!store.contains(1, "obj150"), "removed object still found");
+      Check.that(store.contains(1, "obj205"), "object stored again not found");
+      store.clear();
+      Check.equal(0, store.size(), "objects after clearing");
+    } finally {
+      try (Stream<Path> paths = Files.walk(dir)) {
+        for (Path path : paths.sorted(Comparator.reverseOrder()).toList()) {
+          Files.deleteIfExists(path);
+        }
+      }
+    }
+  }
+
+  /**
+   * Returns the keys of client 1's objects in a range of object numbers.
+   *
+   * @param start the first object number
+   * @param end the object number after the last one
+   * @return the keys
+   */
+  private static List<String> range(int start, int end) {
+    List<String> keys = new ArrayList<>();
+    for (int i = start; i < end; i++) {
+      keys.add(ObjectStore.toKey(1, "obj" + i));
+    }
+    return keys;
+  }
+
+  /**
+   * Adds a range of object numbers to a set.
+   *
+   * @param objectNums the set
+   * @param start the first object number
+   * @param end the object number after the last one
+   */
+  private static void addRange(TreeSet<Integer> objectNums, int start, int end) {
+    for (int i = start; i < end; i++) {
+      objectNums.add(i);
+    }
+  }
+
+  /**
+   * Waits until the compaction thread has flushed every frozen memtable.
+   *
+   * @param store the store
+   * @throws InterruptedException if interrupted while waiting
+   */
+  private static void awaitFlush(LsmObjectStore store) throws InterruptedException {
+    long deadline = System.currentTimeMillis() + FLUSH_TIMEOUT_MS;
+    while (!store.dump().contains(" 0 frozen memtables, 1 tables")
+            && System.currentTimeMillis() < deadline) {
+      Thread.sleep(10);
+    }
+    Check.that(store.dump().contains(" 0 frozen memtables, 1 tables"),
+            "memtable not flushed: " + store.dump());
+  }
+
+  /**
+   * Checks the store's count and Merkle root against a tree built from the expected objects.
+   *
+   * @param store the store
+   * @param expected the object numbers of the objects that should be stored
+   * @param when when the check happens, for failure messages
+   */
+  private static void check(LsmObjectStore store, TreeSet<Integer> expected, String when) {
+    MerkleTree tree = new MerkleTree(ObjectStore.MERKLE_DEPTH);
+    expected.forEach(objectNum -> tree.add(ObjectStore.toKey(1, String.valueOf(objectNum))));
+    Check.equal(expected.size(), store.size(), "objects " + when);
+    Check.equal(tree.hash(1), store.merkleHash(1), "Merkle root " + when);
+  }
+}
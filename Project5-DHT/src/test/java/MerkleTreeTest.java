@@ -0,0 +1,93 @@
+package test.java;
+
+import main.java.MerkleTree;
+
+/**
+ * Tests of {@link MerkleTree}: the tree depends only on its set of keys, and two trees that differ
+ * by one key differ exactly in that key's leaf and the nodes above it.
+ */
+final class MerkleTreeTest {
+  private static final int DEPTH = 8;
+  private static final int NUM_KEYS = 1000;
+
+  private MerkleTreeTest() {
+  }
+
+  /**
+   * Runs the tests.
+   */
+  static void run() {
+    ignoresOrder();
+    removesKeys();
+    narrowsDownDifferences();
+    checksDepth();
+  }
+
+  /**
+   * Two trees built from the same keys in different orders are identical.
+   */
+  private static void ignoresOrder() {
+    MerkleTree forward = new MerkleTree(DEPTH);
+    MerkleTree backward = new MerkleTree(DEPTH);
+    for (int i = 0; i < NUM_KEYS; i++) {
+      forward.add("1::" + i);
+      backward.add("1::" + (NUM_KEYS - 1 - i));
+    }
+    for (int node = 1; node < 2 << DEPTH; node++) {
+      Check.equal(forward.hash(node), backward.hash(node), "hash of node " + node);
+    }
+  }
+
+  /**
+   * Removing every key, or clearing the tree, leaves every node at 0.
+   */
+  private static void removesKeys() {
+    MerkleTree tree = new MerkleTree(DEPTH);
+    for (int i = 0; i < NUM_KEYS; i++) {
+      tree.add("1::" + i);
+    }
+    Check.that(tree.hash(1) != 0, "root of a tree with keys is 0");
+    for (int i = 0; i < NUM_KEYS; i++) {
+      tree.remove("1::" + i);
+    }
+    Check.equal(0, tree.hash(1), "root after removing every key");
+
+    tree.add("1::1");
+    tree.clear();
+    Check.equal(0, tree.hash(1), "root after clearing");
+  }
+
+  /**
+   * Of the leaves of two trees that differ by one key, only that key's leaf differs, and the
+   * difference shows at the root.
+   */
+  private static void narrowsDownDifferences() {
+    MerkleTree tree = new MerkleTree(DEPTH);
+    MerkleTree withExtra = new MerkleTree(DEPTH);
+    for (int i = 0; i < NUM_KEYS; i++) {
+      tree.add("1::" + i);
+      withExtra.add("1::" + i);
+    }
+    withExtra.add("2::extra");
+
+    Check.that(tree.hash(1) != withExtra.hash(1), "roots of different trees are equal");
+    int extraLeaf = withExtra.leafOf("2::extra");
+    Check.that(withExtra.isLeaf(extraLeaf), "leaf of a key is not a leaf");
+    for (int leaf = 1 << DEPTH; leaf < 2 << DEPTH; leaf++) {
+      Check.equal(leaf == extraLeaf, tree.hash(leaf) != withExtra.hash(leaf),
+              "whether leaf " + leaf + " differs");
+    }
+  }
+
+  /**
+   * Only the last 2^depth nodes are leaves, and depths out of range are rejected.
+   */
+  private static void checksDepth() {
+    MerkleTree tree = new MerkleTree(DEPTH);
+    Check.that(!tree.isLeaf(1), "root is a leaf");
+    Check.that(!tree.isLeaf((1 << DEPTH) - 1), "last inner node is a leaf");
+    Check.that(tree.isLeaf(1 << DEPTH), "first leaf is not a leaf");
+    Check.fails(IllegalArgumentException.class, () -> new MerkleTree(25), "depth 25");
+    Check.fails(IllegalArgumentException.class, () -> new MerkleTree(-1), "depth -1");
+  }
+}
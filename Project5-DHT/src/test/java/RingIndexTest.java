@@ -0,0 +1,80 @@
+package test.java;
+
+import java.util.List;
+import main.java.RingIndex;
+
+/**
+ * Tests of {@link RingIndex}: neighbors wrap around the ring, adding, moving and removing peers
+ * keep the ring in order and reject peers or positions that are taken, and a peer asking for a
+ * taken position is added at the next free one.
+ */
+final class RingIndexTest {
+  private RingIndexTest() {
+  }
+
+  /**
+   * Runs the tests.
+   */
+  static void run() {
+    RingIndex ring = new RingIndex();
+    Check.equal(new RingIndex.Neighbors("p20", "p20"), ring.add("p20", 20),
+            "neighbors of a peer alone in the ring");
+    Check.equal(new RingIndex.Neighbors("p20", "p20"), ring.add("p10", 10),
+            "neighbors of the second peer");
+    Check.equal(new RingIndex.Neighbors("p20", "p10"), ring.add("p30", 30),
+            "neighbors of a peer added at the end");
+    Check.equal(new RingIndex.Neighbors("p30", "p20"), ring.neighbors("p10"),
+            "neighbors of the first peer, wrapping around");
+    Check.equal(List.of("p10", "p20", "p30"), ring.peers(), "peers in ring order");
+    Check.equal("p10", ring.first(), "first peer");
+
+    Check.fails(IllegalArgumentException.class, () -> ring.add("p20", 25), "adding a peer twice");
+    Check.fails(IllegalArgumentException.class, () -> ring.add("p99", 30),
+            "adding a peer at a taken position");
+    Check.equal(3, ring.size(), "size after rejected adds");
+
+    Check.equal(20, ring.move("p20", 25), "old position of a moved peer");
+    Check.equal(25, ring.token("p20"), "new position of a moved peer");
+    Check.equal(new RingIndex.Neighbors("p10", "p30"), ring.neighbors("p20"),
+            "neighbors of a moved peer");
+    Check.fails(IllegalArgumentException.class, () -> ring.move("p20", 30),
+            "moving a peer to a taken position");
+    Check.fails(IllegalArgumentException.class, () -> ring.move("p20", 35),
+            "moving a peer past its successor");
+    Check.fails(IllegalArgumentException.class, () -> ring.move("p20", 5),
+            "moving a peer before its predecessor");
+    Check.equal(25, ring.token("p20"), "position after rejected moves");
+    Check.fails(IllegalArgumentException.class, () -> ring.move("p99", 5),
+            "moving a peer not in the ring");
+
+    Check.equal(new RingIndex.Neighbors("p10", "p30"), ring.remove("p20"),
+            "neighbors of a removed peer");
+    Check.fails(IllegalArgumentException.class, () -> ring.remove("p20"),
+            "removing a peer twice");
+    Check.fails(IllegalArgumentException.class, () -> ring.token("p20"),
+            "position of a removed peer");
+    Check.equal(new RingIndex.Placement(11, new RingIndex.Neighbors("p10", "p30")),
+            ring.addNear("p11", 10), "placement of a peer asking for a taken position");
+    Check.equal(new RingIndex.Placement(12, new RingIndex.Neighbors("p11", "p30")),
+            ring.addNear("p12", 10), "placement past several taken positions");
+    Check.equal(new RingIndex.Placement(20, new RingIndex.Neighbors("p12", "p30")),
+            ring.addNear("p20", 20), "placement of a peer asking for a free position");
+    Check.fails(IllegalArgumentException.class, () -> ring.addNear("p11", 40),
+            "adding a peer twice near a position");
+    for (String peer : List.of("p11", "p12", "p20")) {
+      ring.remove(peer);
+    }
+
+    ring.add("pmax", Integer.MAX_VALUE);
+    Check.equal(new RingIndex.Placement(0, new RingIndex.Neighbors("pmax", "p10")),
+            ring.addNear("p0", Integer.MAX_VALUE), "placement past the highest position");
+    Check.fails(IllegalArgumentException.class, () -> ring.addNear("p99", -1),
+            "adding a peer near a negative position");
+    ring.remove("pmax");
+    ring.remove("p0");
+
+    ring.remove("p10");
+    Check.equal(null, ring.remove("p30"), "neighbors once the ring is empty");
+    Check.equal(null, ring.first(), "first peer of an empty ring");
+  }
+}
@@ -0,0 +1,98 @@
+package test.java;
+
+import java.io.IOException;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.util.Iterator;
+import java.util.Map;
+import main.java.ObjectStore.Key;
+import main.java.SSTable;
+
+/**
+ * Tests of {@link SSTable}: a table spanning several blocks answers lookups for its live entries,
+ * its tombstones and keys it does not hold, iterates from any key, and reads the same once
+ * reopened.
+ */
+final class SSTableTest {
+  private static final int NUM_ENTRIES = 2000;
+
+  private SSTableTest() {
+  }
+
+  /**
+   * Runs the tests.
+   *
+   * @throws IOException if the table cannot be written or read
+   */
+  static void run() throws IOException {
+    Path dir = Files.createTempDirectory("sstable-test");
+    Path path = dir.resolve("000001.sst");
+    try {
+      // every even object ID, with every tenth entry a tombstone
+      SSTable.Builder builder = new SSTable.Builder(path, NUM_ENTRIES);
+      for (int i = 0; i < NUM_ENTRIES; i++) {
+        builder.add(new Key(2 * i, 1), i % 10 != 0);
+      }
+      SSTable table = builder.finish();
+      Check.equal(NUM_ENTRIES, table.numEntries(), "entries written");
+      checkLookups(table, "new table");
+      checkIterator(table);
+      table.close();
+
+      SSTable reopened = SSTable.open(path);
+      Check.equal(NUM_ENTRIES, reopened.numEntries(), "entries after reopening");
+      checkLookups(reopened, "reopened table");
+      reopened.delete();
+      Check.that(!Files.exists(path), "deleted table still on disk");
+    } finally {
+      Files.deleteIfExists(path);
+      Files.deleteIfExists(dir);
+    }
+  }
+
+  /**
+   * Checks the lookups of every key in the table and of keys between, before and after them.
+   *
+   * @param table the table
+   * @param name the name of the table in failure messages
+   * @throws IOException if a block cannot be read
+   */
+  private static void checkLookups(SSTable table, String name) throws IOException {
+    int wrong = 0;
+    for (int i = 0; i < NUM_ENTRIES; i++) {
+      Key key = new Key(2 * i, 1);
+      if (!table.mightContain(key) || !Boolean.valueOf(i % 10 != 0).equals(table.get(key))
+              || table.get(new Key(2 * i + 1, 1)) != null || table.get(new Key(2 * i, 2)) != null) {
+        wrong++;
+      }
+    }
+    Check.equal(0, wrong, "wrong lookups in the " + name);
+    Check.equal(null, table.get(new Key(-1, 1)), "lookup before the first key of the " + name);
+    Check.equal(null, table.get(new Key(2 * NUM_ENTRIES, 1)),
+            "lookup after the last key of the " + name);
+  }
+
+  /**
+   * Checks that iterating from a key between two entries starts at the next entry and goes on to
+   * the end in order.
+   *
+   * @param table the table
+   */
+  private static void checkIterator(SSTable table) {
+    Iterator<Map.Entry<Key, Boolean>> it = table.iterator(new Key(1001, 0));
+    int expected = 1002;
+    int numVisited = 0;
+    int wrong = 0;
+    while (it.hasNext()) {
+      Map.Entry<Key, Boolean> entry = it.next();
+      if (!entry.getKey().equals(new Key(expected, 1))
+              || entry.getValue() != ((expected / 2) % 10 != 0)) {
+        wrong++;
+      }
+      expected += 2;
+      numVisited++;
+    }
+    Check.equal(NUM_ENTRIES - 501, numVisited, "entries visited from the middle");
+    Check.equal(0, wrong, "entries visited out of order or with the wrong state");
+  }
+}
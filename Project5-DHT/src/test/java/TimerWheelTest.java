@@ -0,0 +1,88 @@
+package test.java;
+
+import java.util.List;
+import main.java.TimerWheel;
+
+/**
+ * Tests of {@link TimerWheel}: timers expire on time and in order, cancelled timers never expire,
+ * and timers on the upper levels, or beyond them, are cascaded down without losing any.
+ */
+final class TimerWheelTest {
+  private TimerWheelTest() {
+  }
+
+  /**
+   * Runs the tests.
+   */
+  static void run() {
+    expiresOnTime();
+    expiresInOrder();
+    cancels();
+    cascades();
+    keepsTimersBeyondTopLevel();
+  }
+
+  /**
+   * A timer expires within one tick after its time and never before, and a time that has passed
+   * expires on the next tick.
+   */
+  private static void expiresOnTime() {
+    TimerWheel<String> wheel = new TimerWheel<>(100, 1000);
+    wheel.schedule("due", 1250);
+    wheel.schedule("past", 500);
+    Check.equal(2, wheel.size(), "pending timers");
+    Check.equal(List.of("past"), wheel.advance(1100), "timers expired on the first tick");
+    Check.equal(List.of(), wheel.advance(1200), "timers expired before their time");
+    Check.equal(List.of("due"), wheel.advance(1300), "timers expired one tick after their time");
+    Check.equal(0, wheel.size(), "pending timers once all expired");
+  }
+
+  /**
+   * Timers that expire in one advance come out in the order of their times.
+   */
+  private static void expiresInOrder() {
+    TimerWheel<String> wheel = new TimerWheel<>(10, 0);
+    wheel.schedule("third", 900);
+    wheel.schedule("first", 50);
+    wheel.schedule("second", 400);
+    Check.equal(List.of("first", "second", "third"), wheel.advance(1000), "expiry order");
+  }
+
+  /**
+   * A cancelled timer never expires, and cancelling it again does nothing.
+   */
+  private static void cancels() {
+    TimerWheel<String> wheel = new TimerWheel<>(100, 0);
+    TimerWheel.Timer<String> timer = wheel.schedule("cancelled", 500);
+    wheel.schedule("kept", 600);
+    wheel.cancel(timer);
+    wheel.cancel(timer);
+    Check.equal(1, wheel.size(), "pending timers after cancelling");
+    Check.equal(List.of("kept"), wheel.advance(1000), "timers expired after cancelling");
+  }
+
+  /**
+   * Timers far enough out to start on the second and third levels expire exactly on their tick.
+   */
+  private static void cascades() {
+    TimerWheel<String> wheel = new TimerWheel<>(1, 0);
+    wheel.schedule("level 2", 5000);
+    wheel.schedule("level 3", 300000);
+    Check.equal(List.of(), wheel.advance(4999), "level 2 timer expired early");
+    Check.equal(List.of("level 2"), wheel.advance(5000), "level 2 timer on its tick");
+    Check.equal(List.of(), wheel.advance(299999), "level 3 timer expired early");
+    Check.equal(List.of("level 3"), wheel.advance(300000), "level 3 timer on its tick");
+  }
+
+  /**
+   * A timer further out than the wheel spans waits at the top level until it is in reach.
+   */
+  private static void keepsTimersBeyondTopLevel() {
+    long farTick = 1L << 25;
+    TimerWheel<String> wheel = new TimerWheel<>(1, 0);
+    TimerWheel.Timer<String> timer = wheel.schedule("far", farTick);
+    Check.equal(farTick, timer.expiresAt(), "time of the far timer");
+    Check.equal(List.of(), wheel.advance(farTick - 1), "far timer expired early");
+    Check.equal(List.of("far"), wheel.advance(farTick), "far timer on its tick");
+  }
+}
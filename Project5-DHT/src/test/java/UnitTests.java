@@ -0,0 +1,44 @@
+package test.java;
+
+import java.util.LinkedHashMap;
+import java.util.Map;
+
+/**
+ * Runs the unit tests of the data structures behind the DHT, printing one line per class, and
+ * exits with status 1 if any check failed.
+ *
+ * <p>Usage: java test.java.UnitTests
+ */
+public final class UnitTests {
+  private UnitTests() {
+  }
+
+  /**
+   * Runs every test.
+   *
+   * @param args unused
+   */
+  public static void main(String[] args) {
+    Map<String, Check.Action> tests = new LinkedHashMap<>();
+    tests.put("TimerWheel", TimerWheelTest::run);
+    tests.put("MerkleTree", MerkleTreeTest::run);
+    tests.put("BloomFilter", BloomFilterTest::run);
+    tests.put("RingIndex", RingIndexTest::run);
+    tests.put("SSTable", SSTableTest::run);
+    tests.put("LsmObjectStore", LsmObjectStoreTest::run);
+    tests.put("HotKeyTracker", HotKeyTrackerTest::run);
+    tests.put("BlockCodec", BlockCodecTest::run);
+
+    for (Map.Entry<String, Check.Action> test : tests.entrySet()) {
+      int failuresBefore = Check.failures();
+      try {
+        test.getValue().run();
+      } catch (Exception e) {
+        Check.that(false, "unexpected " + e);
+      }
+      System.out.printf("%-14s %s%n", test.getKey(),
+              (Check.failures() == failuresBefore) ? "ok" : "FAILED");
+    }
+    System.exit((Check.failures() == 0) ? 0 : 1);
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+/*
+ * Byte order helpers for the message encoders and decoders generated by msggen. Every field is
+ * stored big-endian, byte by byte, so the layout is the same on every host and reads need no
+ * alignment.
+ */
+
+#include <stdint.h>
+
+/** Store an 8-bit value */
+static inline void codec_put_u8(uint8_t *p, uint8_t v) {
+  p[0] = v;
+}
+
+/** Store a 16-bit value in big-endian order */
+static inline void codec_put_u16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)(v >> 8);
+  p[1] = (uint8_t)v;
+}
+
+/** Store a 32-bit value in big-endian order */
+static inline void codec_put_u32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+}
+
+/** Store a 64-bit value in big-endian order */
+static inline void codec_put_u64(uint8_t *p, uint64_t v) {
+  codec_put_u32(p, (uint32_t)(v >> 32));
+  codec_put_u32(p + 4, (uint32_t)v);
+}
+
+/** Load an 8-bit value */
+static inline uint8_t codec_get_u8(const uint8_t *p) {
+  return p[0];
+}
+
+/** Load a 16-bit value stored in big-endian order */
+static inline uint16_t codec_get_u16(const uint8_t *p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+/** Load a 32-bit value stored in big-endian order */
+static inline uint32_t codec_get_u32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/** Load a 64-bit value stored in big-endian order */
+static inline uint64_t codec_get_u64(const uint8_t *p) {
+  return ((uint64_t)codec_get_u32(p) << 32) | codec_get_u32(p + 4);
+}
+
+#endif // CODEC_H
@@ -0,0 +1,628 @@
+#define _GNU_SOURCE // needed for accept4
+#include "coro.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include "net.h"
+
+// Registers are switched by hand on x86-64, and through ucontext elsewhere or with -DCORO_UCONTEXT
+#if !defined(__x86_64__) || defined(CORO_UCONTEXT)
+#define CORO_USE_UCONTEXT
+#include <ucontext.h>
+#endif
+
+#define NOT_IN_HEAP ((size_t)-1) // Heap index of a coroutine without a deadline
+
+/** Saved registers of a suspended coroutine, or of the scheduler */
+typedef struct {
+#ifdef CORO_USE_UCONTEXT
+  ucontext_t uc;
+#else
+  void *sp; // Stack pointer, with the callee-saved registers pushed just below it
+#endif
+} context_t;
+
+/** A coroutine, stored at the top of its own stack mapping */
+typedef struct coro {
+  context_t context; // Registers while suspended
+  void (*fn)(void *); // Function the coroutine runs
+  void *arg; // Argument of fn
+  void *stack; // Start of the stack mapping, guard page included
+  size_t stack_size; // Size of the stack mapping
+  struct coro *next; // Next coroutine in the ready queue
+  uint64_t deadline_ns; // When a sleep ends or a wait times out
+  size_t heap_index; // Position in the timer heap, or NOT_IN_HEAP
+  int wait_fd; // Socket being waited on, or -1
+  int wait_result; // Events the socket has, or 0 after a timeout
+  int done; // Set once fn has returned
+} coro_t;
+
+/** Coroutines and reactor of one thread */
+typedef struct {
+  int initialized;
+  int epoll_fd;
+  int timer_fd; // Fires at the earliest deadline of the heap
+  uint64_t timer_armed_ns; // Deadline the timer is set for
+  size_t page_size;
+  context_t scheduler; // Registers of coro_run while a coroutine runs
+  coro_t *current; // Running coroutine, or NULL in coro_run
+  coro_t *ready_head; // Queue of coroutines ready to run
+  coro_t *ready_tail;
+  coro_t **heap; // Min-heap of coroutines by deadline
+  size_t heap_size, heap_cap;
+  uint8_t *registered; // Whether each socket has been added to the epoll set
+  size_t registered_cap;
+  size_t fd_waiters; // Coroutines waiting on a socket
+  void *free_stacks[CORO_STACK_CACHE]; // Default-size stack mappings of finished coroutines
+  int num_free_stacks;
+  coro_stats_t stats;
+} runtime_t;
+
+static __thread runtime_t rt;
+
+#ifndef CORO_USE_UCONTEXT
+/** Push the callee-saved registers, save the stack pointer, then pop those of the other side */
+void coro_switch_registers(void **save_sp, void *load_sp);
+__asm__(".text\n"
+        ".globl coro_switch_registers\n"
+        ".hidden coro_switch_registers\n"
+        ".type coro_switch_registers, @function\n"
+        "coro_switch_registers:\n"
+        "  pushq %rbp\n"
+        "  pushq %rbx\n"
+        "  pushq %r12\n"
+        "  pushq %r13\n"
+        "  pushq %r14\n"
+        "  pushq %r15\n"
+        "  movq %rsp, (%rdi)\n"
+        "  movq %rsi, %rsp\n"
+        "  popq %r15\n"
+        "  popq %r14\n"
+        "  popq %r13\n"
+        "  popq %r12\n"
+        "  popq %rbx\n"
+        "  popq %rbp\n"
+        "  ret\n"
+        ".size coro_switch_registers, .-coro_switch_registers\n");
+#endif
+
+/** Save the registers into from and continue with those of to */
+static void switch_context(context_t *from, context_t *to) {
+#ifdef CORO_USE_UCONTEXT
+  swapcontext(&from->uc, &to->uc);
+#else
+  coro_switch_registers(&from->sp, to->sp);
+#endif
+}
+
+/** Get the current monotonic time in nanoseconds */
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/** Create the epoll set and timer of the calling thread on first use */
+static int runtime_init(void) {
+  if (rt.initialized) {
+    return 0;
+  }
+  if ((rt.epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    return -1;
+  }
+  if ((rt.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0) {
+    close(rt.epoll_fd);
+    return -1;
+  }
+  struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL}; // No coroutine is NULL
+  if (epoll_ctl(rt.epoll_fd, EPOLL_CTL_ADD, rt.timer_fd, &event) < 0) {
+    close(rt.timer_fd);
+    close(rt.epoll_fd);
+    return -1;
+  }
+  rt.page_size = sysconf(_SC_PAGESIZE);
+  rt.initialized = 1;
+  return 0;
+}
+
+/** Add a coroutine to the end of the ready queue */
+static void make_ready(coro_t *coro) {
+  coro->next = NULL;
+  if (rt.ready_tail != NULL) {
+    rt.ready_tail->next = coro;
+  } else {
+    rt.ready_head = coro;
+  }
+  rt.ready_tail = coro;
+}
+
+/** Move the coroutine at a heap index up or down until the heap is ordered again */
+static void heap_fix(size_t i) {
+  coro_t *coro = rt.heap[i];
+  while (i > 0 && coro->deadline_ns < rt.heap[(i - 1) / 2]->deadline_ns) {
+    rt.heap[i] = rt.heap[(i - 1) / 2];
+    rt.heap[i]->heap_index = i;
+    i = (i - 1) / 2;
+  }
+  while (2 * i + 1 < rt.heap_size) {
+    size_t child = 2 * i + 1;
+    if (child + 1 < rt.heap_size && rt.heap[child + 1]->deadline_ns < rt.heap[child]->deadline_ns) {
+      child++;
+    }
+    if (rt.heap[child]->deadline_ns >= coro->deadline_ns) {
+      break;
+    }
+    rt.heap[i] = rt.heap[child];
+    rt.heap[i]->heap_index = i;
+    i = child;
+  }
+  rt.heap[i] = coro;
+  coro->heap_index = i;
+}
+
+/** Add a coroutine to the timer heap */
+static int heap_push(coro_t *coro) {
+  if (rt.heap_size == rt.heap_cap) {
+    size_t cap = rt.heap_cap ? rt.heap_cap * 2 : 1024;
+    coro_t **heap = realloc(rt.heap, cap * sizeof(coro_t *));
+    if (heap == NULL) {
+      return -1;
+    }
+    rt.heap = heap;
+    rt.heap_cap = cap;
+  }
+  rt.heap[rt.heap_size] = coro;
+  heap_fix(rt.heap_size++);
+  return 0;
+}
+
+/** Take a coroutine out of the timer heap */
+static void heap_remove(coro_t *coro) {
+  size_t i = coro->heap_index;
+  coro->heap_index = NOT_IN_HEAP;
+  if (i != --rt.heap_size) {
+    rt.heap[i] = rt.heap[rt.heap_size];
+    heap_fix(i);
+  }
+}
+
+/** Suspend the running coroutine until the scheduler resumes it */
+static void suspend(void) {
+  switch_context(&rt.current->context, &rt.scheduler);
+}
+
+/** Free the stack of a finished coroutine, keeping it for a new one if it has the default size */
+static void release(coro_t *coro) {
+  rt.stats.live--;
+  if (coro->stack_size == CORO_STACK_SIZE + rt.page_size && rt.num_free_stacks < CORO_STACK_CACHE) {
+    rt.free_stacks[rt.num_free_stacks++] = coro->stack;
+  } else {
+    munmap(coro->stack, coro->stack_size);
+  }
+}
+
+/** Run a coroutine until it suspends or finishes */
+static void resume(coro_t *coro) {
+  rt.current = coro;
+  rt.stats.switches++;
+  switch_context(&rt.scheduler, &coro->context);
+  rt.current = NULL;
+  if (coro->done) {
+    release(coro);
+  }
+}
+
+/** First function on the stack of every coroutine */
+static void coro_entry(void) {
+  coro_t *coro = rt.current;
+  coro->fn(coro->arg);
+  coro->done = 1;
+  suspend(); // The scheduler never resumes a finished coroutine
+  abort();
+}
+
+/** Start a coroutine running fn(arg) on a stack of stack_size bytes (0 for the default) */
+int coro_spawn(void (*fn)(void *), void *arg, size_t stack_size) {
+  if (runtime_init() < 0) {
+    return -1;
+  }
+
+  // The stack grows down from the coroutine toward a guard page, so an overflow faults
+  size_t size = stack_size ? stack_size : CORO_STACK_SIZE;
+  size = (size + rt.page_size - 1) / rt.page_size * rt.page_size + rt.page_size;
+  void *stack = NULL;
+  if (size == CORO_STACK_SIZE + rt.page_size && rt.num_free_stacks > 0) {
+    stack = rt.free_stacks[--rt.num_free_stacks];
+  } else {
+    stack = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE
+                 | MAP_STACK, -1, 0);
+    if (stack == MAP_FAILED) {
+      return -1;
+    }
+    if (mprotect(stack, rt.page_size, PROT_NONE) < 0) {
+      munmap(stack, size);
+      return -1;
+    }
+  }
+
+  uintptr_t top = ((uintptr_t)stack + size - sizeof(coro_t)) & ~(uintptr_t)63;
+  coro_t *coro = (coro_t *)top;
+  memset(coro, 0, sizeof(coro_t));
+  coro->fn = fn;
+  coro->arg = arg;
+  coro->stack = stack;
+  coro->stack_size = size;
+  coro->heap_index = NOT_IN_HEAP;
+  coro->wait_fd = -1;
+
+#ifdef CORO_USE_UCONTEXT
+  getcontext(&coro->context.uc);
+  coro->context.uc.uc_stack.ss_sp = (uint8_t *)stack + rt.page_size;
+  coro->context.uc.uc_stack.ss_size = top - (uintptr_t)stack - rt.page_size;
+  coro->context.uc.uc_link = NULL;
+  makecontext(&coro->context.uc, coro_entry, 0);
+#else
+  // Lay out the stack as coro_switch_registers leaves it, returning into coro_entry as if called
+  uintptr_t *sp = (uintptr_t *)top;
+  *--sp = 0; // Return address of coro_entry, which never returns
+  *--sp = (uintptr_t)coro_entry;
+  for (int i = 0; i < 6; i++) {
+    *--sp = 0; // rbp, rbx and r12-r15
+  }
+  coro->context.sp = sp;
+#endif
+
+  rt.stats.live++;
+  rt.stats.spawned++;
+  make_ready(coro);
+  return 0;
+}
+
+/** Wake a coroutine whose socket has events */
+static void wake_fd(coro_t *coro, uint32_t events) {
+  coro->wait_fd = -1;
+  coro->wait_result = events;
+  rt.fd_waiters--;
+  if (coro->heap_index != NOT_IN_HEAP) {
+    heap_remove(coro);
+  }
+  make_ready(coro);
+}
+
+/** Wake the coroutines whose deadline has passed */
+static void expire_timers(void) {
+  uint64_t now = now_ns();
+  while (rt.heap_size > 0 && rt.heap[0]->deadline_ns <= now) {
+    coro_t *coro = rt.heap[0];
+    heap_remove(coro);
+    if (coro->wait_fd >= 0) {
+      // Take the socket out of the epoll set, so its events cannot wake the coroutine later
+      epoll_ctl(rt.epoll_fd, EPOLL_CTL_DEL, coro->wait_fd, NULL);
+      rt.registered[coro->wait_fd] = 0;
+      coro->wait_fd = -1;
+      coro->wait_result = 0;
+      rt.fd_waiters--;
+    }
+    make_ready(coro);
+  }
+}
+
+/** Set the timer for the earliest deadline, if it is not set for it already */
+static int arm_timer(void) {
+  if (rt.heap_size == 0 || rt.heap[0]->deadline_ns == rt.timer_armed_ns) {
+    return 0;
+  }
+  uint64_t deadline = rt.heap[0]->deadline_ns;
+  struct itimerspec spec = {.it_value = {.tv_sec = deadline / 1000000000ULL,
+                                         .tv_nsec = deadline % 1000000000ULL}};
+  if (timerfd_settime(rt.timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+    return -1;
+  }
+  rt.timer_armed_ns = deadline;
+  return 0;
+}
+
+/** Run the coroutines of the calling thread until all of them have finished */
+int coro_run(void) {
+  if (runtime_init() < 0) {
+    return -1;
+  }
+  if (rt.current != NULL) {
+    errno = EPERM; // A coroutine cannot run the scheduler it runs on
+    return -1;
+  }
+
+  struct epoll_event events[CORO_MAX_EVENTS];
+  while (rt.stats.live > 0) {
+    // Run the coroutines that are ready; those they make ready wait for the next round
+    coro_t *last = rt.ready_tail;
+    while (rt.ready_head != NULL) {
+      coro_t *coro = rt.ready_head;
+      int is_last = coro == last;
+      if ((rt.ready_head = coro->next) == NULL) {
+        rt.ready_tail = NULL;
+      }
+      resume(coro);
+      if (is_last) {
+        break;
+      }
+    }
+    if (rt.stats.live == 0) {
+      break;
+    }
+
+    // Every coroutine waits for something that will never happen
+    if (rt.ready_head == NULL && rt.heap_size == 0 && rt.fd_waiters == 0) {
+      errno = EDEADLK;
+      return -1;
+    }
+
+    // Coroutines that only yield to each other need no poll between rounds
+    if (rt.ready_head != NULL && rt.heap_size == 0 && rt.fd_waiters == 0) {
+      continue;
+    }
+
+    if (rt.ready_head == NULL && arm_timer() < 0) {
+      return -1;
+    }
+    int n = epoll_wait(rt.epoll_fd, events, CORO_MAX_EVENTS, rt.ready_head ? 0 : -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.ptr == NULL) {
+        uint64_t expirations;
+        if (read(rt.timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+          return -1;
+        }
+        rt.timer_armed_ns = 0;
+      } else {
+        wake_fd(events[i].data.ptr, events[i].events);
+      }
+    }
+    expire_timers();
+  }
+  return 0;
+}
+
+/** Let the other ready coroutines run before this one continues */
+void coro_yield(void) {
+  if (rt.current == NULL) {
+    return;
+  }
+  make_ready(rt.current);
+  suspend();
+}
+
+/** Suspend this coroutine for the given number of microseconds */
+void coro_sleep_us(uint64_t us) {
+  if (rt.current == NULL) {
+    usleep(us);
+    return;
+  }
+  rt.current->deadline_ns = now_ns() + us * 1000;
+  if (heap_push(rt.current) < 0) {
+    usleep(us); // Out of memory for the heap, so block the whole thread instead
+    return;
+  }
+  suspend();
+}
+
+/** Wait until fd has one of events (EPOLLIN, EPOLLOUT); returns those it has, or 0 on timeout */
+int coro_wait_fd(int fd, uint32_t events, int timeout_ms) {
+  coro_t *coro = rt.current;
+  if (coro == NULL) {
+    errno = EPERM; // Only a coroutine can be suspended
+    return -1;
+  }
+  if ((size_t)fd >= rt.registered_cap) {
+    size_t cap = rt.registered_cap ? rt.registered_cap : 64;
+    while (cap <= (size_t)fd) {
+      cap *= 2;
+    }
+    uint8_t *registered = realloc(rt.registered, cap);
+    if (registered == NULL) {
+      return -1;
+    }
+    memset(registered + rt.registered_cap, 0, cap - rt.registered_cap);
+    rt.registered = registered;
+    rt.registered_cap = cap;
+  }
+
+  if (timeout_ms >= 0) {
+    coro->deadline_ns = now_ns() + (uint64_t)timeout_ms * 1000000;
+    if (heap_push(coro) < 0) {
+      return -1;
+    }
+  }
+
+  // A socket stays in the epoll set between waits, so each wait re-arms it with one call
+  struct epoll_event event = {.events = events | EPOLLONESHOT, .data.ptr = coro};
+  int op = rt.registered[fd] ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  if (epoll_ctl(rt.epoll_fd, op, fd, &event) < 0) {
+    // The socket was closed and its number reused, or added outside of the runtime
+    int retry = (op == EPOLL_CTL_MOD && errno == ENOENT)
+                || (op == EPOLL_CTL_ADD && errno == EEXIST);
+    op = (op == EPOLL_CTL_MOD) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    if (!retry || epoll_ctl(rt.epoll_fd, op, fd, &event) < 0) {
+      if (coro->heap_index != NOT_IN_HEAP) {
+        heap_remove(coro);
+      }
+      return -1;
+    }
+  }
+  rt.registered[fd] = 1;
+  coro->wait_fd = fd;
+  coro->wait_result = 0;
+  rt.fd_waiters++;
+  suspend();
+  return coro->wait_result;
+}
+
+/** Make a socket non-blocking, as the coro_* I/O functions expect */
+int coro_set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  if (flags < 0) {
+    return -1;
+  }
+  return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/** Wait for events on fd after a call failed; returns -1 if the failure was not EAGAIN */
+static int wait_again(int fd, uint32_t events) {
+  if (errno == EINTR) {
+    return 0;
+  }
+  if (errno != EAGAIN && errno != EWOULDBLOCK) {
+    return -1;
+  }
+  return coro_wait_fd(fd, events, -1) < 0 ? -1 : 0;
+}
+
+/** Accept a connection on a listening socket; the new socket is non-blocking */
+int coro_accept(int fd, struct sockaddr *addr, socklen_t *addr_len) {
+  while (1) {
+    int new_fd = accept4(fd, addr, addr_len, SOCK_NONBLOCK);
+    if (new_fd >= 0) {
+      return new_fd;
+    }
+    if (wait_again(fd, EPOLLIN) < 0) {
+      return -1;
+    }
+  }
+}
+
+/** Connect a non-blocking socket to an address */
+int coro_connect(int fd, const struct sockaddr *addr, socklen_t addr_len) {
+  if (connect(fd, addr, addr_len) == 0) {
+    return 0;
+  }
+  if (errno != EINPROGRESS || coro_wait_fd(fd, EPOLLOUT, -1) < 0) {
+    return -1;
+  }
+  int error;
+  socklen_t error_len = sizeof(error);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0) {
+    return -1;
+  }
+  if (error != 0) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+/** Send all len bytes of buf on a stream socket */
+int coro_send_all(int fd, const void *buf, size_t len) {
+  const char *bytes = buf;
+  while (len > 0) {
+    ssize_t sent = send(fd, bytes, len, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (wait_again(fd, EPOLLOUT) < 0) {
+        return -1;
+      }
+      continue;
+    }
+    bytes += sent;
+    len -= sent;
+  }
+  return 0;
+}
+
+/** Receive exactly len bytes into buf from a stream socket; returns 0 if the peer closed first */
+ssize_t coro_recv_all(int fd, void *buf, size_t len) {
+  char *bytes = buf;
+  size_t received = 0;
+  while (received < len) {
+    ssize_t n = recv(fd, bytes + received, len - received, 0);
+    if (n < 0) {
+      if (wait_again(fd, EPOLLIN) < 0) {
+        return -1;
+      }
+      continue;
+    }
+    if (n == 0) {
+      return 0;
+    }
+    received += n;
+  }
+  return received;
+}
+
+/** Send one framed message on a stream socket */
+int coro_send_frame(int fd, const void *buf, size_t len) {
+  if (len > NET_MAX_FRAME) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  // Send the header and the message together, so small messages go out in one segment
+  char frame[4 + 512];
+  uint32_t header = htonl((uint32_t)len);
+  if (len <= sizeof(frame) - 4) {
+    memcpy(frame, &header, 4);
+    memcpy(frame + 4, buf, len);
+    return coro_send_all(fd, frame, len + 4);
+  }
+  if (coro_send_all(fd, &header, 4) < 0) {
+    return -1;
+  }
+  return coro_send_all(fd, buf, len);
+}
+
+/** Receive one framed message into buf; returns its length, or 0 if the peer closed the stream */
+ssize_t coro_recv_frame(int fd, void *buf, size_t cap) {
+  uint32_t header;
+  ssize_t n = coro_recv_all(fd, &header, 4);
+  if (n <= 0) {
+    return n;
+  }
+
+  size_t len = ntohl(header);
+  if (len > NET_MAX_FRAME) {
+    errno = EPROTO; // no sender makes such a frame, so the stream is out of step
+    return -1;
+  }
+  if (len == 0) {
+    errno = EPROTO; // an empty frame would be mistaken for the end of the stream
+    return -1;
+  }
+  if (len > cap) {
+    // Read past the message, so the next receive starts at the header of the one after it
+    char discard[512];
+    while (len > 0) {
+      size_t chunk = (len < sizeof(discard)) ? len : sizeof(discard);
+      n = coro_recv_all(fd, discard, chunk);
+      if (n <= 0) {
+        if (n == 0) {
+          errno = ECONNRESET;
+        }
+        return -1;
+      }
+      len -= chunk;
+    }
+    errno = EMSGSIZE;
+    return -1;
+  }
+  n = coro_recv_all(fd, buf, len);
+  if (n == 0) {
+    errno = ECONNRESET; // the stream ended in the middle of a frame
+    return -1;
+  }
+  return n;
+}
+
+/** Get the counters of the coroutines of the calling thread */
+void coro_get_stats(coro_stats_t *stats) {
+  *stats = rt.stats;
+}
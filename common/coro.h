@@ -0,0 +1,74 @@
+#ifndef CORO_H
+#define CORO_H
+
+/*
+ * Stackful coroutines driven by an epoll reactor. A handler runs as a coroutine and is written as
+ * straight-line code: when it would block on a socket or a delay, it is suspended and another
+ * coroutine runs, all on the one thread that called coro_run. Every thread can run its own set of
+ * coroutines.
+ *
+ * Sockets used with the coro_* I/O functions must be non-blocking (see coro_set_nonblocking).
+ * Only one coroutine may wait on a given socket at a time. Stream messages are framed the same
+ * way as in net.h, so a coroutine can talk to a peer that uses net_send_frame and net_recv_frame.
+ * Functions report errors by returning -1 with errno set, like those of net.h.
+ */
+
+#include <stddef.h> // needed for size_t
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#define CORO_STACK_SIZE (64 * 1024) // Default stack size of a coroutine, reserved but not touched
+#define CORO_STACK_CACHE 64 // Number of stacks of finished coroutines kept for new ones
+#define CORO_MAX_EVENTS 256 // Maximum number of events handled per epoll_wait
+
+/** Counters of the coroutines of the calling thread */
+typedef struct {
+  uint64_t switches; // Number of switches into coroutines
+  uint64_t spawned; // Number of coroutines started
+  size_t live; // Number of coroutines that have not finished
+} coro_stats_t;
+
+/** Start a coroutine running fn(arg) on a stack of stack_size bytes (0 for the default) */
+int coro_spawn(void (*fn)(void *), void *arg, size_t stack_size);
+
+/** Run the coroutines of the calling thread until all of them have finished */
+int coro_run(void);
+
+/** Let the other ready coroutines run before this one continues */
+void coro_yield(void);
+
+/** Suspend this coroutine for the given number of microseconds */
+void coro_sleep_us(uint64_t us);
+
+/** Wait until fd has one of events (EPOLLIN, EPOLLOUT); returns those it has, or 0 on timeout */
+int coro_wait_fd(int fd, uint32_t events, int timeout_ms);
+
+/** Make a socket non-blocking, as the coro_* I/O functions expect */
+int coro_set_nonblocking(int fd);
+
+/** Accept a connection on a listening socket; the new socket is non-blocking */
+int coro_accept(int fd, struct sockaddr *addr, socklen_t *addr_len);
+
+/** Connect a non-blocking socket to an address */
+int coro_connect(int fd, const struct sockaddr *addr, socklen_t addr_len);
+
+/** Send all len bytes of buf on a stream socket */
+int coro_send_all(int fd, const void *buf, size_t len);
+
+/** Receive exactly len bytes into buf from a stream socket; returns 0 if the peer closed first */
+ssize_t coro_recv_all(int fd, void *buf, size_t len);
+
+/** Send one framed message on a stream socket */
+int coro_send_frame(int fd, const void *buf, size_t len);
+
+/**
+ * Receive one framed message into buf; returns its length, or 0 if the peer closed the stream.
+ * A message longer than cap is skipped with EMSGSIZE. EPROTO means the stream is out of step.
+ */
+ssize_t coro_recv_frame(int fd, void *buf, size_t cap);
+
+/** Get the counters of the coroutines of the calling thread */
+void coro_get_stats(coro_stats_t *stats);
+
+#endif // CORO_H
@@ -0,0 +1,207 @@
+/*
+ * Benchmark of the coroutine runtime, in three parts:
+ * - switch: two coroutines yield to each other, so each yield switches into the scheduler and
+ *   out of it;
+ * - memory: many coroutines sleep at once, giving the memory each one takes;
+ * - ring: a ring of nodes over loopback TCP, every node a coroutine that accepts its predecessor,
+ *   then reads a frame, waits the token delay and forwards it, all on one thread.
+ *
+ * Usage: coro_bench [nodes] [hops] [tok_delay_us]
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include "coro.h"
+
+#define DEFAULT_NODES 1000 // Number of nodes of the ring by default
+#define DEFAULT_HOPS 100000 // Number of hops the token takes by default
+#define NUM_SWITCHES 10000000 // Number of yields of each coroutine in the switch benchmark
+#define NUM_SLEEPERS 10000 // Number of coroutines alive at once in the memory benchmark
+
+// A node of the ring
+typedef struct {
+  int listen_fd; // Socket the predecessor connects to
+  struct sockaddr_in successor; // Address of the successor's listening socket
+  int starts; // Whether this node sends the first token
+} node_t;
+
+static long num_hops;
+static long tok_delay_us;
+static long long ring_start_ns, ring_end_ns;
+static uint64_t ring_start_switches; // Switches before the first token was sent
+
+/** Get the current monotonic time in nanoseconds */
+static long long now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/** Get the resident memory of this process in bytes */
+static long resident_bytes(void) {
+  long pages = 0, resident = 0;
+  FILE *file = fopen("/proc/self/statm", "r");
+  if (file == NULL || fscanf(file, "%ld %ld", &pages, &resident) != 2) {
+    perror("Error reading /proc/self/statm");
+    exit(1);
+  }
+  fclose(file);
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+/** Yield back and forth for the switch benchmark */
+static void yielder(void *arg) {
+  for (long i = 0; i < NUM_SWITCHES; i++) {
+    coro_yield();
+  }
+}
+
+/** Sleep for the memory benchmark, touching a little stack like a real handler would */
+static void sleeper(void *arg) {
+  char frame[256];
+  memset(frame, 0, sizeof(frame));
+  coro_sleep_us(*(long *)arg);
+}
+
+/** Measure the resident memory once every sleeper has started */
+static void measurer(void *arg) {
+  *(long *)arg = resident_bytes();
+}
+
+/** Node of the ring: accept the predecessor, then forward the token until it has gone far enough */
+static void node(void *arg) {
+  node_t *self = arg;
+
+  int out_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (out_fd < 0 || coro_set_nonblocking(out_fd) < 0
+      || coro_connect(out_fd, (struct sockaddr *)&self->successor, sizeof(self->successor)) < 0) {
+    perror("Error connecting to successor");
+    exit(1);
+  }
+  int in_fd = coro_accept(self->listen_fd, NULL, NULL);
+  if (in_fd < 0) {
+    perror("Error accepting predecessor");
+    exit(1);
+  }
+
+  uint32_t hops = 0;
+  if (self->starts) {
+    // The other nodes may still be connecting, which the first hops then include
+    coro_stats_t stats;
+    coro_get_stats(&stats);
+    ring_start_switches = stats.switches;
+    ring_start_ns = now_ns();
+    if (coro_send_frame(out_fd, &hops, sizeof(hops)) < 0) {
+      perror("Error sending token");
+      exit(1);
+    }
+  }
+  while (1) {
+    ssize_t len = coro_recv_frame(in_fd, &hops, sizeof(hops));
+    if (len <= 0) {
+      break; // The predecessor is done
+    }
+    if (++hops >= num_hops) {
+      ring_end_ns = now_ns();
+      break;
+    }
+    if (tok_delay_us > 0) {
+      coro_sleep_us(tok_delay_us);
+    }
+    if (coro_send_frame(out_fd, &hops, sizeof(hops)) < 0) {
+      perror("Error forwarding token");
+      exit(1);
+    }
+  }
+  close(out_fd); // Lets the successor see the end of the stream and finish too
+  close(in_fd);
+  close(self->listen_fd);
+}
+
+int main(int argc, char *argv[]) {
+  int num_nodes = (argc > 1) ? atoi(argv[1]) : DEFAULT_NODES;
+  num_hops = (argc > 2) ? atol(argv[2]) : DEFAULT_HOPS;
+  tok_delay_us = (argc > 3) ? atol(argv[3]) : 0;
+  if (num_nodes < 2 || num_hops <= 0 || tok_delay_us < 0) {
+    fprintf(stderr, "Usage: %s [nodes] [hops] [tok_delay_us]\n", argv[0]);
+    exit(1);
+  }
+  coro_stats_t stats;
+
+  // Switch: every yield switches into the scheduler and then into the other coroutine
+  coro_spawn(yielder, NULL, 0);
+  coro_spawn(yielder, NULL, 0);
+  long long start = now_ns();
+  if (coro_run() < 0) {
+    perror("Error running coroutines");
+    exit(1);
+  }
+  long long elapsed = now_ns() - start;
+  printf("switch  %d yields in %.3f s (%.1f ns per yield, two switches each)\n", 2 * NUM_SWITCHES,
+         elapsed / 1e9, (double)elapsed / (2 * NUM_SWITCHES));
+
+  // Memory: the stacks are reserved up front, but only the pages a coroutine touches are resident
+  long sleep_us = 200000;
+  long before = resident_bytes();
+  for (int i = 0; i < NUM_SLEEPERS; i++) {
+    if (coro_spawn(sleeper, &sleep_us, 0) < 0) {
+      perror("Error spawning coroutine");
+      exit(1);
+    }
+  }
+  long peak = 0;
+  coro_spawn(measurer, &peak, 0); // Runs after every sleeper has gone to sleep
+  start = now_ns();
+  if (coro_run() < 0) {
+    perror("Error running coroutines");
+    exit(1);
+  }
+  elapsed = now_ns() - start;
+  printf("memory  %d coroutines: %.1f KiB resident and %d KiB reserved each, %.2f s to run\n",
+         NUM_SLEEPERS, (double)(peak - before) / (NUM_SLEEPERS + 1) / 1024,
+         (int)(CORO_STACK_SIZE / 1024), elapsed / 1e9);
+
+  // Ring: each node needs a listening socket and two connections
+  struct rlimit limit;
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+
+  node_t *nodes = calloc(num_nodes, sizeof(node_t));
+  for (int i = 0; i < num_nodes; i++) {
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t addr_len = sizeof(addr);
+    nodes[i].listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (nodes[i].listen_fd < 0
+        || bind(nodes[i].listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || listen(nodes[i].listen_fd, 1) < 0
+        || getsockname(nodes[i].listen_fd, (struct sockaddr *)&addr, &addr_len) < 0
+        || coro_set_nonblocking(nodes[i].listen_fd) < 0) {
+      perror("Error opening listening socket");
+      exit(1);
+    }
+    nodes[(i + num_nodes - 1) % num_nodes].successor = addr;
+  }
+  nodes[0].starts = 1;
+
+  for (int i = 0; i < num_nodes; i++) {
+    coro_spawn(node, &nodes[i], 0);
+  }
+  if (coro_run() < 0) {
+    perror("Error running ring");
+    exit(1);
+  }
+  elapsed = ring_end_ns - ring_start_ns;
+  coro_get_stats(&stats);
+  printf("ring    %d nodes, %ld hops in %.3f s (%.1f us per hop, %.2f switches per hop)\n",
+         num_nodes, num_hops, elapsed / 1e9, elapsed / 1e3 / num_hops - tok_delay_us,
+         (double)(stats.switches - ring_start_switches) / num_hops);
+  free(nodes);
+  return 0;
+}
@@ -0,0 +1,837 @@
+/*
+ * Network impairment proxy. It relays UDP datagrams and TCP connections between peers on one
+ * machine, and on the way applies the delay, jitter, loss, duplication and bandwidth of a slower
+ * network. Each line of the links file describes one link:
+ *
+ *   # protocol, listen port, target, then impairments
+ *   udp 17000 localhost:7000 delay=20ms jitter=5ms dist=normal loss=1% dup=0.1%
+ *   tcp 17001 localhost:7001 delay=40ms rate=10mbit
+ *
+ * The proxy listens on 127.0.0.1 at the listen port and forwards to the target. Replies go back
+ * through the same link, and both directions get the same impairments:
+ *   - delay is the base one-way delay, and jitter the spread around it. dist picks the shape of
+ *     the spread: uniform (delay +/- jitter), normal (standard deviation jitter, the default) or
+ *     pareto (a heavy tail above delay, scaled by jitter).
+ *   - loss and dup are the chances that a datagram is dropped or sent twice.
+ *   - rate caps the bandwidth of each direction. Packets wait their turn behind the ones before
+ *     them, and a direction holding more than queue packets (1000 by default) drops new
+ *     datagrams. For TCP it stops reading from the sender until the direction drains instead,
+ *     so the sender's socket fills up as it would behind a slow link.
+ * Datagrams can overtake each other when jitter is set. TCP bytes are never reordered, lost or
+ * duplicated, since the proxy cannot retransmit them, so only delay, jitter and rate apply.
+ *
+ * Everything runs on one thread around epoll, with the pending packets kept in a heap ordered by
+ * the time they are due. A timerfd wakes the thread when the first one is due, so delays are kept
+ * to the microsecond rather than rounded to the millisecond timeout of epoll_wait.
+ *
+ * Usage: impair [-s <seed>] <links file>
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include "net.h"
+
+#define MAX_LINE 256 // Maximum length of a line of the links file
+#define MAX_LINKS 64 // Maximum number of links
+#define MAX_UDP_FLOWS 64 // Maximum number of clients of a UDP link
+#define MAX_EVENTS 64 // Number of epoll events handled per wakeup
+#define MAX_PACKET 65536 // Largest datagram or TCP chunk relayed at once
+#define DEFAULT_QUEUE 1000 // Default number of packets a direction can hold
+#define PARETO_SHAPE 2.5 // Shape of the pareto delay distribution; lower is heavier
+
+typedef enum { DIST_UNIFORM, DIST_NORMAL, DIST_PARETO } dist_t;
+
+// Impairments of a link, applied to each direction
+typedef struct {
+  double delay_ns; // Base one-way delay
+  double jitter_ns; // Spread of the delay
+  dist_t dist; // Shape of the spread
+  double loss; // Chance of dropping a datagram
+  double dup; // Chance of sending a datagram twice
+  double rate_bps; // Bandwidth in bits per second, or 0 for no cap
+  int queue; // Maximum number of packets waiting in a direction
+} impair_t;
+
+// One direction of a link or connection: its bandwidth queue
+typedef struct {
+  uint64_t free_at_ns; // When the last packet queued will have been sent at the capped rate
+  uint64_t last_due_ns; // When the last packet is due, to keep TCP bytes in order
+  int queued; // Packets waiting
+} direction_t;
+
+struct link;
+struct conn;
+
+// A packet waiting for its time, or a TCP chunk waiting for its socket to take it
+typedef struct packet {
+  uint64_t due_ns; // When the packet is delivered
+  uint64_t seq; // Order of scheduling, which breaks ties between packets due at the same time
+  int fd; // Socket to send on
+  struct sockaddr_storage addr; // Where to send a datagram
+  socklen_t addr_len;
+  direction_t *dir; // Direction the packet counts against
+  struct conn *conn; // TCP connection, or NULL for a datagram
+  int side; // Side of the connection the chunk is written to
+  size_t len; // Length of data; a TCP chunk of length 0 closes the side
+  size_t sent; // Bytes of a TCP chunk already written
+  struct packet *next; // Next chunk to write on the same side
+  uint8_t data[];
+} packet_t;
+
+// What an epoll event refers to
+typedef enum { EP_LISTEN, EP_UDP_UPSTREAM, EP_TCP_SIDE, EP_TIMER } ep_kind_t;
+
+typedef struct {
+  ep_kind_t kind;
+  void *owner; // The link, UDP flow or TCP connection
+  int side; // For a TCP connection, 0 for the client and 1 for the target
+} ep_t;
+
+// A client of a UDP link, with the socket its datagrams are forwarded from
+typedef struct {
+  struct link *link;
+  struct sockaddr_storage client; // Address of the client
+  socklen_t client_len;
+  int fd; // Socket towards the target, which replies arrive on
+  ep_t ep;
+  direction_t to_target, to_client;
+} udp_flow_t;
+
+// A relayed TCP connection; side 0 is the client and side 1 the target
+typedef struct conn {
+  struct link *link;
+  int fd[2];
+  ep_t ep[2];
+  direction_t dir[2]; // dir[i] holds chunks written to side i
+  packet_t *out_head[2], *out_tail[2]; // Chunks due but not yet written to side i
+  int read_closed[2]; // Whether side i has stopped sending
+  int write_closed[2]; // Whether side i has been shut down for writing
+  int watched[2]; // Whether side i is still registered with epoll
+  int connecting; // Whether the target side is still waiting for its connect to finish
+  int pending; // Packets in the heap or the write queues
+  int dead; // Whether the connection failed and only waits for its packets to drain
+  int closed; // Whether the sockets are closed and the connection is about to be freed
+  struct conn *next_closed; // Next connection to free at the end of the event loop iteration
+} conn_t;
+
+typedef struct link {
+  int is_tcp;
+  int port; // Listen port
+  struct sockaddr_storage target;
+  socklen_t target_len;
+  impair_t impair;
+  int fd; // Listening socket
+  ep_t ep;
+  udp_flow_t flows[MAX_UDP_FLOWS];
+  int num_flows;
+} link_t;
+
+static link_t links[MAX_LINKS];
+static int num_links = 0;
+static int epoll_fd;
+static conn_t *closed_conns = NULL; // Freed once no epoll event can refer to them anymore
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+// Min-heap of packets by due time
+static packet_t **heap = NULL;
+static size_t heap_size = 0, heap_cap = 0;
+static uint64_t next_seq = 0;
+
+/** Get the current monotonic time in nanoseconds */
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/** Get a uniformly distributed number in [0, 1) */
+static double random_unit(void) {
+  rng_state ^= rng_state >> 12; // xorshift64*
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return ((rng_state * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/** Draw a one-way delay for a link */
+static double sample_delay_ns(const impair_t *impair) {
+  double delay = impair->delay_ns;
+  if (impair->jitter_ns > 0) {
+    if (impair->dist == DIST_UNIFORM) {
+      delay += (2 * random_unit() - 1) * impair->jitter_ns;
+    } else if (impair->dist == DIST_NORMAL) {
+      double u1 = 1.0 - random_unit(), u2 = random_unit(); // Box-Muller
+      delay += sqrt(-2 * log(u1)) * cos(2 * M_PI * u2) * impair->jitter_ns;
+    } else {
+      delay += (pow(1.0 - random_unit(), -1.0 / PARETO_SHAPE) - 1) * impair->jitter_ns;
+    }
+  }
+  return (delay > 0) ? delay : 0;
+}
+
+/** Check whether a packet is due before another; equal times keep the order of scheduling */
+static int due_before(const packet_t *a, const packet_t *b) {
+  return a->due_ns < b->due_ns || (a->due_ns == b->due_ns && a->seq < b->seq);
+}
+
+/** Add a packet to the heap */
+static void heap_push(packet_t *packet) {
+  if (heap_size == heap_cap) {
+    heap_cap = heap_cap ? heap_cap * 2 : 1024;
+    if ((heap = realloc(heap, heap_cap * sizeof(packet_t *))) == NULL) {
+      perror("Error growing packet heap");
+      exit(1);
+    }
+  }
+  size_t i = heap_size++;
+  while (i > 0 && due_before(packet, heap[(i - 1) / 2])) {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap[i] = packet;
+}
+
+/** Remove the packet due first from the heap */
+static packet_t *heap_pop(void) {
+  packet_t *top = heap[0];
+  packet_t *last = heap[--heap_size];
+  size_t i = 0;
+  while (2 * i + 1 < heap_size) {
+    size_t child = 2 * i + 1;
+    if (child + 1 < heap_size && due_before(heap[child + 1], heap[child])) {
+      child++;
+    }
+    if (!due_before(heap[child], last)) {
+      break;
+    }
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = last;
+  return top;
+}
+
+/** Parse a duration such as 20ms, 500us or 1.5s into nanoseconds */
+static int parse_duration(const char *text, double *ns) {
+  char *unit;
+  double value = strtod(text, &unit);
+  if (strcmp(unit, "s") == 0) {
+    value *= 1e9;
+  } else if (strcmp(unit, "ms") == 0) {
+    value *= 1e6;
+  } else if (strcmp(unit, "us") == 0) {
+    value *= 1e3;
+  } else if (strcmp(unit, "ns") != 0) {
+    return 0;
+  }
+  *ns = value;
+  return value >= 0;
+}
+
+/** Parse a chance such as 1% or 0.01 */
+static int parse_chance(const char *text, double *chance) {
+  char *unit;
+  double value = strtod(text, &unit);
+  if (strcmp(unit, "%") == 0) {
+    value /= 100;
+  } else if (*unit != 0) {
+    return 0;
+  }
+  *chance = value;
+  return value >= 0 && value <= 1;
+}
+
+/** Parse a bandwidth such as 10mbit, 512kbit or 1gbit into bits per second */
+static int parse_rate(const char *text, double *bps) {
+  char *unit;
+  double value = strtod(text, &unit);
+  if (strcmp(unit, "gbit") == 0) {
+    value *= 1e9;
+  } else if (strcmp(unit, "mbit") == 0) {
+    value *= 1e6;
+  } else if (strcmp(unit, "kbit") == 0) {
+    value *= 1e3;
+  } else if (strcmp(unit, "bit") != 0) {
+    return 0;
+  }
+  *bps = value;
+  return value > 0;
+}
+
+/** Parse one key=value impairment */
+static int parse_impairment(const char *option, impair_t *impair) {
+  char key[MAX_LINE];
+  const char *eq = strchr(option, '=');
+  if (eq == NULL || eq - option >= MAX_LINE) {
+    return 0;
+  }
+  snprintf(key, sizeof(key), "%.*s", (int)(eq - option), option);
+  const char *value = eq + 1;
+
+  if (strcmp(key, "delay") == 0) {
+    return parse_duration(value, &impair->delay_ns);
+  } else if (strcmp(key, "jitter") == 0) {
+    return parse_duration(value, &impair->jitter_ns);
+  } else if (strcmp(key, "loss") == 0) {
+    return parse_chance(value, &impair->loss);
+  } else if (strcmp(key, "dup") == 0) {
+    return parse_chance(value, &impair->dup);
+  } else if (strcmp(key, "rate") == 0) {
+    return parse_rate(value, &impair->rate_bps);
+  } else if (strcmp(key, "queue") == 0) {
+    impair->queue = atoi(value);
+    return impair->queue > 0;
+  } else if (strcmp(key, "dist") == 0) {
+    if (strcmp(value, "uniform") == 0) {
+      impair->dist = DIST_UNIFORM;
+    } else if (strcmp(value, "normal") == 0) {
+      impair->dist = DIST_NORMAL;
+    } else if (strcmp(value, "pareto") == 0) {
+      impair->dist = DIST_PARETO;
+    } else {
+      return 0;
+    }
+    return 1;
+  }
+  return 0;
+}
+
+/** Parse the links file into the links table */
+static void parse_links(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    fprintf(stderr, "Error opening file at %s\n", path);
+    exit(1);
+  }
+
+  char line[MAX_LINE];
+  int line_num = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line_num++;
+    line[strcspn(line, "#\n")] = 0; // Remove comments and the newline character
+
+    char *words[MAX_LINE];
+    int num_words = 0;
+    for (char *word = strtok(line, " \t"); word != NULL; word = strtok(NULL, " \t")) {
+      words[num_words++] = word;
+    }
+    if (num_words == 0) {
+      continue;
+    }
+
+    char *colon = (num_words >= 3) ? strrchr(words[2], ':') : NULL;
+    if (colon == NULL || (strcmp(words[0], "udp") != 0 && strcmp(words[0], "tcp") != 0)) {
+      fprintf(stderr, "%s:%d: expected '<udp|tcp> <listen port> <host>:<port> [...]'\n", path,
+              line_num);
+      exit(1);
+    }
+    if (num_links == MAX_LINKS) {
+      fprintf(stderr, "%s:%d: too many links\n", path, line_num);
+      exit(1);
+    }
+
+    link_t *link = &links[num_links++];
+    link->is_tcp = strcmp(words[0], "tcp") == 0;
+    link->port = atoi(words[1]);
+    link->impair = (impair_t){.dist = DIST_NORMAL, .queue = DEFAULT_QUEUE};
+    *colon = 0;
+    if (link->port <= 0 || link->port > 65535
+        || net_resolve(words[2], atoi(colon + 1), link->is_tcp ? SOCK_STREAM : SOCK_DGRAM,
+                       &link->target, &link->target_len) < 0) {
+      fprintf(stderr, "%s:%d: invalid port or unknown target %s\n", path, line_num, words[2]);
+      exit(1);
+    }
+    for (int i = 3; i < num_words; i++) {
+      if (!parse_impairment(words[i], &link->impair)) {
+        fprintf(stderr, "%s:%d: invalid impairment %s\n", path, line_num, words[i]);
+        exit(1);
+      }
+    }
+  }
+  fclose(file);
+}
+
+/** Make a socket non-blocking */
+static void set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    perror("Error making socket non-blocking");
+    exit(1);
+  }
+}
+
+/** Watch a socket with epoll */
+static void watch(int fd, ep_t *ep, uint32_t events, int op) {
+  struct epoll_event event = {.events = events, .data.ptr = ep};
+  if (epoll_ctl(epoll_fd, op, fd, &event) < 0) {
+    perror("Error watching socket");
+    exit(1);
+  }
+}
+
+/** Open the listening socket of a link on the loopback interface */
+static void open_link(link_t *link) {
+  if ((link->fd = socket(AF_INET, link->is_tcp ? SOCK_STREAM : SOCK_DGRAM, 0)) < 0) {
+    perror("Error opening socket");
+    exit(1);
+  }
+  int opt = 1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(link->port);
+  if (setsockopt(link->fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0
+      || bind(link->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+      || (link->is_tcp && listen(link->fd, SOMAXCONN) < 0)) {
+    fprintf(stderr, "Error listening on port %d: %s\n", link->port, strerror(errno));
+    exit(1);
+  }
+  set_nonblocking(link->fd);
+  link->ep = (ep_t){.kind = EP_LISTEN, .owner = link};
+  watch(link->fd, &link->ep, EPOLLIN, EPOLL_CTL_ADD);
+}
+
+/**
+ * Schedule data for delivery through one direction of a link. Returns 0 if the packet was
+ * dropped, which only happens to datagrams.
+ */
+static int schedule(const impair_t *impair, direction_t *dir, conn_t *conn, int side, int fd,
+                    const struct sockaddr_storage *addr, socklen_t addr_len, const void *data,
+                    size_t len) {
+  if (conn == NULL && (random_unit() < impair->loss || dir->queued >= impair->queue)) {
+    return 0;
+  }
+
+  // Wait behind the packets already queued at the capped rate, then travel for the delay
+  uint64_t now = now_ns();
+  uint64_t departs = (dir->free_at_ns > now) ? dir->free_at_ns : now;
+  if (impair->rate_bps > 0) {
+    departs += (uint64_t)(len * 8 * 1e9 / impair->rate_bps);
+    dir->free_at_ns = departs;
+  }
+  uint64_t due = departs + (uint64_t)sample_delay_ns(impair);
+  if (conn != NULL && due < dir->last_due_ns) {
+    due = dir->last_due_ns; // TCP bytes must arrive in order
+  }
+  dir->last_due_ns = due;
+
+  int copies = (conn == NULL && random_unit() < impair->dup) ? 2 : 1;
+  for (int i = 0; i < copies; i++) {
+    packet_t *packet = malloc(sizeof(packet_t) + len);
+    if (packet == NULL) {
+      perror("Error allocating packet");
+      exit(1);
+    }
+    memset(packet, 0, sizeof(packet_t));
+    packet->due_ns = due;
+    packet->seq = next_seq++;
+    packet->fd = fd;
+    if (addr != NULL) {
+      memcpy(&packet->addr, addr, addr_len);
+      packet->addr_len = addr_len;
+    }
+    packet->dir = dir;
+    packet->conn = conn;
+    packet->side = side;
+    packet->len = len;
+    memcpy(packet->data, data, len);
+    dir->queued++;
+    if (conn != NULL) {
+      conn->pending++;
+    }
+    heap_push(packet);
+  }
+  return 1;
+}
+
+/** Watch one side of a connection for what it still has to do, or stop watching it */
+static void conn_watch(conn_t *conn, int side) {
+  if (!conn->watched[side]) {
+    return;
+  }
+  if (conn->dead || (conn->read_closed[side] && conn->write_closed[side])) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd[side], NULL);
+    conn->watched[side] = 0;
+    return;
+  }
+  if (side == 1 && conn->connecting) {
+    watch(conn->fd[side], &conn->ep[side], EPOLLOUT, EPOLL_CTL_MOD); // Writable once connected
+    return;
+  }
+  // Data read from this side waits in the direction of the other, so stop reading while it is full
+  int throttled = conn->dir[1 - side].queued >= conn->link->impair.queue;
+  uint32_t events = (conn->read_closed[side] || throttled ? 0 : EPOLLIN)
+                    | (conn->out_head[side] != NULL ? EPOLLOUT : 0);
+  watch(conn->fd[side], &conn->ep[side], events, EPOLL_CTL_MOD);
+}
+
+/** Close a connection once it has nothing left to deliver */
+static void conn_release(conn_t *conn) {
+  int done = conn->dead || (conn->write_closed[0] && conn->write_closed[1]);
+  if (conn->closed || !done || conn->pending > 0) {
+    return;
+  }
+  close(conn->fd[0]); // Closing also removes the sockets from epoll
+  close(conn->fd[1]);
+  conn->closed = 1;
+  conn->next_closed = closed_conns;
+  closed_conns = conn;
+}
+
+/** Stop relaying a connection after an error; packets in flight are dropped as they come due */
+static void conn_fail(conn_t *conn) {
+  conn->dead = 1;
+  for (int side = 0; side < 2; side++) {
+    while (conn->out_head[side] != NULL) {
+      packet_t *chunk = conn->out_head[side];
+      conn->out_head[side] = chunk->next;
+      chunk->dir->queued--;
+      conn->pending--;
+      free(chunk);
+    }
+  }
+  conn_watch(conn, 0);
+  conn_watch(conn, 1);
+}
+
+/** Write the chunks due on one side of a connection until its socket is full */
+static void conn_flush(conn_t *conn, int side) {
+  if (side == 1 && conn->connecting) {
+    return; // Written once the connection is made
+  }
+  int was_full = conn->dir[side].queued >= conn->link->impair.queue;
+  while (!conn->dead && conn->out_head[side] != NULL) {
+    packet_t *chunk = conn->out_head[side];
+    if (chunk->len == 0) {
+      shutdown(conn->fd[side], SHUT_WR); // The other side closed, and everything before is sent
+      conn->write_closed[side] = 1;
+    } else {
+      ssize_t n = send(conn->fd[side], chunk->data + chunk->sent, chunk->len - chunk->sent,
+                       MSG_NOSIGNAL);
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        conn_watch(conn, side); // Wait for room
+        return;
+      }
+      if (n < 0) {
+        conn_fail(conn);
+        break;
+      }
+      chunk->sent += n;
+      if (chunk->sent < chunk->len) {
+        continue;
+      }
+    }
+    conn->out_head[side] = chunk->next;
+    chunk->dir->queued--;
+    conn->pending--;
+    free(chunk);
+  }
+  conn_watch(conn, side); // Stop waiting for room once everything is written
+  if (was_full && conn->dir[side].queued < conn->link->impair.queue) {
+    conn_watch(conn, 1 - side); // Room again for what the other side sends
+  }
+}
+
+/** Deliver a packet that has come due */
+static void deliver(packet_t *packet) {
+  conn_t *conn = packet->conn;
+  if (conn == NULL) {
+    packet->dir->queued--;
+    // A full socket buffer drops the datagram, as a congested network would
+    sendto(packet->fd, packet->data, packet->len, MSG_DONTWAIT, (struct sockaddr *)&packet->addr,
+           packet->addr_len);
+    free(packet);
+    return;
+  }
+
+  if (conn->dead) {
+    packet->dir->queued--;
+    conn->pending--;
+    free(packet);
+  } else {
+    // A chunk counts against its direction until it is written, which holds back the sender
+    int side = packet->side;
+    if (conn->out_head[side] == NULL) {
+      conn->out_head[side] = packet;
+    } else {
+      conn->out_tail[side]->next = packet;
+    }
+    conn->out_tail[side] = packet;
+    conn_flush(conn, side);
+  }
+  conn_release(conn);
+}
+
+/** Print why connecting to the target of a link failed */
+static void print_connect_error(const link_t *link, int err) {
+  char host[INET_ADDRSTRLEN];
+  const struct sockaddr_in *target = (const struct sockaddr_in *)&link->target;
+  inet_ntop(AF_INET, &target->sin_addr, host, sizeof(host));
+  fprintf(stderr, "Error connecting to %s:%d: %s\n", host, ntohs(target->sin_port), strerror(err));
+}
+
+/**
+ * Accept a connection on a TCP link and start connecting it to the target. The connect does not
+ * block the event loop: the target side is watched until it is writable, and what the client
+ * sends meanwhile waits in its direction like any other chunk.
+ */
+static void accept_tcp(link_t *link) {
+  int client_fd;
+  while ((client_fd = accept(link->fd, NULL, NULL)) >= 0) {
+    int target_fd = socket(link->target.ss_family, SOCK_STREAM, 0);
+    if (target_fd < 0) {
+      print_connect_error(link, errno);
+      close(client_fd);
+      continue;
+    }
+    set_nonblocking(target_fd);
+    int connecting = 0;
+    if (connect(target_fd, (struct sockaddr *)&link->target, link->target_len) < 0) {
+      if (errno != EINPROGRESS) {
+        print_connect_error(link, errno);
+        close(client_fd);
+        close(target_fd);
+        continue;
+      }
+      connecting = 1;
+    }
+
+    conn_t *conn = calloc(1, sizeof(conn_t));
+    if (conn == NULL) {
+      perror("Error allocating connection");
+      exit(1);
+    }
+    conn->link = link;
+    conn->fd[0] = client_fd;
+    conn->fd[1] = target_fd;
+    conn->connecting = connecting;
+    set_nonblocking(client_fd);
+    for (int side = 0; side < 2; side++) {
+      conn->ep[side] = (ep_t){.kind = EP_TCP_SIDE, .owner = conn, .side = side};
+      uint32_t events = (side == 1 && connecting) ? EPOLLOUT : EPOLLIN;
+      watch(conn->fd[side], &conn->ep[side], events, EPOLL_CTL_ADD);
+      conn->watched[side] = 1;
+    }
+  }
+}
+
+/** Finish connecting to the target once its socket is writable, then send what has come due */
+static void finish_connect(conn_t *conn) {
+  int err = 0;
+  socklen_t err_len = sizeof(err);
+  if (getsockopt(conn->fd[1], SOL_SOCKET, SO_ERROR, &err, &err_len) < 0) {
+    err = errno;
+  }
+  if (err != 0) {
+    print_connect_error(conn->link, err);
+    conn_fail(conn);
+    return;
+  }
+  conn->connecting = 0;
+  conn_flush(conn, 1); // Also watches the side for reading
+}
+
+/**
+ * Read what one side of a connection sent and schedule it for the other side, until the direction
+ * is full. A side that hung up is read to the end anyway, which its socket buffer bounds, since
+ * epoll keeps reporting the hang-up while the side is not read.
+ */
+static void read_tcp(conn_t *conn, int side, int hung_up) {
+  static uint8_t buf[MAX_PACKET];
+  int other = 1 - side;
+  while (!conn->dead && !conn->read_closed[side]) {
+    if (conn->dir[other].queued >= conn->link->impair.queue && !hung_up) {
+      conn_watch(conn, side); // Stop reading until the other side takes some of it
+      break;
+    }
+    ssize_t n = recv(conn->fd[side], buf, sizeof(buf), 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+    if (n < 0) {
+      conn_fail(conn);
+      break;
+    }
+    if (n == 0) {
+      // Pass the close on after the data before it, and stop reading this side
+      conn->read_closed[side] = 1;
+      conn_watch(conn, side);
+    }
+    schedule(&conn->link->impair, &conn->dir[other], conn, other, conn->fd[other], NULL, 0, buf,
+             n);
+  }
+  conn_release(conn);
+}
+
+/** Find the flow of a UDP client, creating it on its first datagram */
+static udp_flow_t *udp_flow(link_t *link, const struct sockaddr_storage *client,
+                            socklen_t client_len) {
+  for (int i = 0; i < link->num_flows; i++) {
+    udp_flow_t *flow = &link->flows[i];
+    if (flow->client_len == client_len && memcmp(&flow->client, client, client_len) == 0) {
+      return flow;
+    }
+  }
+  if (link->num_flows == MAX_UDP_FLOWS) {
+    return NULL;
+  }
+
+  udp_flow_t *flow = &link->flows[link->num_flows];
+  if ((flow->fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+    return NULL;
+  }
+  link->num_flows++;
+  flow->link = link;
+  memcpy(&flow->client, client, client_len);
+  flow->client_len = client_len;
+  set_nonblocking(flow->fd);
+  flow->ep = (ep_t){.kind = EP_UDP_UPSTREAM, .owner = flow};
+  watch(flow->fd, &flow->ep, EPOLLIN, EPOLL_CTL_ADD);
+  return flow;
+}
+
+/** Relay the datagrams waiting on a UDP socket */
+static void read_udp(int fd, link_t *link, udp_flow_t *reply_flow) {
+  static uint8_t buf[MAX_PACKET];
+  while (1) {
+    struct sockaddr_storage from;
+    socklen_t from_len = sizeof(from);
+    ssize_t n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+    if (n < 0) {
+      return;
+    }
+
+    if (reply_flow != NULL) {
+      // A reply from the target, back to the client through the listening socket
+      schedule(&link->impair, &reply_flow->to_client, NULL, 0, link->fd, &reply_flow->client,
+               reply_flow->client_len, buf, n);
+    } else {
+      udp_flow_t *flow = udp_flow(link, &from, from_len);
+      if (flow != NULL) {
+        schedule(&link->impair, &flow->to_target, NULL, 0, flow->fd, &link->target,
+                 link->target_len, buf, n);
+      }
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int opt;
+  while ((opt = getopt(argc, argv, "s:")) != -1) {
+    switch (opt) {
+      case 's':
+        rng_state = strtoull(optarg, NULL, 0) | 1;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-s <seed>] <links file>\n", argv[0]);
+        exit(1);
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "Usage: %s [-s <seed>] <links file>\n", argv[0]);
+    exit(1);
+  }
+
+  parse_links(argv[optind]);
+  if ((epoll_fd = epoll_create1(0)) < 0) {
+    perror("Error creating epoll instance");
+    exit(1);
+  }
+  for (int i = 0; i < num_links; i++) {
+    open_link(&links[i]);
+    fprintf(stderr, "{link: %d, protocol: %s, port: %d}\n", i, links[i].is_tcp ? "tcp" : "udp",
+            links[i].port);
+  }
+
+  int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  if (timer_fd < 0) {
+    perror("Error creating timer");
+    exit(1);
+  }
+  ep_t timer_ep = {.kind = EP_TIMER};
+  watch(timer_fd, &timer_ep, EPOLLIN, EPOLL_CTL_ADD);
+  uint64_t timer_due = 0; // When the timer is set to go off, or 0 if it is not set
+
+  struct epoll_event events[MAX_EVENTS];
+  while (1) {
+    // Sleep until the next packet is due, or until a socket has something for us
+    int timeout_ms = -1;
+    if (heap_size > 0) {
+      uint64_t due = heap[0]->due_ns;
+      if (due <= now_ns()) {
+        timeout_ms = 0;
+      } else if (due != timer_due) {
+        struct itimerspec spec = {.it_value = {.tv_sec = due / 1000000000,
+                                               .tv_nsec = due % 1000000000}};
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+        timer_due = due;
+      }
+    }
+    int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+    if (num_events < 0 && errno != EINTR) {
+      perror("Error waiting for events");
+      exit(1);
+    }
+
+    for (int i = 0; i < num_events; i++) {
+      ep_t *ep = events[i].data.ptr;
+      if (ep->kind == EP_TIMER) {
+        uint64_t expirations;
+        if (read(timer_fd, &expirations, sizeof(expirations)) >= 0) {
+          timer_due = 0;
+        }
+      } else if (ep->kind == EP_LISTEN) {
+        link_t *link = ep->owner;
+        if (link->is_tcp) {
+          accept_tcp(link);
+        } else {
+          read_udp(link->fd, link, NULL);
+        }
+      } else if (ep->kind == EP_UDP_UPSTREAM) {
+        udp_flow_t *flow = ep->owner;
+        read_udp(flow->fd, flow->link, flow);
+      } else {
+        conn_t *conn = ep->owner;
+        uint32_t happened = events[i].events;
+        if (!conn->closed && ep->side == 1 && conn->connecting) {
+          finish_connect(conn); // Writable, or failed, once the connect is done
+          happened = 0;
+        }
+        if (!conn->closed && (happened & EPOLLOUT)) {
+          conn_flush(conn, ep->side);
+        }
+        if (!conn->closed && (happened & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+          if (conn->read_closed[ep->side]) {
+            conn_fail(conn); // Reset by the peer after it finished sending
+          } else {
+            read_tcp(conn, ep->side, (happened & (EPOLLHUP | EPOLLERR)) != 0);
+          }
+        }
+        conn_release(conn);
+      }
+    }
+
+    uint64_t now = now_ns();
+    while (heap_size > 0 && heap[0]->due_ns <= now) {
+      deliver(heap_pop());
+    }
+    while (closed_conns != NULL) {
+      conn_t *conn = closed_conns;
+      closed_conns = conn->next_closed;
+      free(conn);
+    }
+  }
+  return 0;
+}
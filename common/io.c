@@ -0,0 +1,655 @@
+#include "io.h"
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Added to io_uring after the kernel headers of older distributions, e.g. Ubuntu 22.04
+#define IO_REGISTER_PBUF_RING 22 // IORING_REGISTER_PBUF_RING, Linux 5.19
+#define IO_RECV_MULTISHOT (1U << 1) // IORING_RECV_MULTISHOT, Linux 6.0
+#define IO_CQE_F_MORE (1U << 1) // IORING_CQE_F_MORE, Linux 5.19
+
+#define IO_RING_ENTRIES IO_QUEUE_DEPTH // Submission queue entries of a ring
+#define IO_RECV_TAG 1 // user_data of the multishot receive
+#define IO_STAGE_SIZE (4 + IO_MAX_FRAME + IO_RECV_BUFFER_SIZE) // Room for a frame and one receive
+
+/** Registration of a provided buffer ring, as struct io_uring_buf_reg */
+typedef struct {
+  uint64_t ring_addr;
+  uint32_t ring_entries;
+  uint16_t bgid;
+  uint16_t pad;
+  uint64_t resv[3];
+} io_buf_reg_t;
+
+/** An entry of a provided buffer ring, as struct io_uring_buf; the ring tail overlays resv of
+ * the first entry */
+typedef struct {
+  uint64_t addr;
+  uint32_t len;
+  uint16_t bid;
+  uint16_t resv;
+} io_buf_t;
+
+/** A message waiting in the send queue */
+typedef struct {
+  int fd; // Socket to send on
+  size_t len; // Length of the message in its slot
+  int is_datagram; // Whether to send to addr instead of writing to a stream
+  size_t done; // Bytes of a frame already written
+  int finished; // Whether the message has been sent, or given up on after an error
+  struct sockaddr_storage addr; // Address of a datagram
+  socklen_t addr_len; // Length of that address
+  struct iovec iov; // Message to send, for sendmsg
+  struct msghdr msg; // Header for sendmsg, which must stay valid until the send completes
+} io_send_t;
+
+struct io {
+  int uring; // Whether this context uses io_uring
+  int fallback; // Whether it may still switch to the blocking backend
+  int fd; // Socket a receiver reads from, or -1 for a sender
+  uint64_t syscalls; // Counters, updated atomically so other threads can read them
+  uint64_t messages;
+
+  // Stream reassembly for receivers
+  uint8_t *stage; // Bytes received but not yet returned
+  size_t stage_start; // Offset of the first of those bytes
+  size_t stage_end; // Offset past the last of those bytes
+
+  // Send queue for senders
+  uint8_t *slots; // IO_QUEUE_DEPTH slots of IO_SLOT_SIZE bytes, registered with io_uring
+  io_send_t sends[IO_QUEUE_DEPTH];
+  int num_sends;
+
+  // io_uring rings
+  int ring_fd;
+  void *sq_ptr, *cq_ptr; // Mapped submission and completion rings
+  size_t sq_size, cq_size;
+  struct io_uring_sqe *sqes; // Mapped submission entries
+  unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned int *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+  unsigned int sq_pending; // Entries pushed but not yet submitted
+
+  // Provided buffers for the multishot receive
+  io_buf_t *buf_ring;
+  uint8_t *recv_bufs; // IO_RECV_BUFFERS buffers of IO_RECV_BUFFER_SIZE bytes
+  int recv_armed; // Whether the multishot receive is still active
+};
+
+/** Add to a counter */
+static void count(uint64_t *counter, uint64_t n) {
+  __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+/** Call io_uring_enter, counting the call */
+static int uring_enter(io_t *io, unsigned int to_submit, unsigned int min_complete) {
+  int rc;
+  do {
+    count(&io->syscalls, 1);
+    rc = (int)syscall(__NR_io_uring_enter, io->ring_fd, to_submit, min_complete,
+                      IORING_ENTER_GETEVENTS, NULL, 0);
+  } while (rc < 0 && errno == EINTR);
+  if (rc >= 0) {
+    io->sq_pending -= (unsigned int)rc;
+  }
+  return rc;
+}
+
+/** Copy an entry into the submission queue; it is submitted by the next uring_enter */
+static int uring_push(io_t *io, const struct io_uring_sqe *sqe) {
+  unsigned int tail = *io->sq_tail;
+  if (tail - __atomic_load_n(io->sq_head, __ATOMIC_ACQUIRE) >= IO_RING_ENTRIES) {
+    errno = EBUSY;
+    return -1;
+  }
+  unsigned int index = tail & *io->sq_mask;
+  io->sqes[index] = *sqe;
+  io->sq_array[index] = index;
+  __atomic_store_n(io->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  io->sq_pending++;
+  return 0;
+}
+
+/** Take back the entries pushed but not submitted, so they cannot go out with a later batch */
+static void uring_unpush(io_t *io) {
+  __atomic_store_n(io->sq_tail, *io->sq_tail - io->sq_pending, __ATOMIC_RELEASE);
+  io->sq_pending = 0;
+}
+
+/** Wait for the next completion, submitting pending entries first; the caller must consume it */
+static struct io_uring_cqe *uring_wait(io_t *io) {
+  while (1) {
+    unsigned int head = *io->cq_head;
+    if (head != __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE)) {
+      return &io->cqes[head & *io->cq_mask];
+    }
+    if (uring_enter(io, io->sq_pending, 1) < 0) {
+      return NULL;
+    }
+  }
+}
+
+/** Mark the completion returned by uring_wait as consumed */
+static void uring_consume(io_t *io) {
+  __atomic_store_n(io->cq_head, *io->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/** Create the rings of a context and map them */
+static int uring_setup(io_t *io) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  io->ring_fd = (int)syscall(__NR_io_uring_setup, IO_RING_ENTRIES, &params);
+  if (io->ring_fd < 0) {
+    return -1;
+  }
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+    errno = ENOSYS; // Kernels this old lack the rest too
+    return -1;
+  }
+
+  io->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  io->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  io->sq_size = io->cq_size = (io->sq_size > io->cq_size) ? io->sq_size : io->cq_size;
+  io->sq_ptr = mmap(NULL, io->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    io->ring_fd, IORING_OFF_SQ_RING);
+  if (io->sq_ptr == MAP_FAILED) {
+    io->sq_ptr = NULL;
+    return -1;
+  }
+  io->cq_ptr = io->sq_ptr;
+  io->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, io->ring_fd, IORING_OFF_SQES);
+  if (io->sqes == MAP_FAILED) {
+    io->sqes = NULL;
+    return -1;
+  }
+
+  uint8_t *sq = io->sq_ptr, *cq = io->cq_ptr;
+  io->sq_head = (unsigned int *)(sq + params.sq_off.head);
+  io->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+  io->sq_mask = (unsigned int *)(sq + params.sq_off.ring_mask);
+  io->sq_array = (unsigned int *)(sq + params.sq_off.array);
+  io->cq_head = (unsigned int *)(cq + params.cq_off.head);
+  io->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+  io->cq_mask = (unsigned int *)(cq + params.cq_off.ring_mask);
+  io->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+  return 0;
+}
+
+/** Give a receive buffer back to the kernel */
+static void uring_recycle(io_t *io, uint16_t bid) {
+  uint16_t *tail = &io->buf_ring[0].resv;
+  io_buf_t *buf = &io->buf_ring[*tail & (IO_RECV_BUFFERS - 1)];
+  buf->addr = (uint64_t)(uintptr_t)(io->recv_bufs + (size_t)bid * IO_RECV_BUFFER_SIZE);
+  buf->len = IO_RECV_BUFFER_SIZE;
+  buf->bid = bid; // Never touch resv, which is the tail for the first entry
+  __atomic_store_n(tail, (uint16_t)(*tail + 1), __ATOMIC_RELEASE);
+}
+
+/** Provide the receive buffers to the kernel as a ring */
+static int uring_setup_recv(io_t *io) {
+  io->buf_ring = mmap(NULL, IO_RECV_BUFFERS * sizeof(io_buf_t), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (io->buf_ring == MAP_FAILED) {
+    io->buf_ring = NULL;
+    return -1;
+  }
+  if ((io->recv_bufs = malloc((size_t)IO_RECV_BUFFERS * IO_RECV_BUFFER_SIZE)) == NULL) {
+    return -1;
+  }
+
+  io_buf_reg_t reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)(uintptr_t)io->buf_ring;
+  reg.ring_entries = IO_RECV_BUFFERS;
+  reg.bgid = 0;
+  if (syscall(__NR_io_uring_register, io->ring_fd, IO_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    return -1;
+  }
+  for (int i = 0; i < IO_RECV_BUFFERS; i++) {
+    uring_recycle(io, (uint16_t)i);
+  }
+  return 0;
+}
+
+/** Register the send slots with the kernel, so writes from them skip the page lookups */
+static int uring_setup_send(io_t *io) {
+  struct iovec iov = {.iov_base = io->slots, .iov_len = (size_t)IO_QUEUE_DEPTH * IO_SLOT_SIZE};
+  return (int)syscall(__NR_io_uring_register, io->ring_fd, IORING_REGISTER_BUFFERS, &iov, 1);
+}
+
+/** Release the io_uring resources of a context */
+static void uring_teardown(io_t *io) {
+  if (io->ring_fd >= 0) {
+    close(io->ring_fd); // Also unregisters the buffers
+    io->ring_fd = -1;
+  }
+  if (io->sqes != NULL) {
+    munmap(io->sqes, IO_RING_ENTRIES * sizeof(struct io_uring_sqe));
+    io->sqes = NULL;
+  }
+  if (io->sq_ptr != NULL) {
+    munmap(io->sq_ptr, io->sq_size);
+    io->sq_ptr = io->cq_ptr = NULL;
+  }
+  if (io->buf_ring != NULL) {
+    munmap(io->buf_ring, IO_RECV_BUFFERS * sizeof(io_buf_t));
+    io->buf_ring = NULL;
+  }
+  free(io->recv_bufs);
+  io->recv_bufs = NULL;
+  io->uring = 0;
+}
+
+/** Allocate a context and set up the backend it asks for */
+static io_t *io_open(const char *backend, int fd) {
+  int want_uring = strcmp(backend, "uring") == 0;
+  int fallback = strcmp(backend, "auto") == 0;
+  if (!want_uring && !fallback && strcmp(backend, "blocking") != 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  io_t *io = calloc(1, sizeof(io_t));
+  if (io == NULL) {
+    return NULL;
+  }
+  io->fd = fd;
+  io->ring_fd = -1;
+  if (fd >= 0) {
+    io->stage = malloc(IO_STAGE_SIZE);
+  } else {
+    io->slots = malloc((size_t)IO_QUEUE_DEPTH * IO_SLOT_SIZE);
+  }
+  if (io->stage == NULL && io->slots == NULL) {
+    io_close(io);
+    return NULL;
+  }
+
+  if (want_uring || fallback) {
+    io->uring = 1;
+    int rc = uring_setup(io);
+    if (rc == 0) {
+      rc = (fd >= 0) ? uring_setup_recv(io) : uring_setup_send(io);
+    }
+    if (rc < 0) {
+      int err = errno;
+      uring_teardown(io);
+      if (!fallback) {
+        io_close(io);
+        errno = err;
+        return NULL;
+      }
+    }
+  }
+  io->fallback = fallback && io->uring;
+  return io;
+}
+
+io_t *io_open_receiver(const char *backend, int fd) {
+  if (fd < 0) {
+    errno = EBADF;
+    return NULL;
+  }
+  return io_open(backend, fd);
+}
+
+io_t *io_open_sender(const char *backend) {
+  return io_open(backend, -1);
+}
+
+const char *io_backend(const io_t *io) {
+  return io->uring ? "uring" : "blocking";
+}
+
+/** Receive the next bytes or datagram from the socket into buf; returns 0 at end of stream */
+static ssize_t io_recv_chunk(io_t *io, void *buf, size_t cap) {
+  while (io->uring) {
+    if (!io->recv_armed) {
+      struct io_uring_sqe sqe;
+      memset(&sqe, 0, sizeof(sqe));
+      sqe.opcode = IORING_OP_RECV;
+      sqe.fd = io->fd;
+      sqe.flags = IOSQE_BUFFER_SELECT;
+      sqe.buf_group = 0;
+      sqe.ioprio = IO_RECV_MULTISHOT;
+      sqe.user_data = IO_RECV_TAG;
+      if (uring_push(io, &sqe) < 0) {
+        return -1;
+      }
+      io->recv_armed = 1;
+    }
+
+    struct io_uring_cqe *cqe = uring_wait(io);
+    if (cqe == NULL) {
+      return -1;
+    }
+    int res = cqe->res;
+    unsigned int flags = cqe->flags;
+    uring_consume(io);
+    if (!(flags & IO_CQE_F_MORE)) {
+      io->recv_armed = 0; // The kernel stopped the receive, so the next call arms a new one
+    }
+
+    if (res == -EINVAL && io->fallback) {
+      uring_teardown(io); // No multishot receives before Linux 6.0, and no data was consumed
+      break;
+    }
+    io->fallback = 0;
+    if (res == -ENOBUFS) {
+      continue; // Every buffer was in use, and they have been given back since
+    }
+    if (res < 0) {
+      errno = -res;
+      return -1;
+    }
+    if (res == 0) {
+      return 0;
+    }
+
+    uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+    size_t len = ((size_t)res < cap) ? (size_t)res : cap;
+    memcpy(buf, io->recv_bufs + (size_t)bid * IO_RECV_BUFFER_SIZE, len);
+    uring_recycle(io, bid);
+    return (ssize_t)len;
+  }
+
+  ssize_t n;
+  do {
+    count(&io->syscalls, 1);
+    n = recv(io->fd, buf, cap, 0);
+  } while (n < 0 && errno == EINTR);
+  return n;
+}
+
+ssize_t io_recv_datagram(io_t *io, void *buf, size_t cap) {
+  ssize_t n = io_recv_chunk(io, buf, cap);
+  if (n > 0) {
+    count(&io->messages, 1);
+  }
+  return n;
+}
+
+ssize_t io_recv_frame(io_t *io, void *buf, size_t cap) {
+  while (1) {
+    size_t avail = io->stage_end - io->stage_start;
+    if (avail >= 4) {
+      uint8_t *header = io->stage + io->stage_start;
+      uint32_t len = ((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16)
+                     | ((uint32_t)header[2] << 8) | header[3];
+      if (len == 0 || len > IO_MAX_FRAME) {
+        errno = EPROTO;
+        return -1;
+      }
+      if (avail >= 4 + len) {
+        io->stage_start += 4 + len;
+        if (len > cap) {
+          errno = EMSGSIZE; // Dropped whole, so the next frame still starts in step
+          return -1;
+        }
+        memcpy(buf, header + 4, len);
+        count(&io->messages, 1);
+        return len;
+      }
+    }
+
+    // Move the partial frame to the front, which leaves room for at least one receive buffer
+    memmove(io->stage, io->stage + io->stage_start, avail);
+    io->stage_start = 0;
+    io->stage_end = avail;
+
+    ssize_t n = io_recv_chunk(io, io->stage + avail, IO_STAGE_SIZE - avail);
+    if (n < 0) {
+      return -1;
+    }
+    if (n == 0) {
+      if (avail > 0) {
+        errno = ECONNRESET; // The stream ended in the middle of a frame
+        return -1;
+      }
+      return 0;
+    }
+    io->stage_end += n;
+  }
+}
+
+/** Take the next free slot of the send queue, flushing the queue if it is full */
+static io_send_t *io_queue_slot(io_t *io, size_t len, uint8_t **slot) {
+  if (io->slots == NULL) {
+    errno = EINVAL; // Not a sender
+    return NULL;
+  }
+  if (len > IO_SLOT_SIZE) {
+    errno = EMSGSIZE;
+    return NULL;
+  }
+  if (io->num_sends == IO_QUEUE_DEPTH && io_flush(io) < 0) {
+    return NULL;
+  }
+  *slot = io->slots + (size_t)io->num_sends * IO_SLOT_SIZE;
+  io_send_t *send = &io->sends[io->num_sends++];
+  memset(send, 0, sizeof(*send));
+  send->len = len;
+  return send;
+}
+
+int io_queue_frame(io_t *io, int fd, const void *buf, size_t len) {
+  uint8_t *slot;
+  io_send_t *send = io_queue_slot(io, len + 4, &slot);
+  if (send == NULL) {
+    return -1;
+  }
+  slot[0] = (uint8_t)(len >> 24);
+  slot[1] = (uint8_t)(len >> 16);
+  slot[2] = (uint8_t)(len >> 8);
+  slot[3] = (uint8_t)len;
+  memcpy(slot + 4, buf, len);
+  send->fd = fd;
+  return 0;
+}
+
+int io_queue_datagram(io_t *io, int fd, const struct sockaddr_storage *addr,
+                      socklen_t addr_len, const void *buf, size_t len) {
+  uint8_t *slot;
+  io_send_t *send = io_queue_slot(io, len, &slot);
+  if (send == NULL) {
+    return -1;
+  }
+  memcpy(slot, buf, len);
+  send->fd = fd;
+  send->is_datagram = 1;
+  memcpy(&send->addr, addr, addr_len);
+  send->addr_len = addr_len;
+  return 0;
+}
+
+/** Send the rest of a frame that a write left unfinished */
+static int io_send_rest(io_t *io, int fd, const uint8_t *buf, size_t len) {
+  while (len > 0) {
+    count(&io->syscalls, 1);
+    ssize_t sent = send(fd, buf, len, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent < 0) {
+      return -1;
+    }
+    buf += sent;
+    len -= sent;
+  }
+  return 0;
+}
+
+/** Fill in the submission entry that sends the unwritten part of a queued message */
+static void uring_prep_send(io_t *io, int i, struct io_uring_sqe *sqe) {
+  io_send_t *send = &io->sends[i];
+  uint8_t *slot = io->slots + (size_t)i * IO_SLOT_SIZE;
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->fd = send->fd;
+  sqe->user_data = i;
+  if (send->is_datagram) {
+    send->iov.iov_base = slot;
+    send->iov.iov_len = send->len;
+    send->msg.msg_name = &send->addr;
+    send->msg.msg_namelen = send->addr_len;
+    send->msg.msg_iov = &send->iov;
+    send->msg.msg_iovlen = 1;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->addr = (uint64_t)(uintptr_t)&send->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+  } else {
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->addr = (uint64_t)(uintptr_t)(slot + send->done);
+    sqe->len = send->len - send->done;
+    sqe->buf_index = 0;
+  }
+}
+
+/** Give up on the unfinished messages of a socket after an error; returns how many there were */
+static int uring_fail_fd(io_t *io, int fd) {
+  int failed = 0;
+  for (int i = 0; i < io->num_sends; i++) {
+    if (!io->sends[i].finished && io->sends[i].fd == fd) {
+      io->sends[i].finished = 1;
+      failed++;
+    }
+  }
+  return failed;
+}
+
+/**
+ * Send the queue with io_uring, one io_uring_enter per round. The messages of each socket are
+ * linked, so the kernel sends them in order. A short write ends its chain and the kernel cancels
+ * the rest of it, so the next round resends the chain from where the write stopped.
+ */
+static int uring_flush(io_t *io) {
+  int rc = 0, err = 0;
+  int remaining = io->num_sends;
+  int push_failed = 0;
+  while (remaining > 0 && !push_failed) {
+    // Push the unfinished messages socket by socket, since a chain must be consecutive entries
+    uint64_t pushed = 0;
+    int submitted = 0;
+    for (int i = 0; i < io->num_sends && !push_failed; i++) {
+      if (io->sends[i].finished || (pushed & (1ULL << i))) {
+        continue;
+      }
+      int fd = io->sends[i].fd;
+      for (int j = i; j < io->num_sends; j++) {
+        if (io->sends[j].finished || io->sends[j].fd != fd) {
+          continue;
+        }
+        struct io_uring_sqe sqe;
+        uring_prep_send(io, j, &sqe);
+        for (int k = j + 1; k < io->num_sends; k++) {
+          if (!io->sends[k].finished && io->sends[k].fd == fd) {
+            sqe.flags |= IOSQE_IO_LINK;
+            break;
+          }
+        }
+        if (uring_push(io, &sqe) < 0) {
+          // Reap what was pushed before giving up, since those entries still point at the slots
+          rc = -1;
+          err = errno;
+          push_failed = 1;
+          break;
+        }
+        pushed |= 1ULL << j;
+        submitted++;
+      }
+    }
+
+    if (submitted > 0 && uring_enter(io, io->sq_pending, submitted) < 0) {
+      uring_unpush(io);
+      return -1;
+    }
+    for (int done = 0; done < submitted; done++) {
+      struct io_uring_cqe *cqe = uring_wait(io);
+      if (cqe == NULL) {
+        uring_unpush(io);
+        return -1;
+      }
+      int res = cqe->res;
+      io_send_t *send = &io->sends[cqe->user_data];
+      uring_consume(io);
+
+      if (send->finished || res == -ECANCELED) {
+        continue; // Cut off by an earlier message of its chain, so it goes in the next round
+      }
+      if (res < 0 || (res == 0 && !send->is_datagram)) {
+        rc = -1;
+        err = (res < 0) ? -res : EPIPE;
+        remaining -= uring_fail_fd(io, send->fd);
+        continue;
+      }
+      if (!send->is_datagram) {
+        send->done += res;
+        if (send->done < send->len) {
+          continue;
+        }
+      }
+      send->finished = 1;
+      remaining--;
+    }
+  }
+  errno = err;
+  return rc;
+}
+
+/** Send the queue with one system call per message */
+static int blocking_flush(io_t *io) {
+  for (int i = 0; i < io->num_sends; i++) {
+    io_send_t *send = &io->sends[i];
+    const uint8_t *slot = io->slots + (size_t)i * IO_SLOT_SIZE;
+    if (!send->is_datagram) {
+      if (io_send_rest(io, send->fd, slot, send->len) < 0) {
+        return -1;
+      }
+      continue;
+    }
+    ssize_t sent;
+    do {
+      count(&io->syscalls, 1);
+      sent = sendto(send->fd, slot, send->len, MSG_NOSIGNAL, (struct sockaddr *)&send->addr,
+                    send->addr_len);
+    } while (sent < 0 && errno == EINTR);
+    if (sent < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int io_flush(io_t *io) {
+  if (io->num_sends == 0) {
+    return 0;
+  }
+  int num_sends = io->num_sends;
+  int rc = io->uring ? uring_flush(io) : blocking_flush(io);
+  io->num_sends = 0;
+  if (rc == 0) {
+    count(&io->messages, num_sends);
+  }
+  return rc;
+}
+
+void io_get_stats(io_t *io, io_stats_t *stats) {
+  stats->syscalls = __atomic_load_n(&io->syscalls, __ATOMIC_RELAXED);
+  stats->messages = __atomic_load_n(&io->messages, __ATOMIC_RELAXED);
+}
+
+void io_close(io_t *io) {
+  if (io == NULL) {
+    return;
+  }
+  uring_teardown(io);
+  free(io->stage);
+  free(io->slots);
+  free(io);
+}
@@ -0,0 +1,73 @@
+#ifndef IO_H
+#define IO_H
+
+/*
+ * Message I/O for the C programs, with a blocking backend and an io_uring backend chosen at
+ * startup. A context belongs to one thread and either receives from one socket or sends.
+ *
+ * With io_uring, a receiving context keeps a single multishot receive armed on its socket. The
+ * kernel fills buffers from a ring the context provides, so one io_uring_enter can return several
+ * messages and no receive has to be resubmitted. A sending context copies queued messages into a
+ * buffer registered with the kernel and submits the whole batch with one io_uring_enter. The
+ * blocking backend makes one recv, send or sendto per call, except that stream receives read as
+ * much as is available, so a single recv can return several frames.
+ *
+ * The "auto" backend uses io_uring when the kernel supports everything above, including
+ * multishot receives (Linux 6.0), and falls back to the blocking backend otherwise.
+ */
+
+#include <stddef.h> // needed for size_t
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#define IO_QUEUE_DEPTH 64 // Number of messages a sender can queue before it must flush
+#define IO_SLOT_SIZE 2048 // Maximum length of a queued message, frame header included
+#define IO_RECV_BUFFERS 64 // Number of buffers provided to the kernel for receives
+#define IO_RECV_BUFFER_SIZE 4096 // Length of each of those buffers
+#define IO_MAX_FRAME 65536 // Maximum length of a received framed message
+
+/** I/O context */
+typedef struct io io_t;
+
+/** Counters of the work done by a context */
+typedef struct {
+  uint64_t syscalls; // System calls made to send or receive
+  uint64_t messages; // Messages sent or received
+} io_stats_t;
+
+/** Open a context that receives from a socket; backend is "uring", "blocking" or "auto" */
+io_t *io_open_receiver(const char *backend, int fd);
+
+/** Open a context that sends; backend is "uring", "blocking" or "auto" */
+io_t *io_open_sender(const char *backend);
+
+/** Get the name of the backend a context ended up using */
+const char *io_backend(const io_t *io);
+
+/** Receive one datagram into buf; returns its length (truncated to cap) or -1 on error */
+ssize_t io_recv_datagram(io_t *io, void *buf, size_t cap);
+
+/**
+ * Receive one framed message into buf; returns its length, or 0 if the peer closed the stream.
+ * A message longer than cap is skipped with EMSGSIZE. EPROTO means the stream is out of step.
+ */
+ssize_t io_recv_frame(io_t *io, void *buf, size_t cap);
+
+/** Queue a framed message for a stream socket, flushing first if the queue is full */
+int io_queue_frame(io_t *io, int fd, const void *buf, size_t len);
+
+/** Queue a datagram for an address, flushing first if the queue is full */
+int io_queue_datagram(io_t *io, int fd, const struct sockaddr_storage *addr,
+                      socklen_t addr_len, const void *buf, size_t len);
+
+/** Send every queued message and wait until they are all sent */
+int io_flush(io_t *io);
+
+/** Read the counters of a context; safe to call from another thread */
+void io_get_stats(io_t *io, io_stats_t *stats);
+
+/** Close a context, leaving its socket open */
+void io_close(io_t *io);
+
+#endif // IO_H
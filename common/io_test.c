@@ -0,0 +1,177 @@
+/*
+ * Ordering test of the I/O backends. A sender queues numbered frames, each filled with a pattern
+ * of its number, onto one stream while a receiver checks that every frame arrives whole and in
+ * order. The send buffer is kept small, so the sender's writes are often cut short. Each
+ * backend is run over a Unix socket pair and over loopback TCP. Then a frame too long for the
+ * receiver is sent, which must be skipped without throwing off the frame after it.
+ *
+ * Usage: io_test
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "io.h"
+
+#define NUM_FRAMES 640 // Number of frames sent per run
+#define FRAME_SIZE 2000 // Length of each frame
+#define FLUSH_EVERY 16 // Number of frames queued between flushes
+#define SOCKET_BUFFER 4096 // Send buffer size asked for, to force short writes
+
+// One run of the test
+typedef struct {
+  const char *backend; // Backend of both sides
+  int send_fd, recv_fd; // Ends of the stream
+  int bad_frames; // Frames that arrived out of order or corrupted
+  int received; // Frames that arrived at all
+} run_t;
+
+/** Fill a frame with the pattern of its number */
+static void fill_frame(uint8_t *frame, int number) {
+  for (int i = 0; i < FRAME_SIZE; i++) {
+    frame[i] = (uint8_t)(number * 7 + i);
+  }
+}
+
+/** Receive every frame and count the ones that are not what was sent at that position */
+static void *receiver(void *arg) {
+  run_t *run = arg;
+  io_t *io = io_open_receiver(run->backend, run->recv_fd);
+  if (io == NULL) {
+    perror("Error opening receiver");
+    exit(1);
+  }
+  uint8_t frame[FRAME_SIZE], expected[FRAME_SIZE];
+  for (int i = 0; i < NUM_FRAMES; i++) {
+    ssize_t len = io_recv_frame(io, frame, sizeof(frame));
+    if (len <= 0) {
+      fprintf(stderr, "%s: receive returned %zd at frame %d\n", run->backend, len, i);
+      break;
+    }
+    fill_frame(expected, i);
+    if (len != FRAME_SIZE || memcmp(frame, expected, FRAME_SIZE) != 0) {
+      run->bad_frames++;
+    }
+    run->received++;
+  }
+  io_close(io);
+  return NULL;
+}
+
+/** Send every frame, flushing in batches, and check what the receiver saw */
+static int run_test(const char *backend, const char *transport, int send_fd, int recv_fd) {
+  int size = SOCKET_BUFFER;
+  setsockopt(send_fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+  run_t run = {.backend = backend, .send_fd = send_fd, .recv_fd = recv_fd};
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, receiver, &run) != 0) {
+    perror("Error creating receiver thread");
+    exit(1);
+  }
+
+  io_t *io = io_open_sender(backend);
+  if (io == NULL) {
+    perror("Error opening sender");
+    exit(1);
+  }
+  uint8_t frame[FRAME_SIZE];
+  for (int i = 0; i < NUM_FRAMES; i++) {
+    fill_frame(frame, i);
+    if (io_queue_frame(io, send_fd, frame, sizeof(frame)) < 0
+        || ((i + 1) % FLUSH_EVERY == 0 && io_flush(io) < 0)) {
+      perror("Error sending frames");
+      exit(1);
+    }
+  }
+  if (io_flush(io) < 0) {
+    perror("Error sending frames");
+    exit(1);
+  }
+  pthread_join(thread, NULL);
+
+  int ok = run.received == NUM_FRAMES && run.bad_frames == 0;
+  printf("%-8s %-10s %-8s %d of %d frames received, %d bad: %s\n", io_backend(io), transport,
+         backend, run.received, NUM_FRAMES, run.bad_frames, ok ? "ok" : "FAILED");
+  io_close(io);
+  close(send_fd);
+  close(recv_fd);
+  return ok ? 0 : -1;
+}
+
+/** Check that a frame longer than the receiver's buffer is skipped without losing the next one */
+static int run_oversized(const char *backend) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+    perror("Error opening socket pair");
+    exit(1);
+  }
+  io_t *sender = io_open_sender(backend);
+  io_t *receiver = io_open_receiver(backend, fds[1]);
+  if (sender == NULL || receiver == NULL) {
+    perror("Error opening context");
+    exit(1);
+  }
+  uint8_t large[FRAME_SIZE], small[16];
+  fill_frame(large, 1);
+  fill_frame(small, 2);
+  if (io_queue_frame(sender, fds[0], large, sizeof(large)) < 0
+      || io_queue_frame(sender, fds[0], small, sizeof(small)) < 0 || io_flush(sender) < 0) {
+    perror("Error sending frames");
+    exit(1);
+  }
+
+  uint8_t buf[FRAME_SIZE / 2];
+  ssize_t first = io_recv_frame(receiver, buf, sizeof(buf));
+  int first_errno = errno;
+  ssize_t second = io_recv_frame(receiver, buf, sizeof(buf));
+  int ok = first < 0 && first_errno == EMSGSIZE && second == sizeof(small)
+           && memcmp(buf, small, sizeof(small)) == 0;
+  printf("%-8s %-10s %-8s oversized frame skipped, next frame intact: %s\n", io_backend(receiver),
+         "socketpair", backend, ok ? "ok" : "FAILED");
+  io_close(sender);
+  io_close(receiver);
+  close(fds[0]);
+  close(fds[1]);
+  return ok ? 0 : -1;
+}
+
+/** Open a connected pair of loopback TCP sockets */
+static void tcp_pair(int fds[2]) {
+  struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  socklen_t addr_len = sizeof(addr);
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+      || listen(listen_fd, 1) < 0
+      || getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) < 0
+      || (fds[0] = socket(AF_INET, SOCK_STREAM, 0)) < 0
+      || connect(fds[0], (struct sockaddr *)&addr, sizeof(addr)) < 0
+      || (fds[1] = accept(listen_fd, NULL, NULL)) < 0) {
+    perror("Error opening TCP pair");
+    exit(1);
+  }
+  close(listen_fd);
+}
+
+int main(void) {
+  const char *backends[] = {"blocking", "auto"};
+  int failures = 0;
+  for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+      perror("Error opening socket pair");
+      exit(1);
+    }
+    failures += run_test(backends[i], "socketpair", fds[0], fds[1]) < 0;
+    tcp_pair(fds);
+    failures += run_test(backends[i], "tcp", fds[0], fds[1]) < 0;
+    failures += run_oversized(backends[i]) < 0;
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,451 @@
+/*
+ * Local cluster launcher. Starts one instance of a program per line of a hostsfile on this
+ * machine, in place of one container per host. Each instance goes by the name on its line and
+ * listens on a port of its own: the launcher writes a cluster map of names to ports and passes it
+ * to the instances through the environment (see net.h), so they find each other on 127.0.0.1.
+ *
+ * A line of the hostsfile may follow the name with extra arguments for that instance only, such
+ * as "p1 -x" for the process that starts with the token. The launcher writes the names alone to
+ * hostsfile.txt in the run directory, for the instances to read.
+ *
+ * Everything an instance writes goes to <name>.log in the run directory. Arguments may contain
+ * {name}, {index}, {port}, {dir} and {hosts} (the path of that hostsfile.txt), which are replaced
+ * for each instance, e.g. "-e unix:{dir}/{name}.sock" gives every instance its own metrics
+ * socket. The launcher scrapes those sockets into <name>.prom before it stops the instances, and
+ * writes the port, CPU and exit status of every instance to summary.tsv.
+ *
+ * The run ends when every instance has exited, when the timeout expires, or on Ctrl-C. Instances
+ * still running then get SIGTERM, and SIGKILL if they are still there a second later.
+ *
+ * Usage: launch [-o <run dir>] [-b <base port>] [-p] [-t <seconds>] <hostsfile> <program> [args]
+ *   -o  run directory (default runs/<date>-<time>)
+ *   -b  port of the first instance; the others follow (default 7000)
+ *   -p  pin instance i to CPU i modulo the number of CPUs
+ *   -t  stop the instances after this many seconds (default: wait for them to exit)
+ */
+
+#define _GNU_SOURCE // needed for sched_setaffinity
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "net.h"
+
+#define MAX_NAME 256 // Maximum length of an instance name
+#define MAX_PATH 4096 // Maximum length of a path
+#define MAX_ARG 4096 // Maximum length of an argument after substitution
+#define MAX_EXTRA_ARGS 32 // Maximum number of extra arguments on a line of the hostsfile
+#define DEFAULT_BASE_PORT 7000 // Port of the first instance by default
+#define POLL_INTERVAL_MS 10 // How often to check on the instances
+#define KILL_GRACE_MS 1000 // How long instances get to exit after SIGTERM
+#define SCRAPE_LENGTH (1 << 20) // Largest metrics page scraped from an instance
+
+// An instance of the program
+typedef struct {
+  char name[MAX_NAME]; // Name from the hostsfile
+  char extra[MAX_NAME]; // Extra arguments from the hostsfile, separated by spaces
+  int port; // Port the instance listens on
+  int cpu; // CPU the instance is pinned to, or -1
+  pid_t pid; // Process ID, or 0 once the instance was reaped
+  int status; // Wait status once the instance was reaped
+} instance_t;
+
+static instance_t *instances = NULL;
+static int num_instances = 0;
+static volatile sig_atomic_t interrupted = 0;
+
+/** Remember that the run should stop */
+static void on_signal(int sig) {
+  (void)sig;
+  interrupted = 1;
+}
+
+/** Get the current monotonic time in milliseconds */
+static long long now_ms(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+/** Read the instance names from the hostsfile */
+static void read_hostsfile(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    fprintf(stderr, "Error opening file at %s\n", path);
+    exit(1);
+  }
+
+  char line[MAX_NAME];
+  int cap = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line[strcspn(line, "\n")] = 0; // Remove trailing newline character
+    char *extra = line + strcspn(line, " \t");
+    if (*extra) {
+      *extra++ = 0;
+    }
+    if (strlen(line) == 0) {
+      continue;
+    }
+    if (strchr(line, '/') != NULL) {
+      fprintf(stderr, "Error: Invalid name in hostfile: %s\n", line);
+      exit(1);
+    }
+    for (int i = 0; i < num_instances; i++) {
+      if (strcmp(instances[i].name, line) == 0) {
+        fprintf(stderr, "Error: Duplicate name in hostfile: %s\n", line);
+        exit(1);
+      }
+    }
+    if (num_instances == cap) {
+      cap = cap ? cap * 2 : 64;
+      if ((instances = realloc(instances, cap * sizeof(instance_t))) == NULL) {
+        perror("Error allocating instances");
+        exit(1);
+      }
+    }
+    instance_t *instance = &instances[num_instances++];
+    memset(instance, 0, sizeof(*instance));
+    strcpy(instance->name, line);
+    strcpy(instance->extra, extra);
+  }
+  fclose(file);
+
+  if (num_instances == 0) {
+    fprintf(stderr, "Error: No names found in %s\n", path);
+    exit(1);
+  }
+}
+
+/** Create a directory and its parents */
+static void make_dirs(const char *path) {
+  char partial[MAX_PATH];
+  snprintf(partial, sizeof(partial), "%s", path);
+  for (char *p = partial + 1; *p; p++) {
+    if (*p == '/') {
+      *p = 0;
+      mkdir(partial, 0755);
+      *p = '/';
+    }
+  }
+  if (mkdir(partial, 0755) < 0 && errno != EEXIST) {
+    fprintf(stderr, "Error creating directory %s: %s\n", path, strerror(errno));
+    exit(1);
+  }
+}
+
+/** Copy an argument, replacing {name}, {index}, {port}, {dir} and {hosts} for an instance */
+static void substitute(char *out, const char *arg, const instance_t *instance, int index,
+                       const char *dir) {
+  size_t len = 0;
+  while (*arg && len < MAX_ARG - 1) {
+    char value[MAX_PATH];
+    const char *close = (*arg == '{') ? strchr(arg, '}') : NULL;
+    size_t key_len = (close != NULL) ? (size_t)(close - arg + 1) : 0;
+    if (key_len == 6 && strncmp(arg, "{name}", 6) == 0) {
+      snprintf(value, sizeof(value), "%s", instance->name);
+    } else if (key_len == 7 && strncmp(arg, "{index}", 7) == 0) {
+      snprintf(value, sizeof(value), "%d", index);
+    } else if (key_len == 6 && strncmp(arg, "{port}", 6) == 0) {
+      snprintf(value, sizeof(value), "%d", instance->port);
+    } else if (key_len == 5 && strncmp(arg, "{dir}", 5) == 0) {
+      snprintf(value, sizeof(value), "%s", dir);
+    } else if (key_len == 7 && strncmp(arg, "{hosts}", 7) == 0) {
+      snprintf(value, sizeof(value), "%s/hostsfile.txt", dir);
+    } else {
+      out[len++] = *arg++;
+      continue;
+    }
+    len += snprintf(out + len, MAX_ARG - len, "%s", value);
+    len = (len < MAX_ARG) ? len : MAX_ARG - 1;
+    arg += key_len;
+  }
+  out[len] = 0;
+}
+
+/** Start one instance; runs in the child after fork and never returns */
+static void run_instance(const instance_t *instance, int index, const char *dir,
+                         const char *map_path, char **args) {
+  char path[MAX_PATH];
+  snprintf(path, sizeof(path), "%s/%s.log", dir, instance->name);
+  int log_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (log_fd < 0 || dup2(log_fd, STDOUT_FILENO) < 0 || dup2(log_fd, STDERR_FILENO) < 0) {
+    _exit(127);
+  }
+  close(log_fd);
+  setpgid(0, 0); // Keep Ctrl-C for the launcher, which stops the instances after scraping them
+
+  if (instance->cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(instance->cpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0) {
+      perror("Error pinning instance to its CPU");
+    }
+  }
+  setenv(NET_NODE_NAME_ENV, instance->name, 1);
+  setenv(NET_CLUSTER_MAP_ENV, map_path, 1);
+
+  // The common arguments, then the ones from the instance's line of the hostsfile
+  char *extra_args[MAX_EXTRA_ARGS + 1];
+  int num_extra = 0;
+  char extra[MAX_NAME];
+  strcpy(extra, instance->extra);
+  for (char *arg = strtok(extra, " \t"); arg != NULL && num_extra < MAX_EXTRA_ARGS;
+       arg = strtok(NULL, " \t")) {
+    extra_args[num_extra++] = arg;
+  }
+  int num_args = 0;
+  while (args[num_args] != NULL) {
+    num_args++;
+  }
+  char **argv = calloc(num_args + num_extra + 1, sizeof(char *));
+  for (int i = 0; argv != NULL && i < num_args + num_extra; i++) {
+    if ((argv[i] = malloc(MAX_ARG)) == NULL) {
+      _exit(127);
+    }
+    substitute(argv[i], (i < num_args) ? args[i] : extra_args[i - num_args], instance, index,
+               dir);
+  }
+  if (argv != NULL) {
+    execvp(argv[0], argv);
+  }
+  fprintf(stderr, "Error starting %s: %s\n", args[0], strerror(errno));
+  _exit(127);
+}
+
+/** Reap every instance that has exited; returns how many are still running */
+static int reap(void) {
+  pid_t pid;
+  int status;
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    for (int i = 0; i < num_instances; i++) {
+      if (instances[i].pid == pid) {
+        instances[i].pid = 0;
+        instances[i].status = status;
+      }
+    }
+  }
+
+  int running = 0;
+  for (int i = 0; i < num_instances; i++) {
+    running += instances[i].pid > 0;
+  }
+  return running;
+}
+
+/** Save the metrics an instance serves on {dir}/{name}.sock, if it serves any */
+static void scrape(const instance_t *instance, const char *dir) {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/%s.sock", dir, instance->name)
+      >= (int)sizeof(addr.sun_path)) {
+    return;
+  }
+  int sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock_fd < 0 || connect(sock_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    if (sock_fd >= 0) {
+      close(sock_fd);
+    }
+    return;
+  }
+
+  static char page[SCRAPE_LENGTH];
+  size_t len = 0;
+  ssize_t n;
+  const char *request = "GET /metrics HTTP/1.0\r\n\r\n";
+  if (net_send_all(sock_fd, request, strlen(request)) == 0) {
+    while (len < sizeof(page) - 1
+           && (n = recv(sock_fd, page + len, sizeof(page) - 1 - len, 0)) > 0) {
+      len += n;
+    }
+  }
+  close(sock_fd);
+  page[len] = 0;
+
+  const char *body = strstr(page, "\r\n\r\n");
+  if (body != NULL) {
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "%s/%s.prom", dir, instance->name);
+    FILE *out = fopen(path, "w");
+    if (out != NULL) {
+      fputs(body + 4, out);
+      fclose(out);
+    }
+  }
+}
+
+/** Stop the instances still running, politely first */
+static void stop_all(void) {
+  for (int i = 0; i < num_instances; i++) {
+    if (instances[i].pid > 0) {
+      kill(instances[i].pid, SIGTERM);
+    }
+  }
+  long long deadline = now_ms() + KILL_GRACE_MS;
+  while (reap() > 0 && now_ms() < deadline) {
+    usleep(POLL_INTERVAL_MS * 1000);
+  }
+  for (int i = 0; i < num_instances; i++) {
+    if (instances[i].pid > 0) {
+      kill(instances[i].pid, SIGKILL);
+    }
+  }
+  while (reap() > 0) {
+    usleep(POLL_INTERVAL_MS * 1000);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  char dir[MAX_PATH] = "";
+  int base_port = DEFAULT_BASE_PORT;
+  int pin = 0;
+  double timeout_seconds = 0;
+
+  // Parse command line arguments, stopping at the program so its own options are left alone
+  int opt;
+  while ((opt = getopt(argc, argv, "+o:b:pt:")) != -1) {
+    switch (opt) {
+      case 'o':
+        snprintf(dir, sizeof(dir), "%s", optarg);
+        break;
+      case 'b':
+        base_port = atoi(optarg);
+        break;
+      case 'p':
+        pin = 1;
+        break;
+      case 't':
+        timeout_seconds = atof(optarg);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-o <run dir>] [-b <base port>] [-p] [-t <seconds>] "
+                "<hostsfile> <program> [args...]\n", argv[0]);
+        exit(1);
+    }
+  }
+  if (argc - optind < 2 || base_port <= 0) {
+    fprintf(stderr, "Usage: %s [-o <run dir>] [-b <base port>] [-p] [-t <seconds>] "
+            "<hostsfile> <program> [args...]\n", argv[0]);
+    exit(1);
+  }
+
+  read_hostsfile(argv[optind]);
+  if (base_port + num_instances > 65536) {
+    fprintf(stderr, "Error: Not enough ports above %d for %d instances\n", base_port,
+            num_instances);
+    exit(1);
+  }
+  if (dir[0] == 0) {
+    time_t now = time(NULL);
+    strftime(dir, sizeof(dir), "runs/%Y%m%d-%H%M%S", localtime(&now));
+  }
+  make_dirs(dir);
+
+  // Write the names alone, for the instances to read as their hostsfile
+  char hosts_path[MAX_PATH];
+  snprintf(hosts_path, sizeof(hosts_path), "%s/hostsfile.txt", dir);
+  FILE *hosts = fopen(hosts_path, "w");
+  if (hosts == NULL) {
+    fprintf(stderr, "Error creating %s\n", hosts_path);
+    exit(1);
+  }
+  for (int i = 0; i < num_instances; i++) {
+    fprintf(hosts, "%s\n", instances[i].name);
+  }
+  fclose(hosts);
+
+  // Write the cluster map the instances find each other with
+  char map_path[MAX_PATH];
+  snprintf(map_path, sizeof(map_path), "%s/cluster.map", dir);
+  FILE *map = fopen(map_path, "w");
+  if (map == NULL) {
+    fprintf(stderr, "Error creating %s\n", map_path);
+    exit(1);
+  }
+  long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  for (int i = 0; i < num_instances; i++) {
+    instances[i].port = base_port + i;
+    instances[i].cpu = pin ? (int)(i % num_cpus) : -1;
+    fprintf(map, "%s %d\n", instances[i].name, instances[i].port);
+  }
+  fclose(map);
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_signal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  // Start every instance
+  long long started_at = now_ms();
+  for (int i = 0; i < num_instances; i++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("Error starting instance");
+      stop_all();
+      exit(1);
+    }
+    if (pid == 0) {
+      run_instance(&instances[i], i, dir, map_path, argv + optind + 1);
+    }
+    instances[i].pid = pid;
+  }
+  fprintf(stderr, "{instances: %d, start_ms: %lld, dir: %s}\n", num_instances,
+          now_ms() - started_at, dir);
+
+  // Wait for the instances to finish, the timeout, or Ctrl-C
+  long long deadline = 0;
+  if (timeout_seconds > 0) {
+    deadline = started_at + (long long)(timeout_seconds * 1000);
+  }
+  while (reap() > 0 && !interrupted && (deadline == 0 || now_ms() < deadline)) {
+    usleep(POLL_INTERVAL_MS * 1000);
+  }
+
+  // Collect the metrics of the instances still running, then stop them
+  for (int i = 0; i < num_instances; i++) {
+    if (instances[i].pid > 0) {
+      scrape(&instances[i], dir);
+    }
+  }
+  stop_all();
+
+  // Record how each instance ended
+  char summary_path[MAX_PATH];
+  snprintf(summary_path, sizeof(summary_path), "%s/summary.tsv", dir);
+  FILE *summary = fopen(summary_path, "w");
+  int failed = 0;
+  if (summary != NULL) {
+    fprintf(summary, "name\tport\tcpu\tstatus\n");
+  }
+  for (int i = 0; i < num_instances; i++) {
+    int status = instances[i].status;
+    char ended[32];
+    if (WIFEXITED(status)) {
+      snprintf(ended, sizeof(ended), "exit %d", WEXITSTATUS(status));
+      failed += WEXITSTATUS(status) != 0;
+    } else {
+      snprintf(ended, sizeof(ended), "signal %d", WTERMSIG(status));
+    }
+    if (summary != NULL) {
+      fprintf(summary, "%s\t%d\t%d\t%s\n", instances[i].name, instances[i].port, instances[i].cpu,
+              ended);
+    }
+  }
+  if (summary != NULL) {
+    fclose(summary);
+  }
+  fprintf(stderr, "{instances: %d, failed: %d, run_ms: %lld, dir: %s}\n", num_instances, failed,
+          now_ms() - started_at, dir);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,294 @@
+#include "metrics.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "net.h"
+
+#define METRICS_BACKLOG 16 // How many pending scrapes the endpoint queues
+#define METRICS_REQUEST_LENGTH 1024 // Longest request read from a scraper
+#define METRICS_TIMEOUT_MS 1000 // How long a scraper may take to send its request or read the reply
+
+typedef enum { METRIC_COUNTER, METRIC_GAUGE, METRIC_HISTOGRAM } metric_type_t;
+
+/** A registered metric */
+typedef struct {
+  const char *name;
+  const char *help;
+  metric_type_t type;
+} metric_t;
+
+/** One thread's copy of a metric, written only by that thread */
+typedef struct {
+  _Alignas(METRICS_CACHE_LINE) uint64_t value; // Counter total, gauge share, or histogram sum
+  uint64_t buckets[METRICS_BUCKETS]; // Histogram values by power of two, not cumulative
+} metric_slot_t;
+
+/** The copies of every metric for one thread; kept after the thread exits, so nothing is lost */
+typedef struct metrics_thread {
+  metric_slot_t slots[METRICS_MAX];
+  struct metrics_thread *next; // Next thread in the list
+} metrics_thread_t;
+
+static metric_t metrics[METRICS_MAX];
+static int num_metrics = 0; // Read without the lock once registration is over
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static metrics_thread_t *threads = NULL; // Every thread that updated a metric, newest first
+static __thread metrics_thread_t *local_thread = NULL; // Copies of the calling thread
+
+/** Register a metric of any type */
+static int metrics_register(const char *name, const char *help, metric_type_t type) {
+  pthread_mutex_lock(&registry_mutex);
+  int id = -1;
+  if (num_metrics < METRICS_MAX) {
+    id = num_metrics;
+    metrics[id] = (metric_t){.name = name, .help = help, .type = type};
+    __atomic_store_n(&num_metrics, num_metrics + 1, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&registry_mutex);
+  return id;
+}
+
+/** Register a counter; returns its id, or -1 if the registry is full */
+int metrics_counter(const char *name, const char *help) {
+  return metrics_register(name, help, METRIC_COUNTER);
+}
+
+/** Register a gauge, whose value is the sum of what each thread set; returns its id or -1 */
+int metrics_gauge(const char *name, const char *help) {
+  return metrics_register(name, help, METRIC_GAUGE);
+}
+
+/** Register a histogram; returns its id, or -1 if the registry is full */
+int metrics_histogram(const char *name, const char *help) {
+  return metrics_register(name, help, METRIC_HISTOGRAM);
+}
+
+/** Get the calling thread's copy of a metric, creating the thread's copies on first use */
+static metric_slot_t *metrics_slot(int id) {
+  if (id < 0 || id >= METRICS_MAX) {
+    return NULL;
+  }
+  if (local_thread == NULL) {
+    metrics_thread_t *thread = aligned_alloc(METRICS_CACHE_LINE, sizeof(metrics_thread_t));
+    if (thread == NULL) {
+      return NULL;
+    }
+    memset(thread, 0, sizeof(*thread));
+
+    // Push onto the list without a lock; readers only ever see fully initialized entries
+    thread->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&threads, &thread->next, thread, 1, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+    }
+    local_thread = thread;
+  }
+  return &local_thread->slots[id];
+}
+
+/** Store a new value in a slot; only the owning thread writes, so no read-modify-write is needed */
+static void slot_store(uint64_t *field, uint64_t value) {
+  __atomic_store_n(field, value, __ATOMIC_RELAXED);
+}
+
+/** Add to a counter */
+void metrics_inc(int id, uint64_t n) {
+  metric_slot_t *slot = metrics_slot(id);
+  if (slot != NULL) {
+    slot_store(&slot->value, slot->value + n);
+  }
+}
+
+/** Set this thread's share of a gauge */
+void metrics_set(int id, int64_t value) {
+  metric_slot_t *slot = metrics_slot(id);
+  if (slot != NULL) {
+    slot_store(&slot->value, (uint64_t)value);
+  }
+}
+
+/** Add to this thread's share of a gauge */
+void metrics_add(int id, int64_t delta) {
+  metric_slot_t *slot = metrics_slot(id);
+  if (slot != NULL) {
+    slot_store(&slot->value, slot->value + (uint64_t)delta);
+  }
+}
+
+/** Get the bucket of a histogram value: the smallest i with v <= 2^i */
+static int bucket_of(uint64_t value) {
+  return (value <= 1) ? 0 : 64 - __builtin_clzll(value - 1);
+}
+
+/** Record a value in a histogram */
+void metrics_observe(int id, uint64_t value) {
+  metric_slot_t *slot = metrics_slot(id);
+  if (slot != NULL) {
+    int bucket = bucket_of(value);
+    bucket = (bucket < METRICS_BUCKETS) ? bucket : METRICS_BUCKETS - 1;
+    slot_store(&slot->buckets[bucket], slot->buckets[bucket] + 1);
+    slot_store(&slot->value, slot->value + value);
+  }
+}
+
+/** Write every metric in the Prometheus text format */
+void metrics_write(FILE *out) {
+  int count = __atomic_load_n(&num_metrics, __ATOMIC_ACQUIRE);
+  metrics_thread_t *first = __atomic_load_n(&threads, __ATOMIC_ACQUIRE);
+
+  for (int id = 0; id < count; id++) {
+    const metric_t *metric = &metrics[id];
+    uint64_t value = 0;
+    uint64_t buckets[METRICS_BUCKETS] = {0};
+    for (metrics_thread_t *thread = first; thread != NULL; thread = thread->next) {
+      metric_slot_t *slot = &thread->slots[id];
+      value += __atomic_load_n(&slot->value, __ATOMIC_RELAXED);
+      if (metric->type == METRIC_HISTOGRAM) {
+        for (int i = 0; i < METRICS_BUCKETS; i++) {
+          buckets[i] += __atomic_load_n(&slot->buckets[i], __ATOMIC_RELAXED);
+        }
+      }
+    }
+
+    static const char *type_names[] = {"counter", "gauge", "histogram"};
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", metric->name, metric->help, metric->name,
+            type_names[metric->type]);
+    if (metric->type == METRIC_COUNTER) {
+      fprintf(out, "%s %llu\n", metric->name, (unsigned long long)value);
+    } else if (metric->type == METRIC_GAUGE) {
+      fprintf(out, "%s %lld\n", metric->name, (long long)value);
+    } else {
+      // Buckets are cumulative in this format; stop after the last one that holds values
+      int last = -1;
+      for (int i = 0; i < METRICS_BUCKETS; i++) {
+        last = buckets[i] ? i : last;
+      }
+      uint64_t cumulative = 0;
+      for (int i = 0; i <= last; i++) {
+        cumulative += buckets[i];
+        fprintf(out, "%s_bucket{le=\"%llu\"} %llu\n", metric->name, 1ULL << i,
+                (unsigned long long)cumulative);
+      }
+      // The count is taken from the buckets, so it always matches them
+      fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n", metric->name,
+              (unsigned long long)cumulative);
+      fprintf(out, "%s_sum %llu\n%s_count %llu\n", metric->name, (unsigned long long)value,
+              metric->name, (unsigned long long)cumulative);
+    }
+  }
+}
+
+/** Answer scrapes until the process exits */
+static void *metrics_server(void *arg) {
+  int sock_fd = (int)(intptr_t)arg;
+
+  while (1) {
+    int conn_fd = accept(sock_fd, NULL, NULL);
+    if (conn_fd < 0) {
+      continue;
+    }
+
+    // One thread answers every scrape, so a scraper that stalls is cut off instead of waited for
+    struct timeval timeout = {.tv_sec = METRICS_TIMEOUT_MS / 1000,
+                              .tv_usec = (METRICS_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(conn_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(conn_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // Any request gets the metrics, so read it only to be polite to the scraper
+    char request[METRICS_REQUEST_LENGTH];
+    if (recv(conn_fd, request, sizeof(request), 0) >= 0) {
+      char *body = NULL;
+      size_t body_len = 0;
+      FILE *out = open_memstream(&body, &body_len);
+      if (out != NULL) {
+        metrics_write(out);
+        fclose(out);
+        char header[128];
+        int header_len = snprintf(header, sizeof(header),
+                                  "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                  "Content-Length: %zu\r\n\r\n", body_len);
+        if (net_send_all(conn_fd, header, header_len) == 0) {
+          net_send_all(conn_fd, body, body_len);
+        }
+        free(body);
+      }
+    }
+    close(conn_fd);
+  }
+  return NULL;
+}
+
+/** Open the listening socket of an endpoint */
+static int metrics_listen(const char *endpoint) {
+  int sock_fd;
+  if (strncmp(endpoint, "unix:", 5) == 0) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(endpoint + 5) >= sizeof(addr.sun_path)) {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    strcpy(addr.sun_path, endpoint + 5);
+    unlink(addr.sun_path); // Left behind by an earlier run
+    if ((sock_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+      return -1;
+    }
+    if (bind(sock_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      goto fail;
+    }
+  } else {
+    int port = atoi(endpoint);
+    if (port <= 0 || port > 65535) {
+      errno = EINVAL;
+      return -1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    int opt = 1;
+    if ((sock_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+      return -1;
+    }
+    if (setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0
+        || bind(sock_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      goto fail;
+    }
+  }
+  if (listen(sock_fd, METRICS_BACKLOG) < 0) {
+    goto fail;
+  }
+  return sock_fd;
+
+fail:;
+  int saved_errno = errno;
+  close(sock_fd);
+  errno = saved_errno;
+  return -1;
+}
+
+/** Serve the metrics from a background thread; endpoint is a loopback port or "unix:<path>" */
+int metrics_serve(const char *endpoint) {
+  int sock_fd = metrics_listen(endpoint);
+  if (sock_fd < 0) {
+    return -1;
+  }
+
+  pthread_t thread;
+  int rc = pthread_create(&thread, NULL, metrics_server, (void *)(intptr_t)sock_fd);
+  if (rc != 0) {
+    close(sock_fd);
+    errno = rc;
+    return -1;
+  }
+  pthread_detach(thread);
+  return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+/*
+ * Metrics registry shared by the C programs. Metrics are registered once at startup, then
+ * updated from any thread without locks: every thread writes to its own copy of each metric, kept
+ * in a cache line of its own, and the copies are only added up when the metrics are read. Reading
+ * never blocks the threads that update.
+ *
+ * Histograms have one bucket per power of two, so a value v falls in the first bucket whose bound
+ * 2^i is at least v. They suit latencies recorded in whole microseconds.
+ *
+ * The metrics can be served in the Prometheus text format over HTTP, either on a loopback port or
+ * on a Unix socket (curl --unix-socket <path> http://localhost/metrics).
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define METRICS_MAX 64 // Maximum number of registered metrics
+#define METRICS_BUCKETS 64 // Number of histogram buckets, one per power of two
+#define METRICS_CACHE_LINE 64 // Size of a cache line, which each thread's copy is aligned to
+
+/** Register a counter; returns its id, or -1 if the registry is full */
+int metrics_counter(const char *name, const char *help);
+
+/** Register a gauge, whose value is the sum of what each thread set; returns its id or -1 */
+int metrics_gauge(const char *name, const char *help);
+
+/** Register a histogram; returns its id, or -1 if the registry is full */
+int metrics_histogram(const char *name, const char *help);
+
+/** Add to a counter */
+void metrics_inc(int id, uint64_t n);
+
+/** Set this thread's share of a gauge */
+void metrics_set(int id, int64_t value);
+
+/** Add to this thread's share of a gauge */
+void metrics_add(int id, int64_t delta);
+
+/** Record a value in a histogram */
+void metrics_observe(int id, uint64_t value);
+
+/** Write every metric in the Prometheus text format */
+void metrics_write(FILE *out);
+
+/** Serve the metrics from a background thread; endpoint is a loopback port or "unix:<path>" */
+int metrics_serve(const char *endpoint);
+
+#endif // METRICS_H
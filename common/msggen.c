@@ -0,0 +1,314 @@
+/*
+ * Generates a C header with binary encoders and decoders from a message schema. A schema lists
+ * messages, each with a numeric type and fixed-size fields:
+ *
+ *   # comment
+ *   message token = 1 {
+ *     u32 sender
+ *     bytes[16] note
+ *   }
+ *
+ * Field types are u8, u16, u32, u64, i8, i16, i32, i64 and bytes[N]. On the wire a message is its
+ * type as a u16 followed by its fields in order, with no padding, every integer big-endian. For
+ * each message the header declares a struct, an encoder into a caller's buffer, and a view that
+ * decodes fields straight from the receive buffer on demand, without copying or allocating.
+ *
+ * Usage: msggen <schema file> > <header file>
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE 256 // Maximum length of a schema line
+#define MAX_NAME 64 // Maximum length of a message or field name
+#define MAX_FIELDS 32 // Maximum number of fields in a message
+#define MAX_MESSAGES 64 // Maximum number of messages in a schema
+#define TYPE_BYTES 2 // Length of the message type that starts every message
+
+// A field of a message
+typedef struct {
+  char name[MAX_NAME]; // Name of the field
+  char type[MAX_NAME]; // Type of the field as written in the schema
+  int bits; // Width of an integer field, or 0 for a bytes field
+  int is_signed; // Whether an integer field is signed
+  int size; // Length of the field on the wire
+} Field;
+
+// A message of the schema
+typedef struct {
+  char name[MAX_NAME]; // Name of the message
+  int type; // Numeric type of the message
+  Field fields[MAX_FIELDS]; // Fields of the message, in wire order
+  int num_fields; // Number of fields
+  int size; // Length of the message on the wire, type included
+} Message;
+
+static Message messages[MAX_MESSAGES];
+static int num_messages = 0;
+static const char *schema_path;
+static int line_num = 0;
+
+/** Report a schema error at the current line and exit */
+static void fail(const char *what) {
+  fprintf(stderr, "%s:%d: %s\n", schema_path, line_num, what);
+  exit(1);
+}
+
+/** Check that a name can be used as a C identifier */
+static int valid_name(const char *name) {
+  if (!isalpha((unsigned char)name[0]) && name[0] != '_') {
+    return 0;
+  }
+  for (const char *p = name; *p; p++) {
+    if (!isalnum((unsigned char)*p) && *p != '_') {
+      return 0;
+    }
+  }
+  return strlen(name) < MAX_NAME;
+}
+
+/** Parse a field type into a field; returns 0 if the type is unknown */
+static int parse_type(const char *type, Field *field) {
+  int count;
+  char rest;
+  strcpy(field->type, type);
+  if (sscanf(type, "bytes[%d]%c", &count, &rest) == 2 && rest == ']' && count > 0) {
+    field->bits = 0;
+    field->is_signed = 0;
+    field->size = count;
+    return 1;
+  }
+  if ((type[0] == 'u' || type[0] == 'i') && sscanf(type + 1, "%d%c", &count, &rest) == 1
+      && (count == 8 || count == 16 || count == 32 || count == 64)) {
+    field->bits = count;
+    field->is_signed = type[0] == 'i';
+    field->size = count / 8;
+    return 1;
+  }
+  return 0;
+}
+
+/** Parse the schema file into the messages table */
+static void parse_schema(FILE *file) {
+  char line[MAX_LINE];
+  Message *current = NULL;
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line_num++;
+    line[strcspn(line, "#\n")] = 0; // Remove comments and the newline character
+
+    char word1[MAX_LINE], word2[MAX_LINE], word3[MAX_LINE], word4[MAX_LINE], word5[MAX_LINE];
+    int num_words = sscanf(line, "%255s %255s %255s %255s %255s", word1, word2, word3, word4,
+                           word5);
+    if (num_words <= 0) {
+      continue;
+    }
+
+    if (current == NULL) {
+      // Expect "message <name> = <type> {"
+      if (num_words != 5 || strcmp(word1, "message") != 0 || strcmp(word3, "=") != 0
+          || strcmp(word5, "{") != 0) {
+        fail("expected 'message <name> = <type> {'");
+      }
+      if (num_messages == MAX_MESSAGES) {
+        fail("too many messages");
+      }
+      if (!valid_name(word2)) {
+        fail("invalid message name");
+      }
+      current = &messages[num_messages];
+      strcpy(current->name, word2);
+      current->type = atoi(word4);
+      if (current->type <= 0 || current->type > 0xffff) {
+        fail("message type must be between 1 and 65535");
+      }
+      for (int i = 0; i < num_messages; i++) {
+        if (messages[i].type == current->type || strcmp(messages[i].name, current->name) == 0) {
+          fail("duplicate message name or type");
+        }
+      }
+      current->size = TYPE_BYTES;
+    } else if (num_words == 1 && strcmp(word1, "}") == 0) {
+      num_messages++;
+      current = NULL;
+    } else {
+      // Expect "<type> <name>"
+      if (num_words != 2) {
+        fail("expected '<type> <name>' or '}'");
+      }
+      if (current->num_fields == MAX_FIELDS) {
+        fail("too many fields");
+      }
+      Field *field = &current->fields[current->num_fields];
+      if (!parse_type(word1, field)) {
+        fail("unknown field type");
+      }
+      if (!valid_name(word2)) {
+        fail("invalid field name");
+      }
+      for (int i = 0; i < current->num_fields; i++) {
+        if (strcmp(current->fields[i].name, word2) == 0) {
+          fail("duplicate field name");
+        }
+      }
+      strcpy(field->name, word2);
+      current->size += field->size;
+      current->num_fields++;
+    }
+  }
+
+  if (current != NULL) {
+    fail("missing '}' at end of file");
+  }
+}
+
+/** Get the C type of an integer field */
+static const char *c_type(const Field *field) {
+  static char type[16];
+  sprintf(type, "%sint%d_t", field->is_signed ? "" : "u", field->bits);
+  return type;
+}
+
+/** Copy a string in upper case */
+static void upper(char *dst, const char *src) {
+  while (*src) {
+    *dst++ = (char)toupper((unsigned char)*src++);
+  }
+  *dst = 0;
+}
+
+/** Write the declarations of one message */
+static void emit_message(const Message *msg, const char *prefix) {
+  char upper_name[MAX_NAME];
+  upper(upper_name, msg->name);
+  const char *n = msg->name;
+
+  printf("\n// Message %s\n", n);
+  printf("#define %s_MSG_TYPE %d\n", upper_name, msg->type);
+  printf("#define %s_MSG_SIZE %d\n\n", upper_name, msg->size);
+
+  printf("typedef struct {\n");
+  for (int i = 0; i < msg->num_fields; i++) {
+    const Field *f = &msg->fields[i];
+    if (f->bits == 0) {
+      printf("  uint8_t %s[%d];\n", f->name, f->size);
+    } else {
+      printf("  %s %s;\n", c_type(f), f->name);
+    }
+  }
+  if (msg->num_fields == 0) {
+    printf("  char unused; // C structs cannot be empty\n");
+  }
+  printf("} %s_msg_t;\n\n", n);
+
+  printf("/** A %s message being decoded, pointing into the receive buffer */\n", n);
+  printf("typedef struct {\n  const uint8_t *buf;\n} %s_msg_view_t;\n\n", n);
+
+  // Encoder
+  printf("/** Encode a %s message; returns its length, or 0 if buf is too small */\n", n);
+  printf("static inline size_t %s_msg_encode(const %s_msg_t *msg, uint8_t *buf, size_t cap) {\n",
+         n, n);
+  printf("  if (cap < %s_MSG_SIZE) {\n    return 0;\n  }\n", upper_name);
+  printf("  codec_put_u16(buf, %s_MSG_TYPE);\n", upper_name);
+  int offset = TYPE_BYTES;
+  for (int i = 0; i < msg->num_fields; i++) {
+    const Field *f = &msg->fields[i];
+    if (f->bits == 0) {
+      printf("  memcpy(buf + %d, msg->%s, %d);\n", offset, f->name, f->size);
+    } else {
+      printf("  codec_put_u%d(buf + %d, (uint%d_t)msg->%s);\n", f->bits, offset, f->bits,
+             f->name);
+    }
+    offset += f->size;
+  }
+  printf("  return %s_MSG_SIZE;\n}\n\n", upper_name);
+
+  // View
+  printf("/** Start decoding a %s message; returns 0 if buf does not hold one */\n", n);
+  printf("static inline int %s_msg_view(const uint8_t *buf, size_t len, %s_msg_view_t *view) {\n",
+         n, n);
+  printf("  if (len != %s_MSG_SIZE || %s_type(buf, len) != %s_MSG_TYPE) {\n    return 0;\n  }\n",
+         upper_name, prefix, upper_name);
+  printf("  view->buf = buf;\n  return 1;\n}\n");
+
+  offset = TYPE_BYTES;
+  for (int i = 0; i < msg->num_fields; i++) {
+    const Field *f = &msg->fields[i];
+    printf("\n/** Get the %s field of a %s message */\n", f->name, n);
+    if (f->bits == 0) {
+      printf("static inline const uint8_t *%s_msg_%s(const %s_msg_view_t *view) {\n", n,
+             f->name, n);
+      printf("  return view->buf + %d;\n}\n", offset);
+    } else {
+      printf("static inline %s %s_msg_%s(const %s_msg_view_t *view) {\n", c_type(f), n, f->name,
+             n);
+      printf("  return (%s)codec_get_u%d(view->buf + %d);\n}\n", c_type(f), f->bits, offset);
+    }
+    offset += f->size;
+  }
+
+  // Copying decoder, for when the message must outlive the buffer
+  printf("\n/** Copy every field of a %s message out of its view */\n", n);
+  printf("static inline void %s_msg_decode(const %s_msg_view_t *view, %s_msg_t *msg) {\n", n, n,
+         n);
+  for (int i = 0; i < msg->num_fields; i++) {
+    const Field *f = &msg->fields[i];
+    if (f->bits == 0) {
+      printf("  memcpy(msg->%s, %s_msg_%s(view), %d);\n", f->name, n, f->name, f->size);
+    } else {
+      printf("  msg->%s = %s_msg_%s(view);\n", f->name, n, f->name);
+    }
+  }
+  if (msg->num_fields == 0) {
+    printf("  (void)view;\n  (void)msg;\n");
+  }
+  printf("}\n");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <schema file>\n", argv[0]);
+    exit(1);
+  }
+
+  schema_path = argv[1];
+  FILE *file = fopen(schema_path, "r");
+  if (file == NULL) {
+    fprintf(stderr, "Error opening file at %s\n", schema_path);
+    exit(1);
+  }
+  parse_schema(file);
+  fclose(file);
+
+  // Name everything after the schema file, e.g. "messages" for "dir/messages.schema"
+  char prefix[MAX_NAME];
+  const char *base = strrchr(schema_path, '/');
+  base = (base != NULL) ? base + 1 : schema_path;
+  snprintf(prefix, sizeof(prefix), "%.*s", (int)strcspn(base, "."), base);
+  if (!valid_name(prefix)) {
+    fprintf(stderr, "Error: schema file name %s is not a valid C identifier\n", base);
+    exit(1);
+  }
+  char upper_prefix[MAX_NAME];
+  upper(upper_prefix, prefix);
+
+  int max_size = TYPE_BYTES;
+  for (int i = 0; i < num_messages; i++) {
+    max_size = (messages[i].size > max_size) ? messages[i].size : max_size;
+  }
+
+  printf("// Generated by msggen from %s. Do not edit.\n", base);
+  printf("#ifndef %s_H\n#define %s_H\n\n", upper_prefix, upper_prefix);
+  printf("#include <stddef.h>\n#include <stdint.h>\n#include <string.h>\n#include \"codec.h\"\n\n");
+  printf("#define %s_MAX_SIZE %d // Length of the longest message\n\n", upper_prefix, max_size);
+  printf("/** Get the type of a received message, or -1 if it is too short to have one */\n");
+  printf("static inline int %s_type(const uint8_t *buf, size_t len) {\n", prefix);
+  printf("  return (len < %d) ? -1 : codec_get_u16(buf);\n}\n", TYPE_BYTES);
+  for (int i = 0; i < num_messages; i++) {
+    emit_message(&messages[i], prefix);
+  }
+  printf("\n#endif // %s_H\n", upper_prefix);
+  return 0;
+}
@@ -0,0 +1,465 @@
+#include "net.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NET_MAX_HOST 256 // Maximum length of a cached hostname
+
+/** A resolved address, as kept in the cache */
+typedef struct {
+  char host[NET_MAX_HOST]; // Hostname that was resolved, empty if the slot is free
+  int port; // Port that was resolved
+  int socktype; // Socket type the address was resolved for
+  struct sockaddr_storage addr; // The resolved address
+  socklen_t addr_len; // Length of the resolved address
+  time_t resolved_at; // Monotonic time of the resolution, in seconds
+} addr_cache_entry_t;
+
+/** A local instance, as listed in the cluster map */
+typedef struct {
+  char name[NET_MAX_HOST]; // Name the instance goes by
+  int port; // Port the instance listens on
+} cluster_entry_t;
+
+static addr_cache_entry_t addr_cache[NET_ADDR_CACHE_SIZE];
+static unsigned int addr_cache_next = 0; // Next slot to evict, round robin
+static pthread_mutex_t addr_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static cluster_entry_t *cluster_map = NULL; // Sorted by name, or NULL outside a local cluster
+static size_t cluster_size = 0;
+static pthread_once_t cluster_once = PTHREAD_ONCE_INIT;
+
+/** Get the current monotonic time in seconds */
+static time_t monotonic_seconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec;
+}
+
+/** Compare cluster map entries by name */
+static int cluster_compare(const void *a, const void *b) {
+  return strcmp(((const cluster_entry_t *)a)->name, ((const cluster_entry_t *)b)->name);
+}
+
+/** Load the cluster map named by NET_CLUSTER_MAP, if there is one */
+static void cluster_load(void) {
+  const char *path = getenv(NET_CLUSTER_MAP_ENV);
+  FILE *file = (path != NULL) ? fopen(path, "r") : NULL;
+  if (file == NULL) {
+    return;
+  }
+
+  size_t cap = 0;
+  char line[NET_MAX_HOST + 32];
+  cluster_entry_t entry;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (sscanf(line, "%255s %d", entry.name, &entry.port) != 2) {
+      continue;
+    }
+    if (cluster_size == cap) {
+      cap = cap ? cap * 2 : 64;
+      cluster_entry_t *grown = realloc(cluster_map, cap * sizeof(cluster_entry_t));
+      if (grown == NULL) {
+        break;
+      }
+      cluster_map = grown;
+    }
+    cluster_map[cluster_size++] = entry;
+  }
+  fclose(file);
+  qsort(cluster_map, cluster_size, sizeof(cluster_entry_t), cluster_compare);
+}
+
+/** Get the port of a name in the cluster map, or -1 if it is not in the map */
+static int cluster_port(const char *name) {
+  pthread_once(&cluster_once, cluster_load);
+  if (cluster_map == NULL || strlen(name) >= NET_MAX_HOST) {
+    return -1;
+  }
+  cluster_entry_t key;
+  strcpy(key.name, name);
+  cluster_entry_t *entry = bsearch(&key, cluster_map, cluster_size, sizeof(cluster_entry_t),
+                                   cluster_compare);
+  return (entry != NULL) ? entry->port : -1;
+}
+
+/** Get the name of this instance: NET_NODE_NAME if it is set, otherwise the hostname */
+int net_hostname(char *name, size_t len) {
+  const char *node_name = getenv(NET_NODE_NAME_ENV);
+  if (node_name == NULL) {
+    return gethostname(name, len);
+  }
+  if (strlen(node_name) >= len) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(name, node_name);
+  return 0;
+}
+
+/** Look up an address in the cache; returns 1 if a fresh entry was found */
+static int addr_cache_get(const char *host, int port, int socktype,
+                          struct sockaddr_storage *addr, socklen_t *addr_len) {
+  int found = 0;
+  time_t now = monotonic_seconds();
+
+  pthread_mutex_lock(&addr_cache_mutex);
+  for (int i = 0; i < NET_ADDR_CACHE_SIZE; i++) {
+    addr_cache_entry_t *entry = &addr_cache[i];
+    if (entry->port == port && entry->socktype == socktype && strcmp(entry->host, host) == 0
+        && now - entry->resolved_at < NET_ADDR_CACHE_TTL_SECONDS) {
+      memcpy(addr, &entry->addr, entry->addr_len);
+      *addr_len = entry->addr_len;
+      found = 1;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&addr_cache_mutex);
+  return found;
+}
+
+/** Add an address to the cache, replacing a stale entry for the same host or the oldest one */
+static void addr_cache_put(const char *host, int port, int socktype,
+                           const struct sockaddr_storage *addr, socklen_t addr_len) {
+  if (strlen(host) >= NET_MAX_HOST) {
+    return;
+  }
+
+  pthread_mutex_lock(&addr_cache_mutex);
+  addr_cache_entry_t *slot = NULL;
+  for (int i = 0; i < NET_ADDR_CACHE_SIZE && slot == NULL; i++) {
+    if (addr_cache[i].port == port && addr_cache[i].socktype == socktype
+        && strcmp(addr_cache[i].host, host) == 0) {
+      slot = &addr_cache[i];
+    }
+  }
+  if (slot == NULL) {
+    slot = &addr_cache[addr_cache_next];
+    addr_cache_next = (addr_cache_next + 1) % NET_ADDR_CACHE_SIZE;
+  }
+
+  strcpy(slot->host, host);
+  slot->port = port;
+  slot->socktype = socktype;
+  memcpy(&slot->addr, addr, addr_len);
+  slot->addr_len = addr_len;
+  slot->resolved_at = monotonic_seconds();
+  pthread_mutex_unlock(&addr_cache_mutex);
+}
+
+/** Resolve a host and port to an IPv4 address, using the cache when possible */
+int net_resolve(const char *host, int port, int socktype, struct sockaddr_storage *addr,
+                socklen_t *addr_len) {
+  int cluster = cluster_port(host);
+  if (cluster > 0) {
+    host = "127.0.0.1";
+    port = cluster;
+  }
+  if (addr_cache_get(host, port, socktype, addr, addr_len)) {
+    return 0;
+  }
+
+  char port_num[16];
+  sprintf(port_num, "%d", port); // Convert port number to string
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = socktype;
+
+  int rc = getaddrinfo(host, port_num, &hints, &res);
+  if (rc != 0) {
+    errno = (rc == EAI_SYSTEM) ? errno : EHOSTUNREACH;
+    return -1;
+  }
+
+  memcpy(addr, res->ai_addr, res->ai_addrlen);
+  *addr_len = res->ai_addrlen;
+  freeaddrinfo(res);
+  addr_cache_put(host, port, socktype, addr, *addr_len);
+  return 0;
+}
+
+/** Drop every cached address, so the next lookups go to the resolver */
+void net_flush_addr_cache(void) {
+  pthread_mutex_lock(&addr_cache_mutex);
+  memset(addr_cache, 0, sizeof(addr_cache));
+  addr_cache_next = 0;
+  pthread_mutex_unlock(&addr_cache_mutex);
+}
+
+/** Open a TCP socket listening on the given port (or the cluster map's) on all interfaces */
+int net_listen_tcp(int port, int backlog) {
+  char name[NET_MAX_HOST];
+  int cluster = (net_hostname(name, sizeof(name)) == 0) ? cluster_port(name) : -1;
+  port = (cluster > 0) ? cluster : port;
+
+  int sock_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (sock_fd < 0) {
+    return -1;
+  }
+
+  int opt = 1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+
+  if (setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0
+      || bind(sock_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+      || listen(sock_fd, backlog) < 0) {
+    int saved_errno = errno;
+    close(sock_fd);
+    errno = saved_errno;
+    return -1;
+  }
+  return sock_fd;
+}
+
+/** Connect to a host over TCP, giving up after timeout_ms (a negative timeout waits forever) */
+int net_connect_tcp(const char *host, int port, int timeout_ms) {
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  if (net_resolve(host, port, SOCK_STREAM, &addr, &addr_len) < 0) {
+    return -1;
+  }
+
+  int sock_fd = socket(addr.ss_family, SOCK_STREAM, 0);
+  if (sock_fd < 0) {
+    return -1;
+  }
+
+  // Connect without blocking, then wait for the connection with a timeout
+  int flags = fcntl(sock_fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(sock_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    goto fail;
+  }
+  if (connect(sock_fd, (struct sockaddr *)&addr, addr_len) < 0) {
+    if (errno != EINPROGRESS) {
+      goto fail;
+    }
+
+    struct pollfd pfd = {.fd = sock_fd, .events = POLLOUT};
+    int ready;
+    do {
+      ready = poll(&pfd, 1, timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+    if (ready == 0) {
+      errno = ETIMEDOUT;
+      goto fail;
+    }
+    if (ready < 0) {
+      goto fail;
+    }
+
+    int err = 0;
+    socklen_t err_len = sizeof(err);
+    if (getsockopt(sock_fd, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0) {
+      goto fail;
+    }
+    if (err != 0) {
+      errno = err;
+      goto fail;
+    }
+  }
+  if (fcntl(sock_fd, F_SETFL, flags) < 0) {
+    goto fail;
+  }
+  return sock_fd;
+
+fail:;
+  int saved_errno = errno;
+  close(sock_fd);
+  errno = saved_errno;
+  return -1;
+}
+
+/** Connect to a host over TCP, retrying up to max_retries times with retry_delay_ms in between */
+int net_connect_tcp_retry(const char *host, int port, int timeout_ms, int max_retries,
+                          int retry_delay_ms) {
+  for (int attempt = 0;; attempt++) {
+    int sock_fd = net_connect_tcp(host, port, timeout_ms);
+    if (sock_fd >= 0 || attempt >= max_retries) {
+      return sock_fd;
+    }
+    usleep(retry_delay_ms * 1000);
+  }
+}
+
+/** Open a UDP socket bound to the given host and port (a NULL host binds to all interfaces) */
+int net_bind_udp(const char *host, int port) {
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  if (host != NULL) {
+    if (net_resolve(host, port, SOCK_DGRAM, &addr, &addr_len) < 0) {
+      return -1;
+    }
+  } else {
+    struct sockaddr_in *any = (struct sockaddr_in *)&addr;
+    memset(&addr, 0, sizeof(addr));
+    any->sin_family = AF_INET;
+    any->sin_addr.s_addr = htonl(INADDR_ANY);
+    any->sin_port = htons(port);
+    addr_len = sizeof(*any);
+  }
+
+  int sock_fd = socket(addr.ss_family, SOCK_DGRAM, 0);
+  if (sock_fd < 0) {
+    return -1;
+  }
+  if (bind(sock_fd, (struct sockaddr *)&addr, addr_len) < 0) {
+    int saved_errno = errno;
+    close(sock_fd);
+    errno = saved_errno;
+    return -1;
+  }
+  return sock_fd;
+}
+
+/** Open an unbound UDP socket for sending datagrams */
+int net_udp_socket(void) {
+  return socket(AF_INET, SOCK_DGRAM, 0);
+}
+
+/** Send all len bytes of buf on a stream socket */
+int net_send_all(int fd, const void *buf, size_t len) {
+  const char *bytes = buf;
+  while (len > 0) {
+    ssize_t sent = send(fd, bytes, len, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    bytes += sent;
+    len -= sent;
+  }
+  return 0;
+}
+
+/** Receive exactly len bytes into buf from a stream socket; returns 0 if the peer closed first */
+ssize_t net_recv_all(int fd, void *buf, size_t len) {
+  char *bytes = buf;
+  size_t received = 0;
+  while (received < len) {
+    ssize_t n = recv(fd, bytes + received, len - received, 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (n == 0) {
+      return 0;
+    }
+    received += n;
+  }
+  return received;
+}
+
+/** Send one framed message on a stream socket */
+int net_send_frame(int fd, const void *buf, size_t len) {
+  if (len > NET_MAX_FRAME) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+
+  // Send the header and the message together, so small messages go out in one segment
+  char frame[4 + 512];
+  uint32_t header = htonl((uint32_t)len);
+  if (len <= sizeof(frame) - 4) {
+    memcpy(frame, &header, 4);
+    memcpy(frame + 4, buf, len);
+    return net_send_all(fd, frame, len + 4);
+  }
+  if (net_send_all(fd, &header, 4) < 0) {
+    return -1;
+  }
+  return net_send_all(fd, buf, len);
+}
+
+/** Receive one framed message into buf; returns its length, or 0 if the peer closed the stream */
+ssize_t net_recv_frame(int fd, void *buf, size_t cap) {
+  uint32_t header;
+  ssize_t n = net_recv_all(fd, &header, 4);
+  if (n <= 0) {
+    return n;
+  }
+
+  size_t len = ntohl(header);
+  if (len > NET_MAX_FRAME) {
+    errno = EPROTO; // no sender makes such a frame, so the stream is out of step
+    return -1;
+  }
+  if (len == 0) {
+    errno = EPROTO; // an empty frame would be mistaken for the end of the stream
+    return -1;
+  }
+  if (len > cap) {
+    // Read past the message, so the next receive starts at the header of the one after it
+    char discard[512];
+    while (len > 0) {
+      size_t chunk = (len < sizeof(discard)) ? len : sizeof(discard);
+      n = net_recv_all(fd, discard, chunk);
+      if (n <= 0) {
+        if (n == 0) {
+          errno = ECONNRESET;
+        }
+        return -1;
+      }
+      len -= chunk;
+    }
+    errno = EMSGSIZE;
+    return -1;
+  }
+  n = net_recv_all(fd, buf, len);
+  if (n == 0) {
+    errno = ECONNRESET; // the stream ended in the middle of a frame
+    return -1;
+  }
+  return n;
+}
+
+/** Send one datagram to a host and port, resolving the host through the cache */
+int net_send_datagram(int fd, const char *host, int port, const void *buf, size_t len) {
+  struct sockaddr_storage addr;
+  socklen_t addr_len;
+  if (net_resolve(host, port, SOCK_DGRAM, &addr, &addr_len) < 0) {
+    return -1;
+  }
+
+  ssize_t sent;
+  do {
+    sent = sendto(fd, buf, len, 0, (struct sockaddr *)&addr, addr_len);
+  } while (sent < 0 && errno == EINTR);
+  return (sent < 0) ? -1 : 0;
+}
+
+/** Receive one datagram into buf; from and from_len may be NULL */
+ssize_t net_recv_datagram(int fd, void *buf, size_t cap, struct sockaddr_storage *from,
+                          socklen_t *from_len) {
+  struct sockaddr_storage ignored_addr;
+  socklen_t ignored_len = sizeof(ignored_addr);
+  if (from == NULL) {
+    from = &ignored_addr;
+    from_len = &ignored_len;
+  } else {
+    *from_len = sizeof(*from);
+  }
+
+  ssize_t n;
+  do {
+    n = recvfrom(fd, buf, cap, 0, (struct sockaddr *)from, from_len);
+  } while (n < 0 && errno == EINTR);
+  return n;
+}
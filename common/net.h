@@ -0,0 +1,77 @@
+#ifndef NET_H
+#define NET_H
+
+/*
+ * Networking layer shared by the C programs. Addresses are resolved through a small cache, so a
+ * program that talks to the same peers over and over only calls getaddrinfo once per peer. Every
+ * function reports errors by returning -1 with errno set, and leaves it to the caller to decide
+ * whether the error is fatal.
+ *
+ * Stream messages are framed with a 4-byte length in network byte order, so a message is always
+ * received whole, no matter how TCP splits or coalesces the bytes.
+ *
+ * To run many instances on one machine, a launcher sets NET_NODE_NAME to the name an instance
+ * goes by, and NET_CLUSTER_MAP to a file of "<name> <port>" lines. Names in the map then resolve
+ * to 127.0.0.1 at their port instead of the port asked for, and net_listen_tcp listens on the
+ * port of the instance's own name.
+ */
+
+#include <stddef.h> // needed for size_t
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#define NET_ADDR_CACHE_SIZE 64 // Maximum number of cached addresses
+#define NET_ADDR_CACHE_TTL_SECONDS 30 // How long a resolved address is trusted
+#define NET_MAX_FRAME (1 << 20) // Maximum length of a framed message
+#define NET_NODE_NAME_ENV "NET_NODE_NAME" // Variable naming this instance
+#define NET_CLUSTER_MAP_ENV "NET_CLUSTER_MAP" // Variable with the path of the cluster map
+
+/** Get the name of this instance: NET_NODE_NAME if it is set, otherwise the hostname */
+int net_hostname(char *name, size_t len);
+
+/** Resolve a host and port to an IPv4 address, using the cache when possible */
+int net_resolve(const char *host, int port, int socktype, struct sockaddr_storage *addr,
+                socklen_t *addr_len);
+
+/** Drop every cached address, so the next lookups go to the resolver */
+void net_flush_addr_cache(void);
+
+/** Open a TCP socket listening on the given port (or the cluster map's) on all interfaces */
+int net_listen_tcp(int port, int backlog);
+
+/** Connect to a host over TCP, giving up after timeout_ms (a negative timeout waits forever) */
+int net_connect_tcp(const char *host, int port, int timeout_ms);
+
+/** Connect to a host over TCP, retrying up to max_retries times with retry_delay_ms in between */
+int net_connect_tcp_retry(const char *host, int port, int timeout_ms, int max_retries,
+                          int retry_delay_ms);
+
+/** Open a UDP socket bound to the given host and port (a NULL host binds to all interfaces) */
+int net_bind_udp(const char *host, int port);
+
+/** Open an unbound UDP socket for sending datagrams */
+int net_udp_socket(void);
+
+/** Send all len bytes of buf on a stream socket */
+int net_send_all(int fd, const void *buf, size_t len);
+
+/** Receive exactly len bytes into buf from a stream socket; returns 0 if the peer closed first */
+ssize_t net_recv_all(int fd, void *buf, size_t len);
+
+/** Send one framed message on a stream socket */
+int net_send_frame(int fd, const void *buf, size_t len);
+
+/**
+ * Receive one framed message into buf; returns its length, or 0 if the peer closed the stream.
+ * A message longer than cap is skipped with EMSGSIZE. EPROTO means the stream is out of step.
+ */
+ssize_t net_recv_frame(int fd, void *buf, size_t cap);
+
+/** Send one datagram to a host and port, resolving the host through the cache */
+int net_send_datagram(int fd, const char *host, int port, const void *buf, size_t len);
+
+/** Receive one datagram into buf; from and from_len may be NULL */
+ssize_t net_recv_datagram(int fd, void *buf, size_t cap, struct sockaddr_storage *from,
+                          socklen_t *from_len);
+
+#endif // NET_H
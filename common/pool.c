@@ -0,0 +1,197 @@
+#include "pool.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_ALIGNMENT 64 // Buffers start on cache lines, so neighbors never share one
+
+struct pool {
+  int id; // Index of the pool in every thread's caches
+  size_t size; // Size of a buffer, rounded up to the alignment
+  size_t count; // Number of buffers
+  uint8_t *slab; // Every buffer, one after the other
+  uint32_t *next; // Next free buffer after each one in the free list, plus one; 0 ends the list
+  uint64_t head; // Top of the free list: a tag in the high half, the first index plus one below
+  size_t free_count; // Buffers in the free list
+};
+
+/** The free buffers one thread keeps for one pool */
+typedef struct {
+  uint32_t count;
+  uint32_t indexes[POOL_CACHE_SIZE];
+} pool_cache_t;
+
+static pool_t *pools[POOL_MAX_POOLS];
+static int num_pools = 0;
+static pthread_mutex_t pools_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t caches_key;
+static pthread_once_t caches_once = PTHREAD_ONCE_INIT;
+static __thread pool_cache_t *caches = NULL; // Caches of the calling thread, one per pool
+
+/** Push a chain of buffers, first to last, onto the free list */
+static void push_chain(pool_t *pool, uint32_t first, uint32_t last, size_t length) {
+  uint64_t head = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+  uint64_t new_head;
+  do {
+    __atomic_store_n(&pool->next[last], (uint32_t)head, __ATOMIC_RELAXED);
+    new_head = ((head >> 32) + 1) << 32 | (first + 1);
+  } while (!__atomic_compare_exchange_n(&pool->head, &head, new_head, 1, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED));
+  __atomic_fetch_add(&pool->free_count, length, __ATOMIC_RELAXED);
+}
+
+/** Pop one buffer off the free list; returns its index, or -1 if the list is empty */
+static int64_t pop(pool_t *pool) {
+  uint64_t head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+  uint64_t new_head;
+  do {
+    if ((uint32_t)head == 0) {
+      return -1;
+    }
+    // The tag changes on every update, so a buffer popped and pushed back meanwhile fails the CAS
+    uint32_t next = __atomic_load_n(&pool->next[(uint32_t)head - 1], __ATOMIC_RELAXED);
+    new_head = ((head >> 32) + 1) << 32 | next;
+  } while (!__atomic_compare_exchange_n(&pool->head, &head, new_head, 1, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_ACQUIRE));
+  __atomic_fetch_sub(&pool->free_count, 1, __ATOMIC_RELAXED);
+  return (int64_t)(uint32_t)head - 1;
+}
+
+/** Move count buffers from the top of a cache to the free list */
+static void drain(pool_t *pool, pool_cache_t *cache, uint32_t count) {
+  uint32_t first = cache->indexes[cache->count - count];
+  for (uint32_t i = cache->count - count; i + 1 < cache->count; i++) {
+    __atomic_store_n(&pool->next[cache->indexes[i]], cache->indexes[i + 1] + 1, __ATOMIC_RELAXED);
+  }
+  push_chain(pool, first, cache->indexes[cache->count - 1], count);
+  cache->count -= count;
+}
+
+/** Give the buffers cached by an exiting thread back to their pools */
+static void release_caches(void *arg) {
+  pool_cache_t *thread_caches = arg;
+  for (int i = 0; i < POOL_MAX_POOLS; i++) {
+    pool_t *pool = __atomic_load_n(&pools[i], __ATOMIC_ACQUIRE);
+    if (pool != NULL && thread_caches[i].count > 0) {
+      drain(pool, &thread_caches[i], thread_caches[i].count);
+    }
+  }
+  free(thread_caches);
+}
+
+/** Create the key that releases a thread's caches when it exits */
+static void create_caches_key(void) {
+  pthread_key_create(&caches_key, release_caches);
+}
+
+/** Get the calling thread's cache for a pool, creating the thread's caches on first use */
+static pool_cache_t *thread_cache(pool_t *pool) {
+  if (caches == NULL) {
+    pthread_once(&caches_once, create_caches_key);
+    if ((caches = calloc(POOL_MAX_POOLS, sizeof(pool_cache_t))) == NULL) {
+      return NULL;
+    }
+    pthread_setspecific(caches_key, caches);
+  }
+  return &caches[pool->id];
+}
+
+/** Create a pool of count buffers of size bytes each; returns NULL on error */
+pool_t *pool_create(size_t size, size_t count) {
+  if (size == 0 || count == 0 || count >= UINT32_MAX) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  pool_t *pool = calloc(1, sizeof(pool_t));
+  if (pool == NULL) {
+    return NULL;
+  }
+  pool->size = (size + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT * POOL_ALIGNMENT;
+  pool->count = count;
+  pool->slab = aligned_alloc(POOL_ALIGNMENT, pool->size * count);
+  pool->next = calloc(count, sizeof(uint32_t));
+  if (pool->slab == NULL || pool->next == NULL) {
+    goto fail;
+  }
+
+  // Chain every buffer into the free list, in order
+  for (size_t i = 0; i + 1 < count; i++) {
+    pool->next[i] = i + 2;
+  }
+  pool->head = 1;
+  pool->free_count = count;
+
+  pthread_mutex_lock(&pools_mutex);
+  if (num_pools == POOL_MAX_POOLS) {
+    pthread_mutex_unlock(&pools_mutex);
+    errno = ENOSPC;
+    goto fail;
+  }
+  pool->id = num_pools++;
+  __atomic_store_n(&pools[pool->id], pool, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&pools_mutex);
+  return pool;
+
+fail:;
+  int saved_errno = errno;
+  free(pool->slab);
+  free(pool->next);
+  free(pool);
+  errno = saved_errno;
+  return NULL;
+}
+
+/** Take a buffer from a pool; returns NULL with errno set to ENOMEM if none is free */
+void *pool_alloc(pool_t *pool) {
+  pool_cache_t *cache = thread_cache(pool);
+  if (cache == NULL) {
+    return NULL;
+  }
+
+  // Refill an empty cache with a batch from the free list
+  while (cache->count < POOL_BATCH) {
+    int64_t index = pop(pool);
+    if (index < 0) {
+      break;
+    }
+    cache->indexes[cache->count++] = (uint32_t)index;
+  }
+  if (cache->count == 0) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  return pool->slab + (size_t)cache->indexes[--cache->count] * pool->size;
+}
+
+/** Return a buffer to the pool it came from; any thread may return it */
+void pool_free(pool_t *pool, void *buf) {
+  if (buf == NULL) {
+    return;
+  }
+  uint32_t index = (uint32_t)(((uint8_t *)buf - pool->slab) / pool->size);
+  pool_cache_t *cache = thread_cache(pool);
+  if (cache == NULL) {
+    pool->next[index] = 0;
+    push_chain(pool, index, index, 1); // Out of memory for a cache, so skip it
+    return;
+  }
+
+  // A thread that only frees, like one sending what another received, passes batches back
+  if (cache->count == POOL_CACHE_SIZE) {
+    drain(pool, cache, POOL_BATCH);
+  }
+  cache->indexes[cache->count++] = index;
+}
+
+/** Get the size of the buffers of a pool */
+size_t pool_buffer_size(const pool_t *pool) {
+  return pool->size;
+}
+
+/** Get the number of buffers in the shared free list, not counting thread caches */
+size_t pool_free_count(pool_t *pool) {
+  return __atomic_load_n(&pool->free_count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,36 @@
+#ifndef POOL_H
+#define POOL_H
+
+/*
+ * Pools of fixed-size buffers for messages. A pool allocates all of its buffers up front, so
+ * taking and returning a buffer never touches the heap. Each thread keeps a small cache of free
+ * buffers for every pool it uses, and only goes to the shared free list, a lock-free stack, to
+ * refill or drain its cache in batches. A buffer may be returned by a different thread than the
+ * one that took it, e.g. when a receiving thread hands messages to a sending thread.
+ */
+
+#include <stddef.h> // needed for size_t
+
+#define POOL_MAX_POOLS 16 // Maximum number of pools in a program
+#define POOL_CACHE_SIZE 32 // Number of free buffers a thread keeps for each pool
+#define POOL_BATCH (POOL_CACHE_SIZE / 2) // Number of buffers moved to or from the free list at once
+
+/** Pool of fixed-size buffers */
+typedef struct pool pool_t;
+
+/** Create a pool of count buffers of size bytes each; returns NULL on error */
+pool_t *pool_create(size_t size, size_t count);
+
+/** Take a buffer from a pool; returns NULL with errno set to ENOMEM if none is free */
+void *pool_alloc(pool_t *pool);
+
+/** Return a buffer to the pool it came from; any thread may return it */
+void pool_free(pool_t *pool, void *buf);
+
+/** Get the size of the buffers of a pool */
+size_t pool_buffer_size(const pool_t *pool);
+
+/** Get the number of buffers in the shared free list, not counting thread caches */
+size_t pool_free_count(pool_t *pool);
+
+#endif // POOL_H
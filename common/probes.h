@@ -0,0 +1,27 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * Static tracepoints (USDT) for the C programs. With sys/sdt.h available (the
+ * systemtap-sdt-dev package on Ubuntu), PROBE compiles to a single nop plus a note in the
+ * binary that bpftrace and perf use to attach at runtime; nothing else happens until a tracer
+ * attaches. Without the header, probes compile to nothing and their arguments are not evaluated.
+ *
+ * List the probes of a binary with: bpftrace -l 'usdt:./program:*'
+ */
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>) && !defined(NO_PROBES)
+#include <sys/sdt.h>
+#define PROBES_ENABLED 1
+#endif
+#endif
+
+#ifdef PROBES_ENABLED
+/** Fire the probe provider:name with up to 12 integer arguments */
+#define PROBE(provider, name, ...) STAP_PROBEV(provider, name, ##__VA_ARGS__)
+#else
+#define PROBE(provider, name, ...) do { } while (0)
+#endif
+
+#endif // PROBES_H
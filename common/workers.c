@@ -0,0 +1,315 @@
+#include "workers.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define INJECT_INITIAL_SIZE 1024 // Initial number of tasks the shared queue holds
+
+/** A function to run and its argument */
+typedef struct {
+  void (*fn)(void *);
+  void *arg;
+} task_t;
+
+/** Deque of one worker; the worker uses the bottom end and thieves the top one */
+typedef struct {
+  _Alignas(64) int64_t top; // Next task to steal
+  _Alignas(64) int64_t bottom; // Next free slot of the owner
+  task_t tasks[WORKERS_DEQUE_SIZE];
+} deque_t;
+
+/** A worker thread and its deque */
+typedef struct {
+  deque_t deque;
+  struct workers *pool;
+  pthread_t thread;
+  unsigned int seed; // State of the random choice of victims
+  unsigned long steals; // Tasks stolen from other workers
+} worker_t;
+
+struct workers {
+  int num_workers;
+  worker_t *workers;
+  pthread_mutex_t mutex; // Protects the shared queue and the sleeping
+  pthread_cond_t work_cond; // Signaled when a task is queued while workers sleep
+  pthread_cond_t done_cond; // Signaled when the last pending task finishes
+  task_t *inject; // Shared queue of tasks from other threads, a ring buffer
+  size_t inject_head, inject_count, inject_cap;
+  int64_t queued; // Tasks in a deque or the shared queue, not yet taken
+  int64_t pending; // Tasks submitted and not finished
+  int sleepers; // Workers waiting on work_cond
+  int stop; // Set when the workers must exit
+};
+
+static __thread worker_t *self = NULL; // Worker running on this thread
+
+/** Push a task onto the bottom of the owner's deque; returns -1 if it is full */
+static int deque_push(deque_t *deque, task_t task) {
+  int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  if (bottom - top >= WORKERS_DEQUE_SIZE) {
+    return -1;
+  }
+  task_t *slot = &deque->tasks[bottom & (WORKERS_DEQUE_SIZE - 1)];
+  __atomic_store_n(&slot->fn, task.fn, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->arg, task.arg, __ATOMIC_RELAXED);
+  __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/** Pop the newest task off the bottom of the owner's deque; returns -1 if it is empty */
+static int deque_pop(deque_t *deque, task_t *task) {
+  int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+  __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+  if (top > bottom) {
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return -1;
+  }
+
+  task_t *slot = &deque->tasks[bottom & (WORKERS_DEQUE_SIZE - 1)];
+  task->fn = __atomic_load_n(&slot->fn, __ATOMIC_RELAXED);
+  task->arg = __atomic_load_n(&slot->arg, __ATOMIC_RELAXED);
+  if (top == bottom) {
+    // The last task, which a thief may be taking too: whoever moves top first gets it
+    int won = __atomic_compare_exchange_n(&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST,
+                                          __ATOMIC_RELAXED);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    return won ? 0 : -1;
+  }
+  return 0;
+}
+
+/** Steal the oldest task off the top of another worker's deque; returns -1 if there was none */
+static int deque_steal(deque_t *deque, task_t *task) {
+  int64_t top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int64_t bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+  if (top >= bottom) {
+    return -1;
+  }
+
+  // The slot can only be reused after top moves past it, in which case the CAS below fails
+  task_t *slot = &deque->tasks[top & (WORKERS_DEQUE_SIZE - 1)];
+  task->fn = __atomic_load_n(&slot->fn, __ATOMIC_RELAXED);
+  task->arg = __atomic_load_n(&slot->arg, __ATOMIC_RELAXED);
+  return __atomic_compare_exchange_n(&deque->top, &top, top + 1, 0, __ATOMIC_SEQ_CST,
+                                     __ATOMIC_RELAXED) ? 0 : -1;
+}
+
+/** Take a task from the shared queue; returns -1 if it is empty */
+static int inject_take(workers_t *pool, task_t *task) {
+  pthread_mutex_lock(&pool->mutex);
+  if (pool->inject_count == 0) {
+    pthread_mutex_unlock(&pool->mutex);
+    return -1;
+  }
+  *task = pool->inject[pool->inject_head];
+  pool->inject_head = (pool->inject_head + 1) % pool->inject_cap;
+  __atomic_store_n(&pool->inject_count, pool->inject_count - 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&pool->mutex);
+  return 0;
+}
+
+/** Find a task: the worker's own newest one, then a shared one, then one stolen from another */
+static int find_task(worker_t *worker, task_t *task) {
+  workers_t *pool = worker->pool;
+  if (deque_pop(&worker->deque, task) == 0) {
+    return 0;
+  }
+  if (__atomic_load_n(&pool->inject_count, __ATOMIC_RELAXED) > 0 && inject_take(pool, task) == 0) {
+    return 0;
+  }
+  int start = rand_r(&worker->seed) % pool->num_workers;
+  for (int i = 0; i < pool->num_workers; i++) {
+    worker_t *victim = &pool->workers[(start + i) % pool->num_workers];
+    if (victim != worker && deque_steal(&victim->deque, task) == 0) {
+      __atomic_fetch_add(&worker->steals, 1, __ATOMIC_RELAXED);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/** Run a task, waking workers_wait if it was the last one pending */
+static void run_task(workers_t *pool, task_t *task) {
+  __atomic_fetch_sub(&pool->queued, 1, __ATOMIC_SEQ_CST);
+  task->fn(task->arg);
+  if (__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+    pthread_mutex_lock(&pool->mutex);
+    pthread_cond_broadcast(&pool->done_cond);
+    pthread_mutex_unlock(&pool->mutex);
+  }
+}
+
+/** Thread of a worker: run tasks until the pool stops, sleeping while there are none */
+static void *worker_main(void *arg) {
+  worker_t *worker = arg;
+  workers_t *pool = worker->pool;
+  self = worker;
+
+  int spins = 0;
+  while (1) {
+    task_t task;
+    if (find_task(worker, &task) == 0) {
+      run_task(pool, &task);
+      spins = 0;
+      continue;
+    }
+    if (++spins < WORKERS_SPINS) {
+      sched_yield();
+      continue;
+    }
+
+    // Sleep until a task is queued; submitters check for sleepers after counting their task
+    spins = 0;
+    pthread_mutex_lock(&pool->mutex);
+    __atomic_fetch_add(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) == 0 && !pool->stop) {
+      pthread_cond_wait(&pool->work_cond, &pool->mutex);
+    }
+    __atomic_fetch_sub(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+    int stop = pool->stop;
+    pthread_mutex_unlock(&pool->mutex);
+    if (stop) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+/** Start a pool of num_workers threads, or one per online core if num_workers is 0 */
+workers_t *workers_create(int num_workers) {
+  if (num_workers == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    num_workers = (cores > 0) ? cores : 1;
+  }
+  if (num_workers < 0 || num_workers > WORKERS_MAX) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  workers_t *pool = calloc(1, sizeof(workers_t));
+  if (pool == NULL) {
+    return NULL;
+  }
+  pool->num_workers = num_workers;
+  pool->inject_cap = INJECT_INITIAL_SIZE;
+  pool->inject = malloc(pool->inject_cap * sizeof(task_t));
+  pool->workers = aligned_alloc(64, num_workers * sizeof(worker_t));
+  if (pool->inject == NULL || pool->workers == NULL) {
+    free(pool->inject);
+    free(pool->workers);
+    free(pool);
+    return NULL;
+  }
+  memset(pool->workers, 0, num_workers * sizeof(worker_t));
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->work_cond, NULL);
+  pthread_cond_init(&pool->done_cond, NULL);
+
+  for (int i = 0; i < num_workers; i++) {
+    worker_t *worker = &pool->workers[i];
+    worker->pool = pool;
+    worker->seed = i + 1;
+    int error = pthread_create(&worker->thread, NULL, worker_main, worker);
+    if (error != 0) {
+      pool->num_workers = i; // Stop the ones already running
+      workers_destroy(pool);
+      errno = error;
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+/** Run fn(arg) on some worker; a worker whose deque is full runs its own submission at once */
+int workers_submit(workers_t *pool, void (*fn)(void *), void *arg) {
+  task_t task = {.fn = fn, .arg = arg};
+  __atomic_fetch_add(&pool->pending, 1, __ATOMIC_ACQ_REL);
+
+  if (self != NULL && self->pool == pool) {
+    if (deque_push(&self->deque, task) < 0) {
+      fn(arg);
+      __atomic_fetch_sub(&pool->pending, 1, __ATOMIC_ACQ_REL);
+      return 0;
+    }
+    __atomic_fetch_add(&pool->queued, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST) == 0) {
+      return 0;
+    }
+    pthread_mutex_lock(&pool->mutex);
+  } else {
+    pthread_mutex_lock(&pool->mutex);
+    if (pool->inject_count == pool->inject_cap) {
+      // Grow the shared queue, unrolling the ring buffer into the new one
+      task_t *inject = malloc(2 * pool->inject_cap * sizeof(task_t));
+      if (inject == NULL) {
+        pthread_mutex_unlock(&pool->mutex);
+        __atomic_fetch_sub(&pool->pending, 1, __ATOMIC_ACQ_REL);
+        return -1;
+      }
+      for (size_t i = 0; i < pool->inject_count; i++) {
+        inject[i] = pool->inject[(pool->inject_head + i) % pool->inject_cap];
+      }
+      free(pool->inject);
+      pool->inject = inject;
+      pool->inject_head = 0;
+      pool->inject_cap *= 2;
+    }
+    pool->inject[(pool->inject_head + pool->inject_count) % pool->inject_cap] = task;
+    __atomic_store_n(&pool->inject_count, pool->inject_count + 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pool->queued, 1, __ATOMIC_SEQ_CST);
+  }
+  if (pool->sleepers > 0) {
+    pthread_cond_signal(&pool->work_cond);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return 0;
+}
+
+/** Wait until every task submitted so far, and every task those submitted, has finished */
+void workers_wait(workers_t *pool) {
+  pthread_mutex_lock(&pool->mutex);
+  while (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) > 0) {
+    pthread_cond_wait(&pool->done_cond, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+/** Get the number of workers of a pool */
+int workers_count(const workers_t *pool) {
+  return pool->num_workers;
+}
+
+/** Get the number of tasks that workers have stolen from each other */
+unsigned long workers_steals(const workers_t *pool) {
+  unsigned long steals = 0;
+  for (int i = 0; i < pool->num_workers; i++) {
+    steals += __atomic_load_n(&pool->workers[i].steals, __ATOMIC_RELAXED);
+  }
+  return steals;
+}
+
+/** Wait for the submitted tasks, then stop the workers and free the pool */
+void workers_destroy(workers_t *pool) {
+  workers_wait(pool);
+  pthread_mutex_lock(&pool->mutex);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->work_cond);
+  pthread_mutex_unlock(&pool->mutex);
+  for (int i = 0; i < pool->num_workers; i++) {
+    pthread_join(pool->workers[i].thread, NULL);
+  }
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->work_cond);
+  pthread_cond_destroy(&pool->done_cond);
+  free(pool->inject);
+  free(pool->workers);
+  free(pool);
+}
@@ -0,0 +1,39 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+/*
+ * Work-stealing pool of threads for CPU-heavy work, so that it does not hold up the threads doing
+ * I/O. Each worker has its own deque of tasks (a Chase-Lev deque): it pushes and pops tasks at one
+ * end without contention, and idle workers steal from the other end. Tasks submitted by a worker
+ * go to its own deque, which keeps work that splits itself up close to the cache it warmed. Tasks
+ * submitted by other threads go to a shared queue that every worker takes from.
+ *
+ * Functions that can fail return -1 (or NULL) with errno set, like those of net.h.
+ */
+
+#define WORKERS_MAX 256 // Maximum number of workers in a pool
+#define WORKERS_DEQUE_SIZE 4096 // Number of tasks a worker's deque holds; must be a power of two
+#define WORKERS_SPINS 64 // Number of failed searches for work before a worker goes to sleep
+
+/** Pool of worker threads */
+typedef struct workers workers_t;
+
+/** Start a pool of num_workers threads, or one per online core if num_workers is 0 */
+workers_t *workers_create(int num_workers);
+
+/** Run fn(arg) on some worker; a worker whose deque is full runs its own submission at once */
+int workers_submit(workers_t *pool, void (*fn)(void *), void *arg);
+
+/** Wait until every task submitted so far, and every task those submitted, has finished */
+void workers_wait(workers_t *pool);
+
+/** Get the number of workers of a pool */
+int workers_count(const workers_t *pool);
+
+/** Get the number of tasks that workers have stolen from each other */
+unsigned long workers_steals(const workers_t *pool);
+
+/** Wait for the submitted tasks, then stop the workers and free the pool */
+void workers_destroy(workers_t *pool);
+
+#endif // WORKERS_H
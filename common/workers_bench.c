@@ -0,0 +1,156 @@
+/*
+ * Scaling benchmark of the work-stealing pool. For each pool size from 1 to 32 workers, it runs
+ * two kinds of CPU work and reports the time and the speedup over one worker:
+ * - checksum: another thread submits one task per block of a buffer, each computing a checksum,
+ *   so every task goes through the shared queue;
+ * - split: one task splits a range in halves, submitting one half and keeping the other, until
+ *   the pieces are small, so the work spreads by stealing.
+ * Speedups are bounded by the number of cores, which is printed first.
+ *
+ * Usage: workers_bench [max_workers]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "workers.h"
+
+#define DEFAULT_MAX_WORKERS 32 // Largest pool by default
+#define BLOCK_SIZE (64 * 1024) // Bytes per checksum task
+#define NUM_BLOCKS 4096 // Number of checksum tasks
+#define SPLIT_RANGE (1 << 27) // Numbers hashed by the split workload
+#define SPLIT_LEAF 4096 // Largest piece the split workload does not split further
+
+// Block for a checksum task and its result
+typedef struct {
+  const uint8_t *data;
+  uint32_t checksum;
+} block_t;
+
+// Range for a split task, and where its result goes
+typedef struct {
+  workers_t *pool;
+  uint64_t begin, end;
+  uint64_t *result;
+} range_t;
+
+/** Get the current monotonic time in nanoseconds */
+static long long now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/** Compute the FNV-1a checksum of a block */
+static void checksum_block(void *arg) {
+  block_t *block = arg;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < BLOCK_SIZE; i++) {
+    hash = (hash ^ block->data[i]) * 16777619u;
+  }
+  block->checksum = hash;
+}
+
+/** Mix the bits of a number, as a stand-in for real work on one item */
+static uint64_t mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  return x ^ (x >> 33);
+}
+
+/** Sum the mixed numbers of a range, handing half of it to the pool while it is large */
+static void split_range(void *arg) {
+  range_t *range = arg;
+  while (range->end - range->begin > SPLIT_LEAF) {
+    uint64_t middle = range->begin + (range->end - range->begin) / 2;
+    range_t *half = malloc(sizeof(range_t));
+    *half = (range_t){range->pool, middle, range->end, range->result};
+    range->end = middle;
+    workers_submit(range->pool, split_range, half);
+  }
+
+  uint64_t sum = 0;
+  for (uint64_t i = range->begin; i < range->end; i++) {
+    sum += mix(i);
+  }
+  __atomic_fetch_add(range->result, sum, __ATOMIC_RELAXED);
+  free(range);
+}
+
+int main(int argc, char *argv[]) {
+  int max_workers = (argc > 1) ? atoi(argv[1]) : DEFAULT_MAX_WORKERS;
+  if (max_workers < 1 || max_workers > WORKERS_MAX) {
+    fprintf(stderr, "Usage: %s [max_workers]\n", argv[0]);
+    exit(1);
+  }
+
+  uint8_t *data = malloc((size_t)NUM_BLOCKS * BLOCK_SIZE);
+  block_t *blocks = malloc(NUM_BLOCKS * sizeof(block_t));
+  if (data == NULL || blocks == NULL) {
+    perror("Error allocating buffer");
+    exit(1);
+  }
+  for (size_t i = 0; i < (size_t)NUM_BLOCKS * BLOCK_SIZE; i++) {
+    data[i] = (uint8_t)(i * 131);
+  }
+
+  printf("%ld online cores\n", sysconf(_SC_NPROCESSORS_ONLN));
+  printf("%-8s %-9s %10s %8s %10s %8s %8s\n", "workload", "workers", "time (s)", "speedup",
+         "tasks/s", "steals", "check");
+  double checksum_base = 0.0, split_base = 0.0;
+  for (int num_workers = 1; num_workers <= max_workers; num_workers *= 2) {
+    workers_t *pool = workers_create(num_workers);
+    if (pool == NULL) {
+      perror("Error creating workers");
+      exit(1);
+    }
+
+    // Checksum: every task comes from this thread
+    long long start = now_ns();
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+      blocks[i].data = data + (size_t)i * BLOCK_SIZE;
+      if (workers_submit(pool, checksum_block, &blocks[i]) < 0) {
+        perror("Error submitting task");
+        exit(1);
+      }
+    }
+    workers_wait(pool);
+    double seconds = (now_ns() - start) / 1e9;
+    uint32_t check = 0;
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+      check += blocks[i].checksum;
+    }
+    if (num_workers == 1) {
+      checksum_base = seconds;
+    }
+    printf("%-8s %-9d %10.3f %8.2f %10.0f %8lu %08x\n", "checksum", num_workers, seconds,
+           checksum_base / seconds, NUM_BLOCKS / seconds, workers_steals(pool), check);
+
+    // Split: one task comes from this thread, and the workers submit the rest
+    unsigned long steals = workers_steals(pool);
+    uint64_t sum = 0;
+    range_t *root = malloc(sizeof(range_t));
+    *root = (range_t){pool, 0, SPLIT_RANGE, &sum};
+    start = now_ns();
+    workers_submit(pool, split_range, root);
+    workers_wait(pool);
+    seconds = (now_ns() - start) / 1e9;
+    if (num_workers == 1) {
+      split_base = seconds;
+    }
+    printf("%-8s %-9d %10.3f %8.2f %10.0f %8lu %08x\n", "split", num_workers, seconds,
+           split_base / seconds, (double)SPLIT_RANGE / SPLIT_LEAF / seconds,
+           workers_steals(pool) - steals, (uint32_t)sum);
+
+    workers_destroy(pool);
+  }
+
+  free(blocks);
+  free(data);
+  return 0;
+}